@@ -1,8 +1,16 @@
 #include "LlamaEngine.h"
+#include "PromptBuilder.h"
 #include <iostream>
 #include <vector>
 #include <cstring>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <set>
 
 // Helper to add token to batch
 static void batch_add(llama_batch & batch, llama_token id, llama_pos pos, const std::vector<llama_seq_id> & seq_ids, bool logits) {
@@ -23,24 +31,118 @@ LlamaEngine::LlamaEngine()
 
 LlamaEngine::~LlamaEngine()
 {
-    if (ctx) llama_free(ctx);
+    freeContexts();
+    freeDraftModel();
     if (model) llama_model_free(model);
     llama_backend_free();
 }
 
-bool LlamaEngine::loadModel(const std::string& modelPath)
+void LlamaEngine::freeContexts()
 {
+    std::unique_lock<std::mutex> lock(slotMutex);
+    // Wait for in-flight generations before tearing the pool down
+    slotAvailable.wait(lock, [this]() {
+        return std::none_of(slots.begin(), slots.end(), [](const ContextSlot& s) { return s.busy; });
+    });
+    for (auto& slot : slots) {
+        if (slot.ctx) llama_free(slot.ctx);
+        if (slot.draftCtx) llama_free(slot.draftCtx);
+    }
+    slots.clear();
+}
+
+void LlamaEngine::freeDraftModel()
+{
+    if (draftModel) {
+        llama_model_free(draftModel);
+        draftModel = nullptr;
+    }
+}
+
+bool LlamaEngine::loadDraftModel(const std::string& draftPath)
+{
+    llama_model_params model_params = llama_model_default_params();
+    model_params.n_gpu_layers = profile.nGpuLayers;
+    model_params.use_mmap = profile.useMmap;
+    model_params.use_mlock = profile.useMlock;
+    draftModel = llama_model_load_from_file(draftPath.c_str(), model_params);
+
+    if (!draftModel) {
+        std::cerr << "Failed to load draft model from " << draftPath << std::endl;
+        return false;
+    }
+    if (!isDraftCompatible()) {
+        std::cerr << "Draft model vocabulary does not match the target, speculative decoding disabled" << std::endl;
+        freeDraftModel();
+        return false;
+    }
+    return true;
+}
+
+// Draft tokens are fed to the target verbatim, so both models must map ids to the
+// same text. Small size differences (extra padding/special tokens) are tolerated.
+bool LlamaEngine::isDraftCompatible() const
+{
+    const llama_vocab* target = llama_model_get_vocab(model);
+    const llama_vocab* draft = llama_model_get_vocab(draftModel);
+
+    if (llama_vocab_type(target) != llama_vocab_type(draft)) return false;
+    if (llama_vocab_bos(target) != llama_vocab_bos(draft)) return false;
+    if (llama_vocab_eos(target) != llama_vocab_eos(draft)) return false;
+
+    int n_target = llama_vocab_n_tokens(target);
+    int n_draft = llama_vocab_n_tokens(draft);
+    if (std::abs(n_target - n_draft) > 128) return false;
+
+    for (int i = 0; i < std::min(n_target, n_draft); ++i) {
+        if (std::strcmp(llama_vocab_get_text(target, i), llama_vocab_get_text(draft, i)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static ggml_type cacheTypeFromName(const std::string& name)
+{
+    if (name == "f32")  return GGML_TYPE_F32;
+    if (name == "bf16") return GGML_TYPE_BF16;
+    if (name == "q8_0") return GGML_TYPE_Q8_0;
+    if (name == "q5_1") return GGML_TYPE_Q5_1;
+    if (name == "q5_0") return GGML_TYPE_Q5_0;
+    if (name == "q4_1") return GGML_TYPE_Q4_1;
+    if (name == "q4_0") return GGML_TYPE_Q4_0;
+    return GGML_TYPE_F16;
+}
+
+static int hardwareThreads()
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Default pool: one context per 8 hardware threads, at most 8 contexts
+static int poolSize(const RuntimeProfile& settings)
+{
+    return settings.nParallel > 0 ? settings.nParallel : std::clamp(hardwareThreads() / 8, 1, 8);
+}
+
+bool LlamaEngine::loadModel(const std::string& modelPath, const RuntimeProfile& profile)
+{
+    std::unique_lock<std::shared_mutex> lock(modelMutex);
+    return loadModelLocked(modelPath, profile);
+}
+
+bool LlamaEngine::loadModelLocked(const std::string& modelPath, const RuntimeProfile& profile)
+{
+    freeContexts();
     if (model) {
         llama_model_free(model);
         model = nullptr;
     }
-    if (ctx) {
-        llama_free(ctx);
-        ctx = nullptr;
-    }
 
     llama_model_params model_params = llama_model_default_params();
-    model_params.n_gpu_layers = 100; // Try to use GPU
+    model_params.n_gpu_layers = profile.nGpuLayers;
+    model_params.use_mmap = profile.useMmap;
+    model_params.use_mlock = profile.useMlock;
     model = llama_model_load_from_file(modelPath.c_str(), model_params);
 
     if (!model) {
@@ -48,11 +150,123 @@ bool LlamaEngine::loadModel(const std::string& modelPath)
         return false;
     }
 
+    this->modelPath = modelPath;
+    this->profile = profile;
+
+    freeDraftModel();
+    if (!profile.draftModel.empty()) {
+        loadDraftModel(profile.draftModel); // Optional: failure only disables speculation
+    }
+    return createContexts(profile);
+}
+
+bool LlamaEngine::applyProfile(const RuntimeProfile& newProfile)
+{
+    std::unique_lock<std::shared_mutex> lock(modelMutex);
+    if (!model) {
+        profile = newProfile;
+        return true;
+    }
+    if (!profile.sameModelSettings(newProfile)) {
+        return loadModelLocked(modelPath, newProfile);
+    }
+
+    freeContexts();
+    bool draftChanged = profile.draftModel != newProfile.draftModel;
+    profile = newProfile;
+    if (draftChanged) {
+        freeDraftModel();
+        if (!profile.draftModel.empty()) loadDraftModel(profile.draftModel);
+    }
+    return createContexts(profile);
+}
+
+bool LlamaEngine::isModelLoaded() const
+{
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return model != nullptr;
+}
+
+int LlamaEngine::contextCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return static_cast<int>(slots.size());
+}
+
+RuntimeProfile LlamaEngine::runtimeProfile() const
+{
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return profile;
+}
+
+bool LlamaEngine::hasDraftModel() const
+{
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return draftModel != nullptr;
+}
+
+llama_context_params LlamaEngine::makeContextParams(const RuntimeProfile& settings, int nContexts) const
+{
+    // Decode is memory-bound, so a handful of threads per context saturates bandwidth;
+    // by default the cores are split evenly over the pooled contexts.
+    int threadsPerContext = std::max(1, hardwareThreads() / std::max(1, nContexts));
+
     llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx = 8192; // Increase context for Llama-3
-    ctx = llama_init_from_model(model, ctx_params);
+    ctx_params.n_ctx = settings.nCtx;
+    ctx_params.n_batch = settings.nBatch;
+    ctx_params.n_ubatch = std::min(settings.nUBatch, settings.nBatch);
+    ctx_params.n_threads = settings.nThreads > 0 ? settings.nThreads : threadsPerContext;
+    ctx_params.n_threads_batch = settings.nThreadsBatch > 0 ? settings.nThreadsBatch : threadsPerContext;
+    // Several sequences (long-document chunks) share one KV buffer
+    ctx_params.n_seq_max = std::max(1, settings.nSeq);
+    ctx_params.kv_unified = true;
+    ctx_params.type_k = cacheTypeFromName(settings.cacheTypeK);
+    ctx_params.type_v = cacheTypeFromName(settings.cacheTypeV);
+
+    if (settings.flashAttention == "on") {
+        ctx_params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    } else if (settings.flashAttention == "off") {
+        ctx_params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_DISABLED;
+    } else {
+        ctx_params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_AUTO;
+    }
 
-    if (!ctx) {
+    // A quantized V cache is only supported by the flash attention kernels
+    if (ctx_params.type_v != GGML_TYPE_F16 && ctx_params.type_v != GGML_TYPE_F32 && ctx_params.type_v != GGML_TYPE_BF16) {
+        if (ctx_params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+            std::cerr << "Quantized V cache requires flash attention, falling back to f16" << std::endl;
+            ctx_params.type_v = GGML_TYPE_F16;
+        } else {
+            ctx_params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+        }
+    }
+    return ctx_params;
+}
+
+bool LlamaEngine::createContexts(const RuntimeProfile& settings)
+{
+    int nContexts = poolSize(settings);
+    llama_context_params ctx_params = makeContextParams(settings, nContexts);
+
+    std::lock_guard<std::mutex> lock(slotMutex);
+    for (int i = 0; i < nContexts; ++i) {
+        llama_context* ctx = llama_init_from_model(model, ctx_params);
+        if (!ctx) {
+            std::cerr << "Failed to create context " << i << std::endl;
+            break;
+        }
+        ContextSlot slot;
+        slot.ctx = ctx;
+        slot.nThreads = ctx_params.n_threads;
+        if (draftModel) {
+            // The draft shares the slot's threads; it runs strictly between target passes
+            slot.draftCtx = llama_init_from_model(draftModel, ctx_params);
+            if (!slot.draftCtx) std::cerr << "Failed to create draft context " << i << std::endl;
+        }
+        slots.push_back(slot);
+    }
+
+    if (slots.empty()) {
         std::cerr << "Failed to create context" << std::endl;
         return false;
     }
@@ -60,9 +274,253 @@ bool LlamaEngine::loadModel(const std::string& modelPath)
     return true;
 }
 
+bool LlamaEngine::decodePrompt(llama_context* ctx, const std::vector<llama_token>& tokens, llama_pos startPos, bool lastLogits)
+{
+    // llama_decode rejects more than n_batch tokens per call, so feed the prompt in slices
+    const int n_batch = static_cast<int>(llama_n_batch(ctx));
+    const int n_tokens = static_cast<int>(tokens.size());
+
+    llama_batch batch = llama_batch_init(n_batch, 0, 1);
+    for (int start = 0; start < n_tokens; start += n_batch) {
+        int end = std::min(n_tokens, start + n_batch);
+        batch.n_tokens = 0;
+        for (int i = start; i < end; ++i) {
+            batch_add(batch, tokens[i], startPos + i, {0}, lastLogits && i == n_tokens - 1);
+        }
+        if (llama_decode(ctx, batch) != 0) {
+            llama_batch_free(batch);
+            return false;
+        }
+    }
+    llama_batch_free(batch);
+    return true;
+}
+
+std::vector<LlamaEngine::TuneResult> LlamaEngine::autoTune(const RuntimeProfile& base, const ProgressCallback& progress)
+{
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    std::vector<TuneResult> results;
+    if (!model) return results;
+
+    // Candidate generation thread counts: all cores, half (SMT siblings) and a quarter.
+    // Prompt processing is compute-bound and always gets every core. Thread counts are
+    // only tuned for a single-context pool; a larger pool keeps its even core split
+    // and only the KV cache / flash attention choice is tuned.
+    int hw = hardwareThreads();
+    std::vector<int> threadCounts = {base.nThreads};
+    if (base.nParallel == 1) {
+        threadCounts = {hw, std::max(1, hw / 2), std::max(1, hw / 4)};
+        if (base.nThreads > 0) threadCounts.push_back(base.nThreads);
+        std::sort(threadCounts.begin(), threadCounts.end());
+        threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+    }
+
+    struct KvChoice { const char* type; const char* flash; };
+    const KvChoice kvChoices[] = { {"f16", "off"}, {"f16", "on"}, {"q8_0", "on"} };
+
+    std::vector<RuntimeProfile> candidates;
+    for (int threads : threadCounts) {
+        for (const auto& kv : kvChoices) {
+            RuntimeProfile candidate = base;
+            candidate.nThreads = threads;
+            if (base.nParallel == 1) candidate.nThreadsBatch = hw;
+            candidate.cacheTypeK = kv.type;
+            candidate.cacheTypeV = kv.type;
+            candidate.flashAttention = kv.flash;
+            candidates.push_back(candidate);
+        }
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (progress) {
+            progress("Benchmark " + std::to_string(i + 1) + "/" + std::to_string(candidates.size()) +
+                     ": " + candidates[i].summary());
+        }
+        TuneResult result;
+        if (benchmark(candidates[i], result)) {
+            results.push_back(result);
+        }
+    }
+
+    std::sort(results.begin(), results.end(), [](const TuneResult& a, const TuneResult& b) {
+        return a.secondsPerDocument < b.secondsPerDocument;
+    });
+    return results;
+}
+
+bool LlamaEngine::benchmark(const RuntimeProfile& candidate, TuneResult& result)
+{
+    const int n_prompt = 512;
+    const int n_gen = 32;
+
+    // Measure one context with the per-context threads it would get inside the pool
+    llama_context_params ctx_params = makeContextParams(candidate, poolSize(candidate));
+    ctx_params.n_ctx = std::max<uint32_t>(ctx_params.n_ctx, n_prompt + n_gen + 16);
+    llama_context* ctx = llama_init_from_model(model, ctx_params);
+    if (!ctx) return false;
+
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    std::string sample = "檔案分析 file analysis benchmark text for tagging. ";
+    std::string text;
+    while (text.size() < n_prompt * 8) text += sample;
+
+    std::vector<llama_token> tokens(text.size() + 16);
+    int n = llama_tokenize(vocab, text.c_str(), text.length(), tokens.data(), tokens.size(), true, false);
+    if (n < n_prompt) {
+        llama_free(ctx);
+        return false;
+    }
+    tokens.resize(n_prompt);
+
+    // Warm-up so page faults from mmap and lazy allocations do not skew the first run
+    decodePrompt(ctx, std::vector<llama_token>(tokens.begin(), tokens.begin() + 16), 0, true);
+    llama_memory_clear(llama_get_memory(ctx), true);
+
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = decodePrompt(ctx, tokens, 0, true);
+    auto t1 = std::chrono::steady_clock::now();
+
+    llama_batch batch = llama_batch_init(1, 0, 1);
+    llama_token token = tokens.back();
+    for (int i = 0; ok && i < n_gen; ++i) {
+        batch.n_tokens = 0;
+        batch_add(batch, token, n_prompt + i, {0}, true);
+        ok = llama_decode(ctx, batch) == 0;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    llama_batch_free(batch);
+    llama_free(ctx);
+    if (!ok) return false;
+
+    double ppSeconds = std::chrono::duration<double>(t1 - t0).count();
+    double tgSeconds = std::chrono::duration<double>(t2 - t1).count();
+
+    result.profile = candidate;
+    result.promptTokensPerSec = n_prompt / std::max(ppSeconds, 1e-9);
+    result.genTokensPerSec = n_gen / std::max(tgSeconds, 1e-9);
+    // A typical tagging request: ~2k prompt tokens and ~32 generated tokens
+    result.secondsPerDocument = 2048.0 / result.promptTokensPerSec + 32.0 / result.genTokensPerSec;
+    return true;
+}
+
+LlamaEngine::ContextSlot* LlamaEngine::acquireSlot()
+{
+    std::unique_lock<std::mutex> lock(slotMutex);
+    ContextSlot* freeSlot = nullptr;
+    slotAvailable.wait(lock, [this, &freeSlot]() {
+        for (auto& slot : slots) {
+            if (!slot.busy) {
+                freeSlot = &slot;
+                return true;
+            }
+        }
+        return slots.empty();
+    });
+    if (freeSlot) freeSlot->busy = true;
+    return freeSlot;
+}
+
+void LlamaEngine::releaseSlot(ContextSlot* slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        slot->busy = false;
+    }
+    slotAvailable.notify_all();
+}
+
 std::string LlamaEngine::generateResponse(const std::string& prompt)
 {
-    if (!ctx || !model) return "Error: Model not loaded";
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return respond(prompt);
+}
+
+std::string LlamaEngine::respond(const std::string& prompt)
+{
+    if (!model) return "Error: Model not loaded";
+
+    ContextSlot* slot = acquireSlot();
+    if (!slot) return "Error: Model not loaded";
+
+    SpeculativeStats run;
+    std::string response = generateWithContext(*slot, prompt, true, run);
+    releaseSlot(slot);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    specStats.merge(run);
+    return response;
+}
+
+LlamaEngine::SpeculativeStats LlamaEngine::benchmarkSpeculative(const std::string& filename, const std::string& content)
+{
+    std::shared_lock<std::shared_mutex> modelLock(modelMutex);
+    SpeculativeStats run;
+    if (!model || !draftModel) return run;
+
+    std::string prompt = buildTagPrompt(filename, PromptBuilder::cleanContent(content));
+    ContextSlot* slot = acquireSlot();
+    if (!slot) return run;
+
+    // Same prompt, same context: once with the target alone, once with the draft
+    generateWithContext(*slot, prompt, false, run);
+    generateWithContext(*slot, prompt, true, run);
+    releaseSlot(slot);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    specStats.merge(run);
+    return run;
+}
+
+LlamaEngine::SpeculativeStats LlamaEngine::speculativeStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return specStats;
+}
+
+void LlamaEngine::resetSpeculativeStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    specStats = SpeculativeStats();
+}
+
+void LlamaEngine::SpeculativeStats::merge(const SpeculativeStats& other)
+{
+    draftedTokens += other.draftedTokens;
+    acceptedTokens += other.acceptedTokens;
+    specGenerated += other.specGenerated;
+    specSeconds += other.specSeconds;
+    plainGenerated += other.plainGenerated;
+    plainSeconds += other.plainSeconds;
+}
+
+double LlamaEngine::SpeculativeStats::acceptanceRate() const
+{
+    return draftedTokens ? double(acceptedTokens) / draftedTokens : 0.0;
+}
+
+double LlamaEngine::SpeculativeStats::speedup() const
+{
+    if (!specGenerated || !plainGenerated || specSeconds <= 0 || plainSeconds <= 0) return 0.0;
+    return (specGenerated / specSeconds) / (plainGenerated / plainSeconds);
+}
+
+static std::string tokenToPiece(const llama_vocab* vocab, llama_token token)
+{
+    char buf[256];
+    int n = llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
+    return n >= 0 ? std::string(buf, n) : std::string();
+}
+
+// Greedy pick from the logits of batch position idx (-1 = last)
+static llama_token argmaxToken(llama_context* ctx, int idx, int n_vocab)
+{
+    const float* logits = llama_get_logits_ith(ctx, idx);
+    return static_cast<llama_token>(std::max_element(logits, logits + n_vocab) - logits);
+}
+
+std::string LlamaEngine::generateWithContext(ContextSlot& slot, const std::string& prompt, bool allowDraft, SpeculativeStats& stats)
+{
+    llama_context* ctx = slot.ctx;
 
     // Clear KV cache
     llama_memory_t mem = llama_get_memory(ctx);
@@ -77,71 +535,410 @@ std::string LlamaEngine::generateResponse(const std::string& prompt)
         return "Error: Tokenization failed";
     }
 
-    // 2. Initial Batch
-    llama_batch batch = llama_batch_init(8192, 0, 1); // Match n_ctx
-    for(int i=0; i<n_prompt; i++) {
-        batch_add(batch, prompt_tokens[i], i, {0}, false);
+    // 2. Decode prompt
+    if (n_prompt >= (int)llama_n_ctx(ctx)) {
+        return "Error: Prompt exceeds context size";
     }
-    batch.logits[batch.n_tokens - 1] = true;
-
-    // 3. Decode
-    if (llama_decode(ctx, batch) != 0) {
-         llama_batch_free(batch);
+    if (!decodePrompt(ctx, prompt_tokens, 0, true)) {
         return "Error: llama_decode failed";
     }
+
+    // 3. Speculative path: the draft needs the same prompt in its own KV cache
+    if (allowDraft && slot.draftCtx) {
+        llama_memory_seq_rm(llama_get_memory(slot.draftCtx), -1, -1, -1);
+        if (decodePrompt(slot.draftCtx, prompt_tokens, 0, true)) {
+            return generateSpeculative(slot, n_prompt, stats);
+        }
+        std::cerr << "Draft prompt decode failed, continuing without speculation" << std::endl;
+    }
     
-    int n_curr = batch.n_tokens; 
-    llama_batch_free(batch); 
+    int n_curr = n_prompt;
 
     // 4. Sample loop
     std::stringstream response_ss;
-    int n_predict = 256; // Allow a bit more output
+    auto t_start = std::chrono::steady_clock::now();
+    int n_generated = 0;
     
     auto sparams = llama_sampler_chain_default_params();
     struct llama_sampler * smpl = llama_sampler_chain_init(sparams);
     llama_sampler_chain_add(smpl, llama_sampler_init_greedy()); // Greedy is fine for tagging
 
     llama_token new_token_id = 0;
+    llama_batch batch_one = llama_batch_init(1, 0, 1);
 
-    for (int i = 0; i < n_predict; ++i) {
+    for (int i = 0; i < kMaxNewTokens; ++i) {
         new_token_id = llama_sampler_sample(smpl, ctx, -1);
 
         if (llama_vocab_is_eog(vocab, new_token_id)) {
             break;
         }
 
-        char buf[256];
-        int n = llama_token_to_piece(vocab, new_token_id, buf, sizeof(buf), 0, true);
-        if (n >= 0) {
-            std::string piece(buf, n);
-            response_ss << piece;
-        }
+        response_ss << tokenToPiece(vocab, new_token_id);
+        n_generated++;
 
-        llama_batch batch_one = llama_batch_init(1, 0, 1);
+        batch_one.n_tokens = 0;
         batch_add(batch_one, new_token_id, n_curr, {0}, true);
         n_curr++;
 
         if (llama_decode(ctx, batch_one) != 0) {
-            llama_batch_free(batch_one);
             break;
         }
-        llama_batch_free(batch_one);
     }
     
+    llama_batch_free(batch_one);
     llama_sampler_free(smpl);
 
+    stats.plainGenerated += n_generated;
+    stats.plainSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
     return response_ss.str();
 }
 
+std::string LlamaEngine::generateSpeculative(ContextSlot& slot, int nPast, SpeculativeStats& stats)
+{
+    // Greedy speculative decoding: the draft proposes n_draft tokens one by one, the
+    // target scores all of them in a single batched decode and keeps the longest
+    // prefix it agrees with, plus its own next token. Output is identical to plain
+    // greedy decoding on the target; only the number of target passes changes.
+    llama_context* ctx = slot.ctx;
+    llama_context* dctx = slot.draftCtx;
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const int n_vocab_draft = llama_vocab_n_tokens(llama_model_get_vocab(draftModel));
+    const int n_draft = std::max(1, profile.nDraft);
+    const int n_ctx = static_cast<int>(std::min(llama_n_ctx(ctx), llama_n_ctx(dctx)));
+
+    llama_batch tbatch = llama_batch_init(n_draft + 1, 0, 1);
+    llama_batch dbatch = llama_batch_init(2, 0, 1);
+
+    auto t_start = std::chrono::steady_clock::now();
+    std::string response;
+    int n_generated = 0;
+
+    // Tokens the target has accepted but the draft has not seen yet
+    std::vector<llama_token> pending;
+    int draftPast = nPast;
+    llama_token last = argmaxToken(ctx, -1, n_vocab);
+
+    while (!llama_vocab_is_eog(vocab, last)) {
+        response += tokenToPiece(vocab, last);
+        n_generated++;
+        pending.push_back(last);
+        if (n_generated >= kMaxNewTokens || nPast + n_draft + 2 >= n_ctx) break;
+
+        // 1. Draft proposes up to n_draft tokens
+        std::vector<llama_token> drafted;
+        dbatch.n_tokens = 0;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            batch_add(dbatch, pending[i], draftPast++, {0}, i + 1 == pending.size());
+        }
+        pending.clear();
+        for (int i = 0; i < n_draft; ++i) {
+            if (llama_decode(dctx, dbatch) != 0) break;
+            llama_token proposal = argmaxToken(dctx, -1, n_vocab_draft);
+            if (proposal >= n_vocab) break;
+            drafted.push_back(proposal);
+            if (llama_vocab_is_eog(vocab, proposal) || i + 1 == n_draft) break;
+            dbatch.n_tokens = 0;
+            batch_add(dbatch, proposal, draftPast++, {0}, true);
+        }
+
+        // 2. Target verifies [last, drafted...] in one pass
+        tbatch.n_tokens = 0;
+        batch_add(tbatch, last, nPast, {0}, true);
+        for (size_t i = 0; i < drafted.size(); ++i) {
+            batch_add(tbatch, drafted[i], nPast + 1 + i, {0}, true);
+        }
+        if (llama_decode(ctx, tbatch) != 0) break;
+
+        size_t accepted = 0;
+        llama_token next = argmaxToken(ctx, 0, n_vocab);
+        bool stop = false;
+        while (accepted < drafted.size() && next == drafted[accepted]) {
+            if (llama_vocab_is_eog(vocab, next) || n_generated >= kMaxNewTokens) {
+                stop = true;
+                break;
+            }
+            response += tokenToPiece(vocab, next);
+            n_generated++;
+            accepted++;
+            next = argmaxToken(ctx, accepted, n_vocab);
+        }
+        stats.draftedTokens += drafted.size();
+        stats.acceptedTokens += accepted;
+        if (stop) break;
+
+        // 3. Roll both caches back to the verified prefix
+        int verifiedEnd = nPast + 1 + static_cast<int>(accepted);
+        llama_memory_seq_rm(llama_get_memory(ctx), 0, verifiedEnd, -1);
+        if (draftPast > verifiedEnd) {
+            llama_memory_seq_rm(llama_get_memory(dctx), 0, verifiedEnd, -1);
+            draftPast = verifiedEnd;
+        }
+        // Accepted tokens the draft never decoded (the whole proposal was accepted)
+        for (int pos = draftPast; pos < verifiedEnd; ++pos) {
+            pending.push_back(pos == nPast ? last : drafted[pos - nPast - 1]);
+        }
+        nPast = verifiedEnd;
+        last = next;
+    }
+
+    llama_batch_free(tbatch);
+    llama_batch_free(dbatch);
+
+    stats.specGenerated += n_generated;
+    stats.specSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    return response;
+}
+
+// Keywords from the chunk pass, counted once per chunk
+struct KeywordCount {
+    std::string text;
+    int count = 0;
+    int firstSeen = 0;
+};
+
+static void collectKeywords(const std::string& answer, std::map<std::string, KeywordCount>& counts, int& order)
+{
+    // Normalise CJK list separators to ','
+    std::string list = answer;
+    for (const char* sep : {"，", "、", "；", "\n", ";"}) {
+        size_t len = std::strlen(sep);
+        for (size_t pos = list.find(sep); pos != std::string::npos; pos = list.find(sep, pos + 1)) {
+            list.replace(pos, len, ",");
+        }
+    }
+
+    std::set<std::string> seenInChunk;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t start = item.find_first_not_of(" \t");
+        size_t end = item.find_last_not_of(" \t.");
+        if (start == std::string::npos || end < start) continue;
+        std::string keyword = item.substr(start, end - start + 1);
+
+        // List markers: "- x", "* x", "• x", "1. x", "2) x"
+        for (const char* bullet : {"- ", "* ", "• "}) {
+            if (keyword.rfind(bullet, 0) == 0) keyword.erase(0, std::strlen(bullet));
+        }
+        size_t digits = keyword.find_first_not_of("0123456789");
+        if (digits > 0 && digits != std::string::npos && digits + 1 < keyword.size() &&
+            (keyword[digits] == '.' || keyword[digits] == ')') && keyword[digits + 1] == ' ') {
+            keyword.erase(0, digits + 2);
+        }
+        if (keyword.empty() || keyword.size() > 40) continue;
+
+        std::string key = keyword;
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (!seenInChunk.insert(key).second) continue;
+
+        KeywordCount& entry = counts[key];
+        if (entry.count == 0) {
+            entry.text = keyword;
+            entry.firstSeen = order++;
+        }
+        entry.count++;
+    }
+}
+
+static std::string chunkKeywordPrompt(const std::string& filename, const std::string& chunk, size_t index, size_t total)
+{
+    return
+        "<|im_start|>system\n"
+        "Extract the key topics of the given document excerpt.\n"
+        "Output ONLY 5-8 short keywords, comma-separated, in the excerpt's language.\n"
+        "<|im_end|>\n"
+        "<|im_start|>user\n"
+        "Filename: " + filename + " (part " + std::to_string(index + 1) + "/" + std::to_string(total) + ")\n"
+        "Excerpt: " + chunk + "\n"
+        "<|im_end|>\n"
+        "<|im_start|>assistant\n";
+}
+
+std::vector<std::string> LlamaEngine::generateParallel(llama_context* ctx, const std::vector<std::string>& prompts,
+                                                       int maxTokens, std::chrono::steady_clock::time_point deadline)
+{
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const int n_seq = static_cast<int>(prompts.size());
+    const int n_batch = static_cast<int>(llama_n_batch(ctx));
+
+    std::vector<std::string> outputs(n_seq);
+    llama_memory_t mem = llama_get_memory(ctx);
+    llama_memory_seq_rm(mem, -1, -1, -1);
+
+    std::vector<llama_pos> pos(n_seq, 0);
+    std::vector<llama_token> next(n_seq, -1);
+    std::vector<bool> active(n_seq, true);
+
+    llama_batch batch = llama_batch_init(n_batch, 0, 1);
+    // Decodes what is queued and picks the next token for every sequence that
+    // requested logits in this batch
+    auto flush = [&]() {
+        if (batch.n_tokens == 0) return true;
+        if (llama_decode(ctx, batch) != 0) return false;
+        for (int i = 0; i < batch.n_tokens; ++i) {
+            if (batch.logits[i]) next[batch.seq_id[i][0]] = argmaxToken(ctx, i, n_vocab);
+        }
+        batch.n_tokens = 0;
+        return true;
+    };
+
+    // 1. All prompts, packed back to back across sequences
+    bool ok = true;
+    for (int seq = 0; seq < n_seq && ok; ++seq) {
+        const std::string& prompt = prompts[seq];
+        int n = -llama_tokenize(vocab, prompt.c_str(), prompt.length(), NULL, 0, true, true);
+        std::vector<llama_token> tokens(n);
+        if (n <= 0 || llama_tokenize(vocab, prompt.c_str(), prompt.length(), tokens.data(), n, true, true) < 0) {
+            active[seq] = false;
+            continue;
+        }
+        for (int t = 0; t < n; ++t) {
+            if (batch.n_tokens == n_batch && !(ok = flush())) break;
+            batch_add(batch, tokens[t], pos[seq]++, {seq}, t + 1 == n);
+        }
+    }
+    ok = ok && flush();
+
+    // 2. Lock-step generation: one token per live sequence per step, decoded
+    // in as many batches as the live sequences need
+    for (int step = 0; ok && step < maxTokens; ++step) {
+        int added = 0;
+        for (int seq = 0; seq < n_seq; ++seq) {
+            if (!active[seq]) continue;
+            if (next[seq] < 0 || llama_vocab_is_eog(vocab, next[seq])) {
+                active[seq] = false;
+                continue;
+            }
+            if (batch.n_tokens == n_batch && !(ok = flush())) break;
+            outputs[seq] += tokenToPiece(vocab, next[seq]);
+            batch_add(batch, next[seq], pos[seq]++, {seq}, true);
+            ++added;
+        }
+        if (!ok || added == 0 || std::chrono::steady_clock::now() > deadline) break;
+        ok = flush();
+    }
+
+    llama_batch_free(batch);
+    llama_memory_seq_rm(mem, -1, -1, -1);
+    return outputs;
+}
+
+std::string LlamaEngine::suggestTagsLong(const std::string& filename, const std::string& content)
+{
+    // Map: keywords per chunk, several chunks decoded together as separate sequences.
+    // Reduce: the most frequent keywords become part of the final tag prompt.
+    const int kChunkKeywordTokens = 48;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(profile.longDocTimeBudgetMs);
+
+    PromptBuilder builder(llama_model_get_vocab(model));
+    int chunkTokens = std::clamp(profile.chunkTokens, 128, std::max(128, profile.nCtx / 2));
+    int maxChunks = std::max(1, profile.longDocTokenBudget / chunkTokens);
+    std::vector<std::string> chunks = builder.sampleChunks(content, chunkTokens, maxChunks);
+
+    ContextSlot* slot = acquireSlot();
+    if (!slot) return "Error: Model not loaded";
+
+    // Every sequence in a wave needs room for its chunk, the template and its answer
+    int perSequence = chunkTokens + 256 + kChunkKeywordTokens;
+    // and a wave's generation step, one token per sequence, fits in one batch
+    int nSeq = std::min({static_cast<int>(llama_n_seq_max(slot->ctx)),
+                         static_cast<int>(llama_n_ctx(slot->ctx)) / perSequence,
+                         static_cast<int>(llama_n_batch(slot->ctx))});
+    nSeq = std::max(1, nSeq);
+
+    std::map<std::string, KeywordCount> counts;
+    int order = 0;
+    for (size_t wave = 0; wave < chunks.size(); wave += nSeq) {
+        if (std::chrono::steady_clock::now() > deadline) break;
+
+        std::vector<std::string> prompts;
+        for (size_t i = wave; i < chunks.size() && i < wave + nSeq; ++i) {
+            prompts.push_back(chunkKeywordPrompt(filename, chunks[i], i, chunks.size()));
+        }
+        for (const auto& answer : generateParallel(slot->ctx, prompts, kChunkKeywordTokens, deadline)) {
+            collectKeywords(answer, counts, order);
+        }
+    }
+
+    std::vector<KeywordCount> ranked;
+    for (const auto& entry : counts) ranked.push_back(entry.second);
+    std::sort(ranked.begin(), ranked.end(), [](const KeywordCount& a, const KeywordCount& b) {
+        return a.count != b.count ? a.count > b.count : a.firstSeen < b.firstSeen;
+    });
+
+    std::string topics;
+    for (size_t i = 0; i < ranked.size() && i < 30; ++i) {
+        if (!topics.empty()) topics += ", ";
+        topics += ranked[i].text;
+    }
+
+    SpeculativeStats run;
+    std::string response = generateWithContext(*slot, buildTagPrompt(filename, content, topics), true, run);
+    releaseSlot(slot);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    specStats.merge(run);
+    return response;
+}
+
 std::string LlamaEngine::suggestTags(const std::string& filename, const std::string& content)
 {
-    // Qwen / ChatML Format
-    // Format: <|im_start|>system\n...\n<|im_end|>\n<|im_start|>user\n...\n<|im_end|>\n<|im_start|>assistant\n
-    
-    // Increase limit to 16000 chars (approx fits in 8k context)
-    std::string safeContent = content.empty() ? "(No content)" : content.substr(0, 16000);
-    
-    std::string prompt = 
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+    return tagDocument(filename, content);
+}
+
+std::string LlamaEngine::tagDocument(const std::string& filename, const std::string& content)
+{
+    std::string cleaned = PromptBuilder::cleanContent(content);
+
+    if (model && profile.longDocuments && !cleaned.empty()) {
+        PromptBuilder builder(llama_model_get_vocab(model));
+        if (!builder.fitsBudget(cleaned, tagPromptBudget(filename, std::string()))) {
+            return suggestTagsLong(filename, cleaned);
+        }
+    }
+    return respond(buildTagPrompt(filename, cleaned));
+}
+
+void LlamaEngine::suggestTagsBatch(const std::vector<std::string>& filenames,
+                                   const ContentLoader& loadContent,
+                                   const ResultCallback& onResult,
+                                   const std::atomic<bool>* cancel)
+{
+    if (filenames.empty()) return;
+    // Held until every worker is done, so the pool cannot be rebuilt under them
+    std::shared_lock<std::shared_mutex> lock(modelMutex);
+
+    // Documents are handed out one at a time from a shared cursor, so a worker that
+    // finishes a short file immediately picks up the next one instead of idling.
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < filenames.size(); i = next++) {
+            if (cancel && *cancel) return;
+            std::string content = loadContent ? loadContent(i) : std::string();
+            std::string result = tagDocument(filenames[i], content);
+            if (onResult) onResult(i, result);
+        }
+    };
+
+    size_t nWorkers = std::min(filenames.size(), std::max<size_t>(1, slots.size()));
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < nWorkers; ++w) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : workers) t.join();
+}
+
+// Qwen / ChatML Format
+// Format: <|im_start|>system\n...\n<|im_end|>\n<|im_start|>user\n...\n<|im_end|>\n<|im_start|>assistant\n
+static std::string tagPromptPrefix(const std::string& filename, const std::string& topics)
+{
+    std::string prefix =
         "<|im_start|>system\n"
         "You are a helpful file organization assistant. Analyze the given file metadata and content to suggest strict tags.\n"
         "Rules:\n"
@@ -151,10 +948,36 @@ std::string LlamaEngine::suggestTags(const std::string& filename, const std::str
         "4. Keep tags concise (under 5 words).\n"
         "<|im_end|>\n"
         "<|im_start|>user\n"
-        "Filename: " + filename + "\n"
-        "Content Preview: " + safeContent + "\n"
-        "<|im_end|>\n"
-        "<|im_start|>assistant\n";
+        "Filename: " + filename + "\n";
+    if (!topics.empty()) {
+        prefix += "Key topics across the whole document: " + topics + "\n";
+    }
+    return prefix + "Content Preview: ";
+}
+
+static const char* const kTagPromptSuffix =
+    "\n"
+    "<|im_end|>\n"
+    "<|im_start|>assistant\n";
+
+int LlamaEngine::tagPromptBudget(const std::string& filename, const std::string& topics) const
+{
+    // Budget = context - template/filename overhead - room for the answer.
+    // A few tokens of slack absorb merges across the prompt/content boundary.
+    PromptBuilder builder(llama_model_get_vocab(model));
+    int overhead = builder.countTokens(tagPromptPrefix(filename, topics) + kTagPromptSuffix, true) + 1; // + BOS
+    return profile.nCtx - overhead - kMaxNewTokens - 8;
+}
+
+std::string LlamaEngine::buildTagPrompt(const std::string& filename, const std::string& content,
+                                        const std::string& topics) const
+{
+    std::string prefix = tagPromptPrefix(filename, topics);
+    if (content.empty() || !model) {
+        return prefix + "(No content)" + kTagPromptSuffix;
+    }
 
-    return generateResponse(prompt);
+    PromptBuilder builder(llama_model_get_vocab(model));
+    std::string fitted = builder.fitToBudget(content, tagPromptBudget(filename, topics));
+    return prefix + (fitted.empty() ? "(No content)" : fitted) + kTagPromptSuffix;
 }
@@ -2,23 +2,136 @@
 #define LLAMAENGINE_H
 
 #include "llama.h"
+#include "RuntimeProfile.h"
 #include <string>
+#include <cstdint>
 #include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <chrono>
 
 class LlamaEngine
 {
 public:
+    // Bulk tagging callbacks. Both may be invoked concurrently from worker threads.
+    using ContentLoader = std::function<std::string(size_t index)>;
+    using ResultCallback = std::function<void(size_t index, const std::string& result)>;
+    using ProgressCallback = std::function<void(const std::string& message)>;
+
+    // One measured configuration from autoTune
+    struct TuneResult {
+        RuntimeProfile profile;
+        double promptTokensPerSec = 0;
+        double genTokensPerSec = 0;
+        double secondsPerDocument = 0; // Estimated cost of one typical tagging request
+    };
+
+    // Speculative decoding counters. "plain" figures come from requests decoded by
+    // the target alone and serve as the baseline for the speedup.
+    struct SpeculativeStats {
+        uint64_t draftedTokens = 0;
+        uint64_t acceptedTokens = 0;
+        uint64_t specGenerated = 0;
+        double specSeconds = 0;
+        uint64_t plainGenerated = 0;
+        double plainSeconds = 0;
+
+        void merge(const SpeculativeStats& other);
+        double acceptanceRate() const;
+        double speedup() const; // 0 until both modes have samples
+    };
+
     LlamaEngine();
     ~LlamaEngine();
 
-    bool loadModel(const std::string& modelPath);
-    bool isModelLoaded() const { return model != nullptr; }
+    bool loadModel(const std::string& modelPath, const RuntimeProfile& profile = RuntimeProfile());
+    bool isModelLoaded() const;
+    int contextCount() const;
+
+    // Rebuilds the context pool with new settings; reloads the model only if
+    // model-level settings (GPU layers, mmap, mlock) changed.
+    bool applyProfile(const RuntimeProfile& profile);
+    RuntimeProfile runtimeProfile() const;
+
+    // Benchmarks thread counts, KV cache types and flash attention on the loaded
+    // model and returns the results, fastest first. Uses temporary contexts, so the
+    // pool keeps serving requests meanwhile.
+    std::vector<TuneResult> autoTune(const RuntimeProfile& base, const ProgressCallback& progress = nullptr);
+
+    // Draft model for speculative decoding, set through RuntimeProfile::draftModel
+    bool hasDraftModel() const;
+    SpeculativeStats speculativeStats() const;
+    void resetSpeculativeStats();
+    // Runs one tagging request once without and once with the draft on the same
+    // context and returns the figures of that pair of runs
+    SpeculativeStats benchmarkSpeculative(const std::string& filename, const std::string& content);
+
     std::string generateResponse(const std::string& prompt);
+    // Content beyond the single-prompt budget goes through the long-document
+    // (map-reduce) path when RuntimeProfile::longDocuments is set
     std::string suggestTags(const std::string& filename, const std::string& content);
 
+    // Tags many documents at once, spreading them over all pooled contexts.
+    // Content is loaded lazily on the worker that picks up the document. Once
+    // cancel is set no further documents are started.
+    void suggestTagsBatch(const std::vector<std::string>& filenames,
+                          const ContentLoader& loadContent,
+                          const ResultCallback& onResult,
+                          const std::atomic<bool>* cancel = nullptr);
+
 private:
+    // One inference slot: its own context (KV cache + threads) on the shared model weights
+    struct ContextSlot {
+        llama_context* ctx = nullptr;
+        llama_context* draftCtx = nullptr; // Only when a draft model is loaded
+        int nThreads = 0;
+        bool busy = false;
+    };
+
+    // Unlocked bodies of the public calls; the caller holds modelMutex
+    bool loadModelLocked(const std::string& modelPath, const RuntimeProfile& profile);
+    std::string respond(const std::string& prompt);
+    std::string tagDocument(const std::string& filename, const std::string& content);
+
+    ContextSlot* acquireSlot();
+    void releaseSlot(ContextSlot* slot);
+    void freeContexts();
+    bool createContexts(const RuntimeProfile& settings);
+    llama_context_params makeContextParams(const RuntimeProfile& settings, int nContexts) const;
+    bool decodePrompt(llama_context* ctx, const std::vector<llama_token>& tokens, llama_pos startPos, bool lastLogits);
+    bool benchmark(const RuntimeProfile& candidate, TuneResult& result);
+    bool loadDraftModel(const std::string& draftPath);
+    void freeDraftModel();
+    bool isDraftCompatible() const;
+    std::string generateWithContext(ContextSlot& slot, const std::string& prompt, bool allowDraft, SpeculativeStats& stats);
+    std::string generateSpeculative(ContextSlot& slot, int nPast, SpeculativeStats& stats);
+    std::string suggestTagsLong(const std::string& filename, const std::string& content);
+    // Decodes one prompt per sequence in a shared batch and generates greedily for all
+    // of them in lock-step until each stops or the deadline passes
+    std::vector<std::string> generateParallel(llama_context* ctx, const std::vector<std::string>& prompts,
+                                              int maxTokens, std::chrono::steady_clock::time_point deadline);
+    // content must already be cleaned; topics are merged chunk keywords (long documents)
+    std::string buildTagPrompt(const std::string& filename, const std::string& content,
+                               const std::string& topics = std::string()) const;
+    int tagPromptBudget(const std::string& filename, const std::string& topics) const;
+
+    static constexpr int kMaxNewTokens = 256;
+
+    // Shared by every request for its whole duration, exclusive while the model or
+    // profile is replaced, so a reload never frees weights or contexts in use
+    mutable std::shared_mutex modelMutex;
     struct llama_model* model = nullptr;
-    struct llama_context* ctx = nullptr;
+    struct llama_model* draftModel = nullptr;
+    std::string modelPath;
+    RuntimeProfile profile;
+    std::vector<ContextSlot> slots;
+    std::mutex slotMutex;
+    std::condition_variable slotAvailable;
+    mutable std::mutex statsMutex;
+    SpeculativeStats specStats;
 };
 
 #endif // LLAMAENGINE_H
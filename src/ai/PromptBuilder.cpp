@@ -0,0 +1,370 @@
+#include "PromptBuilder.h"
+#include <algorithm>
+#include <cctype>
+
+PromptBuilder::PromptBuilder(const llama_vocab* vocab)
+    : vocab(vocab)
+{
+}
+
+// --- Cleaning ---
+
+static std::string toLowerAscii(std::string_view text)
+{
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    return lower;
+}
+
+static bool mentionsLicense(std::string_view block)
+{
+    std::string lower = toLowerAscii(block);
+    return lower.find("license") != std::string::npos || lower.find("licence") != std::string::npos ||
+           lower.find("copyright") != std::string::npos || lower.find("spdx-") != std::string::npos;
+}
+
+static bool isLineComment(std::string_view line)
+{
+    size_t i = line.find_first_not_of(" \t");
+    if (i == std::string_view::npos) return false;
+    line.remove_prefix(i);
+    if (line.rfind("//", 0) == 0 || line.rfind("--", 0) == 0 || line.rfind(";", 0) == 0 || line.rfind("%", 0) == 0) {
+        return true;
+    }
+    // "# text" / "##" but not preprocessor lines like "#include"
+    return line[0] == '#' && (line.size() == 1 || line[1] == ' ' || line[1] == '#' || line[1] == '!');
+}
+
+// Length of a license/copyright comment block at the start of text, 0 if none
+static size_t leadingLicenseBlock(std::string_view text)
+{
+    size_t start = text.find_first_not_of(" \t\n");
+    if (start == std::string_view::npos) return 0;
+    std::string_view rest = text.substr(start);
+
+    size_t end = 0;
+    if (rest.rfind("/*", 0) == 0 || rest.rfind("<!--", 0) == 0) {
+        const char* close = rest[0] == '/' ? "*/" : "-->";
+        size_t pos = rest.find(close);
+        if (pos == std::string_view::npos) return 0;
+        end = pos + std::char_traits<char>::length(close);
+    } else {
+        // Run of consecutive line comments
+        size_t pos = 0;
+        while (pos < rest.size()) {
+            size_t eol = rest.find('\n', pos);
+            if (eol == std::string_view::npos) eol = rest.size();
+            if (!isLineComment(rest.substr(pos, eol - pos))) break;
+            pos = eol + 1;
+        }
+        end = std::min(pos, rest.size());
+    }
+
+    if (end == 0 || !mentionsLicense(rest.substr(0, end))) return 0;
+    return start + end;
+}
+
+static bool isBase64Char(unsigned char c)
+{
+    return std::isalnum(c) || c == '+' || c == '/' || c == '=' || c == '-' || c == '_';
+}
+
+// Encoded payloads (base64, hex dumps, data URIs) are long, space-free and
+// meaningless to the model; a marker keeps the fact that one was there.
+static bool isBlob(std::string_view word)
+{
+    size_t dataUri = word.find(";base64,");
+    if (dataUri != std::string_view::npos) word.remove_prefix(dataUri + 8);
+
+    while (!word.empty() && !isBase64Char(word.front())) word.remove_prefix(1);
+    while (!word.empty() && !isBase64Char(word.back())) word.remove_suffix(1);
+    if (word.size() < 64) return false;
+
+    bool hasDigit = false;
+    bool hasAlpha = false;
+    for (unsigned char c : word) {
+        if (!isBase64Char(c)) return false;
+        hasDigit |= std::isdigit(c) != 0;
+        hasAlpha |= std::isalpha(c) != 0;
+    }
+    return hasDigit && (hasAlpha || word.size() >= 100);
+}
+
+// Collapses whitespace, replaces blobs and shortens runs of one repeated symbol
+// ("==========" -> "===") within a single line
+static std::string cleanLine(std::string_view line)
+{
+    std::string out;
+    size_t i = 0;
+    while (i < line.size()) {
+        if (line[i] == ' ' || line[i] == '\t' || line[i] == '\f' || line[i] == '\v') {
+            while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\f' || line[i] == '\v')) ++i;
+            if (!out.empty()) out += ' ';
+            continue;
+        }
+
+        size_t wordEnd = line.find_first_of(" \t\f\v", i);
+        if (wordEnd == std::string_view::npos) wordEnd = line.size();
+        std::string_view word = line.substr(i, wordEnd - i);
+        i = wordEnd;
+
+        if (isBlob(word)) {
+            out += "[blob]";
+            continue;
+        }
+
+        for (size_t j = 0; j < word.size();) {
+            unsigned char c = word[j];
+            size_t run = 1;
+            while (j + run < word.size() && word[j + run] == word[j]) ++run;
+            size_t keep = (run >= 8 && !std::isalnum(c) && c < 0x80) ? 3 : run;
+            out.append(keep, word[j]);
+            j += run;
+        }
+    }
+    while (!out.empty() && out.back() == ' ') out.pop_back();
+    return out;
+}
+
+std::string PromptBuilder::cleanContent(const std::string& content)
+{
+    std::string text;
+    text.reserve(content.size());
+    for (size_t i = 0; i < content.size(); ++i) {
+        if (content[i] == '\r') {
+            text += '\n';
+            if (i + 1 < content.size() && content[i + 1] == '\n') ++i;
+        } else {
+            text += content[i];
+        }
+    }
+
+    std::string_view view(text);
+    while (size_t block = leadingLicenseBlock(view)) {
+        view.remove_prefix(block);
+    }
+
+    std::string out;
+    out.reserve(view.size());
+    std::string previous;
+    int repeats = 0;
+    bool lastBlank = true;
+
+    auto flushRepeats = [&]() {
+        if (repeats > 0) {
+            out += "[previous line repeated " + std::to_string(repeats) + " times]\n";
+            repeats = 0;
+        }
+    };
+
+    size_t pos = 0;
+    while (pos <= view.size()) {
+        size_t eol = view.find('\n', pos);
+        if (eol == std::string_view::npos) eol = view.size();
+        std::string line = cleanLine(view.substr(pos, eol - pos));
+        pos = eol + 1;
+
+        if (line.empty()) {
+            flushRepeats();
+            if (!lastBlank) out += '\n';
+            lastBlank = true;
+            continue;
+        }
+        if (line == previous) {
+            repeats++;
+            continue;
+        }
+        flushRepeats();
+        out += line;
+        out += '\n';
+        previous = std::move(line);
+        lastBlank = false;
+    }
+    flushRepeats();
+
+    while (!out.empty() && (out.back() == '\n' || out.back() == ' ')) out.pop_back();
+    return out;
+}
+
+// --- Tokenisation ---
+
+int PromptBuilder::countTokens(std::string_view text, bool parseSpecial) const
+{
+    if (text.empty()) return 0;
+    int n = llama_tokenize(vocab, text.data(), text.size(), nullptr, 0, false, parseSpecial);
+    return n < 0 ? -n : n;
+}
+
+std::vector<llama_token> PromptBuilder::tokenize(std::string_view text) const
+{
+    std::vector<llama_token> tokens(countTokens(text));
+    if (!tokens.empty()) {
+        llama_tokenize(vocab, text.data(), text.size(), tokens.data(), tokens.size(), false, false);
+    }
+    return tokens;
+}
+
+std::string PromptBuilder::detokenize(const llama_token* tokens, size_t count) const
+{
+    std::string text;
+    char buf[256];
+    for (size_t i = 0; i < count; ++i) {
+        int n = llama_token_to_piece(vocab, tokens[i], buf, sizeof(buf), 0, false);
+        if (n > 0) text.append(buf, n);
+    }
+    return text;
+}
+
+// Lines, with very long lines (minified code, CSV dumps) sliced at UTF-8
+// boundaries so no single piece needs to be tokenised in full.
+std::vector<std::string_view> PromptBuilder::splitPieces(std::string_view text)
+{
+    const size_t maxPiece = 512;
+    std::vector<std::string_view> pieces;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        size_t end = eol == std::string_view::npos ? text.size() : eol + 1;
+        while (end - pos > maxPiece) {
+            size_t cut = pos + maxPiece;
+            while (cut > pos && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) --cut;
+            if (cut == pos) cut = pos + maxPiece;
+            pieces.push_back(text.substr(pos, cut - pos));
+            pos = cut;
+        }
+        pieces.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    return pieces;
+}
+
+std::string PromptBuilder::takeForward(const std::vector<std::string_view>& pieces, size_t first, int budget, size_t* end) const
+{
+    std::string out;
+    size_t i = first;
+    for (; i < pieces.size() && budget > 0; ++i) {
+        int n = countTokens(pieces[i]);
+        if (n <= budget) {
+            out.append(pieces[i]);
+            budget -= n;
+        } else {
+            std::vector<llama_token> tokens = tokenize(pieces[i]);
+            out += detokenize(tokens.data(), budget);
+            budget = 0;
+        }
+    }
+    if (end) *end = i;
+    return out;
+}
+
+// Walks back from the last piece, never touching pieces before index stop
+std::string PromptBuilder::takeBackward(const std::vector<std::string_view>& pieces, size_t stop, int budget) const
+{
+    std::vector<std::string> parts;
+    for (size_t i = pieces.size(); i-- > stop && budget > 0;) {
+        int n = countTokens(pieces[i]);
+        if (n <= budget) {
+            parts.emplace_back(pieces[i]);
+            budget -= n;
+        } else {
+            std::vector<llama_token> tokens = tokenize(pieces[i]);
+            parts.push_back(detokenize(tokens.data() + tokens.size() - budget, budget));
+            budget = 0;
+        }
+    }
+    std::string out;
+    for (auto it = parts.rbegin(); it != parts.rend(); ++it) out += *it;
+    return out;
+}
+
+bool PromptBuilder::fitsBudget(const std::string& content, int tokenBudget) const
+{
+    // Stop counting as soon as the budget is exceeded
+    int total = 0;
+    for (const auto& piece : splitPieces(content)) {
+        total += countTokens(piece);
+        if (total > tokenBudget) return false;
+    }
+    return true;
+}
+
+std::string PromptBuilder::fitToBudget(const std::string& content, int tokenBudget) const
+{
+    if (tokenBudget <= 0 || content.empty()) return "";
+
+    // Common case: the whole document fits
+    if (fitsBudget(content, tokenBudget)) return content;
+
+    std::vector<std::string_view> pieces = splitPieces(content);
+
+    const std::string marker = "\n[...]\n";
+    int markerTokens = countTokens(marker);
+    int available = tokenBudget - 2 * markerTokens;
+    if (available < 64 || pieces.size() < 3) {
+        return takeForward(pieces, 0, tokenBudget);
+    }
+
+    // Head carries titles and abstracts, the tail conclusions and signatures, and
+    // the middle a sample of the body
+    int headBudget = available / 2;
+    int middleBudget = available / 4;
+    int tailBudget = available - headBudget - middleBudget;
+
+    size_t headEnd = 0;
+    size_t middleEnd = 0;
+    std::string head = takeForward(pieces, 0, headBudget, &headEnd);
+    std::string middle = takeForward(pieces, std::max(headEnd, pieces.size() / 2), middleBudget, &middleEnd);
+    std::string tail = takeBackward(pieces, middleEnd, tailBudget);
+    return head + marker + middle + marker + tail;
+}
+
+std::string PromptBuilder::takeChunk(const std::vector<std::string_view>& pieces, size_t first, int chunkTokens, size_t* end) const
+{
+    std::string out;
+    int used = 0;
+    size_t i = first;
+    for (; i < pieces.size(); ++i) {
+        int n = countTokens(pieces[i]);
+        if (used + n > chunkTokens) {
+            if (out.empty()) {
+                std::vector<llama_token> tokens = tokenize(pieces[i]);
+                out = detokenize(tokens.data(), chunkTokens);
+                ++i;
+            }
+            break;
+        }
+        out.append(pieces[i]);
+        used += n;
+    }
+    *end = i;
+    return out;
+}
+
+std::vector<std::string> PromptBuilder::sampleChunks(const std::string& content, int chunkTokens, int maxChunks) const
+{
+    std::vector<std::string> chunks;
+    if (content.empty() || chunkTokens <= 0 || maxChunks <= 0) return chunks;
+
+    std::vector<std::string_view> pieces = splitPieces(content);
+
+    // Sequential chunking while the document stays within maxChunks
+    size_t next = 0;
+    while (next < pieces.size() && static_cast<int>(chunks.size()) < maxChunks) {
+        size_t end = next;
+        chunks.push_back(takeChunk(pieces, next, chunkTokens, &end));
+        next = end;
+    }
+    if (next >= pieces.size() || maxChunks == 1) return chunks;
+
+    // Too long: use the pieces-per-chunk rate seen so far to place maxChunks
+    // chunks evenly from the first to the last piece
+    double piecesPerChunk = static_cast<double>(next) / chunks.size();
+    double span = std::max(0.0, pieces.size() - piecesPerChunk);
+    chunks.resize(1); // The first chunk is the same either way
+    for (int k = 1; k < maxChunks; ++k) {
+        size_t start = static_cast<size_t>(span * k / (maxChunks - 1));
+        size_t end = start;
+        chunks.push_back(takeChunk(pieces, std::min(start, pieces.size() - 1), chunkTokens, &end));
+    }
+    return chunks;
+}
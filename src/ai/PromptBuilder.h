@@ -0,0 +1,50 @@
+#ifndef PROMPTBUILDER_H
+#define PROMPTBUILDER_H
+
+#include "llama.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fits document content into an exact token budget for the model's vocabulary.
+// Content is tokenised piece by piece (lines, or slices of very long lines), so
+// only about as much text as fits the budget is ever tokenised, however large
+// the document is.
+class PromptBuilder
+{
+public:
+    explicit PromptBuilder(const llama_vocab* vocab);
+
+    // Strips what costs tokens but says nothing about the document: leading
+    // license/copyright comment blocks, base64/hex blobs, runs of a repeated
+    // character, consecutive duplicate lines and redundant whitespace.
+    static std::string cleanContent(const std::string& content);
+
+    int countTokens(std::string_view text, bool parseSpecial = false) const;
+
+    bool fitsBudget(const std::string& content, int tokenBudget) const;
+
+    // Returns at most tokenBudget tokens of content. Content that does not fit is
+    // sampled as head (1/2), middle (1/4) and tail (1/4) joined by "[...]" markers.
+    std::string fitToBudget(const std::string& content, int tokenBudget) const;
+
+    // Splits content into consecutive chunks of at most chunkTokens tokens. If more
+    // than maxChunks would be needed, returns maxChunks chunks spread evenly over
+    // the document (first and last included) without tokenising the rest.
+    std::vector<std::string> sampleChunks(const std::string& content, int chunkTokens, int maxChunks) const;
+
+private:
+    static std::vector<std::string_view> splitPieces(std::string_view text);
+    std::vector<llama_token> tokenize(std::string_view text) const;
+    std::string detokenize(const llama_token* tokens, size_t count) const;
+
+    // Collect pieces until the budget is used; the piece that overflows is cut at token level
+    std::string takeForward(const std::vector<std::string_view>& pieces, size_t first, int budget, size_t* end = nullptr) const;
+    std::string takeBackward(const std::vector<std::string_view>& pieces, size_t stop, int budget) const;
+    // Whole pieces only, unless a single piece alone exceeds the chunk
+    std::string takeChunk(const std::vector<std::string_view>& pieces, size_t first, int chunkTokens, size_t* end) const;
+
+    const llama_vocab* vocab;
+};
+
+#endif // PROMPTBUILDER_H
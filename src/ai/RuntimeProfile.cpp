@@ -0,0 +1,79 @@
+#include "RuntimeProfile.h"
+#include <sstream>
+#include <algorithm>
+
+const char* const RuntimeProfile::cacheTypes[] = {
+    "f16", "bf16", "q8_0", "q5_1", "q5_0", "q4_1", "q4_0", nullptr
+};
+
+bool RuntimeProfile::sameModelSettings(const RuntimeProfile& other) const
+{
+    return nGpuLayers == other.nGpuLayers && useMmap == other.useMmap && useMlock == other.useMlock;
+}
+
+std::string RuntimeProfile::summary() const
+{
+    std::ostringstream ss;
+    ss << "ctx=" << nCtx
+       << " threads=" << (nThreads > 0 ? std::to_string(nThreads) : "auto")
+       << "/" << (nThreadsBatch > 0 ? std::to_string(nThreadsBatch) : "auto")
+       << " parallel=" << (nParallel > 0 ? std::to_string(nParallel) : "auto")
+       << " kv=" << cacheTypeK << "/" << cacheTypeV
+       << " fa=" << flashAttention
+       << " batch=" << nBatch << "/" << nUBatch
+       << " gpu=" << nGpuLayers;
+    if (!draftModel.empty()) ss << " draft=" << nDraft;
+    if (longDocuments) ss << " longdoc=" << chunkTokens << "x" << longDocTokenBudget / std::max(1, chunkTokens);
+    return ss.str();
+}
+
+nlohmann::json RuntimeProfile::toJson() const
+{
+    return {
+        {"n_gpu_layers", nGpuLayers},
+        {"use_mmap", useMmap},
+        {"use_mlock", useMlock},
+        {"n_threads", nThreads},
+        {"n_threads_batch", nThreadsBatch},
+        {"n_ctx", nCtx},
+        {"n_batch", nBatch},
+        {"n_ubatch", nUBatch},
+        {"n_parallel", nParallel},
+        {"n_seq", nSeq},
+        {"cache_type_k", cacheTypeK},
+        {"cache_type_v", cacheTypeV},
+        {"flash_attn", flashAttention},
+        {"draft_model", draftModel},
+        {"n_draft", nDraft},
+        {"long_documents", longDocuments},
+        {"chunk_tokens", chunkTokens},
+        {"long_doc_token_budget", longDocTokenBudget},
+        {"long_doc_time_budget_ms", longDocTimeBudgetMs}
+    };
+}
+
+RuntimeProfile RuntimeProfile::fromJson(const nlohmann::json& j)
+{
+    RuntimeProfile p;
+    if (!j.is_object()) return p;
+    p.nGpuLayers = j.value("n_gpu_layers", p.nGpuLayers);
+    p.useMmap = j.value("use_mmap", p.useMmap);
+    p.useMlock = j.value("use_mlock", p.useMlock);
+    p.nThreads = j.value("n_threads", p.nThreads);
+    p.nThreadsBatch = j.value("n_threads_batch", p.nThreadsBatch);
+    p.nCtx = j.value("n_ctx", p.nCtx);
+    p.nBatch = j.value("n_batch", p.nBatch);
+    p.nUBatch = j.value("n_ubatch", p.nUBatch);
+    p.nParallel = j.value("n_parallel", p.nParallel);
+    p.nSeq = j.value("n_seq", p.nSeq);
+    p.cacheTypeK = j.value("cache_type_k", p.cacheTypeK);
+    p.cacheTypeV = j.value("cache_type_v", p.cacheTypeV);
+    p.flashAttention = j.value("flash_attn", p.flashAttention);
+    p.draftModel = j.value("draft_model", p.draftModel);
+    p.nDraft = j.value("n_draft", p.nDraft);
+    p.longDocuments = j.value("long_documents", p.longDocuments);
+    p.chunkTokens = j.value("chunk_tokens", p.chunkTokens);
+    p.longDocTokenBudget = j.value("long_doc_token_budget", p.longDocTokenBudget);
+    p.longDocTimeBudgetMs = j.value("long_doc_time_budget_ms", p.longDocTimeBudgetMs);
+    return p;
+}
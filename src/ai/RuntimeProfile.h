@@ -0,0 +1,46 @@
+#ifndef RUNTIMEPROFILE_H
+#define RUNTIMEPROFILE_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Tunable llama.cpp settings for one model on one machine.
+// Zero thread/parallel counts mean "pick from the hardware at load time".
+struct RuntimeProfile {
+    // Model-level (changing these requires reloading the model)
+    int nGpuLayers = 100;
+    bool useMmap = true;
+    bool useMlock = false;
+
+    // Context-level (applied by rebuilding the context pool)
+    int nThreads = 0;       // Generation threads per context
+    int nThreadsBatch = 0;  // Prompt processing threads per context
+    int nCtx = 8192;
+    int nBatch = 2048;      // Logical batch: max tokens per llama_decode call
+    int nUBatch = 512;      // Physical micro-batch
+    int nParallel = 0;      // Contexts in the pool
+    int nSeq = 4;           // Sequences decoded together in one context (long-document pass)
+    std::string cacheTypeK = "f16"; // f16, bf16, q8_0, q5_1, q5_0, q4_1, q4_0
+    std::string cacheTypeV = "f16";
+    std::string flashAttention = "auto"; // auto, on, off
+
+    // Speculative decoding: optional small GGUF sharing the model's vocabulary
+    std::string draftModel;
+    int nDraft = 5;         // Tokens proposed per verification pass
+
+    // Long documents: map-reduce over token-sized chunks instead of truncating
+    bool longDocuments = true;
+    int chunkTokens = 1024;
+    int longDocTokenBudget = 32768;  // Content tokens read per document at most
+    int longDocTimeBudgetMs = 60000; // Chunk pass stops when this is used up
+
+    bool sameModelSettings(const RuntimeProfile& other) const;
+    std::string summary() const;
+
+    nlohmann::json toJson() const;
+    static RuntimeProfile fromJson(const nlohmann::json& j);
+
+    static const char* const cacheTypes[];
+};
+
+#endif // RUNTIMEPROFILE_H
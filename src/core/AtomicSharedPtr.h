@@ -0,0 +1,38 @@
+#ifndef ATOMICSHAREDPTR_H
+#define ATOMICSHAREDPTR_H
+
+#include <memory>
+#include <mutex>
+
+// Holder for an immutable snapshot that one thread publishes and others read,
+// with the load/store interface of std::atomic<std::shared_ptr<T>>, which
+// libc++ does not provide. The lock is held only to copy the pointer, so
+// readers never wait for the work that built the snapshot.
+template <typename T>
+class AtomicSharedPtr {
+public:
+    AtomicSharedPtr() = default;
+    explicit AtomicSharedPtr(std::shared_ptr<T> initial) : value(std::move(initial)) {}
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    std::shared_ptr<T> load() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return value;
+    }
+
+    void store(std::shared_ptr<T> next) {
+        // The old snapshot is released outside the lock: freeing a large one
+        // must not hold up readers
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            value.swap(next);
+        }
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::shared_ptr<T> value;
+};
+
+#endif // ATOMICSHAREDPTR_H
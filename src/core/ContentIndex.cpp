@@ -0,0 +1,587 @@
+#include "ContentIndex.h"
+#include "TagJournal.h"
+#include "miniz.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kManifestMagic[8] = {'S', 'F', 'C', 'M', 'A', 'N', 'I', '1'};
+constexpr uint32_t kManifestVersion = 1;
+constexpr size_t kMaxTermBytes = 64;
+
+// BM25 parameters as commonly tuned for short to medium documents
+constexpr double kK1 = 1.2;
+constexpr double kB = 0.75;
+
+template <typename T>
+void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(const std::string& in, size_t& pos, T& value) {
+    if (in.size() - pos < sizeof(T)) return false;
+    std::memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+uint32_t checksum(const std::string& data, size_t size) {
+    return static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const unsigned char*>(data.data()), size));
+}
+
+bool parseSegmentName(const std::string& name, uint64_t& generation) {
+    if (name.size() <= 8 || name.rfind("seg-", 0) != 0 || name.substr(name.size() - 4) != ".idx") return false;
+    std::string digits = name.substr(4, name.size() - 8);
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) return false;
+    generation = std::stoull(digits);
+    return true;
+}
+
+// Decodes one UTF-8 sequence; invalid bytes come back as U+FFFD, one at a time
+uint32_t nextCodepoint(std::string_view text, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c < 0x80) {
+        ++i;
+        return c;
+    }
+    size_t extra = (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xE ? 2 : (c >> 3) == 0x1E ? 3 : 0;
+    if (extra == 0 || text.size() - i <= extra) {
+        ++i;
+        return 0xFFFD;
+    }
+    uint32_t cp = c & (0x3F >> extra);
+    for (size_t k = 1; k <= extra; ++k) {
+        unsigned char cont = static_cast<unsigned char>(text[i + k]);
+        if ((cont & 0xC0) != 0x80) {
+            ++i;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (cont & 0x3F);
+    }
+    i += extra + 1;
+    return cp;
+}
+
+bool isCjk(uint32_t cp) {
+    return (cp >= 0x3040 && cp <= 0x30FF)     // Hiragana, Katakana
+        || (cp >= 0x3400 && cp <= 0x4DBF)     // CJK Extension A
+        || (cp >= 0x4E00 && cp <= 0x9FFF)     // CJK Unified Ideographs
+        || (cp >= 0xAC00 && cp <= 0xD7AF)     // Hangul syllables
+        || (cp >= 0xF900 && cp <= 0xFAFF)     // CJK Compatibility Ideographs
+        || (cp >= 0x20000 && cp <= 0x2FA1F);  // Extensions B and later
+}
+
+bool isWordChar(uint32_t cp) {
+    if (cp < 0x80) return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || cp == '_';
+    // Letters of other scripts; punctuation and symbol blocks separate words
+    return cp >= 0xC0 && cp != 0xD7 && cp != 0xF7 && cp != 0xFFFD
+        && !(cp >= 0x2000 && cp <= 0x2BFF) && !(cp >= 0x3000 && cp <= 0x303F)
+        && !(cp >= 0xFE30 && cp <= 0xFE4F) && !(cp >= 0xFF00 && cp <= 0xFFEF);
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+} // namespace
+
+ContentIndex::~ContentIndex() {
+    cancel();
+    std::lock_guard<std::mutex> lock(writeMutex); // Lets a running update finish first
+}
+
+std::vector<std::string> ContentIndex::tokenize(std::string_view text) {
+    std::vector<std::string> tokens;
+    tokens.reserve(text.size() / 6);
+    std::string word;
+    std::string previousCjk; // Last character of the current CJK run
+    bool cjkRunHasPair = false;
+
+    auto endWord = [&]() {
+        if (!word.empty() && word.size() <= kMaxTermBytes) tokens.push_back(std::move(word));
+        word.clear();
+    };
+    auto endCjkRun = [&]() {
+        if (!previousCjk.empty() && !cjkRunHasPair) tokens.push_back(previousCjk);
+        previousCjk.clear();
+        cjkRunHasPair = false;
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x80) {
+            // Plain ASCII needs no decoding, and is most of the text in most files
+            ++i;
+            if (isWordChar(c)) {
+                endCjkRun();
+                word.push_back(static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c));
+            } else {
+                endWord();
+                endCjkRun();
+            }
+            continue;
+        }
+        uint32_t cp = nextCodepoint(text, i);
+        if (cp >= 0xFF01 && cp <= 0xFF5E) {
+            cp -= 0xFEE0; // Full-width ASCII from CJK input methods
+            if (cp >= 'A' && cp <= 'Z') cp += 'a' - 'A';
+        }
+
+        if (isCjk(cp)) {
+            endWord();
+            std::string current;
+            appendUtf8(current, cp);
+            if (!previousCjk.empty()) {
+                tokens.push_back(previousCjk + current);
+                cjkRunHasPair = true;
+            }
+            previousCjk = std::move(current);
+        } else if (isWordChar(cp)) {
+            endCjkRun();
+            appendUtf8(word, cp);
+        } else {
+            endWord();
+            endCjkRun();
+        }
+    }
+    endWord();
+    endCjkRun();
+    return tokens;
+}
+
+std::string ContentIndex::keyOf(const std::string& path) const {
+    fs::path p(path);
+    if (p.is_absolute()) p = p.lexically_relative(rootDir);
+    return p.lexically_normal().generic_string();
+}
+
+std::string ContentIndex::segmentPath(uint64_t generation) const {
+    return indexDir + "/seg-" + std::to_string(generation) + ".idx";
+}
+
+std::string ContentIndex::manifestPath() const {
+    return indexDir + "/manifest";
+}
+
+void ContentIndex::cancel() {
+    cancelled = true;
+}
+
+bool ContentIndex::open(const std::string& root) {
+    cancel();
+    std::lock_guard<std::mutex> lock(writeMutex);
+    cancelled = false;
+    rootDir = root;
+    indexDir = root + "/.smartfile/content";
+    nextGeneration = 1;
+
+    auto loaded = std::make_shared<State>();
+    std::string data;
+    {
+        std::ifstream f(manifestPath(), std::ios::binary);
+        if (f) {
+            std::stringstream buffer;
+            buffer << f.rdbuf();
+            data = buffer.str();
+        }
+    }
+
+    // A manifest that fails its checksum is ignored; the next update re-indexes
+    std::unordered_set<uint64_t> listed;
+    size_t pos = 0;
+    char magic[8] = {};
+    uint32_t version = 0;
+    uint32_t count = 0;
+    uint32_t storedCrc = 0;
+    bool valid = data.size() >= sizeof(storedCrc)
+                 && get(data, pos, magic) && std::memcmp(magic, kManifestMagic, sizeof(magic)) == 0
+                 && get(data, pos, version) && version == kManifestVersion
+                 && get(data, pos, count) && get(data, pos, nextGeneration);
+    if (valid) {
+        std::memcpy(&storedCrc, data.data() + data.size() - sizeof(storedCrc), sizeof(storedCrc));
+        valid = checksum(data, data.size() - sizeof(storedCrc)) == storedCrc;
+    }
+    for (uint32_t s = 0; valid && s < count; ++s) {
+        uint64_t generation = 0;
+        uint32_t docCount = 0;
+        uint32_t deadCount = 0;
+        if (!get(data, pos, generation) || !get(data, pos, docCount) || !get(data, pos, deadCount)) break;
+        auto dead = std::make_shared<Bitmap>((size_t(docCount) + 63) / 64);
+        if (data.size() - pos < dead->size() * sizeof(uint64_t)) break;
+        std::memcpy(dead->data(), data.data() + pos, dead->size() * sizeof(uint64_t));
+        pos += dead->size() * sizeof(uint64_t);
+
+        auto segment = ContentSegment::open(segmentPath(generation));
+        if (!segment || segment->documentCount() != docCount) continue;
+        listed.insert(generation);
+        loaded->segments.push_back({generation, segment, dead, deadCount});
+        loaded->liveDocs += docCount - deadCount;
+    }
+    if (!valid) nextGeneration = 1;
+
+    // Segments left behind by an interrupted update or merge
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(indexDir, ec)) {
+        uint64_t generation = 0;
+        if (!parseSegmentName(entry.path().filename().string(), generation)) continue;
+        nextGeneration = std::max(nextGeneration, generation + 1);
+        if (!listed.count(generation)) fs::remove(entry.path(), ec);
+    }
+
+    state.store(loaded);
+    return valid || data.empty();
+}
+
+bool ContentIndex::writeManifest(const State& current) const {
+    std::string out;
+    out.append(kManifestMagic, sizeof(kManifestMagic));
+    put(out, kManifestVersion);
+    put(out, static_cast<uint32_t>(current.segments.size()));
+    put(out, nextGeneration);
+    for (const auto& segment : current.segments) {
+        put(out, segment.generation);
+        put(out, segment.data->documentCount());
+        put(out, segment.deadCount);
+        out.append(reinterpret_cast<const char*>(segment.dead->data()), segment.dead->size() * sizeof(uint64_t));
+    }
+    put(out, checksum(out, out.size()));
+    return TagJournal::replaceFile(manifestPath(), out);
+}
+
+size_t ContentIndex::update(const std::vector<std::string>& paths, const Extractor& extract,
+                            const Progress& progress) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    cancelled = false;
+    if (indexDir.empty()) return 0;
+    std::error_code ec;
+    fs::create_directories(indexDir, ec);
+
+    // The live version of every indexed file
+    struct Version {
+        uint64_t size;
+        int64_t mtime;
+    };
+    std::unordered_map<std::string, Version> indexed;
+    std::shared_ptr<const State> current = state.load();
+    for (const auto& segment : current->segments) {
+        for (uint32_t doc = 0; doc < segment.data->documentCount(); ++doc) {
+            if (segment.isDead(doc)) continue;
+            auto d = segment.data->document(doc);
+            indexed[std::string(d.path)] = {d.size, d.mtime};
+        }
+    }
+
+    struct Pending {
+        const std::string* path;
+        std::string key;
+        Version version;
+    };
+    std::vector<Pending> changed;
+    std::unordered_set<std::string> present;
+    for (const auto& path : paths) {
+        uint64_t size = fs::file_size(path, ec);
+        if (ec) continue;
+        auto time = fs::last_write_time(path, ec);
+        if (ec) continue;
+        Version version{size, static_cast<int64_t>(time.time_since_epoch().count())};
+
+        std::string key = keyOf(path);
+        auto it = indexed.find(key);
+        if (it == indexed.end() || it->second.size != version.size || it->second.mtime != version.mtime) {
+            changed.push_back({&path, key, version});
+        }
+        present.insert(std::move(key));
+    }
+    std::vector<std::string> removed;
+    for (const auto& [key, version] : indexed) {
+        if (!present.count(key)) removed.push_back(key);
+    }
+    if (changed.empty() && removed.empty()) return 0;
+
+    ContentSegment::Builder builder;
+    std::vector<std::string> batchKeys;
+    size_t done = 0;
+    for (const auto& file : changed) {
+        if (cancelled) break;
+        std::string text = extract(*file.path);
+        if (text.size() > kMaxIndexedBytes) text.resize(kMaxIndexedBytes);
+
+        std::vector<std::string> tokens = tokenize(text);
+        std::unordered_map<std::string_view, uint32_t> frequencies;
+        frequencies.reserve(tokens.size());
+        for (const auto& token : tokens) ++frequencies[token];
+
+        // Files without text are recorded too, so they are not extracted again
+        uint32_t doc = builder.addDocument(file.key, static_cast<uint32_t>(tokens.size()),
+                                           file.version.size, file.version.mtime);
+        for (const auto& [term, frequency] : frequencies) {
+            builder.addPosting(term, doc, frequency);
+        }
+        batchKeys.push_back(file.key);
+        ++done;
+
+        if (progress && !progress(done, changed.size())) cancelled = true;
+        if (builder.postingBytes() >= kFlushBytes) {
+            commit(builder, batchKeys, {});
+            builder = ContentSegment::Builder();
+            batchKeys.clear();
+        }
+    }
+    commit(builder, batchKeys, removed);
+    return done;
+}
+
+void ContentIndex::commit(ContentSegment::Builder& builder, const std::vector<std::string>& keys,
+                          const std::vector<std::string>& removed) {
+    if (builder.documentCount() == 0 && removed.empty()) return;
+    std::shared_ptr<const State> previous = state.load();
+    State next = *previous;
+
+    // Bitmaps are shared with published states, so each is copied once before marking
+    std::vector<std::shared_ptr<Bitmap>> writable(next.segments.size());
+    auto supersede = [&](const std::string& key) {
+        for (size_t s = 0; s < next.segments.size(); ++s) {
+            Segment& segment = next.segments[s];
+            uint32_t doc = segment.data->findDocument(key);
+            if (doc == ContentSegment::npos || segment.isDead(doc)) continue;
+            if (!writable[s]) {
+                writable[s] = std::make_shared<Bitmap>(*segment.dead);
+                segment.dead = writable[s];
+            }
+            (*writable[s])[doc >> 6] |= uint64_t(1) << (doc & 63);
+            ++segment.deadCount;
+        }
+    };
+    for (const auto& key : keys) supersede(key);
+    for (const auto& key : removed) supersede(key);
+
+    if (builder.documentCount() > 0) {
+        uint64_t generation = nextGeneration++;
+        std::string path = segmentPath(generation);
+        std::shared_ptr<const ContentSegment> data = builder.write(path) ? ContentSegment::open(path) : nullptr;
+        if (data) {
+            auto dead = std::make_shared<const Bitmap>((size_t(data->documentCount()) + 63) / 64);
+            next.segments.push_back({generation, data, dead, 0});
+        } else {
+            std::cerr << "Error writing content segment " << path << std::endl;
+        }
+    }
+
+    merge(next);
+    next.liveDocs = 0;
+    for (const auto& segment : next.segments) {
+        next.liveDocs += segment.data->documentCount() - segment.deadCount;
+    }
+    if (!writeManifest(next)) return;
+    state.store(std::make_shared<const State>(std::move(next)));
+
+    // Readers may still map replaced segments; POSIX and FILE_SHARE_DELETE keep
+    // such mappings valid until they are closed
+    std::shared_ptr<const State> published = state.load();
+    std::error_code ec;
+    for (const auto& old : previous->segments) {
+        bool kept = std::any_of(published->segments.begin(), published->segments.end(),
+                                [&old](const Segment& s) { return s.generation == old.generation; });
+        if (!kept) fs::remove(segmentPath(old.generation), ec);
+    }
+}
+
+void ContentIndex::merge(State& current) {
+    for (;;) {
+        // Mostly dead segments are rewritten whatever their size; otherwise the
+        // smallest are merged once there are too many, so large segments are
+        // rewritten rarely
+        std::vector<size_t> picked;
+        for (size_t s = 0; s < current.segments.size(); ++s) {
+            const Segment& segment = current.segments[s];
+            if (size_t(segment.deadCount) * 2 > segment.data->documentCount()) picked.push_back(s);
+        }
+        if (picked.empty() && current.segments.size() > kMaxSegments) {
+            std::vector<size_t> bySize(current.segments.size());
+            for (size_t s = 0; s < bySize.size(); ++s) bySize[s] = s;
+            std::sort(bySize.begin(), bySize.end(), [&current](size_t a, size_t b) {
+                const Segment& x = current.segments[a];
+                const Segment& y = current.segments[b];
+                return x.data->documentCount() - x.deadCount < y.data->documentCount() - y.deadCount;
+            });
+            picked.assign(bySize.begin(), bySize.begin() + kMergeFactor);
+        }
+        if (picked.empty()) return;
+
+        std::sort(picked.begin(), picked.end());
+        std::vector<Segment> inputs;
+        for (size_t s : picked) inputs.push_back(current.segments[s]);
+        Segment merged{};
+        if (!mergeSegments(inputs, merged)) return; // Keep the inputs
+
+        for (auto it = picked.rbegin(); it != picked.rend(); ++it) {
+            current.segments.erase(current.segments.begin() + static_cast<std::ptrdiff_t>(*it));
+        }
+        if (merged.data) current.segments.push_back(std::move(merged));
+    }
+}
+
+bool ContentIndex::mergeSegments(const std::vector<Segment>& inputs, Segment& merged) {
+    // New ids follow input order, so each term's postings stay ascending when
+    // the inputs are appended one after another
+    ContentSegment::Builder builder;
+    std::vector<std::vector<uint32_t>> idMaps(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const auto& data = *inputs[i].data;
+        idMaps[i].assign(data.documentCount(), ContentSegment::npos);
+        for (uint32_t doc = 0; doc < data.documentCount(); ++doc) {
+            if (inputs[i].isDead(doc)) continue;
+            auto d = data.document(doc);
+            idMaps[i][doc] = builder.addDocument(std::string(d.path), d.length, d.size, d.mtime);
+        }
+    }
+    if (builder.documentCount() == 0) return true;
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const auto& data = *inputs[i].data;
+        const auto& idMap = idMaps[i];
+        for (uint32_t t = 0; t < data.termCount(); ++t) {
+            std::string_view term = data.term(t);
+            data.forEachPosting(t, [&](uint32_t doc, uint32_t frequency) {
+                if (doc < idMap.size() && idMap[doc] != ContentSegment::npos) {
+                    builder.addPosting(term, idMap[doc], frequency);
+                }
+            });
+        }
+    }
+
+    uint64_t generation = nextGeneration++;
+    std::string path = segmentPath(generation);
+    std::shared_ptr<const ContentSegment> data = builder.write(path) ? ContentSegment::open(path) : nullptr;
+    if (!data) {
+        std::cerr << "Error merging content segments into " << path << std::endl;
+        return false;
+    }
+    auto dead = std::make_shared<const Bitmap>((size_t(data->documentCount()) + 63) / 64);
+    merged = {generation, data, dead, 0};
+    return true;
+}
+
+std::vector<ContentIndex::Hit> ContentIndex::search(const std::string& query, size_t limit) const {
+    std::vector<Hit> hits;
+    std::shared_ptr<const State> current = state.load();
+    if (current->liveDocs == 0) return hits;
+
+    std::vector<std::string> terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    if (terms.empty()) return hits;
+
+    // Collection statistics include superseded documents, as is usual for
+    // segmented indexes; the difference vanishes at the next merge
+    uint64_t totalLength = 0;
+    uint64_t totalDocs = 0;
+    std::vector<uint64_t> docFreq(terms.size(), 0);
+    std::vector<std::vector<uint32_t>> termIndex(current->segments.size(), std::vector<uint32_t>(terms.size()));
+    for (size_t s = 0; s < current->segments.size(); ++s) {
+        const auto& data = *current->segments[s].data;
+        totalLength += data.totalLength();
+        totalDocs += data.documentCount();
+        for (size_t t = 0; t < terms.size(); ++t) {
+            termIndex[s][t] = data.findTerm(terms[t]);
+            if (termIndex[s][t] != ContentSegment::npos) docFreq[t] += data.docFreq(termIndex[s][t]);
+        }
+    }
+    double docs = static_cast<double>(current->liveDocs);
+    double averageLength = totalDocs ? std::max(1.0, double(totalLength) / double(totalDocs)) : 1.0;
+    std::vector<double> idf(terms.size());
+    for (size_t t = 0; t < terms.size(); ++t) {
+        double df = std::min(static_cast<double>(docFreq[t]), docs);
+        idf[t] = std::log(1.0 + (docs - df + 0.5) / (df + 0.5));
+    }
+
+    struct Candidate {
+        double score;
+        size_t segment;
+        uint32_t doc;
+        bool operator>(const Candidate& other) const { return score > other.score; }
+    };
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> best; // Worst on top
+
+    for (size_t s = 0; s < current->segments.size(); ++s) {
+        const Segment& segment = current->segments[s];
+        const auto& data = *segment.data;
+        const auto& index = termIndex[s];
+        if (std::any_of(index.begin(), index.end(), [](uint32_t t) { return t == ContentSegment::npos; })) continue;
+
+        // Every term is required: start from the rarest and intersect upwards
+        std::vector<size_t> order(terms.size());
+        for (size_t t = 0; t < order.size(); ++t) order[t] = t;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return data.docFreq(index[a]) < data.docFreq(index[b]);
+        });
+        auto weight = [&](size_t t, uint32_t doc, uint32_t frequency) {
+            double tf = frequency;
+            double norm = kK1 * (1.0 - kB + kB * data.documentLength(doc) / averageLength);
+            return idf[t] * tf * (kK1 + 1.0) / (tf + norm);
+        };
+
+        std::vector<std::pair<uint32_t, double>> matches;
+        data.forEachPosting(index[order[0]], [&](uint32_t doc, uint32_t frequency) {
+            if (!segment.isDead(doc)) matches.emplace_back(doc, weight(order[0], doc, frequency));
+        });
+        std::vector<std::pair<uint32_t, double>> narrowed;
+        for (size_t k = 1; k < order.size() && !matches.empty(); ++k) {
+            narrowed.clear();
+            size_t j = 0;
+            data.forEachPosting(index[order[k]], [&](uint32_t doc, uint32_t frequency) {
+                while (j < matches.size() && matches[j].first < doc) ++j;
+                if (j < matches.size() && matches[j].first == doc) {
+                    narrowed.emplace_back(doc, matches[j].second + weight(order[k], doc, frequency));
+                }
+            });
+            matches.swap(narrowed);
+        }
+
+        for (const auto& [doc, score] : matches) {
+            if (limit && best.size() == limit) {
+                if (score <= best.top().score) continue;
+                best.pop();
+            }
+            best.push({score, s, doc});
+        }
+    }
+
+    hits.resize(best.size());
+    for (size_t i = hits.size(); i-- > 0; best.pop()) {
+        const Candidate& c = best.top();
+        hits[i] = {std::string(current->segments[c.segment].data->document(c.doc).path), c.score};
+    }
+    return hits;
+}
+
+size_t ContentIndex::documentCount() const {
+    return state.load()->liveDocs;
+}
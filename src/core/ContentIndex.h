@@ -0,0 +1,100 @@
+#ifndef CONTENTINDEX_H
+#define CONTENTINDEX_H
+
+#include "ContentSegment.h"
+#include "AtomicSharedPtr.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// Persistent full-text index over extracted document text, kept in
+// .smartfile/content/ as immutable memory-mapped segments plus a manifest that
+// lists them with a bitmap of superseded documents each.
+//
+// Text is split into lowercased words, and runs of CJK characters into
+// overlapping bigrams, so 合約書 is found by 合約 and by 約書. A lone CJK
+// character between non-CJK text is kept as a unigram.
+//
+// update() indexes new and changed files (by size and mtime) into a fresh
+// segment and marks their old versions and vanished files as deleted; segments
+// are merged once there are too many, or too many of their documents are dead.
+// search() ranks the documents that contain every query term by BM25.
+// Searches run on a published snapshot and never wait for an update.
+class ContentIndex {
+public:
+    using Extractor = std::function<std::string(const std::string& path)>;
+    // Called after each extracted file; returning false cancels the update
+    using Progress = std::function<bool(size_t done, size_t total)>;
+
+    struct Hit {
+        std::string file; // Path relative to the root, '/'-separated
+        double score;
+    };
+
+    ContentIndex() = default;
+    ~ContentIndex();
+    ContentIndex(const ContentIndex&) = delete;
+    ContentIndex& operator=(const ContentIndex&) = delete;
+
+    // Maps the segments of root's index (empty if there is none yet); a running
+    // update is cancelled first
+    bool open(const std::string& root);
+    void cancel(); // Makes a running update stop after the current file
+
+    // paths are full paths as returned by FileScanner; returns the number of files indexed
+    size_t update(const std::vector<std::string>& paths, const Extractor& extract,
+                  const Progress& progress = {});
+
+    std::vector<Hit> search(const std::string& query, size_t limit = 50) const;
+    size_t documentCount() const; // Live documents
+
+    static std::vector<std::string> tokenize(std::string_view text);
+
+private:
+    static constexpr size_t kMaxIndexedBytes = 512 * 1024;     // Per document
+    static constexpr size_t kFlushBytes = 64u << 20;           // Encoded postings per new segment
+    static constexpr size_t kMaxSegments = 8;
+    static constexpr size_t kMergeFactor = 4;
+
+    using Bitmap = std::vector<uint64_t>;
+    struct Segment {
+        uint64_t generation;
+        std::shared_ptr<const ContentSegment> data;
+        std::shared_ptr<const Bitmap> dead; // Superseded documents
+        uint32_t deadCount = 0;
+
+        bool isDead(uint32_t doc) const { return ((*dead)[doc >> 6] >> (doc & 63)) & 1; }
+    };
+    struct State {
+        std::vector<Segment> segments; // Oldest first
+        size_t liveDocs = 0;
+    };
+
+    std::string keyOf(const std::string& path) const;
+    std::string segmentPath(uint64_t generation) const;
+    std::string manifestPath() const;
+    bool writeManifest(const State& state) const;
+    // Writes builder as a new segment, marks older versions of keys (the
+    // builder's documents) and of removed as dead, merges if needed and
+    // publishes the result
+    void commit(ContentSegment::Builder& builder, const std::vector<std::string>& keys,
+                const std::vector<std::string>& removed);
+    void merge(State& state);
+    // False if the merged segment could not be written; merged.data stays null
+    // when none of the inputs' documents are live
+    bool mergeSegments(const std::vector<Segment>& inputs, Segment& merged);
+
+    std::string rootDir;
+    std::string indexDir;
+    std::mutex writeMutex; // Held by open and update
+    std::atomic<bool> cancelled{false};
+    uint64_t nextGeneration = 1;
+    AtomicSharedPtr<const State> state{std::make_shared<const State>()};
+};
+
+#endif // CONTENTINDEX_H
@@ -0,0 +1,216 @@
+#include "ContentSegment.h"
+#include "TagJournal.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'F', 'C', 'O', 'N', 'T', 'X', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t docCount;
+    uint32_t termCount;
+    uint64_t totalLength;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t docsOffset;
+    uint64_t docOrderOffset;
+    uint64_t termsOffset;
+    uint64_t postingsOffset;
+    uint64_t postingsSize;
+    uint64_t totalSize;
+};
+
+void align8(std::string& out) {
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+template <typename T>
+uint64_t appendArray(std::string& out, const std::vector<T>& values) {
+    align8(out);
+    uint64_t offset = out.size();
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    return offset;
+}
+
+} // namespace
+
+uint32_t ContentSegment::Builder::addDocument(const std::string& path, uint32_t length, uint64_t size, int64_t mtime) {
+    documents.push_back({path, length, size, mtime});
+    return static_cast<uint32_t>(documents.size() - 1);
+}
+
+void ContentSegment::Builder::addPosting(std::string_view term, uint32_t doc, uint32_t frequency) {
+    auto it = postings.find(term);
+    if (it == postings.end()) it = postings.emplace(std::string(term), PostingList()).first;
+    PostingList& list = it->second;
+    char pair[10];
+    size_t size = encodeVarint(pair, doc - list.lastDoc);
+    size += encodeVarint(pair + size, frequency);
+    list.encoded.append(pair, size);
+    list.lastDoc = doc;
+    ++list.docFreq;
+    bytes += size;
+}
+
+bool ContentSegment::Builder::write(const std::string& path) const {
+    std::string strings;
+    auto intern = [&strings](std::string_view s) {
+        NameRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+        strings.append(s);
+        return ref;
+    };
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.byteOrder = kByteOrderMark;
+    h.docCount = static_cast<uint32_t>(documents.size());
+    h.termCount = static_cast<uint32_t>(postings.size());
+
+    std::vector<DocRef> docRefs;
+    docRefs.reserve(documents.size());
+    for (const auto& d : documents) {
+        docRefs.push_back({intern(d.path), d.length, 0, d.size, d.mtime});
+        h.totalLength += d.length;
+    }
+    std::vector<uint32_t> order(documents.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return documents[a].path < documents[b].path;
+    });
+
+    std::vector<const std::pair<const std::string, PostingList>*> sorted;
+    sorted.reserve(postings.size());
+    for (const auto& entry : postings) sorted.push_back(&entry);
+    std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    std::vector<TermRef> termRefs;
+    termRefs.reserve(sorted.size());
+    uint64_t postingsSize = 0;
+    for (const auto* entry : sorted) {
+        termRefs.push_back({intern(entry->first), entry->second.docFreq,
+                            static_cast<uint32_t>(entry->second.encoded.size()), postingsSize});
+        postingsSize += entry->second.encoded.size();
+    }
+
+    std::string out(sizeof(Header), '\0');
+    align8(out);
+    h.stringsOffset = out.size();
+    h.stringsSize = strings.size();
+    out += strings;
+    h.docsOffset = appendArray(out, docRefs);
+    h.docOrderOffset = appendArray(out, order);
+    h.termsOffset = appendArray(out, termRefs);
+    align8(out);
+    h.postingsOffset = out.size();
+    h.postingsSize = postingsSize;
+    out.reserve(out.size() + postingsSize);
+    for (const auto* entry : sorted) out += entry->second.encoded;
+    align8(out);
+    h.totalSize = out.size();
+    std::memcpy(out.data(), &h, sizeof(Header));
+    return TagJournal::replaceFile(path, out);
+}
+
+std::shared_ptr<const ContentSegment> ContentSegment::open(const std::string& path) {
+    std::shared_ptr<ContentSegment> segment(new ContentSegment());
+    if (!segment->file.open(path)) return nullptr;
+
+    const char* data = segment->file.data();
+    size_t size = segment->file.size();
+    Header h{};
+    if (size < sizeof(Header)) return nullptr;
+    std::memcpy(&h, data, sizeof(Header));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion
+        || h.byteOrder != kByteOrderMark || h.totalSize != size) {
+        std::cerr << "Ignoring incompatible content segment " << path << std::endl;
+        return nullptr;
+    }
+
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t width) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / width;
+    };
+    if (!fits(h.stringsOffset, h.stringsSize, 1) || !fits(h.docsOffset, h.docCount, sizeof(DocRef))
+        || !fits(h.docOrderOffset, h.docCount, 4) || !fits(h.termsOffset, h.termCount, sizeof(TermRef))
+        || !fits(h.postingsOffset, h.postingsSize, 1)) {
+        std::cerr << "Corrupt content segment " << path << std::endl;
+        return nullptr;
+    }
+
+    segment->nDocs = h.docCount;
+    segment->nTerms = h.termCount;
+    segment->sumLength = h.totalLength;
+    segment->strings = data + h.stringsOffset;
+    segment->docs = reinterpret_cast<const DocRef*>(data + h.docsOffset);
+    segment->docOrder = reinterpret_cast<const uint32_t*>(data + h.docOrderOffset);
+    segment->terms = reinterpret_cast<const TermRef*>(data + h.termsOffset);
+    segment->postings = data + h.postingsOffset;
+
+    // Every reference must stay inside its section before it is followed
+    auto validName = [&h](const NameRef& ref) { return uint64_t(ref.offset) + ref.length <= h.stringsSize; };
+    for (uint32_t i = 0; i < h.docCount; ++i) {
+        if (!validName(segment->docs[i].path) || segment->docOrder[i] >= h.docCount) {
+            std::cerr << "Corrupt content segment " << path << std::endl;
+            return nullptr;
+        }
+    }
+    for (uint32_t i = 0; i < h.termCount; ++i) {
+        const TermRef& t = segment->terms[i];
+        if (!validName(t.name) || t.offset > h.postingsSize || t.bytes > h.postingsSize - t.offset
+            || !segment->validPostings(t)) {
+            std::cerr << "Corrupt content segment " << path << std::endl;
+            return nullptr;
+        }
+    }
+    return segment;
+}
+
+// forEachPosting hands out document ids unchecked, so every list is decoded
+// once here: ids must ascend, stay below the document count and number docFreq
+bool ContentSegment::validPostings(const TermRef& t) const {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(postings + t.offset);
+    const unsigned char* end = p + t.bytes;
+    // A varint whose last byte still has the continuation bit was cut off
+    auto complete = [&p]() { return !(p[-1] & 0x80); };
+    uint64_t doc = 0;
+    uint32_t count = 0;
+    while (p < end) {
+        uint32_t delta = readVarint(p, end);
+        if (!complete() || (count > 0 && delta == 0)) return false;
+        doc += delta;
+        if (doc >= nDocs || p == end) return false;
+        readVarint(p, end);
+        if (!complete()) return false;
+        ++count;
+    }
+    return count == t.docFreq;
+}
+
+ContentSegment::Document ContentSegment::document(uint32_t doc) const {
+    const DocRef& d = docs[doc];
+    return {name(d.path), d.length, d.size, d.mtime};
+}
+
+uint32_t ContentSegment::findDocument(std::string_view path) const {
+    const uint32_t* end = docOrder + nDocs;
+    const uint32_t* it = std::lower_bound(docOrder, end, path, [this](uint32_t doc, std::string_view key) {
+        return name(docs[doc].path) < key;
+    });
+    return (it != end && name(docs[*it].path) == path) ? *it : npos;
+}
+
+uint32_t ContentSegment::findTerm(std::string_view key) const {
+    const TermRef* end = terms + nTerms;
+    const TermRef* it = std::lower_bound(terms, end, key, [this](const TermRef& t, std::string_view k) {
+        return name(t.name) < k;
+    });
+    return (it != end && name(it->name) == key) ? static_cast<uint32_t>(it - terms) : npos;
+}
@@ -0,0 +1,150 @@
+#ifndef CONTENTSEGMENT_H
+#define CONTENTSEGMENT_H
+
+#include "MappedFile.h"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Immutable, memory-mapped piece of the content index. Layout (sections 8-byte
+// aligned, native little-endian):
+//   Header
+//   string table   document paths and terms, back to back
+//   documents      DocRef[docCount]   path, token count, size and mtime when indexed
+//   document order u32[docCount]      document ids sorted by path
+//   terms          TermRef[termCount] sorted by term bytes
+//   postings       per term, (document id delta, term frequency) varint pairs,
+//                  document ids ascending
+class ContentSegment {
+public:
+    struct Document {
+        std::string_view path;
+        uint32_t length; // Tokens
+        uint64_t size;
+        int64_t mtime;
+    };
+
+    // Collects documents and postings in memory, then writes a segment
+    class Builder {
+    public:
+        // Ids are handed out in call order from 0
+        uint32_t addDocument(const std::string& path, uint32_t length, uint64_t size, int64_t mtime);
+        // Documents must arrive in ascending order for each term
+        void addPosting(std::string_view term, uint32_t doc, uint32_t frequency);
+        size_t documentCount() const { return documents.size(); }
+        size_t postingBytes() const { return bytes; }
+        bool write(const std::string& path) const;
+
+    private:
+        struct DocumentEntry {
+            std::string path;
+            uint32_t length;
+            uint64_t size;
+            int64_t mtime;
+        };
+        struct PostingList {
+            std::string encoded;
+            uint32_t lastDoc = 0;
+            uint32_t docFreq = 0;
+        };
+        // Transparent, so postings can be looked up without copying the term
+        struct TermHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view term) const { return std::hash<std::string_view>()(term); }
+        };
+        std::vector<DocumentEntry> documents;
+        std::unordered_map<std::string, PostingList, TermHash, std::equal_to<>> postings;
+        size_t bytes = 0;
+    };
+
+    // nullptr if the file is missing or malformed
+    static std::shared_ptr<const ContentSegment> open(const std::string& path);
+
+    uint32_t documentCount() const { return nDocs; }
+    uint32_t termCount() const { return nTerms; }
+    uint64_t totalLength() const { return sumLength; } // Tokens over all documents
+    size_t byteSize() const { return file.size(); }
+
+    Document document(uint32_t doc) const;
+    uint32_t documentLength(uint32_t doc) const { return docs[doc].length; }
+    uint32_t findDocument(std::string_view path) const; // npos if absent
+
+    std::string_view term(uint32_t index) const { return name(terms[index].name); }
+    uint32_t findTerm(std::string_view term) const; // Index into the sorted terms, npos if absent
+    uint32_t docFreq(uint32_t index) const { return terms[index].docFreq; }
+
+    // Calls fn(doc, frequency) for every posting of the term, ascending
+    template <typename Fn>
+    void forEachPosting(uint32_t index, Fn&& fn) const {
+        const TermRef& t = terms[index];
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(postings + t.offset);
+        const unsigned char* end = p + t.bytes;
+        uint32_t doc = 0;
+        while (p < end) {
+            doc += readVarint(p, end);
+            uint32_t frequency = readVarint(p, end);
+            fn(doc, frequency);
+        }
+    }
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // Writes at most 5 bytes to out; returns how many
+    static size_t encodeVarint(char* out, uint32_t value) {
+        size_t n = 0;
+        while (value >= 0x80) {
+            out[n++] = static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out[n++] = static_cast<char>(value);
+        return n;
+    }
+
+private:
+    struct NameRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+    struct DocRef {
+        NameRef path;
+        uint32_t length;
+        uint32_t reserved;
+        uint64_t size;
+        int64_t mtime;
+    };
+    struct TermRef {
+        NameRef name;
+        uint32_t docFreq;
+        uint32_t bytes;
+        uint64_t offset; // Into the postings section
+    };
+
+    static uint32_t readVarint(const unsigned char*& p, const unsigned char* end) {
+        uint32_t value = 0;
+        for (int shift = 0; p < end && shift < 35; shift += 7) {
+            unsigned char byte = *p++;
+            value |= uint32_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        return value;
+    }
+
+    ContentSegment() = default;
+    bool validPostings(const TermRef& t) const;
+    std::string_view name(const NameRef& ref) const { return {strings + ref.offset, ref.length}; }
+
+    MappedFile file;
+    uint32_t nDocs = 0;
+    uint32_t nTerms = 0;
+    uint64_t sumLength = 0;
+    const char* strings = nullptr;
+    const DocRef* docs = nullptr;
+    const uint32_t* docOrder = nullptr;
+    const TermRef* terms = nullptr;
+    const char* postings = nullptr;
+};
+
+#endif // CONTENTSEGMENT_H
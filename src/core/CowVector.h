@@ -0,0 +1,123 @@
+#ifndef COWVECTOR_H
+#define COWVECTOR_H
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
+
+// True if p is the only owner of its object, which may then be written in
+// place. use_count() is a relaxed load: the fence orders the writes after the
+// reads of a snapshot on another thread that has just let go of it.
+template <typename T>
+bool soleOwner(const std::shared_ptr<T>& p) {
+    if (p.use_count() != 1) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+// Vector stored in fixed-size chunks that copies share. Copying costs one
+// pointer per chunk; writing through a copy duplicates only the chunk being
+// written. Chunks that were never written stay unallocated and read as T{}.
+// A const CowVector may be read from any number of threads.
+template <typename T, size_t ChunkBits = 10>
+class CowVector {
+public:
+    static constexpr size_t kChunkSize = size_t(1) << ChunkBits;
+
+    size_t size() const { return count; }
+
+    const T& operator[](size_t i) const {
+        const auto& chunk = chunks[i >> ChunkBits];
+        return chunk ? (*chunk)[i & kMask] : empty();
+    }
+
+    T& mutableAt(size_t i) {
+        auto& chunk = chunks[i >> ChunkBits];
+        if (!chunk) {
+            chunk = std::make_shared<Chunk>();
+        } else if (!soleOwner(chunk)) {
+            // Shared with a snapshot. A count that drops concurrently only costs a spare copy.
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        return (*chunk)[i & kMask];
+    }
+
+    void resize(size_t n) {
+        count = n;
+        chunks.resize((n + kChunkSize - 1) >> ChunkBits);
+    }
+
+    void push_back(T value) {
+        resize(count + 1);
+        mutableAt(count - 1) = std::move(value);
+    }
+
+    // Visits (index, value) for every element in an allocated chunk
+    template <typename Fn>
+    void forEachStored(Fn&& fn) const {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            if (!chunks[c]) continue;
+            size_t end = std::min(count, (c + 1) * kChunkSize);
+            for (size_t i = c * kChunkSize; i < end; ++i) {
+                fn(i, (*chunks[c])[i & kMask]);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kMask = kChunkSize - 1;
+    using Chunk = std::array<T, kChunkSize>;
+
+    static const T& empty() {
+        static const T value{};
+        return value;
+    }
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    size_t count = 0;
+};
+
+// String-keyed hash map split into shards that copies share the same way
+template <typename V, size_t Shards = 256>
+class CowStringMap {
+public:
+    const V* find(const std::string& key) const {
+        const auto& shard = shards[shardOf(key)];
+        if (!shard) return nullptr;
+        auto it = shard->find(key);
+        return it == shard->end() ? nullptr : &it->second;
+    }
+
+    void set(const std::string& key, V value) {
+        mutableShard(key)[key] = std::move(value);
+    }
+
+    void erase(const std::string& key) {
+        if (!find(key)) return;
+        mutableShard(key).erase(key);
+    }
+
+private:
+    using Map = std::unordered_map<std::string, V>;
+
+    static size_t shardOf(const std::string& key) { return std::hash<std::string>{}(key) % Shards; }
+
+    Map& mutableShard(const std::string& key) {
+        auto& shard = shards[shardOf(key)];
+        if (!shard) {
+            shard = std::make_shared<Map>();
+        } else if (!soleOwner(shard)) {
+            shard = std::make_shared<Map>(*shard);
+        }
+        return *shard;
+    }
+
+    std::array<std::shared_ptr<Map>, Shards> shards;
+};
+
+#endif // COWVECTOR_H
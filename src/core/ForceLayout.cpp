@@ -0,0 +1,269 @@
+#include "ForceLayout.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+constexpr double kRepulsion = 75.0;  // Force is kRepulsion / distance, away from the other node
+constexpr double kEdgeWeight = 10.0;
+constexpr double kMinMove = 0.1;     // Smaller steps are not taken, so the layout comes to rest
+constexpr double kMargin = 10.0;
+constexpr double kFriction = 0.6;    // Share of its velocity a node keeps into the next step
+// The temperature falls to kMinTemperature in about 300 steps
+constexpr double kCooling = 0.0175;
+constexpr double kMinTemperature = 0.005;
+// Closer nodes repel as if this far apart, in a direction fixed per pair, so
+// nodes on the same spot separate instead of pushing nothing
+constexpr double kMinDistance = 1.0;
+
+// Unit direction a is pushed away from b in when they (nearly) coincide:
+// opposite to b's, and the same every step, so the pair drifts apart steadily
+void separation(uint32_t a, uint32_t b, double& dx, double& dy) {
+    uint64_t pair = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+    uint64_t hash = pair * 0x9E3779B97F4A7C15ull;
+    double angle = (hash >> 11) * (2 * std::numbers::pi / 9007199254740992.0); // 53 bits to [0, 2pi)
+    double sign = a < b ? 1.0 : -1.0;
+    dx = sign * std::cos(angle);
+    dy = sign * std::sin(angle);
+}
+
+} // namespace
+
+void ForceLayout::reset(size_t nodes, const EdgeList& edges) {
+    xs.assign(nodes, 0.0);
+    ys.assign(nodes, 0.0);
+    vxs.assign(nodes, 0.0);
+    vys.assign(nodes, 0.0);
+    alpha = 1.0;
+    fxs.assign(nodes, 0.0);
+    fys.assign(nodes, 0.0);
+    edgeFrom.clear();
+    edgeTo.clear();
+    edgeFrom.reserve(edges.size());
+    edgeTo.reserve(edges.size());
+    std::vector<uint32_t> degree(nodes, 0);
+    for (const auto& [from, to] : edges) {
+        if (from >= nodes || to >= nodes) continue;
+        edgeFrom.push_back(from);
+        edgeTo.push_back(to);
+        ++degree[from];
+        ++degree[to];
+    }
+    weight.resize(nodes);
+    for (size_t i = 0; i < nodes; ++i) {
+        weight[i] = (degree[i] + 1) * kEdgeWeight;
+    }
+    next.assign(nodes, kEmpty);
+}
+
+void ForceLayout::setPosition(uint32_t node, double x, double y) {
+    xs[node] = x;
+    ys[node] = y;
+    vxs[node] = 0;
+    vys[node] = 0;
+}
+
+void ForceLayout::reheat(double temperature) {
+    alpha = std::max(alpha, temperature);
+}
+
+void ForceLayout::setBounds(double l, double t, double r, double b) {
+    left = l;
+    top = t;
+    right = r;
+    bottom = b;
+}
+
+void ForceLayout::insert(uint32_t body) {
+    const double x = xs[body];
+    const double y = ys[body];
+    int32_t c = 0;
+    for (int depth = 0;; ++depth) {
+        if (cells[c].body == kEmpty) {
+            cells[c].body = static_cast<int32_t>(body);
+            next[body] = kEmpty;
+            return;
+        }
+        if (cells[c].body != kInternal) {
+            if (depth >= kMaxDepth) {
+                // As good as the same spot: the leaf keeps them all
+                next[body] = cells[c].body;
+                cells[c].body = static_cast<int32_t>(body);
+                return;
+            }
+            // Split the leaf and send its body one level down
+            int32_t resident = cells[c].body;
+            cells[c].body = kInternal;
+            const Cell parent = cells[c];
+            int q = (xs[resident] >= parent.cx ? 1 : 0) | (ys[resident] >= parent.cy ? 2 : 0);
+            Cell child;
+            child.half = parent.half / 2;
+            child.cx = parent.cx + ((q & 1) ? child.half : -child.half);
+            child.cy = parent.cy + ((q & 2) ? child.half : -child.half);
+            child.body = resident;
+            cells[c].child[q] = static_cast<int32_t>(cells.size());
+            cells.push_back(child);
+        }
+        const Cell parent = cells[c];
+        int q = (x >= parent.cx ? 1 : 0) | (y >= parent.cy ? 2 : 0);
+        if (parent.child[q] < 0) {
+            Cell child;
+            child.half = parent.half / 2;
+            child.cx = parent.cx + ((q & 1) ? child.half : -child.half);
+            child.cy = parent.cy + ((q & 2) ? child.half : -child.half);
+            cells[c].child[q] = static_cast<int32_t>(cells.size());
+            cells.push_back(child);
+        }
+        c = cells[c].child[q];
+    }
+}
+
+void ForceLayout::buildTree() {
+    cells.clear();
+    double minX = xs[0], maxX = xs[0], minY = ys[0], maxY = ys[0];
+    for (size_t i = 1; i < xs.size(); ++i) {
+        minX = std::min(minX, xs[i]);
+        maxX = std::max(maxX, xs[i]);
+        minY = std::min(minY, ys[i]);
+        maxY = std::max(maxY, ys[i]);
+    }
+    Cell root;
+    root.cx = (minX + maxX) / 2;
+    root.cy = (minY + maxY) / 2;
+    root.half = std::max({maxX - minX, maxY - minY, 1.0}) / 2;
+    cells.push_back(root);
+    for (uint32_t i = 0; i < xs.size(); ++i) {
+        insert(i);
+    }
+
+    // Children come after their parents, so one backward pass sums the masses
+    for (size_t c = cells.size(); c-- > 0;) {
+        Cell& cell = cells[c];
+        double mass = 0, mx = 0, my = 0;
+        if (cell.body == kInternal) {
+            for (int32_t child : cell.child) {
+                if (child < 0) continue;
+                mass += cells[child].mass;
+                mx += cells[child].mx * cells[child].mass;
+                my += cells[child].my * cells[child].mass;
+            }
+        } else {
+            for (int32_t b = cell.body; b != kEmpty; b = next[b]) {
+                mass += 1;
+                mx += xs[b];
+                my += ys[b];
+            }
+        }
+        cell.mass = mass;
+        cell.mx = mass > 0 ? mx / mass : cell.cx;
+        cell.my = mass > 0 ? my / mass : cell.cy;
+    }
+
+    // Bodies in the order their leaves are visited: what is near in space is
+    // near in the loop, so one body's traversal finds the cells the previous
+    // one loaded still in cache
+    order.clear();
+    std::vector<int32_t> pending{0};
+    while (!pending.empty()) {
+        const Cell& cell = cells[pending.back()];
+        pending.pop_back();
+        if (cell.body == kInternal) {
+            for (int32_t child : cell.child) {
+                if (child >= 0) pending.push_back(child);
+            }
+        } else {
+            for (int32_t b = cell.body; b != kEmpty; b = next[b]) order.push_back(static_cast<uint32_t>(b));
+        }
+    }
+}
+
+void ForceLayout::repulsion(uint32_t body, double& fx, double& fy, int32_t* pending) const {
+    const double x = xs[body];
+    const double y = ys[body];
+    const double theta2 = theta * theta;
+    size_t depth = 0;
+    pending[depth++] = 0;
+    while (depth > 0) {
+        const Cell& cell = cells[pending[--depth]];
+        if (cell.mass == 0) continue;
+        if (cell.body != kInternal) {
+            for (int32_t b = cell.body; b != kEmpty; b = next[b]) {
+                if (static_cast<uint32_t>(b) == body) continue;
+                double dx = x - xs[b];
+                double dy = y - ys[b];
+                double d2 = dx * dx + dy * dy;
+                if (d2 < kMinDistance * kMinDistance) {
+                    separation(body, static_cast<uint32_t>(b), dx, dy);
+                    dx *= kMinDistance;
+                    dy *= kMinDistance;
+                    d2 = kMinDistance * kMinDistance;
+                }
+                double f = kRepulsion / d2;
+                fx += dx * f;
+                fy += dy * f;
+            }
+            continue;
+        }
+        double dx = x - cell.mx;
+        double dy = y - cell.my;
+        double d2 = dx * dx + dy * dy;
+        double width = 2 * cell.half;
+        if (width * width < theta2 * d2) {
+            double f = kRepulsion * cell.mass / d2;
+            fx += dx * f;
+            fy += dy * f;
+            continue;
+        }
+        for (int32_t child : cell.child) {
+            if (child >= 0) pending[depth++] = child;
+        }
+    }
+}
+
+bool ForceLayout::step(uint32_t held) {
+    const size_t n = xs.size();
+    if (n == 0) return false;
+
+    buildTree();
+    std::fill(fxs.begin(), fxs.end(), 0.0);
+    std::fill(fys.begin(), fys.end(), 0.0);
+    int32_t pending[kStackDepth];
+    for (uint32_t i : order) {
+        repulsion(i, fxs[i], fys[i], pending);
+    }
+
+    for (size_t e = 0; e < edgeFrom.size(); ++e) {
+        uint32_t a = edgeFrom[e];
+        uint32_t b = edgeTo[e];
+        double dx = xs[a] - xs[b];
+        double dy = ys[a] - ys[b];
+        fxs[a] -= dx / weight[a];
+        fys[a] -= dy / weight[a];
+        fxs[b] += dx / weight[b];
+        fys[b] += dy / weight[b];
+    }
+
+    bool moved = false;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (i == held) {
+            vxs[i] = vys[i] = 0;
+            continue;
+        }
+        double vx = (vxs[i] + fxs[i] * alpha) * kFriction;
+        double vy = (vys[i] + fys[i] * alpha) * kFriction;
+        if (std::abs(vx) < kMinMove && std::abs(vy) < kMinMove) vx = vy = 0;
+        double nx = std::clamp(xs[i] + vx, left + kMargin, right - kMargin);
+        double ny = std::clamp(ys[i] + vy, top + kMargin, bottom - kMargin);
+        // Against a wall the velocity is what the wall lets through
+        vxs[i] = nx - xs[i];
+        vys[i] = ny - ys[i];
+        if (nx != xs[i] || ny != ys[i]) {
+            xs[i] = nx;
+            ys[i] = ny;
+            moved = true;
+        }
+    }
+    alpha -= alpha * kCooling;
+    return moved && alpha >= kMinTemperature;
+}
@@ -0,0 +1,77 @@
+#ifndef FORCELAYOUT_H
+#define FORCELAYOUT_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Force-directed placement for the files-and-tags graph: every node pushes
+// every other one away, and each edge pulls its two ends together. Positions
+// and velocities live in flat arrays and the edges in a list made once, so a
+// step touches no graphics items. Repulsion is computed Barnes-Hut style: a
+// quadtree of the nodes is built each step, and a cell far enough away acts
+// as one body at its centre of mass, which makes a step O(N log N) instead of
+// O(N^2). Forces are scaled by a temperature that cools with every step, so
+// the layout settles instead of oscillating; reheat it when the graph is
+// disturbed.
+class ForceLayout {
+public:
+    static constexpr uint32_t npos = ~uint32_t(0);
+    static constexpr double kDefaultTheta = 0.9;
+
+    using EdgeList = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    // Every node starts at rest at the origin, at full temperature; edges are
+    // pairs of node indices
+    void reset(size_t nodes, const EdgeList& edges);
+    size_t size() const { return xs.size(); }
+
+    void setPosition(uint32_t node, double x, double y); // Also stops the node
+    double x(uint32_t node) const { return xs[node]; }
+    double y(uint32_t node) const { return ys[node]; }
+
+    // Nodes are kept 10 units inside these
+    void setBounds(double left, double top, double right, double bottom);
+    // Cells narrower than theta times their distance count as one body; 0 is exact
+    void setTheta(double value) { theta = value; }
+
+    // Moves every node but held one step along its velocity. Returns false
+    // once the layout has settled: nothing moved, or it has cooled down.
+    bool step(uint32_t held = npos);
+    double temperature() const { return alpha; }
+    void reheat(double temperature); // Never cools the layout down
+    void setTemperature(double temperature) { alpha = temperature; } // 0 holds every node still
+
+private:
+    static constexpr int32_t kEmpty = -1;
+    static constexpr int32_t kInternal = -2;
+    static constexpr int kMaxDepth = 40; // Deeper cells hold all their bodies
+    // Cells waiting in a traversal: at most three siblings per level, plus four
+    static constexpr int kStackDepth = 3 * kMaxDepth + 4;
+
+    struct Cell {
+        double cx, cy, half; // Square around (cx, cy)
+        double mass = 0, mx = 0, my = 0; // Body count and centre of mass
+        int32_t body = kEmpty; // First body of a leaf, chained through next
+        int32_t child[4] = {-1, -1, -1, -1};
+    };
+
+    void buildTree();
+    void insert(uint32_t body);
+    void repulsion(uint32_t body, double& fx, double& fy, int32_t* pending) const;
+
+    std::vector<double> xs, ys;
+    std::vector<double> vxs, vys;
+    std::vector<double> fxs, fys;
+    std::vector<uint32_t> edgeFrom, edgeTo;
+    std::vector<double> weight; // (degree + 1) * 10; heavier nodes follow their edges less
+    std::vector<Cell> cells;
+    std::vector<int32_t> next; // Next body in the same leaf
+    std::vector<uint32_t> order; // Bodies leaf by leaf
+    double left = -400, top = -400, right = 400, bottom = 400;
+    double theta = kDefaultTheta;
+    double alpha = 1.0;
+};
+
+#endif // FORCELAYOUT_H
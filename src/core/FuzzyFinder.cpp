@@ -0,0 +1,270 @@
+#include "FuzzyFinder.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FUZZY_SSE2 1
+#endif
+
+namespace {
+
+// fzf's scoring constants
+constexpr int kScoreMatch = 16;
+constexpr int kScoreGapStart = -3;
+constexpr int kScoreGapExtension = -1;
+constexpr int kBonusBoundary = kScoreMatch / 2;
+constexpr int kBonusNonWord = kScoreMatch / 2;
+constexpr int kBonusCamel123 = kBonusBoundary + kScoreGapExtension;
+constexpr int kBonusConsecutive = -(kScoreGapStart + kScoreGapExtension);
+constexpr int kBonusFirstCharMultiplier = 2;
+constexpr int kBonusBoundaryWhite = kBonusBoundary + 2;
+constexpr int kBonusBoundaryDelimiter = kBonusBoundary + 1; // After a path separator
+
+enum CharClass { White, NonWord, Delimiter, Lower, Upper, Letter, Number };
+
+CharClass classOf(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return Lower;
+    if (c >= 'A' && c <= 'Z') return Upper;
+    if (c >= '0' && c <= '9') return Number;
+    if (c >= 0x80) return Letter; // Part of a multi-byte character
+    if (c == ' ' || c == '\t') return White;
+    if (c == '/' || c == '\\' || c == ',' || c == ':' || c == ';' || c == '|') return Delimiter;
+    return NonWord;
+}
+
+int bonusFor(CharClass previous, CharClass current) {
+    if (current > NonWord) {
+        if (previous == White) return kBonusBoundaryWhite;
+        if (previous == Delimiter) return kBonusBoundaryDelimiter;
+        if (previous == NonWord) return kBonusBoundary;
+    }
+    if ((previous == Lower && current == Upper) || (previous != Number && current == Number)) return kBonusCamel123;
+    if (current == NonWord || current == Delimiter) return kBonusNonWord;
+    if (current == White) return kBonusBoundaryWhite;
+    return 0;
+}
+
+unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+} // namespace
+
+uint64_t FuzzyFinder::charBit(unsigned char c) {
+    c = fold(c);
+    if (c >= 'a' && c <= 'z') return uint64_t(1) << (c - 'a');
+    if (c >= '0' && c <= '9') return uint64_t(1) << (26 + c - '0');
+    if (c >= 0x80) return uint64_t(1) << 63;
+    return uint64_t(1) << (36 + c % 27); // Other ASCII shares the remaining bits
+}
+
+uint64_t FuzzyFinder::maskOf(std::string_view text) {
+    uint64_t mask = 0;
+    for (unsigned char c : text) mask |= charBit(c);
+    return mask;
+}
+
+void FuzzyFinder::reset(const std::vector<std::string>& items) {
+    auto next = std::make_shared<Corpus>();
+    size_t total = 0;
+    for (const auto& item : items) total += item.size();
+    next->text.reserve(total);
+    next->offsets.reserve(items.size() + 1);
+    next->offsets.push_back(0);
+    next->masks.reserve(items.size());
+    for (const auto& item : items) {
+        next->text += item;
+        next->offsets.push_back(static_cast<uint32_t>(next->text.size()));
+        next->masks.push_back(maskOf(item));
+    }
+    corpus.store(std::move(next));
+}
+
+int FuzzyFinder::score(std::string_view text, std::string_view term) {
+    size_t m = term.size();
+    if (m == 0 || m > text.size()) return m == 0 ? 0 : -1;
+
+    // Forward: the first place the whole term occurs as a subsequence
+    size_t t = 0;
+    size_t start = std::string_view::npos;
+    size_t end = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (fold(static_cast<unsigned char>(text[i])) != static_cast<unsigned char>(term[t])) continue;
+        if (start == std::string_view::npos) start = i;
+        if (++t == m) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (t < m) return -1;
+
+    // Backward from there: the latest start, which gives the shortest window
+    t = m - 1;
+    for (size_t i = end; i-- > start;) {
+        if (fold(static_cast<unsigned char>(text[i])) != static_cast<unsigned char>(term[t])) continue;
+        if (t == 0) {
+            start = i;
+            break;
+        }
+        --t;
+    }
+
+    int total = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    t = 0;
+    CharClass previous = start > 0 ? classOf(static_cast<unsigned char>(text[start - 1])) : White;
+    for (size_t i = start; i < end; ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        CharClass current = classOf(c);
+        if (t < m && fold(c) == static_cast<unsigned char>(term[t])) {
+            total += kScoreMatch;
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // A run keeps the bonus of the boundary it started at
+                if (bonus >= kBonusBoundary && bonus > firstBonus) firstBonus = bonus;
+                bonus = std::max({bonus, firstBonus, kBonusConsecutive});
+            }
+            total += t == 0 ? bonus * kBonusFirstCharMultiplier : bonus;
+            inGap = false;
+            ++consecutive;
+            ++t;
+        } else {
+            total += inGap ? kScoreGapExtension : kScoreGapStart;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+    return std::max(total, 0);
+}
+
+std::vector<FuzzyFinder::Match> FuzzyFinder::search(const std::string& query, size_t limit,
+                                                    const std::atomic<bool>& cancelled,
+                                                    const Progress& progress,
+                                                    std::chrono::milliseconds interval) const {
+    std::shared_ptr<const Corpus> data = corpus.load();
+    const size_t count = data->masks.size();
+
+    std::vector<std::string> terms;
+    uint64_t required = 0;
+    for (size_t i = 0; i < query.size();) {
+        while (i < query.size() && (query[i] == ' ' || query[i] == '\t')) ++i;
+        size_t j = i;
+        while (j < query.size() && query[j] != ' ' && query[j] != '\t') ++j;
+        if (j > i) {
+            std::string term;
+            for (size_t k = i; k < j; ++k) term.push_back(static_cast<char>(fold(static_cast<unsigned char>(query[k]))));
+            required |= maskOf(term);
+            terms.push_back(std::move(term));
+        }
+        i = j;
+    }
+    if (terms.empty() || limit == 0) {
+        if (progress && !cancelled) progress({}, true);
+        return {};
+    }
+
+    auto length = [&data](uint32_t item) { return data->offsets[item + 1] - data->offsets[item]; };
+    auto better = [&length](const Match& a, const Match& b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (length(a.item) != length(b.item)) return length(a.item) < length(b.item);
+        return a.item < b.item;
+    };
+
+    // The best matches found so far, as a heap with the worst on top
+    std::mutex bestMutex;
+    std::vector<Match> best;
+    auto offer = [&](std::vector<Match>& found) {
+        if (found.size() > limit) {
+            std::nth_element(found.begin(), found.begin() + static_cast<std::ptrdiff_t>(limit), found.end(), better);
+            found.resize(limit);
+        }
+        std::lock_guard<std::mutex> lock(bestMutex);
+        for (const Match& match : found) {
+            if (best.size() < limit) {
+                best.push_back(match);
+                std::push_heap(best.begin(), best.end(), better);
+            } else if (better(match, best.front())) {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.back() = match;
+                std::push_heap(best.begin(), best.end(), better);
+            }
+        }
+    };
+    auto ranked = [&]() {
+        std::lock_guard<std::mutex> lock(bestMutex);
+        std::vector<Match> sorted = best;
+        std::sort(sorted.begin(), sorted.end(), better);
+        return sorted;
+    };
+
+    const size_t chunks = (count + kChunkSize - 1) / kChunkSize;
+    std::atomic<size_t> nextChunk{0};
+    auto work = [&](bool reports) {
+        auto lastReport = std::chrono::steady_clock::now();
+        std::vector<uint32_t> candidates;
+        std::vector<Match> found;
+        for (size_t chunk = nextChunk++; chunk < chunks && !cancelled; chunk = nextChunk++) {
+            size_t i = chunk * kChunkSize;
+            size_t end = std::min(count, i + kChunkSize);
+            const uint64_t* masks = data->masks.data();
+
+            candidates.clear();
+#ifdef FUZZY_SSE2
+            const __m128i want = _mm_set1_epi64x(static_cast<long long>(required));
+            for (; i + 2 <= end; i += 2) {
+                __m128i have = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + i));
+                int bits = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(have, want), want));
+                if ((bits & 0x00FF) == 0x00FF) candidates.push_back(static_cast<uint32_t>(i));
+                if ((bits & 0xFF00) == 0xFF00) candidates.push_back(static_cast<uint32_t>(i + 1));
+            }
+#endif
+            for (; i < end; ++i) {
+                if ((masks[i] & required) == required) candidates.push_back(static_cast<uint32_t>(i));
+            }
+
+            found.clear();
+            for (uint32_t item : candidates) {
+                std::string_view text(data->text.data() + data->offsets[item], length(item));
+                int total = 0;
+                for (const auto& term : terms) {
+                    int s = score(text, term);
+                    if (s < 0) {
+                        total = -1;
+                        break;
+                    }
+                    total += s;
+                }
+                if (total >= 0) found.push_back({item, total});
+            }
+            if (!found.empty()) offer(found);
+
+            if (reports && progress && std::chrono::steady_clock::now() - lastReport >= interval) {
+                progress(ranked(), false);
+                lastReport = std::chrono::steady_clock::now();
+            }
+        }
+    };
+
+    size_t workers = std::min<size_t>(chunks, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; ++w) {
+        pool.emplace_back(work, false);
+    }
+    work(true);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    if (cancelled) return {};
+    std::vector<Match> result = ranked();
+    if (progress) progress(result, true);
+    return result;
+}
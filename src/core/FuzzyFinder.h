@@ -0,0 +1,64 @@
+#ifndef FUZZYFINDER_H
+#define FUZZYFINDER_H
+
+#include "AtomicSharedPtr.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+// fzf-style fuzzy ranking of file paths. A query is split on whitespace and
+// every term must occur in the path as a subsequence, ASCII case-insensitively,
+// so "q3 rpt final" finds reports/Q3_Report_final.docx. Terms are scored like
+// fzf's v1 algorithm: the shortest window found by a forward and a backward
+// scan, with bonuses for matches at word boundaries, camelCase humps and
+// consecutive characters, and penalties for gaps.
+//
+// Each path carries a 64-bit mask of the characters it contains. A search
+// first drops every path whose mask lacks one of the query's characters, two
+// masks per SSE2 compare, and only scores the rest. Paths are searched in
+// chunks on all cores.
+class FuzzyFinder {
+public:
+    struct Match {
+        uint32_t item; // Index into the items given to reset
+        int score;
+    };
+    // Receives the best matches so far, best first; done is set on the last call
+    using Progress = std::function<void(const std::vector<Match>& best, bool done)>;
+
+    // Replaces the searched paths; a search already running keeps the old ones
+    void reset(const std::vector<std::string>& items);
+    size_t size() const { return corpus.load()->masks.size(); }
+
+    // The best limit matches, best first; ties go to the shorter path, then the
+    // lower index. progress is called from the calling thread at most once per
+    // interval while the search runs, and once at the end. A cancelled search
+    // stops within a chunk and returns nothing.
+    std::vector<Match> search(const std::string& query, size_t limit, const std::atomic<bool>& cancelled,
+                              const Progress& progress = {},
+                              std::chrono::milliseconds interval = std::chrono::milliseconds(16)) const;
+
+    // Score of one lowercase term against text, or -1 if it does not occur
+    static int score(std::string_view text, std::string_view term);
+
+private:
+    static constexpr size_t kChunkSize = 16384;
+
+    struct Corpus {
+        std::string text;               // Items back to back
+        std::vector<uint32_t> offsets;  // Item i is text[offsets[i], offsets[i + 1])
+        std::vector<uint64_t> masks;    // Characters present in each item
+    };
+
+    static uint64_t charBit(unsigned char c);
+    static uint64_t maskOf(std::string_view text);
+
+    AtomicSharedPtr<const Corpus> corpus{std::make_shared<const Corpus>(Corpus{{}, {0}, {}})};
+};
+
+#endif // FUZZYFINDER_H
@@ -0,0 +1,170 @@
+#include "GraphClustering.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+constexpr int kMaxLevels = 16;
+constexpr int kMaxPasses = 32; // Per level; later passes move very few nodes
+constexpr double kMinGain = 1e-9;
+
+// Weighted undirected graph in CSR form. A community folded into one node
+// keeps its inner edges as a self-loop weight, counted from both ends.
+struct Level {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> targets;
+    std::vector<double> weights;
+    std::vector<double> selfLoops;
+
+    size_t size() const { return selfLoops.size(); }
+};
+
+Level fromEdges(size_t nodes, const GraphClustering::EdgeList& edges) {
+    Level level;
+    level.selfLoops.assign(nodes, 0.0);
+    std::vector<uint32_t> degree(nodes, 0);
+    for (const auto& [a, b] : edges) {
+        if (a >= nodes || b >= nodes) continue;
+        if (a == b) {
+            level.selfLoops[a] += 2;
+            continue;
+        }
+        ++degree[a];
+        ++degree[b];
+    }
+    level.offsets.assign(nodes + 1, 0);
+    for (size_t i = 0; i < nodes; ++i) level.offsets[i + 1] = level.offsets[i] + degree[i];
+    level.targets.resize(level.offsets[nodes]);
+    level.weights.assign(level.offsets[nodes], 1.0);
+    std::vector<uint32_t> fill(level.offsets.begin(), level.offsets.end() - 1);
+    for (const auto& [a, b] : edges) {
+        if (a >= nodes || b >= nodes || a == b) continue;
+        level.targets[fill[a]++] = b;
+        level.targets[fill[b]++] = a;
+    }
+    return level;
+}
+
+// Local moving phase; returns true if any node changed community
+bool moveNodes(const Level& level, std::vector<uint32_t>& community) {
+    const size_t n = level.size();
+    std::vector<double> degree(n), total(n);
+    double twiceWeight = 0;
+    for (size_t i = 0; i < n; ++i) {
+        degree[i] = level.selfLoops[i];
+        for (uint32_t e = level.offsets[i]; e < level.offsets[i + 1]; ++e) degree[i] += level.weights[e];
+        twiceWeight += degree[i];
+    }
+    community.resize(n);
+    std::iota(community.begin(), community.end(), 0u);
+    if (twiceWeight == 0) return false;
+    total = degree;
+
+    // Weight from the node being moved to each neighbouring community
+    std::vector<double> linkWeight(n, 0.0);
+    std::vector<uint32_t> neighbours;
+    bool movedAny = false;
+    for (int pass = 0; pass < kMaxPasses; ++pass) {
+        bool moved = false;
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t own = community[i];
+            neighbours.clear();
+            neighbours.push_back(own);
+            for (uint32_t e = level.offsets[i]; e < level.offsets[i + 1]; ++e) {
+                uint32_t c = community[level.targets[e]];
+                if (linkWeight[c] == 0 && c != own) neighbours.push_back(c);
+                linkWeight[c] += level.weights[e];
+            }
+
+            // Gain of joining c, up to a constant factor: links to c minus
+            // what a random graph with the same degrees would put there
+            total[own] -= degree[i];
+            uint32_t best = own;
+            double bestGain = linkWeight[own] - total[own] * degree[i] / twiceWeight;
+            for (uint32_t c : neighbours) {
+                double gain = linkWeight[c] - total[c] * degree[i] / twiceWeight;
+                if (gain > bestGain + kMinGain) {
+                    best = c;
+                    bestGain = gain;
+                }
+            }
+            total[best] += degree[i];
+            for (uint32_t c : neighbours) linkWeight[c] = 0;
+
+            if (best != own) {
+                community[i] = best;
+                moved = true;
+                movedAny = true;
+            }
+        }
+        if (!moved) break;
+    }
+    return movedAny;
+}
+
+// Numbers communities densely in order of first member; returns their count
+uint32_t renumber(std::vector<uint32_t>& community) {
+    std::vector<uint32_t> id(community.size(), ~0u);
+    uint32_t next = 0;
+    for (uint32_t& c : community) {
+        if (id[c] == ~0u) id[c] = next++;
+        c = id[c];
+    }
+    return next;
+}
+
+// One node per community, with the links between communities summed
+Level fold(const Level& level, const std::vector<uint32_t>& community, uint32_t count) {
+    Level folded;
+    folded.selfLoops.assign(count, 0.0);
+    std::vector<std::vector<uint32_t>> members(count);
+    for (uint32_t i = 0; i < level.size(); ++i) {
+        members[community[i]].push_back(i);
+        folded.selfLoops[community[i]] += level.selfLoops[i];
+    }
+
+    std::vector<double> linkWeight(count, 0.0);
+    std::vector<uint32_t> touched;
+    folded.offsets.push_back(0);
+    for (uint32_t c = 0; c < count; ++c) {
+        touched.clear();
+        for (uint32_t i : members[c]) {
+            for (uint32_t e = level.offsets[i]; e < level.offsets[i + 1]; ++e) {
+                uint32_t other = community[level.targets[e]];
+                if (other == c) {
+                    folded.selfLoops[c] += level.weights[e];
+                    continue;
+                }
+                if (linkWeight[other] == 0) touched.push_back(other);
+                linkWeight[other] += level.weights[e];
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        for (uint32_t other : touched) {
+            folded.targets.push_back(other);
+            folded.weights.push_back(linkWeight[other]);
+            linkWeight[other] = 0;
+        }
+        folded.offsets.push_back(static_cast<uint32_t>(folded.targets.size()));
+    }
+    return folded;
+}
+
+} // namespace
+
+std::vector<uint32_t> GraphClustering::communities(size_t nodes, const EdgeList& edges) {
+    std::vector<uint32_t> result(nodes);
+    std::iota(result.begin(), result.end(), 0u);
+    Level level = fromEdges(nodes, edges);
+
+    std::vector<uint32_t> community;
+    for (int depth = 0; depth < kMaxLevels; ++depth) {
+        if (!moveNodes(level, community)) break;
+        uint32_t count = renumber(community);
+        for (uint32_t& c : result) c = community[c];
+        if (count == level.size()) break;
+        level = fold(level, community, count);
+    }
+    renumber(result);
+    return result;
+}
@@ -0,0 +1,23 @@
+#ifndef GRAPHCLUSTERING_H
+#define GRAPHCLUSTERING_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Community detection for the files-and-tags graph, so the view can draw a
+// dense neighbourhood as one node until it is zoomed into. Uses Louvain:
+// nodes move to the neighbouring community that raises modularity most, then
+// each community becomes a node of a smaller graph and the process repeats
+// until no move helps. Each pass is O(edges), and a few passes suffice.
+class GraphClustering {
+public:
+    using EdgeList = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    // Community of every node, numbered densely from 0 in order of first node.
+    // Edges are unweighted and undirected; isolated nodes get one each.
+    static std::vector<uint32_t> communities(size_t nodes, const EdgeList& edges);
+};
+
+#endif // GRAPHCLUSTERING_H
@@ -0,0 +1,90 @@
+#include "GraphLayoutStore.h"
+#include "TagJournal.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'F', 'G', 'R', 'A', 'P', 'H', '1'};
+constexpr uint32_t kVersion = 1;
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(const std::string& in, size_t& at, T& value) {
+    if (in.size() - at < sizeof(T)) return false;
+    std::memcpy(&value, in.data() + at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+} // namespace
+
+std::string GraphLayoutStore::keyOf(Kind kind, std::string_view name) {
+    std::string key(1, static_cast<char>(kind));
+    key.append(name);
+    return key;
+}
+
+bool GraphLayoutStore::load(const std::string& path) {
+    positions.clear();
+    std::ifstream f(fs::path(path), std::ios::binary);
+    if (!f) return true;
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    size_t at = sizeof(kMagic);
+    uint32_t version = 0, count = 0;
+    bool ok = data.size() >= sizeof(kMagic) && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0
+              && get(data, at, version) && version == kVersion && get(data, at, count);
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        uint8_t kind = 0;
+        uint32_t length = 0;
+        Position p{};
+        ok = get(data, at, kind) && kind <= static_cast<uint8_t>(Kind::File)
+             && get(data, at, length) && data.size() - at >= length;
+        if (!ok) break;
+        std::string_view name(data.data() + at, length);
+        at += length;
+        ok = get(data, at, p.x) && get(data, at, p.y);
+        if (ok) positions[keyOf(static_cast<Kind>(kind), name)] = p;
+    }
+    if (!ok) {
+        std::cerr << "Graph layout " << path << " is damaged; starting over" << std::endl;
+        positions.clear();
+    }
+    return ok;
+}
+
+bool GraphLayoutStore::save(const std::string& path) const {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    std::string out(kMagic, sizeof(kMagic));
+    put(out, kVersion);
+    put(out, static_cast<uint32_t>(positions.size()));
+    for (const auto& [key, p] : positions) {
+        put(out, static_cast<uint8_t>(key[0]));
+        put(out, static_cast<uint32_t>(key.size() - 1));
+        out.append(key, 1);
+        put(out, p.x);
+        put(out, p.y);
+    }
+    return TagJournal::replaceFile(path, out);
+}
+
+const GraphLayoutStore::Position* GraphLayoutStore::find(Kind kind, std::string_view name) const {
+    auto it = positions.find(keyOf(kind, name));
+    return it == positions.end() ? nullptr : &it->second;
+}
+
+void GraphLayoutStore::set(Kind kind, std::string_view name, float x, float y) {
+    positions[keyOf(kind, name)] = {x, y};
+}
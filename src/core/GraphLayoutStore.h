@@ -0,0 +1,37 @@
+#ifndef GRAPHLAYOUTSTORE_H
+#define GRAPHLAYOUTSTORE_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+
+// Where the nodes of the files-and-tags graph were when it last settled, so
+// reopening the graph puts every node back instead of laying it out again.
+// Kept in .smartfile/graph-layout.bin (native little-endian):
+//   magic[8] version:u32 count:u32
+//   count x { kind:u8 nameLength:u32 name x:f32 y:f32 }
+class GraphLayoutStore {
+public:
+    enum class Kind : uint8_t { Tag, File };
+    struct Position {
+        float x, y;
+    };
+
+    // Missing or damaged files leave the store empty; false only for damage
+    bool load(const std::string& path);
+    bool save(const std::string& path) const; // Creates the directory if needed
+
+    const Position* find(Kind kind, std::string_view name) const;
+    void set(Kind kind, std::string_view name, float x, float y);
+    void clear() { positions.clear(); }
+    size_t size() const { return positions.size(); }
+
+private:
+    static std::string keyOf(Kind kind, std::string_view name);
+
+    // Keyed by the kind byte followed by the tag name or file key
+    std::unordered_map<std::string, Position> positions;
+};
+
+#endif // GRAPHLAYOUTSTORE_H
@@ -0,0 +1,144 @@
+#include "LayoutEngine.h"
+
+namespace {
+
+// A drag warms the layout up again, though not to a fresh graph's temperature,
+// so only the neighbourhood of the dragged node rearranges
+constexpr double kDragTemperature = 0.3;
+
+} // namespace
+
+LayoutEngine::LayoutEngine()
+    : worker([this]() { run(); }) {
+}
+
+LayoutEngine::~LayoutEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+uint64_t LayoutEngine::setGraph(std::vector<double> xs, std::vector<double> ys, ForceLayout::EdgeList edges,
+                                double temperature) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = ++graphId;
+        graphPending = true;
+        pendingXs = std::move(xs);
+        pendingYs = std::move(ys);
+        pendingEdges = std::move(edges);
+        pendingTemperature = temperature;
+        pendingMoves.clear();
+        held = ForceLayout::npos;
+    }
+    wake.notify_all();
+    return id;
+}
+
+void LayoutEngine::setBounds(double left, double top, double right, double bottom) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bounds[0] = left;
+        bounds[1] = top;
+        bounds[2] = right;
+        bounds[3] = bottom;
+        boundsPending = true;
+    }
+    wake.notify_all();
+}
+
+void LayoutEngine::moveNode(uint32_t node, double x, double y) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingMoves.emplace_back(node, x, y);
+        held = node;
+    }
+    wake.notify_all();
+}
+
+void LayoutEngine::release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    held = ForceLayout::npos;
+}
+
+void LayoutEngine::run() {
+    uint64_t graph = 0;
+    uint64_t sequence = 0;
+    bool active = false;
+    auto communities = std::make_shared<const std::vector<uint32_t>>();
+    std::vector<double> xs, ys;
+    ForceLayout::EdgeList edges;
+    std::vector<std::tuple<uint32_t, double, double>> moves;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&]() {
+            return stopping || active || graphPending || boundsPending || !pendingMoves.empty();
+        });
+        if (stopping) return;
+
+        // Requests are taken over under the lock and carried out without it,
+        // so a large graph being set up never holds up the caller
+        bool newGraph = graphPending;
+        double temperature = pendingTemperature;
+        if (newGraph) {
+            xs.swap(pendingXs);
+            ys.swap(pendingYs);
+            edges.swap(pendingEdges);
+            graph = graphId;
+            graphPending = false;
+        }
+        bool newBounds = boundsPending;
+        double l = bounds[0], t = bounds[1], r = bounds[2], b = bounds[3];
+        boundsPending = false;
+        moves.swap(pendingMoves);
+        uint32_t pinned = held;
+        lock.unlock();
+
+        if (newGraph) {
+            layout.reset(xs.size(), edges);
+            for (uint32_t i = 0; i < xs.size() && i < ys.size(); ++i) {
+                layout.setPosition(i, xs[i], ys[i]);
+            }
+            layout.setTemperature(temperature);
+            communities = std::make_shared<const std::vector<uint32_t>>(
+                GraphClustering::communities(xs.size(), edges));
+            xs.clear();
+            ys.clear();
+            edges.clear();
+            sequence = 0;
+        }
+        if (newBounds) {
+            layout.setBounds(l, t, r, b);
+        }
+        for (const auto& [node, x, y] : moves) {
+            if (node >= layout.size()) continue;
+            layout.setPosition(node, x, y);
+            layout.reheat(kDragTemperature);
+        }
+        moves.clear();
+
+        auto started = std::chrono::steady_clock::now();
+        active = layout.step(pinned);
+        auto frame = std::make_shared<Frame>();
+        frame->graph = graph;
+        frame->sequence = ++sequence;
+        frame->xs.resize(layout.size());
+        frame->ys.resize(layout.size());
+        for (uint32_t i = 0; i < layout.size(); ++i) {
+            frame->xs[i] = static_cast<float>(layout.x(i));
+            frame->ys[i] = static_cast<float>(layout.y(i));
+        }
+        frame->settled = !active;
+        frame->communities = communities;
+        latest.store(std::move(frame));
+        lock.lock();
+
+        if (active) {
+            wake.wait_until(lock, started + kStepInterval, [&]() { return stopping || graphPending; });
+        }
+    }
+}
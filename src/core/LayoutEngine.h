@@ -0,0 +1,77 @@
+#ifndef LAYOUTENGINE_H
+#define LAYOUTENGINE_H
+
+#include "ForceLayout.h"
+#include "GraphClustering.h"
+#include "AtomicSharedPtr.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Runs a ForceLayout on a thread of its own, so a large graph settles without
+// holding up the UI. After every step the positions are published as an
+// immutable Frame, which the view picks up at its own frame rate and applies
+// in one go; steps it was too slow to show are simply skipped. The thread
+// sleeps while the layout is settled, and wakes for a new graph or a drag.
+// Each new graph is also split into communities there, for the view to
+// collapse when zoomed out.
+class LayoutEngine {
+public:
+    struct Frame {
+        uint64_t graph = 0;    // setGraph call the positions belong to
+        uint64_t sequence = 0; // Steps taken on that graph
+        std::vector<float> xs, ys;
+        bool settled = true;   // No further frames until the layout is disturbed
+        // Community of every node; the same for all frames of a graph
+        std::shared_ptr<const std::vector<uint32_t>> communities;
+    };
+
+    // Steps of small graphs are spaced this far apart, so settling is
+    // visible and does not spin a core
+    static constexpr std::chrono::milliseconds kStepInterval{16};
+
+    LayoutEngine();
+    ~LayoutEngine();
+    LayoutEngine(const LayoutEngine&) = delete;
+    LayoutEngine& operator=(const LayoutEngine&) = delete;
+
+    // Replaces the simulated graph and returns the id its frames carry. A
+    // graph whose nodes are mostly where they belong starts cooler, so it
+    // rearranges only as much as needed.
+    uint64_t setGraph(std::vector<double> xs, std::vector<double> ys, ForceLayout::EdgeList edges,
+                      double temperature = 1.0);
+    void setBounds(double left, double top, double right, double bottom);
+    // Puts a node where the user dragged it and holds it there until release
+    void moveNode(uint32_t node, double x, double y);
+    void release();
+
+    std::shared_ptr<const Frame> frame() const { return latest.load(); }
+
+private:
+    void run();
+
+    ForceLayout layout; // Used by the worker only
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    // Requests waiting for the worker's next step
+    bool graphPending = false;
+    uint64_t graphId = 0;
+    std::vector<double> pendingXs, pendingYs;
+    ForceLayout::EdgeList pendingEdges;
+    double pendingTemperature = 1.0;
+    bool boundsPending = false;
+    double bounds[4] = {-400, -400, 400, 400};
+    std::vector<std::tuple<uint32_t, double, double>> pendingMoves;
+    uint32_t held = ForceLayout::npos;
+
+    AtomicSharedPtr<const Frame> latest{std::make_shared<const Frame>()};
+    std::thread worker; // Last, so it starts after everything it uses
+};
+
+#endif // LAYOUTENGINE_H
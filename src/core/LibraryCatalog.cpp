@@ -0,0 +1,295 @@
+#include "LibraryCatalog.h"
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool containsNoCase(std::string_view haystack, const std::string& loweredNeedle) {
+    auto it = std::search(haystack.begin(), haystack.end(), loweredNeedle.begin(), loweredNeedle.end(),
+                          [](char a, char b) { return lower(a) == b; });
+    return it != haystack.end();
+}
+
+} // namespace
+
+LibraryCatalog::LibraryCatalog(size_t memoryBudget)
+    : memoryBudget(memoryBudget) {
+}
+
+std::string LibraryCatalog::normalize(const std::string& root) {
+    std::string normal = fs::path(root).lexically_normal().generic_string();
+    while (normal.size() > 1 && normal.back() == '/') normal.pop_back();
+    return normal;
+}
+
+size_t LibraryCatalog::estimateCost(const std::string& root) {
+    // The snapshot is mapped and the journal replayed into memory, so their
+    // sizes bound what a loaded shard holds
+    size_t bytes = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(root + "/.smartfile", ec)) {
+        if (entry.is_regular_file(ec)) bytes += static_cast<size_t>(entry.file_size(ec));
+    }
+    return bytes;
+}
+
+bool LibraryCatalog::addRoot(const std::string& root) {
+    std::string normal = normalize(root);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& shard : shards) {
+        if (shard->root == normal) return false;
+    }
+    auto shard = std::make_shared<Shard>();
+    shard->root = normal;
+    shards.push_back(std::move(shard));
+    return true;
+}
+
+void LibraryCatalog::removeRoot(const std::string& root) {
+    std::string normal = normalize(root);
+    std::shared_ptr<Shard> removed; // Destroyed after unlocking
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(shards.begin(), shards.end(), [&normal](const auto& shard) {
+        return shard->root == normal;
+    });
+    if (it == shards.end()) return;
+    if ((*it)->manager && !(*it)->pinned) loaded -= (*it)->cost;
+    removed = std::move(*it);
+    shards.erase(it);
+}
+
+std::vector<std::string> LibraryCatalog::roots() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> result;
+    result.reserve(shards.size());
+    for (const auto& shard : shards) {
+        result.push_back(shard->root);
+    }
+    return result;
+}
+
+void LibraryCatalog::setMemoryBudget(size_t bytes) {
+    std::vector<std::shared_ptr<TagManager>> released; // Destroyed after unlocking
+    std::lock_guard<std::mutex> lock(mutex);
+    memoryBudget = bytes;
+    released = evict(nullptr);
+}
+
+size_t LibraryCatalog::loadedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return loaded;
+}
+
+void LibraryCatalog::pin(const std::string& root, TagManager& manager) {
+    addRoot(root);
+    std::shared_ptr<Shard> shard = findShard(root);
+    std::shared_ptr<TagManager> previous; // Destroyed after unlocking
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shard->manager && !shard->pinned) loaded -= shard->cost;
+    previous = std::move(shard->manager);
+    // Not owned: the caller keeps the manager alive while it is pinned
+    shard->manager = std::shared_ptr<TagManager>(&manager, [](TagManager*) {});
+    shard->pinned = true;
+    shard->cost = 0;
+}
+
+void LibraryCatalog::unpin(const std::string& root) {
+    std::shared_ptr<Shard> shard = findShard(root);
+    if (!shard) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!shard->pinned) return;
+    shard->manager.reset();
+    shard->pinned = false;
+}
+
+std::shared_ptr<LibraryCatalog::Shard> LibraryCatalog::findShard(const std::string& root) const {
+    std::string normal = normalize(root);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& shard : shards) {
+        if (shard->root == normal) return shard;
+    }
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<LibraryCatalog::Shard>> LibraryCatalog::allShards() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return shards;
+}
+
+std::shared_ptr<TagManager> LibraryCatalog::library(const std::string& root) {
+    std::shared_ptr<Shard> shard = findShard(root);
+    return shard ? acquire(shard) : nullptr;
+}
+
+std::shared_ptr<TagManager> LibraryCatalog::acquire(const std::shared_ptr<Shard>& shard) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (shard->manager) {
+            shard->lastUse = ++useClock;
+            return shard->manager;
+        }
+    }
+
+    std::lock_guard<std::mutex> loadLock(shard->loadMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (shard->manager) { // Loaded or pinned while we waited
+            shard->lastUse = ++useClock;
+            return shard->manager;
+        }
+    }
+
+    // Only read: a library is migrated and compacted when it is opened as a
+    // folder, not because a search passed over it
+    auto manager = std::make_shared<TagManager>();
+    manager->loadTags(shard->root, true);
+    size_t cost = estimateCost(shard->root);
+
+    std::vector<std::shared_ptr<TagManager>> released; // Destroyed after unlocking
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shard->manager) return shard->manager; // Pinned meanwhile
+    shard->manager = manager;
+    shard->cost = cost;
+    shard->lastUse = ++useClock;
+    loaded += cost;
+    released = evict(shard.get());
+    return manager;
+}
+
+std::vector<std::shared_ptr<TagManager>> LibraryCatalog::evict(const Shard* keep) {
+    // Callers still holding an evicted manager keep it alive until they finish
+    std::vector<std::shared_ptr<TagManager>> released;
+    while (loaded > memoryBudget) {
+        Shard* oldest = nullptr;
+        for (const auto& shard : shards) {
+            if (!shard->manager || shard->pinned || shard.get() == keep) continue;
+            if (!oldest || shard->lastUse < oldest->lastUse) oldest = shard.get();
+        }
+        if (!oldest) break;
+        released.push_back(std::move(oldest->manager));
+        loaded -= oldest->cost;
+        oldest->cost = 0;
+    }
+    return released;
+}
+
+void LibraryCatalog::forEachShard(const std::vector<std::shared_ptr<Shard>>& targets,
+                                  const std::function<void(size_t, TagManager&)>& fn) {
+    size_t workers = std::min<size_t>(targets.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < targets.size(); i = next++) {
+            std::shared_ptr<TagManager> manager = acquire(targets[i]);
+            fn(i, *manager);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; ++w) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+LibraryCatalog::QueryResult LibraryCatalog::query(const std::string& expression, size_t maxFacets) {
+    std::vector<std::shared_ptr<Shard>> targets = allShards();
+    std::vector<TagManager::QueryResult> partial(targets.size());
+    forEachShard(targets, [&](size_t i, TagManager& manager) {
+        partial[i] = manager.query(expression);
+    });
+
+    QueryResult result;
+    std::map<std::string, size_t> facetCounts;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!partial[i].error.empty()) { // The same for every shard
+            result.error = partial[i].error;
+            result.files.clear();
+            return result;
+        }
+        for (auto& file : partial[i].files) {
+            result.files.push_back({targets[i]->root, std::move(file)});
+        }
+        for (const auto& [tag, count] : partial[i].facets) {
+            facetCounts[tag] += count;
+        }
+    }
+    std::sort(result.files.begin(), result.files.end());
+
+    result.facets.assign(facetCounts.begin(), facetCounts.end());
+    auto byCount = [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    if (maxFacets && result.facets.size() > maxFacets) {
+        std::partial_sort(result.facets.begin(), result.facets.begin() + maxFacets, result.facets.end(), byCount);
+        result.facets.resize(maxFacets);
+    } else {
+        std::sort(result.facets.begin(), result.facets.end(), byCount);
+    }
+    return result;
+}
+
+std::vector<LibraryCatalog::Hit> LibraryCatalog::search(const std::string& text, size_t limit) {
+    std::string needle;
+    for (char c : text) needle += lower(c);
+
+    std::vector<std::shared_ptr<Shard>> targets = allShards();
+    std::vector<std::vector<Hit>> partial(targets.size());
+    forEachShard(targets, [&](size_t i, TagManager& manager) {
+        std::shared_ptr<const TagIndex> view = manager.snapshot();
+
+        // Matching tags are few; mark their files once instead of testing every file's tags
+        std::vector<bool> byTag(view->fileIdLimit(), false);
+        for (uint32_t tag : view->sortedTags()) {
+            if (!containsNoCase(view->tagName(tag), needle)) continue;
+            for (uint32_t file : view->filesOf(tag)) byTag[file] = true;
+        }
+
+        auto& hits = partial[i];
+        for (uint32_t file = 0; file < view->fileIdLimit(); ++file) {
+            if (!byTag[file] && view->tagsOf(file).empty()) continue;
+            std::string name = view->fileName(file);
+            if (byTag[file] || containsNoCase(name, needle)) {
+                hits.push_back({targets[i]->root, std::move(name)});
+            }
+        }
+        std::sort(hits.begin(), hits.end());
+        if (limit && hits.size() > limit) hits.resize(limit);
+    });
+
+    std::vector<Hit> result;
+    for (auto& hits : partial) {
+        result.insert(result.end(), std::make_move_iterator(hits.begin()), std::make_move_iterator(hits.end()));
+    }
+    std::sort(result.begin(), result.end());
+    if (limit && result.size() > limit) result.resize(limit);
+    return result;
+}
+
+std::vector<std::pair<std::string, size_t>> LibraryCatalog::allTags() {
+    std::vector<std::shared_ptr<Shard>> targets = allShards();
+    std::vector<std::vector<std::pair<std::string, size_t>>> partial(targets.size());
+    forEachShard(targets, [&](size_t i, TagManager& manager) {
+        std::shared_ptr<const TagIndex> view = manager.snapshot();
+        for (uint32_t tag : view->sortedTags()) {
+            partial[i].emplace_back(std::string(view->tagName(tag)), view->filesOf(tag).size());
+        }
+    });
+
+    std::map<std::string, size_t> counts;
+    for (const auto& tags : partial) {
+        for (const auto& [tag, count] : tags) counts[tag] += count;
+    }
+    return {counts.begin(), counts.end()};
+}
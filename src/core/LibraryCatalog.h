@@ -0,0 +1,91 @@
+#ifndef LIBRARYCATALOG_H
+#define LIBRARYCATALOG_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "TagManager.h"
+
+// Many library roots behind one index. Every root is a shard with its own
+// TagManager, loaded read-only on first use and evicted least recently used first once
+// the loaded shards exceed the memory budget. Queries and searches run over
+// the shards in parallel and merge the results.
+// The catalog only knows which roots are registered; persisting that list is
+// up to the caller.
+class LibraryCatalog {
+public:
+    static constexpr size_t kDefaultMemoryBudget = size_t(512) << 20;
+
+    struct Hit {
+        std::string root;
+        std::string file; // Key within root, see TagManager::fileKey
+        bool operator<(const Hit& other) const {
+            return root != other.root ? root < other.root : file < other.file;
+        }
+    };
+    struct QueryResult {
+        std::vector<Hit> files;
+        std::vector<std::pair<std::string, size_t>> facets; // Summed over roots, most frequent first
+        std::string error;                                   // Parse error; empty on success
+    };
+
+    explicit LibraryCatalog(size_t memoryBudget = kDefaultMemoryBudget);
+
+    bool addRoot(const std::string& root); // False if already registered
+    void removeRoot(const std::string& root);
+    std::vector<std::string> roots() const;
+    void setMemoryBudget(size_t bytes);
+    size_t loadedBytes() const; // Estimated size of the loaded shards
+
+    // Serves root from a TagManager the caller already has it loaded in (the
+    // open folder), so no second instance appends to the same journal. Pinned
+    // shards are never evicted; the manager must outlive the pin.
+    void pin(const std::string& root, TagManager& manager);
+    void unpin(const std::string& root);
+
+    // The shard's manager, loading it if needed; nullptr if root is not registered.
+    // Unless root is pinned the manager is read-only.
+    std::shared_ptr<TagManager> library(const std::string& root);
+
+    // Tag query over every root, see TagQuery for the syntax. Files without
+    // tags are not in the catalog, so they never match.
+    QueryResult query(const std::string& expression, size_t maxFacets = 0);
+    // Tagged files whose key or one of whose tags contains text (ASCII case-insensitive);
+    // limit = 0 returns all
+    std::vector<Hit> search(const std::string& text, size_t limit = 0);
+    std::vector<std::pair<std::string, size_t>> allTags(); // Tags with file counts over all roots, by name
+
+private:
+    struct Shard {
+        std::string root;
+        std::mutex loadMutex; // Held while loading, so each shard loads once
+        std::shared_ptr<TagManager> manager; // Null while not loaded
+        bool pinned = false;
+        uint64_t lastUse = 0;
+        size_t cost = 0;
+    };
+
+    static std::string normalize(const std::string& root);
+    static size_t estimateCost(const std::string& root);
+    std::shared_ptr<Shard> findShard(const std::string& root) const;
+    std::shared_ptr<TagManager> acquire(const std::shared_ptr<Shard>& shard);
+    // Drops the least recently used shards until the budget holds. Caller holds
+    // mutex and destroys the returned managers after releasing it, since a
+    // manager's destructor may wait for its compaction.
+    std::vector<std::shared_ptr<TagManager>> evict(const Shard* keep);
+    // Runs fn(i, manager of targets[i]) for every target on a pool of threads
+    void forEachShard(const std::vector<std::shared_ptr<Shard>>& targets,
+                      const std::function<void(size_t, TagManager&)>& fn);
+    std::vector<std::shared_ptr<Shard>> allShards() const;
+
+    mutable std::mutex mutex; // Guards everything below and Shard::manager/lastUse/cost
+    std::vector<std::shared_ptr<Shard>> shards;
+    size_t memoryBudget;
+    size_t loaded = 0;
+    uint64_t useClock = 0;
+};
+
+#endif // LIBRARYCATALOG_H
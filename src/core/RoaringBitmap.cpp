@@ -0,0 +1,400 @@
+#include "RoaringBitmap.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define ROARING_SSE2 1
+#endif
+
+namespace {
+
+// Binary search in the remaining part of the larger array; wins when one side
+// is much smaller than the other
+void intersectGalloping(const uint16_t* small, size_t ns, const uint16_t* large, size_t nl,
+                        std::vector<uint16_t>& out) {
+    const uint16_t* pos = large;
+    const uint16_t* end = large + nl;
+    for (size_t i = 0; i < ns && pos != end; ++i) {
+        pos = std::lower_bound(pos, end, small[i]);
+        if (pos != end && *pos == small[i]) out.push_back(small[i]);
+    }
+}
+
+void intersectScalar(const uint16_t* a, size_t na, const uint16_t* b, size_t nb, size_t i, size_t j,
+                     std::vector<uint16_t>& out) {
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) ++i;
+        else if (b[j] < a[i]) ++j;
+        else {
+            out.push_back(a[i]);
+            ++i;
+            ++j;
+        }
+    }
+}
+
+void intersectArrays(const uint16_t* a, size_t na, const uint16_t* b, size_t nb, std::vector<uint16_t>& out) {
+    if (na > nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if (na * 32 < nb) {
+        intersectGalloping(a, na, b, nb, out);
+        return;
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+#ifdef ROARING_SSE2
+    // Block merge: compare 8 values of a against all 8 rotations of a block of b,
+    // then advance whichever block ends lower (both when they end equal)
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i hits = _mm_cmpeq_epi16(va, vb);
+        for (int r = 1; r < 8; ++r) {
+            vb = _mm_or_si128(_mm_srli_si128(vb, 2), _mm_slli_si128(vb, 14));
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi16(va, vb));
+        }
+        int mask = _mm_movemask_epi8(hits);
+        for (int k = 0; k < 8; ++k) {
+            if (mask & (1 << (2 * k))) out.push_back(a[i + k]);
+        }
+
+        uint16_t lastA = a[i + 7];
+        uint16_t lastB = b[j + 7];
+        if (lastA <= lastB) i += 8;
+        if (lastB <= lastA) j += 8;
+    }
+#endif
+    intersectScalar(a, na, b, nb, i, j, out);
+}
+
+uint32_t andWords(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t n) {
+    uint32_t count = 0;
+    size_t w = 0;
+#ifdef ROARING_SSE2
+    for (; w + 2 <= n; w += 2) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + w)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + w)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + w), v);
+        count += std::popcount(out[w]) + std::popcount(out[w + 1]);
+    }
+#endif
+    for (; w < n; ++w) {
+        out[w] = a[w] & b[w];
+        count += std::popcount(out[w]);
+    }
+    return count;
+}
+
+uint32_t andWordsCount(const uint64_t* a, const uint64_t* b, size_t n) {
+    uint32_t count = 0;
+    for (size_t w = 0; w < n; ++w) count += std::popcount(a[w] & b[w]);
+    return count;
+}
+
+} // namespace
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (isBitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::add(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t& word = bits[low >> 6];
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (!(word & bit)) {
+            word |= bit;
+            ++cardinality;
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) return;
+    array.insert(it, low);
+    ++cardinality;
+    normalize();
+}
+
+void RoaringBitmap::Container::remove(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t& word = bits[low >> 6];
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (word & bit) {
+            word &= ~bit;
+            --cardinality;
+            normalize();
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        array.erase(it);
+        --cardinality;
+    }
+}
+
+void RoaringBitmap::Container::normalize() {
+    if (isBitmap() && cardinality <= kArrayMax) {
+        array.clear();
+        array.reserve(cardinality);
+        for (size_t w = 0; w < bits.size(); ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                array.push_back(static_cast<uint16_t>(w * 64 + std::countr_zero(word)));
+            }
+        }
+        bits.clear();
+        bits.shrink_to_fit();
+    } else if (!isBitmap() && cardinality > kArrayMax) {
+        bits.assign(kBitmapWords, 0);
+        for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+        array.clear();
+        array.shrink_to_fit();
+    }
+}
+
+RoaringBitmap RoaringBitmap::fromSorted(std::span<const uint32_t> values) {
+    RoaringBitmap result;
+    size_t i = 0;
+    while (i < values.size()) {
+        Container c;
+        c.key = static_cast<uint16_t>(values[i] >> 16);
+        size_t end = i;
+        while (end < values.size() && (values[end] >> 16) == c.key) ++end;
+
+        c.cardinality = static_cast<uint32_t>(end - i);
+        if (c.cardinality > kArrayMax) {
+            c.bits.assign(kBitmapWords, 0);
+            for (size_t k = i; k < end; ++k) c.bits[(values[k] >> 6) & 1023] |= uint64_t(1) << (values[k] & 63);
+        } else {
+            c.array.reserve(c.cardinality);
+            for (size_t k = i; k < end; ++k) c.array.push_back(static_cast<uint16_t>(values[k]));
+        }
+        result.containers.push_back(std::move(c));
+        i = end;
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::range(uint32_t begin, uint32_t end) {
+    RoaringBitmap result;
+    uint64_t v = begin;
+    while (v < end) {
+        Container c;
+        c.key = static_cast<uint16_t>(v >> 16);
+        uint64_t stop = std::min<uint64_t>(end, (uint64_t(c.key) + 1) << 16);
+        c.cardinality = static_cast<uint32_t>(stop - v);
+        if (c.cardinality > kArrayMax) {
+            c.bits.assign(kBitmapWords, 0);
+            for (uint64_t x = v; x < stop; ++x) c.bits[(x >> 6) & 1023] |= uint64_t(1) << (x & 63);
+        } else {
+            for (uint64_t x = v; x < stop; ++x) c.array.push_back(static_cast<uint16_t>(x));
+        }
+        result.containers.push_back(std::move(c));
+        v = stop;
+    }
+    return result;
+}
+
+RoaringBitmap::Container* RoaringBitmap::find(uint16_t key) {
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    return (it != containers.end() && it->key == key) ? &*it : nullptr;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::find(uint16_t key) const {
+    return const_cast<RoaringBitmap*>(this)->find(key);
+}
+
+void RoaringBitmap::add(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key) {
+        Container c;
+        c.key = key;
+        it = containers.insert(it, std::move(c));
+    }
+    it->add(static_cast<uint16_t>(value));
+}
+
+void RoaringBitmap::remove(uint32_t value) {
+    Container* c = find(static_cast<uint16_t>(value >> 16));
+    if (!c) return;
+    c->remove(static_cast<uint16_t>(value));
+    if (c->cardinality == 0) containers.erase(containers.begin() + (c - containers.data()));
+}
+
+bool RoaringBitmap::contains(uint32_t value) const {
+    const Container* c = find(static_cast<uint16_t>(value >> 16));
+    return c && c->contains(static_cast<uint16_t>(value));
+}
+
+uint64_t RoaringBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (const auto& c : containers) total += c.cardinality;
+    return total;
+}
+
+std::vector<uint32_t> RoaringBitmap::toVector() const {
+    std::vector<uint32_t> values;
+    values.reserve(cardinality());
+    forEach([&values](uint32_t v) { values.push_back(v); });
+    return values;
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (a.isBitmap() && b.isBitmap()) {
+        out.bits.resize(kBitmapWords);
+        out.cardinality = andWords(out.bits.data(), a.bits.data(), b.bits.data(), kBitmapWords);
+        out.normalize();
+    } else if (a.isBitmap() || b.isBitmap()) {
+        const Container& arr = a.isBitmap() ? b : a;
+        const Container& bmp = a.isBitmap() ? a : b;
+        for (uint16_t low : arr.array) {
+            if ((bmp.bits[low >> 6] >> (low & 63)) & 1) out.array.push_back(low);
+        }
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+    } else {
+        out.array.reserve(std::min(a.array.size(), b.array.size()));
+        intersectArrays(a.array.data(), a.array.size(), b.array.data(), b.array.size(), out.array);
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+    }
+    return out;
+}
+
+uint32_t RoaringBitmap::intersectCount(const Container& a, const Container& b) {
+    if (a.isBitmap() && b.isBitmap()) {
+        return andWordsCount(a.bits.data(), b.bits.data(), kBitmapWords);
+    }
+    if (a.isBitmap() || b.isBitmap()) {
+        const Container& arr = a.isBitmap() ? b : a;
+        const Container& bmp = a.isBitmap() ? a : b;
+        uint32_t count = 0;
+        for (uint16_t low : arr.array) count += (bmp.bits[low >> 6] >> (low & 63)) & 1;
+        return count;
+    }
+    return intersect(a, b).cardinality;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (!a.isBitmap() && !b.isBitmap() && a.cardinality + b.cardinality <= kArrayMax) {
+        out.array.reserve(a.array.size() + b.array.size());
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(out.array));
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+        return out;
+    }
+
+    out.bits.assign(kBitmapWords, 0);
+    for (const Container* c : {&a, &b}) {
+        if (c->isBitmap()) {
+            for (size_t w = 0; w < kBitmapWords; ++w) out.bits[w] |= c->bits[w];
+        } else {
+            for (uint16_t low : c->array) out.bits[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+    }
+    for (uint64_t word : out.bits) out.cardinality += std::popcount(word);
+    out.normalize();
+    return out;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (a.isBitmap()) {
+        out.bits = a.bits;
+        if (b.isBitmap()) {
+            for (size_t w = 0; w < kBitmapWords; ++w) out.bits[w] &= ~b.bits[w];
+        } else {
+            for (uint16_t low : b.array) out.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        }
+        for (uint64_t word : out.bits) out.cardinality += std::popcount(word);
+        out.normalize();
+    } else if (b.isBitmap()) {
+        for (uint16_t low : a.array) {
+            if (!((b.bits[low >> 6] >> (low & 63)) & 1)) out.array.push_back(low);
+        }
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+    } else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                            std::back_inserter(out.array));
+        out.cardinality = static_cast<uint32_t>(out.array.size());
+    }
+    return out;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        const Container& a = containers[i];
+        const Container& b = other.containers[j];
+        if (a.key < b.key) ++i;
+        else if (b.key < a.key) ++j;
+        else {
+            Container c = intersect(a, b);
+            if (c.cardinality) result.containers.push_back(std::move(c));
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key)) {
+            result.containers.push_back(containers[i++]);
+        } else if (i == containers.size() || other.containers[j].key < containers[i].key) {
+            result.containers.push_back(other.containers[j++]);
+        } else {
+            result.containers.push_back(unite(containers[i++], other.containers[j++]));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::andNot(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    size_t j = 0;
+    for (const Container& a : containers) {
+        while (j < other.containers.size() && other.containers[j].key < a.key) ++j;
+        if (j < other.containers.size() && other.containers[j].key == a.key) {
+            Container c = subtract(a, other.containers[j]);
+            if (c.cardinality) result.containers.push_back(std::move(c));
+        } else {
+            result.containers.push_back(a);
+        }
+    }
+    return result;
+}
+
+uint64_t RoaringBitmap::andCardinality(const RoaringBitmap& other) const {
+    uint64_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        const Container& a = containers[i];
+        const Container& b = other.containers[j];
+        if (a.key < b.key) ++i;
+        else if (b.key < a.key) ++j;
+        else {
+            count += intersectCount(a, b);
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,76 @@
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <vector>
+#include <span>
+#include <bit>
+#include <cstdint>
+
+// Compressed set of 32-bit ids in the roaring layout: values are grouped by
+// their high 16 bits, and each group is a sorted uint16 array while it holds
+// at most 4096 values, a 65536-bit bitmap above that. Intersections use SSE2
+// where available.
+class RoaringBitmap {
+public:
+    RoaringBitmap() = default;
+
+    static RoaringBitmap fromSorted(std::span<const uint32_t> values); // Ascending, no duplicates
+    static RoaringBitmap range(uint32_t begin, uint32_t end);          // [begin, end)
+
+    void add(uint32_t value);
+    void remove(uint32_t value);
+    bool contains(uint32_t value) const;
+    bool empty() const { return containers.empty(); }
+    uint64_t cardinality() const;
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const;
+    RoaringBitmap operator|(const RoaringBitmap& other) const;
+    RoaringBitmap andNot(const RoaringBitmap& other) const;
+    uint64_t andCardinality(const RoaringBitmap& other) const;
+
+    std::vector<uint32_t> toVector() const;
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& c : containers) {
+            uint32_t high = uint32_t(c.key) << 16;
+            if (c.isBitmap()) {
+                for (size_t w = 0; w < c.bits.size(); ++w) {
+                    for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                        fn(high | uint32_t(w * 64 + std::countr_zero(word)));
+                    }
+                }
+            } else {
+                for (uint16_t low : c.array) fn(high | low);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kArrayMax = 4096;
+    static constexpr size_t kBitmapWords = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array; // Used while cardinality <= kArrayMax
+        std::vector<uint64_t> bits;  // kBitmapWords words otherwise
+
+        bool isBitmap() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+        void add(uint16_t low);
+        void remove(uint16_t low);
+        void normalize(); // Picks the representation that fits the cardinality
+    };
+
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+    static uint32_t intersectCount(const Container& a, const Container& b);
+
+    Container* find(uint16_t key);
+    const Container* find(uint16_t key) const;
+
+    std::vector<Container> containers; // Sorted by key, never empty
+};
+
+#endif // ROARINGBITMAP_H
@@ -0,0 +1,100 @@
+#include "SearchIndex.h"
+#include <algorithm>
+#include <numeric>
+
+void SearchIndex::reset(size_t count) {
+    texts.assign(count, std::string());
+    postings.clear();
+    lastValid = false;
+}
+
+std::vector<uint32_t> SearchIndex::trigramsOf(const std::string& text) {
+    std::vector<uint32_t> grams;
+    if (text.size() < 3) return grams;
+    grams.reserve(text.size() - 2);
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        // Trigrams spanning two fields can never be part of a match
+        if (text[i] == kFieldSeparator || text[i + 1] == kFieldSeparator || text[i + 2] == kFieldSeparator) continue;
+        grams.push_back(trigram(text.data() + i));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+void SearchIndex::set(uint32_t doc, const std::vector<std::string>& fields) {
+    std::string text;
+    for (const auto& field : fields) {
+        if (!text.empty()) text += kFieldSeparator;
+        text += field;
+    }
+    if (text == texts[doc]) return;
+
+    for (uint32_t gram : trigramsOf(texts[doc])) {
+        auto& list = postings[gram];
+        auto pos = std::lower_bound(list.begin(), list.end(), doc);
+        if (pos != list.end() && *pos == doc) list.erase(pos);
+    }
+    for (uint32_t gram : trigramsOf(text)) {
+        auto& list = postings[gram];
+        // Documents are usually filled in order, which makes this an append
+        if (list.empty() || list.back() < doc) {
+            list.push_back(doc);
+        } else {
+            list.insert(std::lower_bound(list.begin(), list.end(), doc), doc);
+        }
+    }
+    texts[doc] = std::move(text);
+    lastValid = false;
+}
+
+bool SearchIndex::contains(uint32_t doc, const std::string& query) const {
+    return texts[doc].find(query) != std::string::npos;
+}
+
+std::vector<uint32_t> SearchIndex::search(const std::string& query) {
+    std::vector<uint32_t> result;
+    if (query.empty()) {
+        result.resize(texts.size());
+        std::iota(result.begin(), result.end(), 0u);
+    } else if (lastValid && !lastQuery.empty() && query.find(lastQuery) != std::string::npos) {
+        // Whatever contains the longer query contains the previous one
+        for (uint32_t doc : lastResult) {
+            if (contains(doc, query)) result.push_back(doc);
+        }
+    } else if (query.size() < 3) {
+        for (uint32_t doc = 0; doc < texts.size(); ++doc) {
+            if (contains(doc, query)) result.push_back(doc);
+        }
+    } else {
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (uint32_t gram : trigramsOf(query)) {
+            auto it = postings.find(gram);
+            if (it == postings.end() || it->second.empty()) {
+                lists.clear();
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        if (!lists.empty()) {
+            std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+            std::vector<uint32_t> candidates = *lists.front();
+            std::vector<uint32_t> narrowed;
+            for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+                narrowed.clear();
+                std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                                      std::back_inserter(narrowed));
+                candidates.swap(narrowed);
+            }
+            // Trigrams in a different order or spread across positions still pass the filter
+            for (uint32_t doc : candidates) {
+                if (contains(doc, query)) result.push_back(doc);
+            }
+        }
+    }
+
+    lastQuery = query;
+    lastResult = result;
+    lastValid = true;
+    return result;
+}
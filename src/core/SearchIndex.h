@@ -0,0 +1,44 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Substring search over short documents (a file name and its tags) through a
+// byte trigram index. A query's trigrams narrow the candidates to a few posting
+// list intersections, which are then verified. A query that extends the
+// previous one only re-checks the previous matches.
+// Text is matched byte for byte, so callers pass lowercased UTF-8 for
+// case-insensitive search.
+class SearchIndex {
+public:
+    void reset(size_t count); // count empty documents, numbered from 0
+    size_t size() const { return texts.size(); }
+
+    // Replaces a document; a query matches it when it occurs within one field
+    void set(uint32_t doc, const std::vector<std::string>& fields);
+
+    // Documents containing query, ascending; every document for an empty query
+    std::vector<uint32_t> search(const std::string& query);
+
+private:
+    static constexpr char kFieldSeparator = '\x1f';
+
+    static uint32_t trigram(const char* p) {
+        return (uint32_t(uint8_t(p[0])) << 16) | (uint32_t(uint8_t(p[1])) << 8) | uint8_t(p[2]);
+    }
+    static std::vector<uint32_t> trigramsOf(const std::string& text); // Sorted, unique
+    bool contains(uint32_t doc, const std::string& query) const;
+
+    std::vector<std::string> texts; // Fields joined by kFieldSeparator
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings; // Trigram -> ascending documents
+
+    // The previous query and its result, kept until a document changes
+    std::string lastQuery;
+    std::vector<uint32_t> lastResult;
+    bool lastValid = false;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,105 @@
+#include "TagCooccurrence.h"
+#include "TagIndex.h"
+#include <algorithm>
+
+namespace {
+
+bool byTag(const TagCooccurrence::Entry& entry, uint32_t tag) {
+    return entry.tag < tag;
+}
+
+} // namespace
+
+TagCooccurrence TagCooccurrence::build(const TagIndex& index) {
+    TagCooccurrence matrix;
+    uint32_t limit = index.tagIdLimit();
+    matrix.rows.resize(limit);
+
+    // Dense counters for the row being built; touched remembers which to reset
+    std::vector<uint32_t> counts(limit, 0);
+    std::vector<uint32_t> touched;
+    size_t entries = 0;
+    for (uint32_t tag = 0; tag < limit; ++tag) {
+        for (uint32_t file : index.filesOf(tag)) {
+            for (uint32_t other : index.tagsOf(file)) {
+                if (other == tag) continue;
+                if (counts[other]++ == 0) touched.push_back(other);
+            }
+        }
+        if (touched.empty()) continue;
+
+        std::sort(touched.begin(), touched.end());
+        auto row = std::make_shared<std::vector<Entry>>();
+        row->reserve(touched.size());
+        for (uint32_t other : touched) {
+            row->push_back({other, counts[other]});
+            counts[other] = 0;
+        }
+        entries += row->size();
+        matrix.rows.mutableAt(tag) = std::move(row);
+        touched.clear();
+    }
+    matrix.pairs = entries / 2;
+    return matrix;
+}
+
+std::span<const TagCooccurrence::Entry> TagCooccurrence::row(uint32_t tag) const {
+    if (tag >= rows.size() || !rows[tag]) return {};
+    return *rows[tag];
+}
+
+uint32_t TagCooccurrence::count(uint32_t a, uint32_t b) const {
+    auto entries = row(a);
+    auto it = std::lower_bound(entries.begin(), entries.end(), b, byTag);
+    return (it != entries.end() && it->tag == b) ? it->count : 0;
+}
+
+void TagCooccurrence::update(uint32_t tag, std::span<const uint32_t> others, int delta) {
+    for (uint32_t other : others) {
+        if (other == tag) continue;
+        add(tag, other, delta);
+        add(other, tag, delta);
+    }
+}
+
+void TagCooccurrence::add(uint32_t tag, uint32_t partner, int delta) {
+    if (tag >= rows.size()) rows.resize(tag + 1);
+    Row& shared = rows.mutableAt(tag);
+    if (!shared) {
+        shared = std::make_shared<std::vector<Entry>>();
+    } else if (!soleOwner(shared)) {
+        shared = std::make_shared<std::vector<Entry>>(*shared);
+    }
+
+    // pairs counts each unordered pair once, on the side with the smaller id
+    auto& entries = *shared;
+    auto it = std::lower_bound(entries.begin(), entries.end(), partner, byTag);
+    if (it != entries.end() && it->tag == partner) {
+        it->count += delta;
+        if (it->count == 0) {
+            entries.erase(it);
+            if (tag < partner) --pairs;
+        }
+    } else if (delta > 0) {
+        entries.insert(it, {partner, static_cast<uint32_t>(delta)});
+        if (tag < partner) ++pairs;
+    }
+}
+
+TagCooccurrence TagCooccurrence::remapped(const std::vector<uint32_t>& idMap, uint32_t tagLimit) const {
+    TagCooccurrence matrix;
+    matrix.rows.resize(tagLimit);
+    rows.forEachStored([&](size_t tag, const Row& entries) {
+        if (!entries || entries->empty() || idMap[tag] == TagIndex::npos) return;
+        auto row = std::make_shared<std::vector<Entry>>();
+        row->reserve(entries->size());
+        for (const Entry& entry : *entries) {
+            if (idMap[entry.tag] != TagIndex::npos) row->push_back({idMap[entry.tag], entry.count});
+        }
+        std::sort(row->begin(), row->end(), [](const Entry& a, const Entry& b) { return a.tag < b.tag; });
+        matrix.pairs += row->size();
+        matrix.rows.mutableAt(idMap[tag]) = std::move(row);
+    });
+    matrix.pairs /= 2;
+    return matrix;
+}
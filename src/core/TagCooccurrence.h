@@ -0,0 +1,45 @@
+#ifndef TAGCOOCCURRENCE_H
+#define TAGCOOCCURRENCE_H
+
+#include "CowVector.h"
+#include <span>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class TagIndex;
+
+// Sparse symmetric tag x tag matrix: how many files carry both tags. Each tag
+// has a row of (partner, count) pairs sorted by partner, holding only non-zero
+// counts, so memory is proportional to the number of co-occurring pairs.
+// Rows are shared between copies like TagIndex posting lists.
+class TagCooccurrence {
+public:
+    struct Entry {
+        uint32_t tag;
+        uint32_t count;
+    };
+
+    // Counts every pair in the index, one row at a time: O(sum of squared tags per file)
+    static TagCooccurrence build(const TagIndex& index);
+
+    std::span<const Entry> row(uint32_t tag) const;
+    uint32_t count(uint32_t a, uint32_t b) const;
+    size_t pairCount() const { return pairs; } // Non-zero unordered pairs
+
+    // tag was attached to (delta = 1) or detached from (delta = -1) a file that
+    // carries others besides it
+    void update(uint32_t tag, std::span<const uint32_t> others, int delta);
+
+    // Same counts under new tag ids; idMap[old] = new, npos for tags that no longer exist
+    TagCooccurrence remapped(const std::vector<uint32_t>& idMap, uint32_t tagLimit) const;
+
+private:
+    using Row = std::shared_ptr<std::vector<Entry>>;
+    void add(uint32_t tag, uint32_t partner, int delta);
+
+    CowVector<Row> rows;
+    size_t pairs = 0;
+};
+
+#endif // TAGCOOCCURRENCE_H
@@ -0,0 +1,381 @@
+#include "TagDatabase.h"
+#include "TagIndex.h"
+#include "TagJournal.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'F', 'T', 'A', 'G', 'D', 'B', '1'};
+constexpr uint32_t kVersion = 2;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t journalSeq;
+    uint32_t fileCount;
+    uint32_t tagCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fileNamesOffset;
+    uint64_t fileOrderOffset;
+    uint64_t fileTagIndexOffset;
+    uint64_t fileTagsOffset;
+    uint64_t tagNamesOffset;
+    uint64_t tagOrderOffset;
+    uint64_t tagFileIndexOffset;
+    uint64_t tagFilesOffset;
+    uint64_t totalSize;
+    // Version 2
+    uint32_t dirCount;
+    uint32_t reserved;
+    uint64_t dirsOffset;
+    uint64_t identitiesOffset;
+};
+// Version 1 headers end at totalSize
+constexpr size_t kHeaderV1Size = offsetof(Header, dirCount);
+
+void align8(std::string& out) {
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+template <typename T>
+uint64_t appendArray(std::string& out, const std::vector<T>& values) {
+    align8(out);
+    uint64_t offset = out.size();
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    return offset;
+}
+
+} // namespace
+
+std::shared_ptr<const TagDatabase> TagDatabase::open(const std::string& path) {
+    std::shared_ptr<TagDatabase> db(new TagDatabase());
+    if (!db->file.open(path)) return nullptr;
+
+    const char* data = db->file.data();
+    size_t size = db->file.size();
+    if (size < kHeaderV1Size) return nullptr;
+
+    Header h{};
+    std::memcpy(&h, data, kHeaderV1Size);
+    bool legacy = h.version == 1;
+    if (!legacy && size >= sizeof(Header)) std::memcpy(&h, data, sizeof(Header));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || (!legacy && h.version != kVersion)
+        || (!legacy && size < sizeof(Header)) || h.byteOrder != kByteOrderMark || h.totalSize != size) {
+        std::cerr << "Ignoring incompatible tag database " << path << std::endl;
+        return nullptr;
+    }
+
+    // Every section must lie inside the file before any pointer is formed
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t width) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / width;
+    };
+    uint64_t fileTagCount = 0;
+    uint64_t tagFileCount = 0;
+    if (!fits(h.stringsOffset, h.stringsSize, 1)
+        || !fits(h.fileNamesOffset, h.fileCount, legacy ? sizeof(NameRef) : sizeof(FileRef))
+        || (!legacy && (!fits(h.dirsOffset, h.dirCount, sizeof(DirRef))
+                        || (h.identitiesOffset && !fits(h.identitiesOffset, h.fileCount, sizeof(FileIdentity)))))
+        || !fits(h.fileOrderOffset, h.fileCount, 4)
+        || !fits(h.fileTagIndexOffset, uint64_t(h.fileCount) + 1, 4)
+        || !fits(h.tagNamesOffset, h.tagCount, sizeof(NameRef))
+        || !fits(h.tagOrderOffset, h.tagCount, 4)
+        || !fits(h.tagFileIndexOffset, uint64_t(h.tagCount) + 1, 4)) {
+        std::cerr << "Corrupt tag database " << path << std::endl;
+        return nullptr;
+    }
+    fileTagCount = reinterpret_cast<const uint32_t*>(data + h.fileTagIndexOffset)[h.fileCount];
+    tagFileCount = reinterpret_cast<const uint32_t*>(data + h.tagFileIndexOffset)[h.tagCount];
+    if (!fits(h.fileTagsOffset, fileTagCount, 4) || !fits(h.tagFilesOffset, tagFileCount, 4)) {
+        std::cerr << "Corrupt tag database " << path << std::endl;
+        return nullptr;
+    }
+
+    db->seq = h.journalSeq;
+    db->nFiles = h.fileCount;
+    db->nTags = h.tagCount;
+    db->strings = data + h.stringsOffset;
+    db->stringsSize = h.stringsSize;
+    if (legacy) {
+        // Flat names become files in the root directory; the name order is unchanged
+        const NameRef* names = reinterpret_cast<const NameRef*>(data + h.fileNamesOffset);
+        db->legacyDirs.push_back({0, {0, 0}});
+        db->legacyFileNames.reserve(h.fileCount);
+        for (uint32_t i = 0; i < h.fileCount; ++i) {
+            db->legacyFileNames.push_back({0, names[i]});
+        }
+        db->nDirs = 1;
+        db->dirs = db->legacyDirs.data();
+        db->fileNames = db->legacyFileNames.data();
+    } else {
+        db->nDirs = h.dirCount;
+        db->dirs = reinterpret_cast<const DirRef*>(data + h.dirsOffset);
+        db->fileNames = reinterpret_cast<const FileRef*>(data + h.fileNamesOffset);
+        if (h.identitiesOffset) {
+            db->identities = reinterpret_cast<const FileIdentity*>(data + h.identitiesOffset);
+        }
+    }
+    db->fileOrder = reinterpret_cast<const uint32_t*>(data + h.fileOrderOffset);
+    db->fileTagIndex = reinterpret_cast<const uint32_t*>(data + h.fileTagIndexOffset);
+    db->fileTags = reinterpret_cast<const uint32_t*>(data + h.fileTagsOffset);
+    db->tagNames = reinterpret_cast<const NameRef*>(data + h.tagNamesOffset);
+    db->tagOrder = reinterpret_cast<const uint32_t*>(data + h.tagOrderOffset);
+    db->tagFileIndex = reinterpret_cast<const uint32_t*>(data + h.tagFileIndexOffset);
+    db->tagFiles = reinterpret_cast<const uint32_t*>(data + h.tagFilesOffset);
+
+    if (!db->validate()) {
+        std::cerr << "Corrupt tag database " << path << std::endl;
+        return nullptr;
+    }
+    return db;
+}
+
+// One linear pass over the id arrays: cheap next to parsing, and it makes every
+// accessor safe to use without further checks
+bool TagDatabase::validate() const {
+    auto validName = [this](const NameRef& ref) {
+        return ref.offset <= stringsSize && ref.length <= stringsSize - ref.offset;
+    };
+    auto validNames = [&validName](const NameRef* names, uint32_t count) {
+        return std::all_of(names, names + count, validName);
+    };
+    // Parents before children also rules out cycles when paths are rebuilt
+    auto validDirs = [this, &validName]() {
+        if (nDirs == 0) return false;
+        for (uint32_t i = 0; i < nDirs; ++i) {
+            if ((i > 0 && dirs[i].parent >= i) || !validName(dirs[i].name)) return false;
+        }
+        return true;
+    };
+    auto validFiles = [this, &validName]() {
+        for (uint32_t i = 0; i < nFiles; ++i) {
+            if (fileNames[i].dir >= nDirs || !validName(fileNames[i].name)) return false;
+        }
+        return true;
+    };
+    auto validCsr = [](const uint32_t* index, uint32_t count, const uint32_t* values, uint32_t limit) {
+        if (index[0] != 0) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (index[i] > index[i + 1]) return false;
+        }
+        for (uint32_t i = 0; i < index[count]; ++i) {
+            if (values[i] >= limit) return false;
+        }
+        return true;
+    };
+    auto validOrder = [](const uint32_t* order, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (order[i] >= count) return false;
+        }
+        return true;
+    };
+
+    return validDirs() && validFiles() && validNames(tagNames, nTags)
+        && validOrder(fileOrder, nFiles) && validOrder(tagOrder, nTags)
+        && validCsr(fileTagIndex, nFiles, fileTags, nTags)
+        && validCsr(tagFileIndex, nTags, tagFiles, nFiles);
+}
+
+void TagDatabase::appendDirPath(uint32_t dir, std::string& out) const {
+    if (dir == 0) return;
+    appendDirPath(dirs[dir].parent, out);
+    out.append(name(dirs[dir].name));
+    out.push_back('/');
+}
+
+std::string TagDatabase::fileName(uint32_t id) const {
+    std::string path;
+    appendDirPath(fileNames[id].dir, path);
+    path.append(name(fileNames[id].name));
+    return path;
+}
+
+uint32_t TagDatabase::findDir(uint32_t parent, std::string_view key) const {
+    const DirRef* begin = dirs + 1;
+    const DirRef* end = dirs + nDirs;
+    const DirRef* it = std::lower_bound(begin, end, key, [this, parent](const DirRef& d, std::string_view k) {
+        return d.parent != parent ? d.parent < parent : name(d.name) < k;
+    });
+    return (it != end && it->parent == parent && name(it->name) == key) ? static_cast<uint32_t>(it - dirs) : npos;
+}
+
+uint32_t TagDatabase::findFile(std::string_view path) const {
+    uint32_t dir = 0;
+    size_t slash;
+    while ((slash = path.find('/')) != std::string_view::npos) {
+        dir = findDir(dir, path.substr(0, slash));
+        if (dir == npos) return npos;
+        path.remove_prefix(slash + 1);
+    }
+
+    const uint32_t* end = fileOrder + nFiles;
+    const uint32_t* it = std::lower_bound(fileOrder, end, path, [this, dir](uint32_t id, std::string_view k) {
+        const FileRef& f = fileNames[id];
+        return f.dir != dir ? f.dir < dir : name(f.name) < k;
+    });
+    return (it != end && fileNames[*it].dir == dir && name(fileNames[*it].name) == path) ? *it : npos;
+}
+
+uint32_t TagDatabase::findTag(std::string_view key) const {
+    const uint32_t* end = tagOrder + nTags;
+    const uint32_t* it = std::lower_bound(tagOrder, end, key, [this](uint32_t id, std::string_view k) {
+        return name(tagNames[id]) < k;
+    });
+    return (it != end && name(tagNames[*it]) == key) ? *it : npos;
+}
+
+bool TagDatabase::write(const std::string& path, const TagIndex& index, uint64_t journalSeq) {
+    // Renumber densely: dropped files and unused tags are left out. Ids are handed
+    // out in ascending old-id order, so posting lists stay sorted.
+    std::vector<uint32_t> fileMap(index.fileIdLimit(), npos);
+    std::vector<uint32_t> tagMap(index.tagIdLimit(), npos);
+    std::vector<uint32_t> liveFiles;
+    std::vector<uint32_t> liveTags;
+    for (uint32_t f = 0; f < index.fileIdLimit(); ++f) {
+        if (!index.tagsOf(f).empty()) {
+            fileMap[f] = static_cast<uint32_t>(liveFiles.size());
+            liveFiles.push_back(f);
+        }
+    }
+    for (uint32_t t = 0; t < index.tagIdLimit(); ++t) {
+        if (!index.filesOf(t).empty()) {
+            tagMap[t] = static_cast<uint32_t>(liveTags.size());
+            liveTags.push_back(t);
+        }
+    }
+
+    std::string strings;
+    auto addName = [&strings](std::string_view name) {
+        NameRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(name.size())};
+        strings.append(name);
+        return ref;
+    };
+    auto nameOf = [&strings](const NameRef& ref) {
+        return std::string_view(strings).substr(ref.offset, ref.length);
+    };
+
+    // Directory tree of the live paths; a std::map keeps each directory's
+    // children sorted by name
+    struct PendingDir {
+        std::map<std::string, uint32_t, std::less<>> children;
+    };
+    std::vector<PendingDir> tree(1);
+    std::vector<std::pair<uint32_t, std::string>> fileParts; // Pending directory + base name
+    fileParts.reserve(liveFiles.size());
+    for (uint32_t f : liveFiles) {
+        std::string path = index.fileName(f);
+        std::string_view rest(path);
+        uint32_t dir = 0;
+        size_t slash;
+        while ((slash = rest.find('/')) != std::string_view::npos) {
+            auto& children = tree[dir].children;
+            auto it = children.find(rest.substr(0, slash));
+            if (it == children.end()) {
+                it = children.emplace(std::string(rest.substr(0, slash)), static_cast<uint32_t>(tree.size())).first;
+                tree.emplace_back();
+            }
+            dir = it->second;
+            rest.remove_prefix(slash + 1);
+        }
+        fileParts.emplace_back(dir, std::string(rest));
+    }
+
+    // Breadth-first numbering yields the (parent, name) order findDir searches
+    std::vector<DirRef> dirRefs{{0, {0, 0}}};
+    std::vector<uint32_t> dirIds(tree.size(), 0);
+    std::vector<uint32_t> queue{0};
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t pending = queue[head];
+        for (const auto& [childName, child] : tree[pending].children) {
+            dirIds[child] = static_cast<uint32_t>(dirRefs.size());
+            dirRefs.push_back({dirIds[pending], addName(childName)});
+            queue.push_back(child);
+        }
+    }
+
+    std::vector<FileRef> fileNameRefs;
+    std::vector<FileIdentity> identities;
+    std::vector<NameRef> tagNameRefs;
+    fileNameRefs.reserve(liveFiles.size());
+    identities.reserve(liveFiles.size());
+    tagNameRefs.reserve(liveTags.size());
+    for (size_t i = 0; i < liveFiles.size(); ++i) {
+        fileNameRefs.push_back({dirIds[fileParts[i].first], addName(fileParts[i].second)});
+        identities.push_back(index.identity(liveFiles[i]));
+    }
+    fileParts = {};
+    for (uint32_t t : liveTags) tagNameRefs.push_back(addName(index.tagName(t)));
+    if (strings.size() > UINT32_MAX) {
+        std::cerr << "Tag database string table too large" << std::endl;
+        return false;
+    }
+
+    auto sequence = [](size_t count) {
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        return order;
+    };
+    std::vector<uint32_t> fileOrder = sequence(fileNameRefs.size());
+    std::sort(fileOrder.begin(), fileOrder.end(), [&](uint32_t a, uint32_t b) {
+        const FileRef& fa = fileNameRefs[a];
+        const FileRef& fb = fileNameRefs[b];
+        return fa.dir != fb.dir ? fa.dir < fb.dir : nameOf(fa.name) < nameOf(fb.name);
+    });
+    std::vector<uint32_t> tagOrder = sequence(tagNameRefs.size());
+    std::sort(tagOrder.begin(), tagOrder.end(), [&](uint32_t a, uint32_t b) {
+        return nameOf(tagNameRefs[a]) < nameOf(tagNameRefs[b]);
+    });
+
+    std::vector<uint32_t> fileTagIndex{0};
+    std::vector<uint32_t> fileTags;
+    for (uint32_t f : liveFiles) {
+        for (uint32_t t : index.tagsOf(f)) fileTags.push_back(tagMap[t]);
+        fileTagIndex.push_back(static_cast<uint32_t>(fileTags.size()));
+    }
+    std::vector<uint32_t> tagFileIndex{0};
+    std::vector<uint32_t> tagFiles;
+    tagFiles.reserve(fileTags.size());
+    for (uint32_t t : liveTags) {
+        for (uint32_t f : index.filesOf(t)) tagFiles.push_back(fileMap[f]);
+        tagFileIndex.push_back(static_cast<uint32_t>(tagFiles.size()));
+    }
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.byteOrder = kByteOrderMark;
+    h.journalSeq = journalSeq;
+    h.fileCount = static_cast<uint32_t>(liveFiles.size());
+    h.tagCount = static_cast<uint32_t>(liveTags.size());
+    h.dirCount = static_cast<uint32_t>(dirRefs.size());
+
+    std::string out(sizeof(Header), '\0');
+    align8(out);
+    h.stringsOffset = out.size();
+    h.stringsSize = strings.size();
+    out += strings;
+    h.dirsOffset = appendArray(out, dirRefs);
+    h.fileNamesOffset = appendArray(out, fileNameRefs);
+    h.fileOrderOffset = appendArray(out, fileOrder);
+    // Left out until some file's identity is known
+    bool anyIdentity = std::any_of(identities.begin(), identities.end(), [](const FileIdentity& i) { return i.known(); });
+    h.identitiesOffset = anyIdentity ? appendArray(out, identities) : 0;
+    h.fileTagIndexOffset = appendArray(out, fileTagIndex);
+    h.fileTagsOffset = appendArray(out, fileTags);
+    h.tagNamesOffset = appendArray(out, tagNameRefs);
+    h.tagOrderOffset = appendArray(out, tagOrder);
+    h.tagFileIndexOffset = appendArray(out, tagFileIndex);
+    h.tagFilesOffset = appendArray(out, tagFiles);
+    align8(out);
+    h.totalSize = out.size();
+    std::memcpy(out.data(), &h, sizeof(Header));
+
+    return TagJournal::replaceFile(path, out);
+}
@@ -0,0 +1,114 @@
+#ifndef TAGDATABASE_H
+#define TAGDATABASE_H
+
+#include "MappedFile.h"
+#include <string>
+#include <string_view>
+#include <span>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+class TagIndex;
+
+// Secondary identity of a file, used to follow it across renames and moves
+// made outside the app. Zero when unknown.
+struct FileIdentity {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+
+    bool known() const { return device != 0 || inode != 0; }
+    bool operator==(const FileIdentity&) const = default;
+};
+
+// Immutable, memory-mapped tag snapshot. Layout (all sections 8-byte aligned,
+// native little-endian):
+//   Header
+//   string table   directory names, file base names and tag names, back to back
+//   directories    DirRef[dirCount]   0 is the library root; children sorted by
+//                                     (parent, name), parents before children
+//   file names     FileRef[fileCount] directory + base name of the relative path
+//   file order     u32[fileCount]     file ids sorted by (directory, name)
+//   identities     FileIdentity[fileCount], absent (offset 0) if none is known
+//   file tag index u32[fileCount + 1] CSR offsets into file tags
+//   file tags      u32[...]           tag ids, in the order they were added
+//   tag names      NameRef[tagCount]
+//   tag order      u32[tagCount]      tag ids sorted by name
+//   tag file index u32[tagCount + 1]  CSR offsets into tag files
+//   tag files      u32[...]           file ids, ascending
+// Paths share their directories, so deep trees do not repeat long prefixes.
+// Version 1 files (flat names, no directories or identities) are still read.
+// Opening only validates the layout; pages are read on demand.
+class TagDatabase {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // nullptr if the file is missing or malformed
+    static std::shared_ptr<const TagDatabase> open(const std::string& path);
+    // Writes the live files and tags of index, renumbered densely
+    static bool write(const std::string& path, const TagIndex& index, uint64_t journalSeq);
+
+    uint64_t journalSeq() const { return seq; }
+    uint32_t fileCount() const { return nFiles; }
+    uint32_t tagCount() const { return nTags; }
+    size_t byteSize() const { return file.size(); }
+
+    std::string fileName(uint32_t id) const; // Relative path, '/'-separated
+    FileIdentity identity(uint32_t id) const { return identities ? identities[id] : FileIdentity{}; }
+    std::string_view tagName(uint32_t id) const { return name(tagNames[id]); }
+    std::span<const uint32_t> tagsOf(uint32_t fileId) const {
+        return {fileTags + fileTagIndex[fileId], fileTags + fileTagIndex[fileId + 1]};
+    }
+    std::span<const uint32_t> filesOf(uint32_t tagId) const {
+        return {tagFiles + tagFileIndex[tagId], tagFiles + tagFileIndex[tagId + 1]};
+    }
+
+    uint32_t findFile(std::string_view path) const; // Walks the directories, then binary search
+    uint32_t findTag(std::string_view name) const;
+
+private:
+    struct NameRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+    struct DirRef {
+        uint32_t parent;
+        NameRef name;
+    };
+    struct FileRef {
+        uint32_t dir;
+        NameRef name;
+    };
+
+    TagDatabase() = default;
+    bool validate() const;
+    std::string_view name(const NameRef& ref) const { return {strings + ref.offset, ref.length}; }
+    uint32_t findDir(uint32_t parent, std::string_view name) const;
+    void appendDirPath(uint32_t dir, std::string& out) const;
+
+    MappedFile file;
+    uint64_t seq = 0;
+    uint32_t nDirs = 0;
+    uint32_t nFiles = 0;
+    uint32_t nTags = 0;
+    const char* strings = nullptr;
+    uint64_t stringsSize = 0;
+    const DirRef* dirs = nullptr;
+    const FileRef* fileNames = nullptr;
+    const FileIdentity* identities = nullptr; // nullptr for version 1
+    const uint32_t* fileOrder = nullptr;
+    const uint32_t* fileTagIndex = nullptr;
+    const uint32_t* fileTags = nullptr;
+    const NameRef* tagNames = nullptr;
+    const uint32_t* tagOrder = nullptr;
+    const uint32_t* tagFileIndex = nullptr;
+    const uint32_t* tagFiles = nullptr;
+
+    // Version 1 names converted to the current layout
+    std::vector<DirRef> legacyDirs;
+    std::vector<FileRef> legacyFileNames;
+};
+
+#endif // TAGDATABASE_H
@@ -0,0 +1,235 @@
+#include "TagIndex.h"
+#include <algorithm>
+
+std::atomic<uint64_t> TagIndex::nextRevision{1};
+
+TagIndex::TagIndex(std::shared_ptr<const TagDatabase> database)
+    : base(std::move(database)) {
+    if (base) {
+        baseFiles = base->fileCount();
+        baseTags = base->tagCount();
+        // The writer only stores files that have tags
+        liveFiles = baseFiles;
+    }
+    fileNames.resize(baseFiles);
+    identities.resize(baseFiles);
+    fileTags.resize(baseFiles);
+    tagFiles.resize(baseTags);
+    tagRevisions.resize(baseTags);
+}
+
+uint32_t TagIndex::findFile(const std::string& name) const {
+    if (const uint32_t* id = fileIds.find(name)) return *id;
+
+    if (base) {
+        uint32_t id = base->findFile(name);
+        // A renamed or dropped base file no longer answers to its stored name
+        if (id != npos && !fileNames[id]) return id;
+    }
+    return npos;
+}
+
+uint32_t TagIndex::findTag(const std::string& name) const {
+    if (const uint32_t* id = tagIds.find(name)) return *id;
+    return base ? base->findTag(name) : npos;
+}
+
+std::string TagIndex::fileName(uint32_t file) const {
+    const auto& name = fileNames[file];
+    return name ? *name : base->fileName(file);
+}
+
+FileIdentity TagIndex::identity(uint32_t file) const {
+    const auto& stored = identities[file];
+    if (stored) return *stored;
+    return file < baseFiles ? base->identity(file) : FileIdentity{};
+}
+
+std::string_view TagIndex::tagName(uint32_t tag) const {
+    return tag >= baseTags ? std::string_view(extraTagNames[tag - baseTags]) : base->tagName(tag);
+}
+
+std::span<const uint32_t> TagIndex::tagsOf(uint32_t file) const {
+    const auto& tags = fileTags[file];
+    if (tags) return *tags;
+    return file < baseFiles ? base->tagsOf(file) : std::span<const uint32_t>();
+}
+
+std::span<const uint32_t> TagIndex::filesOf(uint32_t tag) const {
+    const auto& files = tagFiles[tag];
+    if (files) return *files;
+    return tag < baseTags ? base->filesOf(tag) : std::span<const uint32_t>();
+}
+
+bool TagIndex::hasTag(uint32_t file, uint32_t tag) const {
+    auto files = filesOf(tag);
+    return std::binary_search(files.begin(), files.end(), file);
+}
+
+const std::vector<uint32_t>& TagIndex::sortedTags() const {
+    if (!sortedTagCache) {
+        auto sorted = std::make_shared<std::vector<uint32_t>>();
+        for (uint32_t tag = 0; tag < tagIdLimit(); ++tag) {
+            if (!filesOf(tag).empty()) sorted->push_back(tag);
+        }
+        std::sort(sorted->begin(), sorted->end(), [this](uint32_t a, uint32_t b) {
+            return tagName(a) < tagName(b);
+        });
+        sortedTagCache = std::move(sorted);
+    }
+    return *sortedTagCache;
+}
+
+RoaringBitmap TagIndex::liveFileSet() const {
+    // Base files are all tagged unless the overlay cleared them
+    RoaringBitmap live = RoaringBitmap::range(0, baseFiles);
+    fileTags.forEachStored([&live, this](size_t file, const List& tags) {
+        if (!tags) return;
+        if (tags->empty() && file < baseFiles) live.remove(static_cast<uint32_t>(file));
+        if (!tags->empty() && file >= baseFiles) live.add(static_cast<uint32_t>(file));
+    });
+    return live;
+}
+
+uint32_t TagIndex::internFile(const std::string& name) {
+    uint32_t id = findFile(name);
+    if (id != npos) return id;
+
+    id = fileIdLimit();
+    fileNames.push_back(name);
+    identities.push_back(FileIdentity{});
+    fileTags.push_back(std::make_shared<std::vector<uint32_t>>());
+    fileIds.set(name, id);
+    return id;
+}
+
+uint32_t TagIndex::internTag(const std::string& name) {
+    uint32_t id = findTag(name);
+    if (id != npos) return id;
+
+    id = tagIdLimit();
+    extraTagNames.push_back(name);
+    tagFiles.push_back(std::make_shared<std::vector<uint32_t>>());
+    tagRevisions.push_back(0);
+    tagIds.set(name, id);
+    return id;
+}
+
+std::vector<uint32_t>& TagIndex::writable(List& list, std::span<const uint32_t> stored) {
+    if (!list) {
+        list = std::make_shared<std::vector<uint32_t>>(stored.begin(), stored.end());
+    } else if (!soleOwner(list)) {
+        list = std::make_shared<std::vector<uint32_t>>(*list);
+    }
+    return *list;
+}
+
+std::vector<uint32_t>& TagIndex::mutableTagsOf(uint32_t file) {
+    auto& tags = fileTags.mutableAt(file);
+    return writable(tags, tags ? std::span<const uint32_t>() : base->tagsOf(file));
+}
+
+std::vector<uint32_t>& TagIndex::mutableFilesOf(uint32_t tag) {
+    auto& files = tagFiles.mutableAt(tag);
+    return writable(files, files ? std::span<const uint32_t>() : base->filesOf(tag));
+}
+
+bool TagIndex::attach(uint32_t file, uint32_t tag) {
+    auto current = tagsOf(file);
+    if (std::find(current.begin(), current.end(), tag) != current.end()) return false;
+    if (pairs) pairs->update(tag, current, 1);
+
+    auto& files = mutableFilesOf(tag);
+    files.insert(std::lower_bound(files.begin(), files.end(), file), file);
+    if (files.size() == 1) sortedTagCache.reset();
+    tagRevisions.mutableAt(tag) = currentRevision = nextRevision++;
+
+    auto& tags = mutableTagsOf(file);
+    if (tags.empty()) ++liveFiles;
+    tags.push_back(tag);
+    return true;
+}
+
+bool TagIndex::detach(uint32_t file, uint32_t tag) {
+    auto current = tagsOf(file);
+    if (std::find(current.begin(), current.end(), tag) == current.end()) return false;
+
+    auto& tags = mutableTagsOf(file);
+    tags.erase(std::find(tags.begin(), tags.end(), tag));
+    if (tags.empty()) --liveFiles;
+    if (pairs) pairs->update(tag, tags, -1);
+
+    auto& files = mutableFilesOf(tag);
+    auto pos = std::lower_bound(files.begin(), files.end(), file);
+    if (pos != files.end() && *pos == file) files.erase(pos);
+    if (files.empty()) sortedTagCache.reset();
+    tagRevisions.mutableAt(tag) = currentRevision = nextRevision++;
+    return true;
+}
+
+bool TagIndex::setTags(uint32_t file, std::vector<uint32_t> tags) {
+    std::vector<uint32_t> wanted;
+    wanted.reserve(tags.size());
+    for (uint32_t t : tags) {
+        if (std::find(wanted.begin(), wanted.end(), t) == wanted.end()) wanted.push_back(t);
+    }
+
+    auto current = tagsOf(file);
+    if (std::equal(current.begin(), current.end(), wanted.begin(), wanted.end())) return false;
+
+    // Only the difference touches the posting lists; the forward list is then
+    // replaced so the caller's order is kept
+    std::vector<uint32_t> old(current.begin(), current.end());
+    for (uint32_t t : old) {
+        if (std::find(wanted.begin(), wanted.end(), t) == wanted.end()) detach(file, t);
+    }
+    for (uint32_t t : wanted) {
+        attach(file, t);
+    }
+    mutableTagsOf(file) = std::move(wanted);
+    return true;
+}
+
+void TagIndex::dropFile(uint32_t file) {
+    auto current = tagsOf(file);
+    std::vector<uint32_t> tags(current.begin(), current.end());
+    for (uint32_t t : tags) {
+        detach(file, t);
+    }
+
+    fileIds.erase(fileName(file));
+    fileNames.mutableAt(file) = std::string();
+    identities.mutableAt(file) = FileIdentity{};
+}
+
+bool TagIndex::setIdentity(uint32_t file, const FileIdentity& value) {
+    if (identity(file) == value) return false;
+    identities.mutableAt(file) = value;
+    return true;
+}
+
+bool TagIndex::renameFile(uint32_t file, const std::string& newName) {
+    if (fileName(file) == newName) return false;
+
+    uint32_t existing = findFile(newName);
+    if (existing != npos) dropFile(existing);
+
+    // The id stays, so the posting lists need no update
+    fileIds.erase(fileName(file));
+    fileIds.set(newName, file);
+    fileNames.mutableAt(file) = newName;
+    return true;
+}
+
+void TagIndex::buildCooccurrence() {
+    pairs = TagCooccurrence::build(*this);
+}
+
+void TagIndex::adoptCooccurrence(const TagIndex& other) {
+    if (!other.pairs) return;
+    std::vector<uint32_t> idMap(other.tagIdLimit(), npos);
+    for (uint32_t tag : other.sortedTags()) {
+        idMap[tag] = findTag(std::string(other.tagName(tag)));
+    }
+    pairs = other.pairs->remapped(idMap, tagIdLimit());
+}
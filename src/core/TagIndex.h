@@ -0,0 +1,101 @@
+#ifndef TAGINDEX_H
+#define TAGINDEX_H
+
+#include "TagDatabase.h"
+#include "RoaringBitmap.h"
+#include "CowVector.h"
+#include "TagCooccurrence.h"
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <cstdint>
+
+// Forward (file -> tags) and inverted (tag -> files) index over interned ids.
+// Ids below the base counts belong to the mapped TagDatabase; mutations go to
+// an overlay that copies a base list the first time it is changed, so opening
+// a large library costs nothing until it is edited. Dropped files and unused
+// tags keep their id with an empty list until the next compaction.
+// The overlay lives in CowVector chunks, so a copy is cheap and shares all
+// unchanged data: TagManager publishes copies as immutable snapshots.
+class TagIndex {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    explicit TagIndex(std::shared_ptr<const TagDatabase> base = nullptr);
+
+    const std::shared_ptr<const TagDatabase>& database() const { return base; }
+    uint32_t fileIdLimit() const { return static_cast<uint32_t>(fileNames.size()); }
+    uint32_t tagIdLimit() const { return baseTags + static_cast<uint32_t>(extraTagNames.size()); }
+    size_t liveFileCount() const { return liveFiles; }
+
+    uint32_t findFile(const std::string& name) const;
+    uint32_t findTag(const std::string& name) const;
+    std::string fileName(uint32_t file) const; // Library-relative path
+    FileIdentity identity(uint32_t file) const;
+    std::string_view tagName(uint32_t tag) const;
+    std::span<const uint32_t> tagsOf(uint32_t file) const;  // In the order they were added
+    std::span<const uint32_t> filesOf(uint32_t tag) const;  // Ascending
+    bool hasTag(uint32_t file, uint32_t tag) const;
+    const std::vector<uint32_t>& sortedTags() const;        // Tags in use, by name
+    RoaringBitmap liveFileSet() const;                      // Files with at least one tag
+
+    // Bumped by every posting list change, so caches of derived data (query
+    // bitmaps) can tell whether a tag is still current. Revisions are unique
+    // across all indexes in the process, so equal revisions mean equal lists.
+    uint64_t revision() const { return currentRevision; }
+    uint64_t tagRevision(uint32_t tag) const { return tagRevisions[tag]; }
+
+    // Co-occurrence counts, maintained by every mutation once built; null until then
+    const TagCooccurrence* cooccurrence() const { return pairs ? &*pairs : nullptr; }
+    void buildCooccurrence();
+    // Takes over the counts of an index with the same content but other tag ids,
+    // e.g. the one a compaction replaced
+    void adoptCooccurrence(const TagIndex& other);
+
+    // Builds the lazily computed data (sortedTags) so the index can be shared
+    // as const between threads
+    void seal() const { sortedTags(); }
+
+    uint32_t internFile(const std::string& name);
+    uint32_t internTag(const std::string& name);
+    bool attach(uint32_t file, uint32_t tag);
+    bool detach(uint32_t file, uint32_t tag);
+    bool setTags(uint32_t file, std::vector<uint32_t> tags); // Keeps the given order
+    void dropFile(uint32_t file);
+    bool setIdentity(uint32_t file, const FileIdentity& identity);
+    bool renameFile(uint32_t file, const std::string& newName); // Replaces a file already named newName
+
+private:
+    // Lists are shared between copies as well; a shared one is copied before writing
+    using List = std::shared_ptr<std::vector<uint32_t>>;
+    static std::vector<uint32_t>& writable(List& list, std::span<const uint32_t> stored);
+    std::vector<uint32_t>& mutableTagsOf(uint32_t file);
+    std::vector<uint32_t>& mutableFilesOf(uint32_t tag);
+
+    std::shared_ptr<const TagDatabase> base;
+    uint32_t baseFiles = 0;
+    uint32_t baseTags = 0;
+
+    CowVector<std::optional<std::string>> fileNames; // Set for renamed ("" = dropped) and new files
+    CowVector<std::string> extraTagNames;            // Ids from baseTags on
+    CowVector<std::optional<FileIdentity>> identities; // Changed or new identities
+    CowStringMap<uint32_t> fileIds;                  // Names not found in the base
+    CowStringMap<uint32_t> tagIds;
+
+    CowVector<List> fileTags; // Changed or new lists; null = as in the base
+    CowVector<List> tagFiles;
+    CowVector<uint64_t> tagRevisions;                         // 0 = as in the base
+    size_t liveFiles = 0;
+    uint64_t currentRevision = 0;
+    static std::atomic<uint64_t> nextRevision;
+    std::optional<TagCooccurrence> pairs;
+
+    // Rebuilt only when a tag appears or disappears; shared by copies until then
+    mutable std::shared_ptr<const std::vector<uint32_t>> sortedTagCache;
+};
+
+#endif // TAGINDEX_H
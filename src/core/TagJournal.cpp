@@ -0,0 +1,314 @@
+#include "TagJournal.h"
+#include "miniz.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t kMaxRecordSize = 64u << 20; // Anything larger is treated as corruption
+
+void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+void putU64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+uint32_t getU32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint64_t getU64(const unsigned char* p) {
+    return uint64_t(getU32(p)) | (uint64_t(getU32(p + 4)) << 32);
+}
+
+uint32_t checksum(const unsigned char* data, size_t size) {
+    return static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, data, size));
+}
+
+bool syncFile(std::FILE* f) {
+    if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Makes a rename in dir durable. Windows has no directory handles for this;
+// MoveFileEx there is already journaled by NTFS.
+void syncDirectory(const fs::path& dir) {
+#ifndef _WIN32
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)dir;
+#endif
+}
+
+std::string encode(const TagJournal::Record& record) {
+    std::string payload;
+    putU64(payload, record.seq);
+    payload.push_back(static_cast<char>(record.op));
+    putU32(payload, static_cast<uint32_t>(record.args.size()));
+    for (const auto& arg : record.args) {
+        putU32(payload, static_cast<uint32_t>(arg.size()));
+        payload += arg;
+    }
+
+    std::string frame;
+    frame.reserve(payload.size() + 8);
+    putU32(frame, static_cast<uint32_t>(payload.size()));
+    putU32(frame, checksum(reinterpret_cast<const unsigned char*>(payload.data()), payload.size()));
+    frame += payload;
+    return frame;
+}
+
+bool decode(const unsigned char* p, size_t size, TagJournal::Record& record) {
+    if (size < 13) return false;
+    record.seq = getU64(p);
+    record.op = static_cast<TagJournal::Op>(p[8]);
+    uint32_t count = getU32(p + 9);
+    size_t pos = 13;
+
+    record.args.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (pos + 4 > size) return false;
+        uint32_t len = getU32(p + pos);
+        pos += 4;
+        if (len > size - pos) return false;
+        record.args.emplace_back(reinterpret_cast<const char*>(p + pos), len);
+        pos += len;
+    }
+    return pos == size;
+}
+
+} // namespace
+
+TagJournal::ReplayResult TagJournal::replay(const std::string& path, uint64_t afterSeq,
+                                            const std::function<void(const Record&)>& apply) {
+    ReplayResult result;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return result;
+
+    unsigned char header[8];
+    std::vector<unsigned char> payload;
+    Record record;
+    while (in.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        uint32_t size = getU32(header);
+        uint32_t crc = getU32(header + 4);
+        if (size > kMaxRecordSize) {
+            result.torn = true;
+            break;
+        }
+        payload.resize(size);
+        if (!in.read(reinterpret_cast<char*>(payload.data()), size)
+            || checksum(payload.data(), size) != crc
+            || !decode(payload.data(), size, record)) {
+            result.torn = true;
+            break;
+        }
+
+        result.validBytes += sizeof(header) + size;
+        result.lastSeq = std::max(result.lastSeq, record.seq);
+        if (record.seq > afterSeq) {
+            apply(record);
+            ++result.applied;
+        }
+    }
+    // A partial header at the end is a torn write as well
+    if (!result.torn && in.gcount() > 0) result.torn = true;
+
+    if (result.torn) {
+        std::cerr << "Journal " << path << ": ignoring damaged tail after byte "
+                  << result.validBytes << std::endl;
+    }
+    return result;
+}
+
+bool TagJournal::replaceFile(const std::string& target, const std::string& data) {
+    fs::path finalPath(target);
+    fs::path tmpPath = finalPath;
+    tmpPath += ".tmp";
+
+    std::FILE* f = std::fopen(tmpPath.string().c_str(), "wb");
+    if (!f) {
+        std::cerr << "Error writing " << tmpPath.string() << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size() && syncFile(f);
+    std::fclose(f);
+
+    std::error_code ec;
+    if (ok) fs::rename(tmpPath, finalPath, ec);
+    if (!ok || ec) {
+        std::cerr << "Error replacing " << target << ": " << ec.message() << std::endl;
+        fs::remove(tmpPath, ec);
+        return false;
+    }
+    syncDirectory(finalPath.parent_path());
+    return true;
+}
+
+TagJournal::TagJournal(std::chrono::milliseconds flushInterval)
+    : flushInterval(flushInterval) {
+}
+
+TagJournal::~TagJournal() {
+    close();
+}
+
+bool TagJournal::open(const std::string& journalPath, uint64_t validBytes, uint64_t firstSeq) {
+    close();
+
+    std::error_code ec;
+    if (fs::exists(journalPath, ec) && fs::file_size(journalPath, ec) > validBytes) {
+        fs::resize_file(journalPath, validBytes, ec);
+        if (ec) {
+            std::cerr << "Error truncating journal: " << ec.message() << std::endl;
+            return false;
+        }
+    }
+
+    std::FILE* f = std::fopen(journalPath.c_str(), "ab");
+    if (!f) {
+        std::cerr << "Error opening journal " << journalPath << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        std::lock_guard<std::mutex> lock(mutex);
+        path = journalPath;
+        file = f;
+        nextSeq = firstSeq;
+        records = 0;
+        pending.clear();
+        stopping = false;
+    }
+    flusher = std::thread(&TagJournal::flusherLoop, this);
+    return true;
+}
+
+void TagJournal::close() {
+    if (flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        flusher.join();
+    }
+
+    std::lock_guard<std::mutex> ioLock(ioMutex);
+    if (file) {
+        writePending();
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+uint64_t TagJournal::append(Record record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    record.seq = nextSeq++;
+    pending += encode(record);
+    ++records;
+    wakeup.notify_one();
+    return record.seq;
+}
+
+uint64_t TagJournal::append(std::vector<Record> batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& record : batch) {
+        record.seq = nextSeq++;
+        pending += encode(record);
+    }
+    records += batch.size();
+    if (!batch.empty()) wakeup.notify_one();
+    return nextSeq - 1;
+}
+
+void TagJournal::flush() {
+    std::lock_guard<std::mutex> ioLock(ioMutex);
+    writePending();
+}
+
+// Caller holds ioMutex
+void TagJournal::writePending() {
+    std::string data;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        data.swap(pending);
+    }
+    if (data.empty() || !file) return;
+
+    if (std::fwrite(data.data(), 1, data.size(), file) != data.size() || !syncFile(file)) {
+        std::cerr << "Error writing journal " << path << std::endl;
+    }
+}
+
+void TagJournal::flusherLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        wakeup.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (stopping) break;
+
+        // Group commit: let further records arrive before paying for the sync
+        wakeup.wait_for(lock, flushInterval, [this] { return stopping; });
+
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+bool TagJournal::rotate(const std::string& rotatedPath) {
+    std::lock_guard<std::mutex> ioLock(ioMutex);
+    if (!file) return false;
+
+    writePending();
+    std::fclose(file);
+    file = nullptr;
+
+    std::error_code ec;
+    fs::rename(path, rotatedPath, ec);
+    if (ec) {
+        std::cerr << "Error rotating journal: " << ec.message() << std::endl;
+    }
+    syncDirectory(fs::path(path).parent_path());
+
+    // On a failed rename this keeps appending to the old file, which replay still reads
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        std::cerr << "Error reopening journal " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    records = 0;
+    return !ec;
+}
+
+uint64_t TagJournal::lastSeq() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextSeq - 1;
+}
+
+size_t TagJournal::recordCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return records;
+}
@@ -0,0 +1,93 @@
+#ifndef TAGJOURNAL_H
+#define TAGJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// Write-ahead log of tag mutations. Each record is framed as
+//   [u32 payload size][u32 crc32 of payload][payload]
+// with payload = u64 sequence, u8 op, u32 argument count, then per argument
+// u32 size + bytes. Appends are buffered and written + fsynced by a flusher
+// thread, so a burst of mutations shares one sync.
+class TagJournal {
+public:
+    enum class Op : uint8_t {
+        AddTag = 1,     // file, tag
+        RemoveTag = 2,  // file, tag
+        DeleteTag = 3,  // tag
+        SetTags = 4,    // file, tags...
+        RenameFile = 5, // old file, new file
+        RemoveFile = 6, // file
+        SetIdentity = 7 // file, packed FileIdentity
+    };
+
+    struct Record {
+        Op op;
+        std::vector<std::string> args;
+        uint64_t seq = 0;
+    };
+
+    struct ReplayResult {
+        uint64_t lastSeq = 0;  // Highest sequence seen, applied or not
+        uint64_t validBytes = 0; // Offset just past the last intact record
+        size_t applied = 0;
+        bool torn = false;     // Stopped at a truncated or corrupt record
+    };
+
+    // Reads records in order and calls apply for those with seq > afterSeq.
+    // Stops at the first record that is incomplete or fails its checksum.
+    static ReplayResult replay(const std::string& path, uint64_t afterSeq,
+                               const std::function<void(const Record&)>& apply);
+
+    // Writes data to target via a synced temporary file and a rename, so target
+    // holds either the old or the new contents after a crash
+    static bool replaceFile(const std::string& target, const std::string& data);
+
+    explicit TagJournal(std::chrono::milliseconds flushInterval = std::chrono::milliseconds(50));
+    ~TagJournal();
+
+    // Opens path for appending after validBytes (a torn tail is cut off);
+    // the next record gets sequence nextSeq
+    bool open(const std::string& path, uint64_t validBytes, uint64_t nextSeq);
+    void close(); // Flushes and syncs pending records
+    bool isOpen() const { return file != nullptr; }
+
+    uint64_t append(Record record); // Returns the assigned sequence
+    // Queues the records together, so the flusher never writes part of them;
+    // returns the last assigned sequence
+    uint64_t append(std::vector<Record> batch);
+    void flush();                   // Writes and syncs everything appended so far
+
+    // Moves the current log to rotatedPath and continues in a fresh file
+    bool rotate(const std::string& rotatedPath);
+
+    uint64_t lastSeq() const;
+    size_t recordCount() const; // Records appended since open or the last rotate
+
+private:
+    void flusherLoop();
+    void writePending();
+
+    std::string path;
+    std::FILE* file = nullptr;
+    std::chrono::milliseconds flushInterval;
+
+    mutable std::mutex mutex;     // Guards the fields below
+    std::condition_variable wakeup;
+    std::string pending;          // Encoded records not yet written
+    uint64_t nextSeq = 1;
+    size_t records = 0;
+    bool stopping = false;
+
+    std::mutex ioMutex;           // Serializes writes, syncs and rotation
+    std::thread flusher;
+};
+
+#endif // TAGJOURNAL_H
@@ -2,39 +2,220 @@
 #include <fstream>
 #include <filesystem>
 #include <iostream>
-#include <set>
+#include <algorithm>
+
+#include <cstring>
+#include <unordered_map>
+#include <cmath>
+#include <limits>
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/stat.h>
 #endif
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Accepts the flat {"file": [tags]} format and the versioned
+// {"version": 2, "journalSeq": n, "files": {...}} snapshot
+template <typename Fn>
+void forEachJsonFile(const nlohmann::json& json, Fn&& fn) {
+    const nlohmann::json* files = &json;
+    if (json.is_object() && json.contains("version") && json["version"].is_number()) {
+        if (!json.contains("files")) return;
+        files = &json["files"];
+    }
+    if (!files->is_object()) return;
+
+    for (auto& element : files->items()) {
+        if (!element.value().is_array()) continue;
+        std::vector<std::string> tags;
+        for (const auto& t : element.value()) {
+            if (t.is_string()) tags.push_back(t.get<std::string>());
+        }
+        fn(element.key(), std::move(tags));
+    }
+}
+
+// tags-<seq>.db; returns false for anything else in .smartfile
+bool parseDatabaseName(const std::string& name, uint64_t& seq) {
+    const std::string prefix = "tags-";
+    const std::string suffix = ".db";
+    if (name.size() <= prefix.size() + suffix.size()
+        || name.compare(0, prefix.size(), prefix) != 0
+        || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+    std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) return false;
+    try {
+        seq = std::stoull(digits);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool readIdentity(const std::string& path, FileIdentity& identity) {
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    bool ok = GetFileInformationByHandle(h, &info) != 0;
+    CloseHandle(h);
+    if (!ok) return false;
+    identity.device = info.dwVolumeSerialNumber;
+    identity.inode = (uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    identity.size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity.mtime = int64_t((uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    identity.device = static_cast<uint64_t>(st.st_dev);
+    identity.inode = static_cast<uint64_t>(st.st_ino);
+    identity.size = static_cast<uint64_t>(st.st_size);
+    identity.mtime = static_cast<int64_t>(st.st_mtime);
+#endif
+    return true;
+}
+
+std::string packIdentity(const FileIdentity& identity) {
+    std::string packed(sizeof(FileIdentity), '\0');
+    std::memcpy(packed.data(), &identity, sizeof(FileIdentity));
+    return packed;
+}
+
+bool unpackIdentity(const std::string& packed, FileIdentity& identity) {
+    if (packed.size() != sizeof(FileIdentity)) return false;
+    std::memcpy(&identity, packed.data(), sizeof(FileIdentity));
+    return true;
+}
+
+struct InodeKey {
+    uint64_t device;
+    uint64_t inode;
+    bool operator==(const InodeKey&) const = default;
+};
+
+struct InodeKeyHash {
+    size_t operator()(const InodeKey& k) const {
+        return std::hash<uint64_t>{}(k.device * 0x9E3779B97F4A7C15ULL ^ k.inode);
+    }
+};
+
+// Co-occurrence scores of b relative to a; count = files carrying both
+TagManager::RelatedTag scorePair(const TagIndex& view, uint32_t a, uint32_t b, size_t count) {
+    TagManager::RelatedTag related;
+    related.tag = std::string(view.tagName(b));
+    related.count = count;
+    double files = static_cast<double>(view.liveFileCount());
+    double countA = static_cast<double>(view.filesOf(a).size());
+    double countB = static_cast<double>(view.filesOf(b).size());
+    double both = static_cast<double>(count);
+    if (countA + countB - both > 0) related.jaccard = both / (countA + countB - both);
+    related.pmi = count ? std::log2(both * files / (countA * countB))
+                        : -std::numeric_limits<double>::infinity();
+    return related;
+}
+
+} // namespace
+
 TagManager::TagManager() {
-    metadata = nlohmann::json::object();
+    publishSnapshot();
+}
+
+TagManager::~TagManager() {
+    journal.close();
+    if (compactor.joinable()) compactor.join();
 }
 
-void TagManager::loadTags(const std::string& directory) {
+void TagManager::loadTags(const std::string& directory, bool readOnly) {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    journal.close();
+    if (compactor.joinable()) compactor.join();
+    {
+        std::lock_guard<std::mutex> lock(compactedMutex);
+        compacted.reset();
+    }
+
     currentDirectory = directory;
+    this->readOnly = readOnly;
     metadataFile = getMetadataPath();
-    metadata.clear();
+    index = TagIndex();
+    {
+        std::lock_guard<std::mutex> lock(queryMutex);
+        queryEngine.clear();
+    }
+    lastSeq = 0;
+    journalValidBytes = 0;
+    replayedRecords = 0;
+    unjournaled.clear();
+    changedFiles.clear();
+    changedTags.clear();
 
-    if (fs::exists(metadataFile)) {
-        try {
-            std::ifstream f(metadataFile);
-            metadata = nlohmann::json::parse(f);
-        } catch (const std::exception& e) {
-            std::cerr << "Error loading metadata: " << e.what() << std::endl;
-            metadata = nlohmann::json::object();
-        }
-    } else {
-        metadata = nlohmann::json::object();
+    uint64_t snapshotSeq = 0;
+    bool imported = false;
+    if (auto db = openNewestDatabase()) {
+        index = TagIndex(db);
+        snapshotSeq = db->journalSeq();
+    } else if (fs::exists(metadataFile)) {
+        imported = importLegacyJson(snapshotSeq);
     }
+
+    // A rotated journal is left behind when compaction did not finish
+    auto replay = [this](const TagJournal::Record& record) { apply(index, record); };
+    auto rotated = TagJournal::replay(getRotatedJournalPath(), snapshotSeq, replay);
+    auto current = TagJournal::replay(getJournalPath(), snapshotSeq, replay);
+
+    journalValidBytes = current.validBytes;
+    replayedRecords = rotated.applied + current.applied;
+    lastSeq = std::max({snapshotSeq, rotated.lastSeq, current.lastSeq});
+    publishSnapshot();
+
+    // Convert a JSON library once so later opens can map it
+    if (imported && !readOnly) compact();
 }
 
-void TagManager::saveTags() {
-    if (currentDirectory.empty()) return;
+std::shared_ptr<const TagDatabase> TagManager::openNewestDatabase() const {
+    std::vector<uint64_t> generations;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(currentDirectory + "/.smartfile", ec)) {
+        uint64_t seq = 0;
+        if (parseDatabaseName(entry.path().filename().string(), seq)) generations.push_back(seq);
+    }
+    std::sort(generations.rbegin(), generations.rend());
+
+    // Fall back to an older generation if the newest one is damaged
+    for (uint64_t seq : generations) {
+        if (auto db = TagDatabase::open(getDatabasePath(seq))) return db;
+    }
+    return nullptr;
+}
+
+bool TagManager::importLegacyJson(uint64_t& snapshotSeq) {
+    try {
+        std::ifstream f(metadataFile);
+        nlohmann::json json = nlohmann::json::parse(f);
+        if (json.is_object() && json.contains("version")) {
+            snapshotSeq = json.value("journalSeq", uint64_t(0));
+        }
+        forEachJsonFile(json, [this](const std::string& file, std::vector<std::string> tags) {
+            tags.insert(tags.begin(), file);
+            apply(index, {TagJournal::Op::SetTags, std::move(tags)});
+        });
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading metadata: " << e.what() << std::endl;
+        index = TagIndex();
+        return false;
+    }
+}
 
+void TagManager::ensureMetadataDir() {
     std::string smartfileDir = currentDirectory + "/.smartfile";
     if (!fs::exists(smartfileDir)) {
         fs::create_directory(smartfileDir);
@@ -42,119 +223,585 @@ void TagManager::saveTags() {
 #ifdef _WIN32
     SetFileAttributesA(smartfileDir.c_str(), FILE_ATTRIBUTE_HIDDEN);
 #endif
+}
+
+bool TagManager::ensureJournal() {
+    if (journal.isOpen()) return true;
+    if (currentDirectory.empty()) return false;
 
     try {
-        std::ofstream f(metadataFile);
-        f << metadata.dump(4);
+        ensureMetadataDir();
     } catch (const std::exception& e) {
-        std::cerr << "Error saving metadata: " << e.what() << std::endl;
+        std::cerr << "Error creating metadata directory: " << e.what() << std::endl;
+        return false;
     }
+    return journal.open(getJournalPath(), journalValidBytes, lastSeq + 1);
 }
 
-void TagManager::addTag(const std::string& filename, const std::string& tag) {
-    if (!metadata.contains(filename)) {
-        metadata[filename] = nlohmann::json::array();
+void TagManager::saveTags() {
+    if (journal.isOpen()) {
+        journal.flush();
+    }
+}
+
+void TagManager::commit(TagJournal::Record record) {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    if (readOnly) {
+        std::cerr << "Ignoring change to read-only library " << currentDirectory << std::endl;
+        return;
     }
-    
-    // Check if tag already exists
-    bool exists = false;
-    for (const auto& t : metadata[filename]) {
-        if (t.get<std::string>() == tag) {
-            exists = true;
-            break;
+    // A snapshot adopted mid-batch would miss the records not yet journaled
+    if (batchDepth == 0) adoptCompacted();
+    ChangeSet affected = affectedBy(record);
+    if (!apply(index, record)) return;
+
+    changedFiles.insert(affected.files.begin(), affected.files.end());
+    changedTags.insert(affected.tags.begin(), affected.tags.end());
+    unjournaled.push_back(std::move(record));
+    if (batchDepth == 0) publish(false);
+}
+
+void TagManager::beginBatch() {
+    writeMutex.lock(); // Released by the matching commitBatch
+    ++batchDepth;
+}
+
+void TagManager::commitBatch() {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    if (batchDepth == 0) return;
+    if (--batchDepth == 0) publish(true);
+    writeMutex.unlock();
+}
+
+void TagManager::addChangeListener(ChangeListener listener) {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    listeners.push_back(std::move(listener));
+}
+
+void TagManager::publishSnapshot() {
+    index.seal();
+    published.store(std::make_shared<const TagIndex>(index));
+}
+
+void TagManager::publish(bool sync) {
+    if (unjournaled.empty()) return;
+    if (ensureJournal()) {
+        lastSeq = journal.append(std::move(unjournaled));
+        if (sync) journal.flush();
+        if (!compacting && replayedRecords + journal.recordCount() > std::max(kCompactMinRecords, index.liveFileCount())) {
+            compact();
         }
     }
-    
-    if (!exists) {
-        metadata[filename].push_back(tag);
-        saveTags();
+    unjournaled.clear();
+    publishSnapshot();
+    if (changedFiles.empty() && changedTags.empty()) return; // e.g. only identities changed
+
+    ChangeSet changes;
+    changes.files.assign(changedFiles.begin(), changedFiles.end());
+    changes.tags.assign(changedTags.begin(), changedTags.end());
+    std::sort(changes.files.begin(), changes.files.end());
+    std::sort(changes.tags.begin(), changes.tags.end());
+    changedFiles.clear();
+    changedTags.clear();
+    for (const auto& listener : listeners) {
+        listener(changes);
     }
 }
 
-void TagManager::removeTag(const std::string& filename, const std::string& tag) {
-    if (metadata.contains(filename)) {
-        auto& tags = metadata[filename];
-        for (auto it = tags.begin(); it != tags.end(); ++it) {
-            if (it->get<std::string>() == tag) {
-                tags.erase(it);
-                saveTags();
-                break;
-            }
+TagManager::ChangeSet TagManager::affectedBy(const TagJournal::Record& record) const {
+    ChangeSet affected;
+    const auto& args = record.args;
+    auto addTagsOf = [this, &affected](const std::string& filename) {
+        uint32_t file = index.findFile(filename);
+        if (file == npos) return;
+        for (uint32_t tag : index.tagsOf(file)) {
+            affected.tags.emplace_back(index.tagName(tag));
+        }
+    };
+
+    switch (record.op) {
+    case TagJournal::Op::AddTag:
+    case TagJournal::Op::RemoveTag:
+        if (args.size() != 2) break;
+        affected.files.push_back(args[0]);
+        affected.tags.push_back(args[1]);
+        break;
+
+    case TagJournal::Op::DeleteTag: {
+        if (args.size() != 1) break;
+        affected.tags.push_back(args[0]);
+        uint32_t tag = index.findTag(args[0]);
+        if (tag == npos) break;
+        for (uint32_t file : index.filesOf(tag)) {
+            affected.files.emplace_back(index.fileName(file));
         }
+        break;
+    }
+
+    case TagJournal::Op::SetTags:
+        if (args.empty()) break;
+        affected.files.push_back(args[0]);
+        addTagsOf(args[0]);
+        affected.tags.insert(affected.tags.end(), args.begin() + 1, args.end());
+        break;
+
+    case TagJournal::Op::RenameFile:
+        if (args.size() != 2) break;
+        affected.files = args;
+        addTagsOf(args[0]);
+        addTagsOf(args[1]); // Replaced by the rename
+        break;
+
+    case TagJournal::Op::RemoveFile:
+        if (args.size() != 1) break;
+        affected.files.push_back(args[0]);
+        addTagsOf(args[0]);
+        break;
+
+    case TagJournal::Op::SetIdentity:
+        break; // Tags are unchanged
     }
+    return affected;
 }
 
-void TagManager::deleteTag(const std::string& tag) {
-    bool changed = false;
-    for (auto& element : metadata.items()) {
-        auto& tags = element.value();
-        for (auto it = tags.begin(); it != tags.end(); ) {
-            if (it->get<std::string>() == tag) {
-                it = tags.erase(it);
-                changed = true;
-            } else {
-                ++it;
+void TagManager::compact() {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    if (readOnly) return;
+    if (batchDepth > 0) return; // The snapshot would hold records the journal does not have yet
+    adoptCompacted();
+    if (compacting || !ensureJournal()) return;
+    if (compactor.joinable()) compactor.join();
+    if (index.database() && index.database()->journalSeq() == lastSeq) return; // Nothing new
+
+    // Rotate only onto a free slot: an existing rotated journal belongs to an
+    // unfinished compaction and is covered by this snapshot instead
+    std::string rotatedPath = getRotatedJournalPath();
+    if (!fs::exists(rotatedPath)) {
+        journal.rotate(rotatedPath);
+    } else {
+        journal.flush();
+    }
+    replayedRecords = 0;
+
+    // The copy shares the mapped base and duplicates only the overlay
+    uint64_t seq = lastSeq;
+    std::string target = getDatabasePath(seq);
+    std::string smartfileDir = currentDirectory + "/.smartfile";
+    std::string legacyJson = metadataFile;
+
+    compacting = true;
+    compactor = std::thread([this, snapshot = index, seq, target, smartfileDir, legacyJson, rotatedPath]() {
+        std::shared_ptr<const TagDatabase> db;
+        if (TagDatabase::write(target, snapshot, seq)) {
+            db = TagDatabase::open(target);
+        }
+
+        if (db) {
+            std::error_code ec;
+            fs::remove(rotatedPath, ec);
+            if (fs::exists(legacyJson, ec)) {
+                fs::rename(legacyJson, legacyJson + ".bak", ec);
             }
+            // Older generations may still be mapped; POSIX and FILE_SHARE_DELETE both
+            // keep such mappings valid until they are closed
+            for (const auto& entry : fs::directory_iterator(smartfileDir, ec)) {
+                uint64_t generation = 0;
+                if (parseDatabaseName(entry.path().filename().string(), generation) && generation != seq) {
+                    fs::remove(entry.path(), ec);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(compactedMutex);
+            compacted = db;
+        }
+        compacting = false;
+    });
+}
+
+void TagManager::adoptCompacted() {
+    std::shared_ptr<const TagDatabase> db;
+    {
+        std::lock_guard<std::mutex> lock(compactedMutex);
+        db.swap(compacted);
+    }
+    if (!db) return;
+
+    // Everything after the snapshot is in the live journal
+    journal.flush();
+    TagIndex rebased(db);
+    TagJournal::replay(getJournalPath(), db->journalSeq(), [&rebased](const TagJournal::Record& record) {
+        apply(rebased, record);
+    });
+    rebased.adoptCooccurrence(index); // Same content, so only the tag ids change
+    index = std::move(rebased);
+    publishSnapshot(); // Lets readers release the old overlay
+}
+
+bool TagManager::exportJson(const std::string& path) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
+    nlohmann::json json = nlohmann::json::object();
+    for (uint32_t file = 0; file < view->fileIdLimit(); ++file) {
+        auto tags = view->tagsOf(file);
+        if (tags.empty()) continue;
+        nlohmann::json list = nlohmann::json::array();
+        for (uint32_t tag : tags) {
+            list.push_back(std::string(view->tagName(tag)));
         }
+        json[std::string(view->fileName(file))] = std::move(list);
+    }
+    return TagJournal::replaceFile(path, json.dump(4));
+}
+
+int TagManager::importJson(const std::string& path) {
+    nlohmann::json json;
+    try {
+        std::ifstream f(path);
+        json = nlohmann::json::parse(f);
+    } catch (const std::exception& e) {
+        std::cerr << "Error importing tags: " << e.what() << std::endl;
+        return -1;
+    }
+
+    Batch batch(*this);
+    int count = 0;
+    forEachJsonFile(json, [this, &count](const std::string& file, const std::vector<std::string>& tags) {
+        setTags(file, tags);
+        ++count;
+    });
+    return count;
+}
+
+bool TagManager::apply(TagIndex& index, const TagJournal::Record& record) {
+    const auto& args = record.args;
+    switch (record.op) {
+    case TagJournal::Op::AddTag:
+        if (args.size() != 2) break;
+        return index.attach(index.internFile(args[0]), index.internTag(args[1]));
+
+    case TagJournal::Op::RemoveTag: {
+        if (args.size() != 2) break;
+        uint32_t file = index.findFile(args[0]);
+        uint32_t tag = index.findTag(args[1]);
+        return file != npos && tag != npos && index.detach(file, tag);
+    }
+
+    case TagJournal::Op::DeleteTag: {
+        if (args.size() != 1) break;
+        uint32_t tag = index.findTag(args[0]);
+        if (tag == npos || index.filesOf(tag).empty()) return false;
+        // Copy: detach shrinks the posting list while we walk it
+        auto posting = index.filesOf(tag);
+        std::vector<uint32_t> files(posting.begin(), posting.end());
+        for (uint32_t file : files) {
+            index.detach(file, tag);
+        }
+        return true;
+    }
+
+    case TagJournal::Op::SetTags: {
+        if (args.empty()) break;
+        std::vector<uint32_t> tags;
+        tags.reserve(args.size() - 1);
+        for (size_t i = 1; i < args.size(); ++i) {
+            tags.push_back(index.internTag(args[i]));
+        }
+        return index.setTags(index.internFile(args[0]), std::move(tags));
+    }
+
+    case TagJournal::Op::RenameFile: {
+        if (args.size() != 2) break;
+        uint32_t file = index.findFile(args[0]);
+        return file != npos && index.renameFile(file, args[1]);
+    }
+
+    case TagJournal::Op::RemoveFile: {
+        if (args.size() != 1) break;
+        uint32_t file = index.findFile(args[0]);
+        if (file == npos) return false;
+        index.dropFile(file);
+        return true;
+    }
+
+    case TagJournal::Op::SetIdentity: {
+        FileIdentity identity;
+        if (args.size() != 2 || !unpackIdentity(args[1], identity)) break;
+        uint32_t file = index.findFile(args[0]);
+        return file != npos && index.setIdentity(file, identity);
     }
-    if (changed) {
-        saveTags();
     }
+    std::cerr << "Ignoring malformed tag record " << record.seq << std::endl;
+    return false;
+}
+
+void TagManager::addTag(const std::string& filename, const std::string& tag) {
+    commit({TagJournal::Op::AddTag, {filename, tag}});
+}
+
+void TagManager::removeTag(const std::string& filename, const std::string& tag) {
+    commit({TagJournal::Op::RemoveTag, {filename, tag}});
+}
+
+void TagManager::deleteTag(const std::string& tag) {
+    commit({TagJournal::Op::DeleteTag, {tag}});
 }
 
 std::vector<std::string> TagManager::getTags(const std::string& filename) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
     std::vector<std::string> tags;
-    if (metadata.contains(filename)) {
-        for (const auto& t : metadata[filename]) {
-            tags.push_back(t.get<std::string>());
+    uint32_t file = view->findFile(filename);
+    if (file != npos) {
+        auto ids = view->tagsOf(file);
+        tags.reserve(ids.size());
+        for (uint32_t tag : ids) {
+            tags.emplace_back(view->tagName(tag));
         }
     }
     return tags;
 }
 
+bool TagManager::hasTag(const std::string& filename, const std::string& tag) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
+    uint32_t file = view->findFile(filename);
+    uint32_t t = view->findTag(tag);
+    return file != npos && t != npos && view->hasTag(file, t);
+}
+
 void TagManager::setTags(const std::string& filename, const std::vector<std::string>& tags) {
-    metadata[filename] = tags;
-    saveTags();
+    std::vector<std::string> args;
+    args.reserve(tags.size() + 1);
+    args.push_back(filename);
+    args.insert(args.end(), tags.begin(), tags.end());
+    commit({TagJournal::Op::SetTags, std::move(args)});
 }
 
 void TagManager::renameFile(const std::string& oldFilename, const std::string& newFilename) {
-    if (metadata.contains(oldFilename)) {
-        metadata[newFilename] = metadata[oldFilename];
-        metadata.erase(oldFilename);
-        saveTags();
-    }
+    commit({TagJournal::Op::RenameFile, {oldFilename, newFilename}});
 }
 
 void TagManager::removeFile(const std::string& filename) {
-    if (metadata.contains(filename)) {
-        metadata.erase(filename);
-        saveTags();
-    }
+    commit({TagJournal::Op::RemoveFile, {filename}});
 }
 
 std::vector<std::string> TagManager::getAllTags() const {
-    std::set<std::string> uniqueTags;
-    for (auto& element : metadata.items()) {
-        for (const auto& tag : element.value()) {
-            uniqueTags.insert(tag.get<std::string>());
-        }
+    std::shared_ptr<const TagIndex> view = snapshot();
+    const auto& sorted = view->sortedTags();
+    std::vector<std::string> tags;
+    tags.reserve(sorted.size());
+    for (uint32_t tag : sorted) {
+        tags.emplace_back(view->tagName(tag));
     }
-    return std::vector<std::string>(uniqueTags.begin(), uniqueTags.end());
+    return tags;
 }
 
 std::vector<std::string> TagManager::getFilesByTag(const std::string& tag) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
     std::vector<std::string> files;
-    for (auto& element : metadata.items()) {
-        for (const auto& t : element.value()) {
-            if (t.get<std::string>() == tag) {
-                files.push_back(element.key());
-                break;
+    uint32_t t = view->findTag(tag);
+    if (t == npos) return files;
+
+    auto ids = view->filesOf(t);
+    files.reserve(ids.size());
+    for (uint32_t file : ids) {
+        files.emplace_back(view->fileName(file));
+    }
+    return files;
+}
+
+size_t TagManager::getTagCount(const std::string& tag) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
+    uint32_t t = view->findTag(tag);
+    return t == npos ? 0 : view->filesOf(t).size();
+}
+
+TagManager::QueryResult TagManager::query(const std::string& expression, size_t maxFacets) const {
+    std::shared_ptr<const TagIndex> view = snapshot();
+
+    // The cache only speeds things up, so a query that finds it busy runs
+    // without one instead of waiting
+    std::unique_lock<std::mutex> cacheLock(queryMutex, std::try_to_lock);
+    TagQuery uncached;
+    TagQuery& engine = cacheLock.owns_lock() ? queryEngine : uncached;
+    TagQuery::Result found = engine.run(*view, expression, maxFacets);
+
+    QueryResult result;
+    result.error = std::move(found.error);
+    result.matchesUntagged = found.matchesUntagged;
+    result.files.reserve(found.files.cardinality());
+    found.files.forEach([&view, &result](uint32_t file) {
+        result.files.emplace_back(view->fileName(file));
+    });
+    result.facets.reserve(found.facets.size());
+    for (const auto& [tag, count] : found.facets) {
+        result.facets.emplace_back(std::string(view->tagName(tag)), count);
+    }
+    return result;
+}
+
+std::shared_ptr<const TagIndex> TagManager::cooccurrenceView() {
+    std::shared_ptr<const TagIndex> view = snapshot();
+    if (view->cooccurrence()) return view;
+
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    if (!index.cooccurrence()) index.buildCooccurrence();
+    if (batchDepth == 0) {
+        publishSnapshot();
+        return snapshot();
+    }
+    // Publishing now would expose this thread's open batch
+    auto copy = std::make_shared<TagIndex>(*snapshot());
+    copy->buildCooccurrence();
+    return copy;
+}
+
+std::vector<TagManager::RelatedTag> TagManager::relatedTags(const std::string& tag, size_t limit, Relatedness rankBy) {
+    std::shared_ptr<const TagIndex> view = cooccurrenceView();
+    std::vector<RelatedTag> related;
+    uint32_t t = view->findTag(tag);
+    if (t == npos) return related;
+
+    auto row = view->cooccurrence()->row(t);
+    related.reserve(row.size());
+    for (const auto& entry : row) {
+        related.push_back(scorePair(*view, t, entry.tag, entry.count));
+    }
+
+    auto score = [rankBy](const RelatedTag& r) {
+        switch (rankBy) {
+        case Relatedness::Jaccard: return r.jaccard;
+        case Relatedness::Pmi: return r.pmi;
+        default: return static_cast<double>(r.count);
+        }
+    };
+    auto better = [&score](const RelatedTag& a, const RelatedTag& b) {
+        if (score(a) != score(b)) return score(a) > score(b);
+        if (a.count != b.count) return a.count > b.count;
+        return a.tag < b.tag;
+    };
+    if (limit && related.size() > limit) {
+        std::partial_sort(related.begin(), related.begin() + limit, related.end(), better);
+        related.resize(limit);
+    } else {
+        std::sort(related.begin(), related.end(), better);
+    }
+    return related;
+}
+
+TagManager::RelatedTag TagManager::relatedness(const std::string& a, const std::string& b) {
+    std::shared_ptr<const TagIndex> view = cooccurrenceView();
+    uint32_t ta = view->findTag(a);
+    uint32_t tb = view->findTag(b);
+    if (ta == npos || tb == npos) {
+        RelatedTag none;
+        none.tag = b;
+        none.pmi = -std::numeric_limits<double>::infinity();
+        return none;
+    }
+    return scorePair(*view, ta, tb, view->cooccurrence()->count(ta, tb));
+}
+
+std::string TagManager::fileKey(const std::string& path) const {
+    fs::path p(path);
+    if (p.is_absolute()) p = p.lexically_relative(currentDirectory);
+    return p.lexically_normal().generic_string();
+}
+
+size_t TagManager::reconcile(const std::string& directory, const std::vector<std::string>& paths) {
+    std::lock_guard<std::recursive_mutex> writeLock(writeMutex);
+    // The scan may be of a library that has been closed since
+    if (directory != currentDirectory) return 0;
+    Batch batch(*this);
+
+    // Scanned files by key; claimed once a tagged file is matched to them
+    std::unordered_map<std::string, size_t> scanned;
+    scanned.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        scanned.emplace(fileKey(paths[i]), i);
+    }
+    std::vector<bool> claimed(paths.size(), false);
+
+    std::vector<std::string> missing;
+    for (uint32_t file = 0; file < index.fileIdLimit(); ++file) {
+        if (index.tagsOf(file).empty()) continue;
+        std::string key = index.fileName(file);
+        auto it = scanned.find(key);
+        if (it == scanned.end()) {
+            missing.push_back(std::move(key));
+            continue;
+        }
+        // Files still where they were are matched by name alone; only those
+        // tagged since the last scan are read, to record their identity
+        claimed[it->second] = true;
+        FileIdentity identity;
+        if (!index.identity(file).known() && readIdentity(paths[it->second], identity)) {
+            commit({TagJournal::Op::SetIdentity, {key, packIdentity(identity)}});
+        }
+    }
+    if (missing.empty()) return 0;
+
+    // Unclaimed files are the candidates a missing file may have turned into.
+    // Their identities are only read if some missing file has one to compare.
+    bool anyKnown = std::any_of(missing.begin(), missing.end(), [this](const std::string& key) {
+        return index.identity(index.findFile(key)).known();
+    });
+    std::unordered_map<InodeKey, std::pair<size_t, FileIdentity>, InodeKeyHash> byInode;
+    std::unordered_multimap<std::string, size_t> byName;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (claimed[i]) continue;
+        byName.emplace(fs::path(paths[i]).filename().string(), i);
+        FileIdentity identity;
+        if (anyKnown && readIdentity(paths[i], identity)) {
+            byInode.emplace(InodeKey{identity.device, identity.inode}, std::make_pair(i, identity));
+        }
+    }
+
+    size_t moved = 0;
+    for (const std::string& key : missing) {
+        FileIdentity known = index.identity(index.findFile(key));
+        size_t target = paths.size();
+        if (known.known()) {
+            // Same inode with unchanged size and mtime, or with the same name
+            // (edited since it was tagged): the file was moved or renamed
+            auto it = byInode.find(InodeKey{known.device, known.inode});
+            if (it != byInode.end() && !claimed[it->second.first]) {
+                const FileIdentity& found = it->second.second;
+                bool unchanged = found.size == known.size && found.mtime == known.mtime;
+                bool sameName = fs::path(paths[it->second.first]).filename() == fs::path(key).filename();
+                if (unchanged || sameName) target = it->second.first;
+            }
+        } else if (key.find('/') == std::string::npos) {
+            // Keyed by bare file name before identities existed: adopt the one
+            // file of that name, if it is unambiguous
+            auto [begin, end] = byName.equal_range(key);
+            if (begin != end && std::next(begin) == end && !claimed[begin->second]) {
+                target = begin->second;
             }
         }
+        if (target == paths.size()) continue;
+
+        claimed[target] = true;
+        std::string newKey = fileKey(paths[target]);
+        commit({TagJournal::Op::RenameFile, {key, newKey}});
+        FileIdentity identity;
+        if (readIdentity(paths[target], identity) && identity != known) {
+            commit({TagJournal::Op::SetIdentity, {newKey, packIdentity(identity)}});
+        }
+        ++moved;
     }
-    return files;
+    return moved;
 }
 
 std::string TagManager::getMetadataPath() const {
     return currentDirectory + "/.smartfile/metadata.json";
 }
+
+std::string TagManager::getDatabasePath(uint64_t seq) const {
+    return currentDirectory + "/.smartfile/tags-" + std::to_string(seq) + ".db";
+}
+
+std::string TagManager::getJournalPath() const {
+    return currentDirectory + "/.smartfile/metadata.journal";
+}
+
+std::string TagManager::getRotatedJournalPath() const {
+    return currentDirectory + "/.smartfile/metadata.journal.1";
+}
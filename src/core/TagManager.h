@@ -3,36 +3,185 @@
 
 #include <string>
 #include <vector>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
+#include "TagJournal.h"
+#include "TagIndex.h"
+#include "TagQuery.h"
+#include "AtomicSharedPtr.h"
 
+// Files are keyed by their path relative to the library root, '/'-separated;
+// fileKey converts scanner paths. reconcile keeps tags attached to files that
+// were moved or renamed outside the app, using the (device, inode, size, mtime)
+// identity recorded for every tagged file.
+//
+// Tags live in a TagIndex: a memory-mapped binary snapshot (.smartfile/tags-<seq>.db)
+// plus an in-memory overlay. Mutations are appended to .smartfile/metadata.journal;
+// background compaction folds them into a new snapshot generation. metadata.json
+// is only read once to import libraries from the JSON format.
+//
+// Threading: mutations are serialized by a writer lock and work on a private
+// index. After each mutation (or batch) a copy is published as an immutable
+// snapshot; the read methods and snapshot() just load the current one, so
+// readers on any thread wait at most for a pointer copy and see a consistent
+// state.
 class TagManager {
 public:
+    // What a mutation, or a whole batch of them, touched
+    struct ChangeSet {
+        std::vector<std::string> files; // Files whose tags changed; both names of a rename
+        std::vector<std::string> tags;  // Tags that gained or lost files
+    };
+    using ChangeListener = std::function<void(const ChangeSet&)>;
+
+    // Groups mutations: they become visible to readers, are journaled and synced
+    // with one write, and reach listeners once, when the outermost batch ends.
+    // The batch holds the writer lock, so other threads' mutations wait for it.
+    class Batch {
+    public:
+        explicit Batch(TagManager& manager) : manager(manager) { manager.beginBatch(); }
+        ~Batch() { manager.commitBatch(); }
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+    private:
+        TagManager& manager;
+    };
+
     TagManager();
-    
-    void loadTags(const std::string& directory);
-    void saveTags();
-    
+    ~TagManager();
+
+    // Called after every mutation outside a batch and at the end of each batch,
+    // on the thread that made the change
+    void addChangeListener(ChangeListener listener);
+    void beginBatch();
+    void commitBatch(); // Batches nest; only the outermost commit takes effect
+
+    // Maps the snapshot and replays the journal. A read-only library is only
+    // looked at: nothing under .smartfile is created, migrated or compacted,
+    // and mutations are refused.
+    void loadTags(const std::string& directory, bool readOnly = false);
+    void saveTags();  // Syncs journaled mutations to disk
+    void compact();   // Writes a fresh snapshot in the background and retires the journal
+
+    std::string fileKey(const std::string& path) const; // Absolute or root-relative path -> key
+    // Records the identity of newly tagged files among paths (full paths as
+    // returned by FileScanner, scanned from directory) and re-keys tagged files
+    // that are gone to the file they moved to; returns the number of files
+    // re-keyed. Only files that are not at their key are examined on disk.
+    // Libraries keyed by bare file names are migrated the same way. Does
+    // nothing if another directory has been loaded since, so it can run on a
+    // worker thread.
+    size_t reconcile(const std::string& directory, const std::vector<std::string>& paths);
+
+    // Consistent read-only view for work that spans many lookups, e.g. on a worker thread
+    std::shared_ptr<const TagIndex> snapshot() const { return published.load(); }
+
+    // JSON interchange in the flat {"file": ["tag", ...]} format
+    bool exportJson(const std::string& path) const;
+    int importJson(const std::string& path); // Number of files updated, -1 on error
+
     void addTag(const std::string& filename, const std::string& tag);
     void removeTag(const std::string& filename, const std::string& tag);
     void deleteTag(const std::string& tag); // Remove tag from all files
     std::vector<std::string> getTags(const std::string& filename) const;
-    
+    bool hasTag(const std::string& filename, const std::string& tag) const;
+
     void setTags(const std::string& filename, const std::vector<std::string>& tags);
-    
+
     // File operations support
     void renameFile(const std::string& oldFilename, const std::string& newFilename);
     void removeFile(const std::string& filename);
 
-    std::vector<std::string> getAllTags() const;
+    std::vector<std::string> getAllTags() const; // Tags in use, sorted
     std::vector<std::string> getFilesByTag(const std::string& tag) const;
+    size_t getTagCount(const std::string& tag) const; // Number of files with the tag
+    size_t getTaggedFileCount() const { return snapshot()->liveFileCount(); }
+
+    struct QueryResult {
+        std::vector<std::string> files;
+        std::vector<std::pair<std::string, size_t>> facets; // Tags within the result, most frequent first
+        bool matchesUntagged = false; // Files without any tag satisfy the query too
+        std::string error;            // Parse error; empty on success
+    };
+    // Boolean tag query, see TagQuery for the syntax
+    QueryResult query(const std::string& expression, size_t maxFacets = 0) const;
+
+    // Tag co-occurrence. The matrix is counted on first use (O(sum of squared
+    // tags per file)) and from then on updated by every mutation.
+    enum class Relatedness { Count, Jaccard, Pmi };
+    struct RelatedTag {
+        std::string tag;
+        size_t count = 0;   // Files carrying both tags
+        double jaccard = 0; // count / files carrying either
+        double pmi = 0;     // log2(P(both) / (P(a) P(b))) over tagged files; -inf if never together
+    };
+    // Tags that share files with tag, best first by rankBy
+    std::vector<RelatedTag> relatedTags(const std::string& tag, size_t limit = 10,
+                                        Relatedness rankBy = Relatedness::Count);
+    RelatedTag relatedness(const std::string& a, const std::string& b); // Scores b against a
 
 private:
+    static constexpr uint32_t npos = TagIndex::npos;
+    // Compaction runs once the journal backlog exceeds max(this, tagged files),
+    // which keeps its O(library) cost amortized to O(1) per mutation
+    static constexpr size_t kCompactMinRecords = 20000;
+
     std::string currentDirectory;
     std::string metadataFile;
-    nlohmann::json metadata;
-    
+    bool readOnly = false;
+
+    std::recursive_mutex writeMutex; // Held by every mutation and for the length of a batch
+    TagIndex index;                  // The writer's working copy
+    AtomicSharedPtr<const TagIndex> published;
+
+    mutable std::mutex queryMutex;
+    mutable TagQuery queryEngine; // Holds the bitmap cache; guarded by queryMutex
+    TagJournal journal;
+    uint64_t journalValidBytes = 0; // Intact prefix of the journal found by loadTags
+    uint64_t lastSeq = 0;           // Newest sequence in snapshot or journal
+    size_t replayedRecords = 0;     // Backlog found by loadTags
+
+    std::thread compactor;
+    std::atomic<bool> compacting{false};
+    std::mutex compactedMutex;
+    std::shared_ptr<const TagDatabase> compacted; // Finished snapshot not yet adopted
+
+    int batchDepth = 0;
+    std::vector<TagJournal::Record> unjournaled;  // Applied but not yet appended
+    std::unordered_set<std::string> changedFiles; // Not yet announced to listeners
+    std::unordered_set<std::string> changedTags;
+    std::vector<ChangeListener> listeners;
+
+    // Applies a mutation to index; true if anything changed
+    static bool apply(TagIndex& index, const TagJournal::Record& record);
+    // apply, then journal and announce it unless a batch is open
+    void commit(TagJournal::Record record);
+    // Files and tags that applying record may change; call before applying it
+    ChangeSet affectedBy(const TagJournal::Record& record) const;
+    // Journals the applied records (syncing them when sync is set), publishes a
+    // new snapshot and notifies listeners
+    void publish(bool sync);
+    void publishSnapshot();
+    // A snapshot that has the co-occurrence matrix, building it if needed
+    std::shared_ptr<const TagIndex> cooccurrenceView();
+    // Switches to the snapshot written by the last compaction so the overlay
+    // shrinks back to the mutations made since
+    void adoptCompacted();
+    bool ensureJournal();
+    void ensureMetadataDir();
+    std::shared_ptr<const TagDatabase> openNewestDatabase() const;
+    bool importLegacyJson(uint64_t& snapshotSeq);
+
     std::string getMetadataPath() const;
+    std::string getDatabasePath(uint64_t seq) const;
+    std::string getJournalPath() const;
+    std::string getRotatedJournalPath() const;
 };
 
 #endif // TAGMANAGER_H
@@ -0,0 +1,301 @@
+#include "TagQuery.h"
+#include <algorithm>
+#include <deque>
+#include <functional>
+
+namespace {
+
+struct Token {
+    enum Kind { Word, And, Or, Not, Open, Close, End } kind;
+    std::string text;
+};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool startsWith(const std::string& s, size_t pos, const char* literal) {
+    return s.compare(pos, std::char_traits<char>::length(literal), literal) == 0;
+}
+
+std::string upper(std::string s) {
+    for (char& c : s) {
+        if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+    }
+    return s;
+}
+
+std::vector<Token> tokenize(const std::string& text) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (isSpace(c)) {
+            ++i;
+        } else if (c == '(' || startsWith(text, i, "（")) { // Full-width forms come from CJK input methods
+            tokens.push_back({Token::Open, ""});
+            i += (c == '(') ? 1 : 3;
+        } else if (c == ')' || startsWith(text, i, "）")) {
+            tokens.push_back({Token::Close, ""});
+            i += (c == ')') ? 1 : 3;
+        } else if (startsWith(text, i, "&&") || startsWith(text, i, "||")) {
+            tokens.push_back({c == '&' ? Token::And : Token::Or, ""});
+            i += 2;
+        } else if (c == '!' || c == '-') {
+            tokens.push_back({Token::Not, ""});
+            ++i;
+        } else if (c == '"') {
+            size_t close = text.find('"', i + 1);
+            if (close == std::string::npos) close = text.size();
+            tokens.push_back({Token::Word, text.substr(i + 1, close - i - 1)});
+            i = close + 1;
+        } else {
+            size_t start = i;
+            while (i < text.size() && !isSpace(text[i]) && text[i] != '(' && text[i] != ')'
+                   && !startsWith(text, i, "（") && !startsWith(text, i, "）")) {
+                ++i;
+            }
+            std::string word = text.substr(start, i - start);
+            std::string op = upper(word);
+            if (op == "AND") tokens.push_back({Token::And, ""});
+            else if (op == "OR") tokens.push_back({Token::Or, ""});
+            else if (op == "NOT") tokens.push_back({Token::Not, ""});
+            else tokens.push_back({Token::Word, word});
+        }
+    }
+    tokens.push_back({Token::End, ""});
+    return tokens;
+}
+
+} // namespace
+
+bool TagQuery::parse(const std::string& text, Node& root, std::string& error) {
+    std::vector<Token> tokens = tokenize(text);
+    size_t pos = 0;
+
+    // Recursive descent over the grammar in the header
+    std::function<bool(Node&)> parseOr;
+    std::function<bool(Node&)> parseFactor = [&](Node& out) -> bool {
+        const Token& token = tokens[pos];
+        switch (token.kind) {
+        case Token::Not: {
+            ++pos;
+            out.kind = Node::Not;
+            out.children.emplace_back();
+            return parseFactor(out.children.back());
+        }
+        case Token::Open:
+            ++pos;
+            if (!parseOr(out)) return false;
+            if (tokens[pos].kind != Token::Close) {
+                error = "缺少右括號 (Missing ')')";
+                return false;
+            }
+            ++pos;
+            return true;
+        case Token::Word:
+            ++pos;
+            out.kind = Node::Tag;
+            out.tag = token.text;
+            return true;
+        case Token::Close:
+            error = "多餘的右括號 (Unexpected ')')";
+            return false;
+        default:
+            error = "缺少標籤 (Expected a tag)";
+            return false;
+        }
+    };
+    auto parseAnd = [&](Node& out) -> bool {
+        Node first;
+        if (!parseFactor(first)) return false;
+        out.kind = Node::And;
+        out.children.push_back(std::move(first));
+        for (;;) {
+            Token::Kind next = tokens[pos].kind;
+            if (next == Token::And) {
+                ++pos;
+            } else if (next != Token::Word && next != Token::Not && next != Token::Open) {
+                break;
+            }
+            out.children.emplace_back();
+            if (!parseFactor(out.children.back())) return false;
+        }
+        if (out.children.size() == 1) {
+            Node only = std::move(out.children.front());
+            out = std::move(only);
+        }
+        return true;
+    };
+    parseOr = [&](Node& out) -> bool {
+        Node first;
+        if (!parseAnd(first)) return false;
+        out.kind = Node::Or;
+        out.children.push_back(std::move(first));
+        while (tokens[pos].kind == Token::Or) {
+            ++pos;
+            out.children.emplace_back();
+            if (!parseAnd(out.children.back())) return false;
+        }
+        if (out.children.size() == 1) {
+            Node only = std::move(out.children.front());
+            out = std::move(only);
+        }
+        return true;
+    };
+
+    if (tokens.front().kind == Token::End) {
+        error = "查詢是空的 (Empty query)";
+        return false;
+    }
+    if (!parseOr(root)) return false;
+    if (tokens[pos].kind != Token::End) {
+        error = tokens[pos].kind == Token::Close ? "多餘的右括號 (Unexpected ')')" : "語法錯誤 (Syntax error)";
+        return false;
+    }
+    return true;
+}
+
+bool TagQuery::matchesEmpty(const Node& node) {
+    switch (node.kind) {
+    case Node::Tag:
+        return false;
+    case Node::Not:
+        return !matchesEmpty(node.children.front());
+    case Node::And:
+        return std::all_of(node.children.begin(), node.children.end(), matchesEmpty);
+    case Node::Or:
+        return std::any_of(node.children.begin(), node.children.end(), matchesEmpty);
+    }
+    return false;
+}
+
+void TagQuery::clear() {
+    cachedBase.reset();
+    tagCache.clear();
+    liveCache = RoaringBitmap();
+    liveRevision = UINT64_MAX;
+}
+
+const RoaringBitmap& TagQuery::tagBitmap(const TagIndex& index, uint32_t tag) {
+    uint64_t revision = index.tagRevision(tag);
+    auto it = tagCache.find(tag);
+    if (it == tagCache.end() || it->second.revision != revision) {
+        CachedBitmap entry{revision, RoaringBitmap::fromSorted(index.filesOf(tag))};
+        it = tagCache.insert_or_assign(tag, std::move(entry)).first;
+    }
+    return it->second.bits;
+}
+
+const RoaringBitmap& TagQuery::liveFiles(const TagIndex& index) {
+    if (liveRevision != index.revision()) {
+        liveCache = index.liveFileSet();
+        liveRevision = index.revision();
+    }
+    return liveCache;
+}
+
+RoaringBitmap TagQuery::evaluate(const TagIndex& index, const Node& node) {
+    switch (node.kind) {
+    case Node::Tag: {
+        uint32_t tag = index.findTag(node.tag);
+        return tag == TagIndex::npos ? RoaringBitmap() : tagBitmap(index, tag);
+    }
+
+    case Node::Not:
+        return liveFiles(index).andNot(evaluate(index, node.children.front()));
+
+    case Node::Or: {
+        RoaringBitmap result;
+        for (const auto& child : node.children) {
+            result = result | evaluate(index, child);
+        }
+        return result;
+    }
+
+    case Node::And: {
+        // Intersect the positive operands smallest first, then subtract the
+        // negated ones, so "a AND NOT b" never materializes the complement of b
+        std::deque<RoaringBitmap> owned;
+        std::vector<const RoaringBitmap*> positive;
+        std::vector<const Node*> negative;
+        for (const auto& child : node.children) {
+            if (child.kind == Node::Not) {
+                negative.push_back(&child.children.front());
+            } else if (child.kind == Node::Tag) {
+                uint32_t tag = index.findTag(child.tag);
+                if (tag == TagIndex::npos) return RoaringBitmap();
+                positive.push_back(&tagBitmap(index, tag));
+            } else {
+                owned.push_back(evaluate(index, child));
+                positive.push_back(&owned.back());
+            }
+        }
+        std::sort(positive.begin(), positive.end(), [](const RoaringBitmap* a, const RoaringBitmap* b) {
+            return a->cardinality() < b->cardinality();
+        });
+
+        RoaringBitmap result = positive.empty() ? liveFiles(index) : *positive.front();
+        for (size_t i = 1; i < positive.size() && !result.empty(); ++i) {
+            result = result & *positive[i];
+        }
+        for (const Node* neg : negative) {
+            if (result.empty()) break;
+            result = result.andNot(evaluate(index, *neg));
+        }
+        return result;
+    }
+    }
+    return RoaringBitmap();
+}
+
+void TagQuery::facets(const TagIndex& index, Result& result, size_t maxFacets) {
+    // Walking the result's forward lists costs O(result x tags per file); one
+    // andCardinality per tag costs O(tags x containers). The scan wins unless the
+    // result is large and the tag vocabulary small.
+    uint64_t matched = result.files.cardinality();
+    const auto& liveTags = index.sortedTags();
+    std::vector<std::pair<uint32_t, uint32_t>> counts;
+    if (matched <= std::max<uint64_t>(kFacetScanLimit, uint64_t(liveTags.size()) * 2048)) {
+        std::vector<uint32_t> byTag(index.tagIdLimit(), 0);
+        result.files.forEach([&](uint32_t file) {
+            for (uint32_t tag : index.tagsOf(file)) ++byTag[tag];
+        });
+        for (uint32_t tag = 0; tag < byTag.size(); ++tag) {
+            if (byTag[tag]) counts.emplace_back(tag, byTag[tag]);
+        }
+    } else {
+        for (uint32_t tag : liveTags) {
+            uint64_t n = tagBitmap(index, tag).andCardinality(result.files);
+            if (n) counts.emplace_back(tag, static_cast<uint32_t>(n));
+        }
+    }
+
+    auto byCount = [&index](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return index.tagName(a.first) < index.tagName(b.first);
+    };
+    if (maxFacets && counts.size() > maxFacets) {
+        std::partial_sort(counts.begin(), counts.begin() + maxFacets, counts.end(), byCount);
+        counts.resize(maxFacets);
+    } else {
+        std::sort(counts.begin(), counts.end(), byCount);
+    }
+    result.facets = std::move(counts);
+}
+
+TagQuery::Result TagQuery::run(const TagIndex& index, const std::string& expression, size_t maxFacets) {
+    Result result;
+    Node root;
+    if (!parse(expression, root, result.error)) return result;
+
+    if (cachedBase != index.database()) {
+        clear();
+        cachedBase = index.database();
+    }
+
+    result.files = evaluate(index, root);
+    result.matchesUntagged = matchesEmpty(root);
+    facets(index, result, maxFacets);
+    return result;
+}
@@ -0,0 +1,61 @@
+#ifndef TAGQUERY_H
+#define TAGQUERY_H
+
+#include "TagIndex.h"
+#include "RoaringBitmap.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// Boolean tag queries, e.g.  合約 AND 2024 AND NOT 草稿  or  (報告 OR 簡報) -草稿
+//   expr   := term (OR term)*
+//   term   := factor ((AND)? factor)*     adjacent factors are ANDed
+//   factor := NOT factor | ( expr ) | tag
+// Operators are case-insensitive; && || ! and a leading - work as well, and
+// tags containing spaces or operator words can be "quoted".
+// Tag posting lists are converted to roaring bitmaps on first use and cached
+// until the tag changes.
+class TagQuery {
+public:
+    struct Result {
+        RoaringBitmap files;
+        std::vector<std::pair<uint32_t, uint32_t>> facets; // (tag, files in result), most frequent first
+        bool matchesUntagged = false; // The expression holds for a file with no tags
+        std::string error;            // Parse error; empty on success
+    };
+
+    // maxFacets = 0 returns every tag present in the result
+    Result run(const TagIndex& index, const std::string& expression, size_t maxFacets = 0);
+    void clear(); // Drops cached bitmaps, e.g. when another library is loaded
+
+private:
+    struct Node {
+        enum Kind { Tag, And, Or, Not } kind = Tag;
+        std::string tag;
+        std::vector<Node> children;
+    };
+
+    // Below this many result files, facets are counted from the forward lists
+    // instead of intersecting every tag bitmap with the result
+    static constexpr uint64_t kFacetScanLimit = 20000;
+
+    static bool parse(const std::string& text, Node& root, std::string& error);
+    static bool matchesEmpty(const Node& node);
+    RoaringBitmap evaluate(const TagIndex& index, const Node& node);
+    const RoaringBitmap& tagBitmap(const TagIndex& index, uint32_t tag);
+    const RoaringBitmap& liveFiles(const TagIndex& index);
+    void facets(const TagIndex& index, Result& result, size_t maxFacets);
+
+    struct CachedBitmap {
+        uint64_t revision = 0;
+        RoaringBitmap bits;
+    };
+    std::shared_ptr<const TagDatabase> cachedBase; // Ids are only stable for one base
+    std::unordered_map<uint32_t, CachedBitmap> tagCache;
+    RoaringBitmap liveCache;
+    uint64_t liveRevision = UINT64_MAX;
+};
+
+#endif // TAGQUERY_H
@@ -0,0 +1,190 @@
+#include "TextPager.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace {
+
+constexpr uint64_t kScanChunk = 1 << 20;     // Bytes between cancellation checks
+constexpr uint64_t kPublishBytes = 32 << 20; // Bytes between index snapshots
+constexpr uint64_t kFindChunk = 16 << 20;
+constexpr double kDefaultLineLength = 80.0;  // Until the index has seen some lines
+
+inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+} // namespace
+
+bool TextPager::open(const std::string& path) {
+    close();
+    std::error_code ec;
+    uint64_t bytes = std::filesystem::file_size(std::filesystem::path(path), ec);
+    if (ec) return false;
+    // MappedFile refuses empty files; they are shown as nothing at all
+    if (bytes > 0 && !file.open(path)) return false;
+
+    auto initial = std::make_shared<LineIndex>();
+    initial->checkpoints.push_back(0);
+    initial->lines = size() > 0 ? 1 : 0;
+    initial->complete = size() == 0;
+    index.store(std::move(initial));
+    opened = true;
+    return true;
+}
+
+void TextPager::close() {
+    file.close();
+    opened = false;
+    index.store(std::make_shared<const LineIndex>());
+}
+
+bool TextPager::buildIndex(const std::atomic<bool>& cancelled, const Progress& progress) {
+    std::shared_ptr<const LineIndex> current = index.load();
+    if (current->complete) {
+        if (progress) progress(current->lines, true);
+        return true;
+    }
+
+    LineIndex local = *current;
+    const char* data = file.data();
+    const uint64_t total = size();
+    uint64_t nextPublish = kPublishBytes;
+    while (local.scanned < total) {
+        if (cancelled) return false;
+        const char* end = data + std::min(total, local.scanned + kScanChunk);
+        for (const char* p = data + local.scanned;
+             (p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)))); ++p) {
+            uint64_t start = static_cast<uint64_t>(p - data) + 1;
+            if (start >= total) break; // A final newline does not start another line
+            if (local.lines % kCheckpointLines == 0) local.checkpoints.push_back(start);
+            ++local.lines;
+        }
+        local.scanned = static_cast<uint64_t>(end - data);
+
+        if (local.scanned >= nextPublish || local.scanned == total) {
+            local.complete = local.scanned == total;
+            index.store(std::make_shared<const LineIndex>(local));
+            if (progress) progress(local.lines, local.complete);
+            nextPublish = local.scanned + kPublishBytes;
+        }
+    }
+    return true;
+}
+
+double TextPager::averageLineLength(const LineIndex& snapshot) const {
+    if (snapshot.scanned == 0 || snapshot.lines == 0) return kDefaultLineLength;
+    return std::max(1.0, static_cast<double>(snapshot.scanned) / static_cast<double>(snapshot.lines));
+}
+
+uint64_t TextPager::lineCount() const {
+    std::shared_ptr<const LineIndex> snapshot = index.load();
+    if (snapshot->complete) return snapshot->lines;
+    uint64_t remaining = size() - snapshot->scanned;
+    return snapshot->lines + static_cast<uint64_t>(static_cast<double>(remaining) / averageLineLength(*snapshot));
+}
+
+uint64_t TextPager::advance(uint64_t offset, uint64_t count) const {
+    const char* data = file.data();
+    const uint64_t total = size();
+    for (; count > 0 && offset < total; --count) {
+        const char* p = static_cast<const char*>(std::memchr(data + offset, '\n', static_cast<size_t>(total - offset)));
+        if (!p) return total;
+        offset = static_cast<uint64_t>(p - data) + 1;
+    }
+    return offset;
+}
+
+uint64_t TextPager::lineStart(uint64_t line) const {
+    std::shared_ptr<const LineIndex> snapshot = index.load();
+    if (line < snapshot->lines) {
+        return advance(snapshot->checkpoints[line / kCheckpointLines], line % kCheckpointLines);
+    }
+    if (snapshot->complete || size() == 0) return size();
+
+    // Past the index: as far beyond its last line as the average line length says
+    uint64_t last = snapshot->lines - 1;
+    uint64_t known = advance(snapshot->checkpoints[last / kCheckpointLines], last % kCheckpointLines);
+    double estimate = static_cast<double>(known) + static_cast<double>(line - last) * averageLineLength(*snapshot);
+    if (estimate >= static_cast<double>(size())) return startOfLine(size() - 1);
+    return startOfLine(static_cast<uint64_t>(estimate));
+}
+
+uint64_t TextPager::lineAt(uint64_t offset) const {
+    if (size() == 0) return 0;
+    offset = std::min(offset, size() - 1);
+    std::shared_ptr<const LineIndex> snapshot = index.load();
+    if (offset < snapshot->scanned || snapshot->complete) {
+        auto it = std::upper_bound(snapshot->checkpoints.begin(), snapshot->checkpoints.end(), offset) - 1;
+        uint64_t k = static_cast<uint64_t>(it - snapshot->checkpoints.begin());
+        const char* data = file.data();
+        return k * kCheckpointLines + static_cast<uint64_t>(std::count(data + *it, data + offset, '\n'));
+    }
+    uint64_t beyond = offset - snapshot->scanned;
+    return snapshot->lines + static_cast<uint64_t>(static_cast<double>(beyond) / averageLineLength(*snapshot));
+}
+
+uint64_t TextPager::startOfLine(uint64_t offset) const {
+    const char* data = file.data();
+    offset = std::min(offset, size());
+    while (offset > 0 && data[offset - 1] != '\n') --offset;
+    return offset;
+}
+
+uint64_t TextPager::nextLine(uint64_t offset) const {
+    return advance(offset, 1);
+}
+
+uint64_t TextPager::previousLine(uint64_t offset) const {
+    return offset == 0 ? 0 : startOfLine(offset - 1);
+}
+
+std::string_view TextPager::line(uint64_t offset) const {
+    if (offset >= size()) return {};
+    const char* begin = file.data() + offset;
+    size_t limit = static_cast<size_t>(std::min<uint64_t>(size() - offset, kMaxLineBytes));
+    const char* end = static_cast<const char*>(std::memchr(begin, '\n', limit));
+    if (!end) return {begin, limit};
+    if (end > begin && end[-1] == '\r') --end;
+    return {begin, static_cast<size_t>(end - begin)};
+}
+
+uint64_t TextPager::find(std::string_view needle, uint64_t from, uint64_t to, bool caseSensitive,
+                         const std::atomic<bool>& cancelled) const {
+    to = std::min(to, size());
+    const uint64_t n = needle.size();
+    if (n == 0 || from >= to || to - from < n) return npos;
+
+    // Horspool: on a mismatch, shift by how far the window's last byte is from
+    // its last occurrence in the needle
+    std::string pattern(needle);
+    if (!caseSensitive) {
+        for (char& c : pattern) c = static_cast<char>(fold(static_cast<unsigned char>(c)));
+    }
+    uint64_t shift[256];
+    std::fill(std::begin(shift), std::end(shift), n);
+    for (uint64_t i = 0; i + 1 < n; ++i) {
+        shift[static_cast<unsigned char>(pattern[i])] = n - 1 - i;
+    }
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(file.data());
+    const unsigned char* want = reinterpret_cast<const unsigned char*>(pattern.data());
+    auto scan = [&](auto key) -> uint64_t {
+        for (uint64_t pos = from; pos + n <= to;) {
+            if (cancelled) return npos;
+            uint64_t stop = std::min(to - n, pos + kFindChunk); // Last window start in this chunk
+            for (; pos <= stop; ) {
+                unsigned char last = key(data[pos + n - 1]);
+                if (last == want[n - 1]) {
+                    uint64_t i = 0;
+                    while (i + 1 < n && key(data[pos + i]) == want[i]) ++i;
+                    if (i + 1 == n) return pos;
+                }
+                pos += shift[last];
+            }
+        }
+        return npos;
+    };
+    return caseSensitive ? scan([](unsigned char c) { return c; }) : scan(fold);
+}
@@ -0,0 +1,77 @@
+#ifndef TEXTPAGER_H
+#define TEXTPAGER_H
+
+#include "MappedFile.h"
+#include "AtomicSharedPtr.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// Random access to the lines of a text file of any size. The file is mapped,
+// not read, so opening is instant and only the pages looked at are loaded.
+// Line numbers come from an index built by buildIndex, typically on a worker
+// thread while the file is already being shown: it keeps the offset of every
+// kCheckpointLines-th line, so a file of a hundred million lines needs less
+// than a megabyte, and reaching any line scans at most that many lines. Until
+// the index is complete, lines past its end are estimated from the average
+// line length so far.
+//
+// Lines end at '\n'; a trailing '\r' is not part of the line. Offsets passed
+// in are expected to be line starts unless stated otherwise.
+class TextPager {
+public:
+    static constexpr uint64_t npos = ~uint64_t(0);
+    static constexpr uint64_t kCheckpointLines = 1024;
+    // line() returns at most this much of a line, so a minified file does not
+    // turn one line into a hundred megabytes of string
+    static constexpr size_t kMaxLineBytes = 64 * 1024;
+
+    // Receives the lines indexed so far; done is set on the last call
+    using Progress = std::function<void(uint64_t lines, bool done)>;
+
+    bool open(const std::string& path);
+    void close(); // No buildIndex or find may be running
+    bool isOpen() const { return opened; }
+    uint64_t size() const { return file.size(); }
+
+    // Returns false if cancelled. progress is called about every 32 MB.
+    bool buildIndex(const std::atomic<bool>& cancelled, const Progress& progress = {});
+    bool indexComplete() const { return index.load()->complete; }
+    uint64_t indexedLines() const { return index.load()->lines; } // Lines whose start is known exactly
+    uint64_t indexedBytes() const { return index.load()->scanned; }
+
+    uint64_t lineCount() const; // Exact once the index is complete
+    uint64_t lineStart(uint64_t line) const; // Estimated past the index; size() past the end
+    uint64_t lineAt(uint64_t offset) const;  // Of any offset; estimated past the index
+    uint64_t startOfLine(uint64_t offset) const; // Of any offset
+    uint64_t nextLine(uint64_t offset) const;    // size() after the last line
+    uint64_t previousLine(uint64_t offset) const; // 0 for the first line
+    std::string_view line(uint64_t offset) const;
+
+    // First occurrence of needle in [from, to), ASCII case-insensitively
+    // unless caseSensitive; npos if there is none or once cancelled
+    uint64_t find(std::string_view needle, uint64_t from, uint64_t to, bool caseSensitive,
+                  const std::atomic<bool>& cancelled) const;
+
+private:
+    struct LineIndex {
+        std::vector<uint64_t> checkpoints; // Start of line i * kCheckpointLines
+        uint64_t lines = 0;   // Lines starting before scanned
+        uint64_t scanned = 0; // Bytes searched for line breaks
+        bool complete = false;
+    };
+
+    // Start of the line count lines after the line starting at offset
+    uint64_t advance(uint64_t offset, uint64_t count) const;
+    double averageLineLength(const LineIndex& snapshot) const;
+
+    MappedFile file;
+    bool opened = false;
+    AtomicSharedPtr<const LineIndex> index{std::make_shared<const LineIndex>()};
+};
+
+#endif // TEXTPAGER_H
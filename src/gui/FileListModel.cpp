@@ -0,0 +1,162 @@
+#include "FileListModel.h"
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+
+FileListModel::FileListModel(QObject *parent)
+    : QAbstractListModel(parent), offsets(1, 0)
+{
+}
+
+void FileListModel::setFiles(const std::string& rootPath, const std::vector<std::string>& fileKeys)
+{
+    beginResetModel();
+    root = rootPath;
+    keys.clear();
+    offsets.assign(1, 0);
+    offsets.reserve(fileKeys.size() + 1);
+    size_t total = 0;
+    for (const auto& key : fileKeys) total += key.size();
+    keys.reserve(total);
+    for (const auto& key : fileKeys) {
+        keys += key;
+        offsets.push_back(static_cast<uint32_t>(keys.size()));
+    }
+    byKey.resize(fileKeys.size());
+    std::iota(byKey.begin(), byKey.end(), 0u);
+    std::sort(byKey.begin(), byKey.end(), [this](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    keys.shrink_to_fit();
+    endResetModel();
+}
+
+int FileListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : count();
+}
+
+QVariant FileListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= count()) return QVariant();
+    int row = index.row();
+    switch (role) {
+    case Qt::DisplayRole: {
+        std::string_view n = name(row);
+        return QString::fromUtf8(n.data(), static_cast<qsizetype>(n.size()));
+    }
+    case Qt::ToolTipRole:
+    case KeyRole: {
+        std::string_view k = key(row);
+        return QString::fromUtf8(k.data(), static_cast<qsizetype>(k.size()));
+    }
+    case PathRole:
+        return QString::fromStdString(path(row));
+    default:
+        return QVariant();
+    }
+}
+
+std::string_view FileListModel::name(int row) const
+{
+    std::string_view k = key(row);
+    size_t slash = k.rfind('/');
+    return slash == std::string_view::npos ? k : k.substr(slash + 1);
+}
+
+std::string FileListModel::path(int row) const
+{
+    std::filesystem::path p(root);
+    p /= std::string(key(row));
+    return p.make_preferred().string();
+}
+
+int FileListModel::rowOf(std::string_view wanted) const
+{
+    auto it = std::lower_bound(byKey.begin(), byKey.end(), wanted,
+                               [this](uint32_t row, std::string_view k) { return key(row) < k; });
+    return (it != byKey.end() && key(*it) == wanted) ? static_cast<int>(*it) : -1;
+}
+
+FileFilterModel::FileFilterModel(QObject *parent)
+    : QAbstractProxyModel(parent)
+{
+}
+
+void FileFilterModel::setSourceModel(QAbstractItemModel *model)
+{
+    beginResetModel();
+    if (sourceModel()) {
+        disconnect(sourceModel(), SIGNAL(modelAboutToBeReset()), this, nullptr);
+        disconnect(sourceModel(), SIGNAL(modelReset()), this, nullptr);
+    }
+    QAbstractProxyModel::setSourceModel(model);
+    rows.clear();
+    filtered = false;
+    if (model) {
+        // A new scan replaces every row, and with them any filter
+        connect(model, &QAbstractItemModel::modelAboutToBeReset, this, [this]() { beginResetModel(); });
+        connect(model, &QAbstractItemModel::modelReset, this, [this]() {
+            rows.clear();
+            filtered = false;
+            endResetModel();
+        });
+    }
+    endResetModel();
+}
+
+void FileFilterModel::setRows(std::vector<uint32_t> sourceRows)
+{
+    if (filtered && sourceRows == rows) return;
+    beginResetModel();
+    rows = std::move(sourceRows);
+    filtered = true;
+    ascending = std::is_sorted(rows.begin(), rows.end());
+    endResetModel();
+}
+
+void FileFilterModel::showAll()
+{
+    if (!filtered) return;
+    beginResetModel();
+    rows.clear();
+    rows.shrink_to_fit();
+    filtered = false;
+    endResetModel();
+}
+
+QModelIndex FileFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || column != 0 || row < 0 || row >= rowCount()) return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex FileFilterModel::parent(const QModelIndex &) const
+{
+    return QModelIndex();
+}
+
+int FileFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !sourceModel()) return 0;
+    return filtered ? static_cast<int>(rows.size()) : sourceModel()->rowCount();
+}
+
+int FileFilterModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : 1;
+}
+
+QModelIndex FileFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel()) return QModelIndex();
+    return sourceModel()->index(sourceRow(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex FileFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid()) return QModelIndex();
+    if (!filtered) return index(sourceIndex.row(), sourceIndex.column());
+    uint32_t row = static_cast<uint32_t>(sourceIndex.row());
+    auto it = ascending ? std::lower_bound(rows.begin(), rows.end(), row) : std::find(rows.begin(), rows.end(), row);
+    if (it == rows.end() || *it != row) return QModelIndex();
+    return index(static_cast<int>(it - rows.begin()), sourceIndex.column());
+}
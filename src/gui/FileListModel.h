@@ -0,0 +1,76 @@
+#ifndef FILELISTMODEL_H
+#define FILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QAbstractProxyModel>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// The explorer's file list: one row per scanned file, held as a single pool
+// of '/'-separated tag keys plus two 4-byte arrays, so a row costs its key
+// bytes and 8 bytes more. Display strings and full paths are built only when
+// a view asks for a row it paints.
+class FileListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        PathRole = Qt::UserRole, // Full path
+        KeyRole                  // Tag key, relative to the root
+    };
+
+    explicit FileListModel(QObject *parent = nullptr);
+
+    // keys are TagManager::fileKey of the scanned files, relative to root
+    void setFiles(const std::string& root, const std::vector<std::string>& keys);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    int count() const { return static_cast<int>(byKey.size()); }
+    std::string_view key(int row) const { return {keys.data() + offsets[row], offsets[row + 1] - offsets[row]}; }
+    std::string_view name(int row) const; // Last component of the key
+    std::string path(int row) const;
+    int rowOf(std::string_view key) const; // -1 if absent
+
+private:
+    std::string root;
+    std::string keys;               // Back to back
+    std::vector<uint32_t> offsets;  // Row i is keys[offsets[i], offsets[i + 1])
+    std::vector<uint32_t> byKey;    // Rows sorted by key, for rowOf
+};
+
+// Shows a subset of a FileListModel's rows, given as an array of source rows,
+// so applying a filter is one array swap instead of hiding and showing items
+// one by one. Rows are ascending for filters and in rank order for the fuzzy
+// finder; the latter are few, so mapping back to them is a linear scan.
+class FileFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit FileFilterModel(QObject *parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel *model) override;
+    void setRows(std::vector<uint32_t> rows);
+    void showAll();
+    bool isFiltered() const { return filtered; }
+    int sourceRow(int row) const { return filtered ? static_cast<int>(rows[row]) : row; }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+
+private:
+    std::vector<uint32_t> rows;
+    bool filtered = false;
+    bool ascending = true;
+};
+
+#endif // FILELISTMODEL_H
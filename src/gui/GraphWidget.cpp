@@ -8,57 +8,113 @@
 #include <QWheelEvent>
 #include <QStyleOptionGraphicsItem>
 #include <QRandomGenerator>
+#include <QSet>
+#include <unordered_set>
+#include <algorithm>
+
+namespace {
+
+// Nodes restored from the saved layout are where they belong; a graph that
+// was partly restored, or changed while shown, warms up only this much, so
+// the new nodes find their place without shuffling the rest
+constexpr double kRestoredTemperature = 0.0;
+constexpr double kUpdateTemperature = 0.1;
+constexpr double kPartialTemperature = 0.3;
+
+// Level of detail, in screen pixels per scene unit
+constexpr qreal kTextLod = 0.6;      // Below this nodes lose text, shadow and gradient
+constexpr qreal kPointLod = 0.25;    // Below this they are points
+constexpr qreal kSmoothEdgeLod = 1.0; // Edges are antialiased from here on
+
+// Smaller graphs always show every node
+constexpr size_t kClusterMinNodes = 1000;
+constexpr size_t kMinClusterSize = 12;
+// A cluster opens once its members spread this many pixels across
+constexpr qreal kExpandPixels = 160;
+
+// The scene grows with the graph, so nodes keep about this much room each
+// however many there are; small graphs get the minimum. Less than this and
+// the repulsion of a large graph presses most nodes against the walls.
+constexpr qreal kNodeSpacing = 160;
+constexpr qreal kMinSceneHalf = 400;
+
+qreal sceneHalfFor(size_t nodes)
+{
+    return std::max(kMinSceneHalf, std::sqrt(static_cast<qreal>(nodes)) * kNodeSpacing / 2);
+}
+
+QString layoutPathOf(const QString &root)
+{
+    return root + "/.smartfile/graph-layout.bin";
+}
+
+} // namespace
 
 // --- Edge Implementation ---
 Edge::Edge(Node *sourceNode, Node *destNode)
     : source(sourceNode), dest(destNode)
 {
-    setAcceptedMouseButtons(Qt::NoButton);
     source->addEdge(this);
     dest->addEdge(this);
-    adjust();
 }
 
-void Edge::adjust()
+// --- EdgeLayer Implementation ---
+EdgeLayer::EdgeLayer()
 {
-    if (!source || !dest) return;
-
-    QLineF line(mapFromItem(source, 0, 0), mapFromItem(dest, 0, 0));
-    qreal length = line.length();
+    setAcceptedMouseButtons(Qt::NoButton);
+    setZValue(0);
+}
 
+void EdgeLayer::setBounds(const QRectF &rect)
+{
     prepareGeometryChange();
-
-    if (length > qreal(20.)) {
-        QPointF edgeOffset((line.dx() * 10) / length, (line.dy() * 10) / length);
-        sourcePoint = line.p1() + edgeOffset;
-        destPoint = line.p2() - edgeOffset;
-    } else {
-        sourcePoint = destPoint = line.p1();
-    }
+    bounds = rect;
 }
 
-QRectF Edge::boundingRect() const
+void EdgeLayer::setLines(QList<QLineF> newLines)
 {
-    if (!source || !dest) return QRectF();
+    lines = std::move(newLines);
+    update();
+}
 
-    qreal penWidth = 1;
-    qreal extra = (penWidth + arrowSize) / 2.0;
+void EdgeLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
+{
+    if (lines.isEmpty()) return;
+
+    // Hairlines: a zoomed-out edge costs the same as a zoomed-in one
+    painter->save();
+    qreal lod = option->levelOfDetailFromTransform(painter->worldTransform());
+    painter->setRenderHint(QPainter::Antialiasing, lod >= kSmoothEdgeLod);
+    painter->setPen(QPen(Qt::gray, 0));
+    painter->drawLines(lines);
+    painter->restore();
+}
 
-    return QRectF(sourcePoint, QSizeF(destPoint.x() - sourcePoint.x(),
-                                      destPoint.y() - sourcePoint.y()))
-        .normalized()
-        .adjusted(-extra, -extra, extra, extra);
+// --- ClusterNode Implementation ---
+ClusterNode::ClusterNode(const QString &label, int members)
+    : m_label(label), m_members(members), m_radius(12 + 3 * std::sqrt(qreal(members)))
+{
+    setAcceptedMouseButtons(Qt::NoButton);
+    setCacheMode(DeviceCoordinateCache);
+    setZValue(1);
+    setToolTip(QString("%1 (%2)").arg(label).arg(members));
 }
 
-void Edge::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+QRectF ClusterNode::boundingRect() const
 {
-    if (!source || !dest) return;
+    return QRectF(-m_radius - 1, -m_radius - 1, 2 * m_radius + 2, 2 * m_radius + 2);
+}
 
-    QLineF line(sourcePoint, destPoint);
-    if (qFuzzyCompare(line.length(), qreal(0.))) return;
+void ClusterNode::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
+{
+    painter->setPen(QPen(Qt::black, 0));
+    painter->setBrush(QColor(230, 160, 60)); // Orange
+    painter->drawEllipse(QPointF(0, 0), m_radius, m_radius);
 
-    painter->setPen(QPen(Qt::gray, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-    painter->drawLine(line);
+    qreal lod = option->levelOfDetailFromTransform(painter->worldTransform());
+    if (lod * m_radius < 20) return;
+    painter->setPen(Qt::black);
+    painter->drawText(boundingRect(), Qt::AlignCenter, QString("%1\n(%2)").arg(m_label).arg(m_members));
 }
 
 // --- Node Implementation ---
@@ -74,71 +130,16 @@ Node::Node(GraphWidget *graphWidget, NodeType type, const QString &text)
 void Node::addEdge(Edge *edge)
 {
     edgeList << edge;
-    edge->adjust();
 }
 
-QList<Edge *> Node::edges() const
+void Node::removeEdge(Edge *edge)
 {
-    return edgeList;
-}
-
-void Node::calculateForces()
-{
-    if (!scene() || scene()->mouseGrabberItem() == this) {
-        newPos = pos();
-        return;
-    }
-
-    // Sum up all forces
-    qreal xvel = 0;
-    qreal yvel = 0;
-
-    // Repulsion from other nodes
-    for (QGraphicsItem *item : scene()->items()) {
-        Node *node = qgraphicsitem_cast<Node *>(item);
-        if (!node) continue;
-
-        QPointF vec = mapToItem(node, 0, 0);
-        qreal dx = vec.x();
-        qreal dy = vec.y();
-        double l = 2.0 * (dx * dx + dy * dy);
-        if (l > 0) {
-            xvel += (dx * 150.0) / l;
-            yvel += (dy * 150.0) / l;
-        }
-    }
-
-    // Attraction to connected nodes (Edges)
-    double weight = (edgeList.size() + 1) * 10;
-    for (const Edge *edge : edgeList) {
-        QPointF vec;
-        if (edge->sourceNode() == this)
-            vec = mapToItem(edge->destNode(), 0, 0);
-        else
-            vec = mapToItem(edge->sourceNode(), 0, 0);
-        
-        xvel -= vec.x() / weight;
-        yvel -= vec.y() / weight;
-    }
-
-    if (qAbs(xvel) < 0.1 && qAbs(yvel) < 0.1)
-        xvel = yvel = 0;
-
-    QRectF sceneRect = scene()->sceneRect();
-    newPos = pos() + QPointF(xvel, yvel);
-    
-    // Keep within bounds
-    newPos.setX(qMin(qMax(newPos.x(), sceneRect.left() + 10), sceneRect.right() - 10));
-    newPos.setY(qMin(qMax(newPos.y(), sceneRect.top() + 10), sceneRect.bottom() - 10));
+    edgeList.removeOne(edge);
 }
 
-bool Node::advancePosition()
+QList<Edge *> Node::edges() const
 {
-    if (newPos == pos())
-        return false;
-
-    setPos(newPos);
-    return true;
+    return edgeList;
 }
 
 QRectF Node::boundingRect() const
@@ -159,20 +160,32 @@ QPainterPath Node::shape() const
 
 void Node::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
 {
-    // Shadow
-    painter->setPen(Qt::NoPen);
-    painter->setBrush(Qt::darkGray);
     int width = 20 + m_text.length() * 6;
-    painter->drawRoundedRect(-width/2 + 3, -15 + 3, width, 30, 5, 5);
-
-    // Body
     QColor color;
     if (m_type == File) {
         color = QColor(100, 200, 100); // Green
     } else {
         color = QColor(100, 150, 255); // Blue
     }
-    
+
+    qreal lod = option->levelOfDetailFromTransform(painter->worldTransform());
+    if (lod < kPointLod) {
+        // About 3 pixels, whatever the zoom
+        qreal r = std::min(1.5 / lod, qreal(15));
+        painter->fillRect(QRectF(-r, -r, 2 * r, 2 * r), color);
+        return;
+    }
+    if (lod < kTextLod) {
+        painter->fillRect(QRectF(-width/2, -15, width, 30), color);
+        return;
+    }
+
+    // Shadow
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(Qt::darkGray);
+    painter->drawRoundedRect(-width/2 + 3, -15 + 3, width, 30, 5, 5);
+
+    // Body
     QRadialGradient gradient(-3, -3, width/2);
     if (option->state & QStyle::State_Sunken) {
         gradient.setCenter(3, 3);
@@ -197,9 +210,10 @@ QVariant Node::itemChange(GraphicsItemChange change, const QVariant &value)
 {
     switch (change) {
     case ItemPositionHasChanged:
-        for (Edge *edge : edgeList)
-            edge->adjust();
-        graph->itemMoved();
+        // A tick moves many nodes at once and redraws the edges after them
+        if (graph->isApplyingLayout())
+            break;
+        graph->itemMoved(this);
         break;
     default:
         break;
@@ -217,6 +231,7 @@ void Node::mousePressEvent(QGraphicsSceneMouseEvent *event)
 void Node::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
     update();
+    graph->itemReleased(this);
     QGraphicsItem::mouseReleaseEvent(event);
 }
 
@@ -236,40 +251,187 @@ GraphWidget::GraphWidget(TagManager* tagMgr, QWidget *parent)
     scale(0.8, 0.8);
     setMinimumSize(400, 400);
 
-    // Initial build
-    // buildGraph(); 
+    edgeLayer = new EdgeLayer();
+    edgeLayer->setBounds(scene->sceneRect());
+    scene->addItem(edgeLayer);
+
+    // Built on first show, see refresh()
 }
 
-void GraphWidget::itemMoved()
+GraphWidget::~GraphWidget()
 {
-    if (!timerId)
-        timerId = startTimer(1000 / 25);
+    saveLayout();
+    for (const auto &[tag, node] : tagNodes)
+        qDeleteAll(node->edges());
 }
 
-void GraphWidget::timerEvent(QTimerEvent *event)
+void GraphWidget::itemMoved(Node *node)
 {
-    QList<Node *> nodes;
-    const QList<QGraphicsItem *> items = scene()->items();
-    for (QGraphicsItem *item : items) {
-        if (Node *node = qgraphicsitem_cast<Node *>(item))
-            nodes << node;
+    // A node dragged by the user takes the layout along, and stays where it
+    // is put until released
+    if (node->layoutIndex() < nodes.size()) {
+        positions[node->layoutIndex()] = node->pos();
+        lodDirty = true;
+        layoutDirty = true;
+        movedAt = engine.frame()->sequence;
+        engine.moveNode(node->layoutIndex(), node->x(), node->y());
     }
+    if (!timerId)
+        timerId = startTimer(1000 / 60);
+}
 
-    for (Node *node : nodes)
-        node->calculateForces();
+void GraphWidget::itemReleased(Node *)
+{
+    engine.release();
+}
 
-    bool itemsMoved = false;
-    for (Node *node : nodes) {
-        if (node->advancePosition())
-            itemsMoved = true;
+void GraphWidget::timerEvent(QTimerEvent *)
+{
+    // Only the latest frame is shown; steps taken in between are skipped
+    std::shared_ptr<const LayoutEngine::Frame> frame = engine.frame();
+    if (frame->graph != graphId)
+        return;
+    if (frame->communities && frame->communities != communities && frame->communities->size() == nodes.size()) {
+        communities = frame->communities;
+        rebuildClusters();
+    }
+    if (frame->sequence != appliedSequence && frame->xs.size() == nodes.size()) {
+        appliedSequence = frame->sequence;
+        // The node under the mouse goes where it is dragged, not where it is pushed
+        Node *grabbed = qgraphicsitem_cast<Node *>(scene()->mouseGrabberItem());
+        for (uint32_t i = 0; i < nodes.size(); ++i) {
+            QPointF pos(frame->xs[i], frame->ys[i]);
+            if (nodes[i] == grabbed || pos == positions[i])
+                continue;
+            positions[i] = pos;
+            lodDirty = true;
+            layoutDirty = true;
+        }
     }
+    if (lodDirty)
+        updateLevelOfDetail();
 
-    if (!itemsMoved) {
+    // A frame from before the last drag may say settled though the drag woke
+    // the layout up again
+    if (frame->settled && frame->sequence > movedAt) {
         killTimer(timerId);
         timerId = 0;
+        saveLayout();
+    }
+}
+
+void GraphWidget::rebuildClusters()
+{
+    for (const Cluster &cluster : clusters) {
+        scene()->removeItem(cluster.item);
+        delete cluster.item;
+    }
+    clusters.clear();
+    clusterOf.assign(nodes.size(), -1);
+    lodDirty = true;
+    if (nodes.size() < kClusterMinNodes || !communities || communities->size() != nodes.size())
+        return;
+
+    std::vector<std::vector<uint32_t>> members;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        uint32_t community = (*communities)[i];
+        if (community >= members.size())
+            members.resize(community + 1);
+        members[community].push_back(i);
+    }
+    for (std::vector<uint32_t> &group : members) {
+        if (group.size() < kMinClusterSize)
+            continue;
+        // Named after its best-connected tag
+        Node *named = nullptr;
+        for (uint32_t i : group) {
+            if (nodes[i]->nodeType() == Node::Tag && (!named || nodes[i]->edges().size() > named->edges().size()))
+                named = nodes[i];
+        }
+        Cluster cluster;
+        cluster.item = new ClusterNode((named ? named : nodes[group.front()])->text(), static_cast<int>(group.size()));
+        cluster.item->setVisible(false);
+        scene()->addItem(cluster.item);
+        for (uint32_t i : group)
+            clusterOf[i] = static_cast<int32_t>(clusters.size());
+        cluster.members = std::move(group);
+        clusters.push_back(std::move(cluster));
     }
 }
 
+void GraphWidget::updateLevelOfDetail()
+{
+    lodDirty = false;
+    if (clusterOf.size() != nodes.size())
+        clusterOf.assign(nodes.size(), -1);
+
+    // A cluster opens when the spread of its members would be large enough
+    // on screen to tell them apart
+    qreal zoom = transform().m11();
+    for (Cluster &cluster : clusters) {
+        // Emptied by a change: shown as open, which hides it
+        if (cluster.members.empty()) {
+            cluster.expanded = true;
+            cluster.item->setVisible(false);
+            continue;
+        }
+        qreal sx = 0, sy = 0, sxx = 0, syy = 0;
+        for (uint32_t i : cluster.members) {
+            sx += positions[i].x();
+            sy += positions[i].y();
+            sxx += positions[i].x() * positions[i].x();
+            syy += positions[i].y() * positions[i].y();
+        }
+        qreal n = cluster.members.size();
+        cluster.centre = QPointF(sx / n, sy / n);
+        qreal spread = std::sqrt(std::max(qreal(0), sxx / n + syy / n - (sx * sx + sy * sy) / (n * n)));
+        cluster.expanded = 2 * spread * zoom > kExpandPixels;
+        cluster.item->setVisible(!cluster.expanded);
+        if (!cluster.expanded)
+            cluster.item->setPos(cluster.centre);
+    }
+
+    // Hidden members are neither moved nor painted
+    Node *grabbed = qgraphicsitem_cast<Node *>(scene()->mouseGrabberItem());
+    applyingLayout = true;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        Node *node = nodes[i];
+        bool shown = clusterOf[i] < 0 || clusters[clusterOf[i]].expanded;
+        if (node->isVisible() != shown)
+            node->setVisible(shown);
+        if (shown && node != grabbed && node->pos() != positions[i])
+            node->setPos(positions[i]);
+    }
+    applyingLayout = false;
+
+    // Edges into a closed cluster end at its centre, and each pair of
+    // clusters is joined once
+    const uint64_t n = nodes.size();
+    QList<QLineF> lines;
+    lines.reserve(edgeEnds.size());
+    std::unordered_set<uint64_t> clusterLinks;
+    auto endOf = [&](uint32_t i, uint64_t &key) {
+        int32_t c = clusterOf[i];
+        if (c >= 0 && !clusters[c].expanded) {
+            key = n + c;
+            return clusters[c].centre;
+        }
+        key = i;
+        return positions[i];
+    };
+    for (const auto &[a, b] : edgeEnds) {
+        uint64_t ka, kb;
+        QPointF pa = endOf(a, ka);
+        QPointF pb = endOf(b, kb);
+        if (ka == kb)
+            continue;
+        if ((ka >= n || kb >= n) && !clusterLinks.insert(std::min(ka, kb) << 32 | std::max(ka, kb)).second)
+            continue;
+        lines.append(QLineF(pa, pb));
+    }
+    edgeLayer->setLines(std::move(lines));
+}
+
 void GraphWidget::wheelEvent(QWheelEvent *event)
 {
     scaleView(pow(2., -event->angleDelta().y() / 240.0));
@@ -294,6 +456,8 @@ void GraphWidget::scaleView(qreal scaleFactor)
         return;
 
     scale(scaleFactor, scaleFactor);
+    if (!clusters.empty())
+        updateLevelOfDetail();
 }
 
 void GraphWidget::zoomIn()
@@ -306,60 +470,335 @@ void GraphWidget::zoomOut()
     scaleView(1 / 1.2);
 }
 
-void GraphWidget::buildGraph() {
+void GraphWidget::setLibraryRoot(const QString &root)
+{
+    saveLayout();
+    clearGraph();
+    built = false;
+    layoutDirty = false;
+
+    libraryRoot = root;
+    savedLayout.load(layoutPathOf(root).toStdString());
+    if (isVisible())
+        buildGraph();
+}
+
+void GraphWidget::refresh()
+{
+    if (!built)
+        buildGraph();
+    else
+        applyPendingChanges();
+}
+
+void GraphWidget::applyChanges(const TagManager::ChangeSet &changes)
+{
+    // Before the first build there is nothing to update
+    if (!built) return;
+    pendingFiles.insert(changes.files.begin(), changes.files.end());
+    pendingTags.insert(changes.tags.begin(), changes.tags.end());
+    if (isVisible())
+        applyPendingChanges();
+}
+
+Node *GraphWidget::addTagNode(const QString &tag, const QPointF &fallback)
+{
+    Node *tagNode = new Node(this, Node::Tag, tag);
+    if (const auto *saved = savedLayout.find(GraphLayoutStore::Kind::Tag, tag.toStdString()))
+        tagNode->setPos(saved->x, saved->y);
+    else
+        tagNode->setPos(fallback);
+    scene()->addItem(tagNode);
+    tagNodes[tag] = tagNode;
+    return tagNode;
+}
+
+Node *GraphWidget::addFileNode(const QString &key, const QPointF &fallback)
+{
+    // Same-named files in different folders stay apart: nodes are keyed by path, labelled by name
+    Node *fileNode = new Node(this, Node::File, QString::fromStdString(std::filesystem::path(key.toStdString()).filename().string()));
+    if (const auto *saved = savedLayout.find(GraphLayoutStore::Kind::File, key.toStdString()))
+        fileNode->setPos(saved->x, saved->y);
+    else
+        fileNode->setPos(fallback);
+    scene()->addItem(fileNode);
+    fileNodes[key] = fileNode;
+    return fileNode;
+}
+
+void GraphWidget::removeNode(Node *node)
+{
+    for (Edge *edge : node->edges()) {
+        Node *other = edge->sourceNode() == node ? edge->destNode() : edge->sourceNode();
+        other->removeEdge(edge);
+        delete edge;
+    }
+    scene()->removeItem(node);
+    delete node;
+}
+
+void GraphWidget::clearGraph()
+{
+    // Edges are not items, so the scene does not delete them
+    for (const auto &[tag, node] : tagNodes)
+        qDeleteAll(node->edges());
+    scene()->removeItem(edgeLayer);
     scene()->clear();
+    scene()->addItem(edgeLayer);
+    edgeLayer->setLines({});
+    clusters.clear();
+    clusterOf.clear();
+    communities.reset();
     fileNodes.clear();
     tagNodes.clear();
+    nodes.clear();
+    positions.clear();
+    edgeEnds.clear();
+    pendingFiles.clear();
+    pendingTags.clear();
+    appliedSequence = 0;
+    movedAt = 0;
+    graphId = engine.setGraph({}, {}, {});
+}
+
+void GraphWidget::applyPendingChanges()
+{
+    if (pendingFiles.empty() && pendingTags.empty()) return;
+
+    std::shared_ptr<const TagIndex> view = tagManager->snapshot();
+    bool changed = false;
+
+    // Each changed file gets the edges of its current tags: stale ones are
+    // dropped, missing ones (and the tag nodes they need) added
+    for (const std::string &key : pendingFiles) {
+        QString qFile = QString::fromStdString(key);
+        QSet<QString> wanted;
+        std::vector<QString> wantedInOrder;
+        uint32_t file = view->findFile(key);
+        if (file != TagIndex::npos) {
+            for (uint32_t tag : view->tagsOf(file)) {
+                QString qTag = QString::fromStdString(std::string(view->tagName(tag)));
+                if (!wanted.contains(qTag)) {
+                    wanted.insert(qTag);
+                    wantedInOrder.push_back(qTag);
+                }
+            }
+        }
+
+        auto it = fileNodes.find(qFile);
+        Node *fileNode = it != fileNodes.end() ? it->second : nullptr;
+        if (wanted.isEmpty()) {
+            if (fileNode) {
+                fileNodes.erase(it);
+                removeNode(fileNode);
+                changed = true;
+            }
+            continue;
+        }
+
+        if (fileNode) {
+            for (Edge *edge : fileNode->edges()) {
+                if (wanted.remove(edge->sourceNode()->text()))
+                    continue;
+                edge->sourceNode()->removeEdge(edge);
+                fileNode->removeEdge(edge);
+                delete edge;
+                changed = true;
+            }
+        } else {
+            // A new file starts next to its first tag
+            int spread = static_cast<int>(scene()->sceneRect().width() / 4);
+            QPointF near(QRandomGenerator::global()->bounded(2 * spread) - spread,
+                         QRandomGenerator::global()->bounded(2 * spread) - spread);
+            auto tagIt = tagNodes.find(wantedInOrder.front());
+            if (tagIt != tagNodes.end())
+                near = positionOf(tagIt->second) + QPointF(QRandomGenerator::global()->bounded(40) - 20,
+                                                     QRandomGenerator::global()->bounded(40) - 20);
+            fileNode = addFileNode(qFile, near);
+            changed = true;
+        }
+
+        for (const QString &qTag : wantedInOrder) {
+            if (!wanted.contains(qTag)) continue;
+            auto tagIt = tagNodes.find(qTag);
+            Node *tagNode = tagIt != tagNodes.end() ? tagIt->second
+                                                    : addTagNode(qTag, fileNode->pos() + QPointF(30, 30));
+            new Edge(tagNode, fileNode);
+            changed = true;
+        }
+    }
+
+    // Every file a tag gained or lost was handled above, so a tag node left
+    // without edges has no files
+    for (const std::string &tag : pendingTags) {
+        auto it = tagNodes.find(QString::fromStdString(tag));
+        if (it != tagNodes.end() && it->second->edges().isEmpty()) {
+            Node *tagNode = it->second;
+            tagNodes.erase(it);
+            removeNode(tagNode);
+            changed = true;
+        }
+    }
+
+    pendingFiles.clear();
+    pendingTags.clear();
+    if (changed)
+        restartLayout(kUpdateTemperature);
+}
+
+void GraphWidget::restartLayout(double temperature)
+{
+    // Positions and clusters are by layout index: carry them over to the new
+    // numbering. Clusters are recomputed for the new graph, but until then
+    // the old ones stay closed.
+    std::vector<Node*> renumbered;
+    std::vector<QPointF> newPositions;
+    std::vector<int32_t> newClusterOf;
+    renumbered.reserve(tagNodes.size() + fileNodes.size());
+    auto carryOver = [&](Node *node) {
+        uint32_t old = node->layoutIndex();
+        bool known = old < nodes.size() && nodes[old] == node;
+        newPositions.push_back(known ? positions[old] : node->pos());
+        newClusterOf.push_back(known && old < clusterOf.size() ? clusterOf[old] : -1);
+        node->setLayoutIndex(static_cast<uint32_t>(renumbered.size()));
+        renumbered.push_back(node);
+    };
+    for (const auto &[tag, node] : tagNodes)
+        carryOver(node);
+    for (const auto &[key, node] : fileNodes)
+        carryOver(node);
+    nodes = std::move(renumbered);
+    positions = std::move(newPositions);
+    clusterOf = std::move(newClusterOf);
+    for (Cluster &cluster : clusters)
+        cluster.members.clear();
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (clusterOf[i] >= 0)
+            clusters[clusterOf[i]].members.push_back(i);
+    }
+    // Every edge joins a tag to a file, so the tags' edges are all of them
+    edgeEnds.clear();
+    for (const auto &[tag, node] : tagNodes) {
+        for (Edge *edge : node->edges())
+            edgeEnds.emplace_back(edge->sourceNode()->layoutIndex(), edge->destNode()->layoutIndex());
+    }
+
+    std::vector<double> xs, ys;
+    xs.reserve(nodes.size());
+    ys.reserve(nodes.size());
+    for (const QPointF &pos : positions) {
+        xs.push_back(pos.x());
+        ys.push_back(pos.y());
+    }
+    qreal half = sceneHalfFor(nodes.size());
+    QRectF bounds(-half, -half, 2 * half, 2 * half);
+    if (bounds != scene()->sceneRect()) {
+        scene()->setSceneRect(bounds);
+        edgeLayer->setBounds(bounds);
+        resetCachedContent();
+    }
+    engine.setBounds(bounds.left(), bounds.top(), bounds.right(), bounds.bottom());
+    graphId = engine.setGraph(std::move(xs), std::move(ys), edgeEnds, temperature);
+    appliedSequence = 0;
+    movedAt = 0;
+    layoutDirty = true;
+    updateLevelOfDetail();
+    if (!timerId)
+        timerId = startTimer(1000 / 60);
+}
+
+QPointF GraphWidget::positionOf(Node *node) const
+{
+    uint32_t index = node->layoutIndex();
+    return index < nodes.size() && nodes[index] == node ? positions[index] : node->pos();
+}
+
+void GraphWidget::rememberPositions()
+{
+    savedLayout.clear();
+    for (const auto &[tag, node] : tagNodes) {
+        QPointF pos = positionOf(node);
+        savedLayout.set(GraphLayoutStore::Kind::Tag, tag.toStdString(), pos.x(), pos.y());
+    }
+    for (const auto &[key, node] : fileNodes) {
+        QPointF pos = positionOf(node);
+        savedLayout.set(GraphLayoutStore::Kind::File, key.toStdString(), pos.x(), pos.y());
+    }
+}
+
+void GraphWidget::saveLayout()
+{
+    if (!built || !layoutDirty || libraryRoot.isEmpty()) return;
+    rememberPositions();
+    savedLayout.save(layoutPathOf(libraryRoot).toStdString());
+    layoutDirty = false;
+}
+
+void GraphWidget::buildGraph() {
+    // A rebuild keeps the nodes that are still there in place
+    if (built)
+        rememberPositions();
+    clearGraph();
+    built = true;
 
     if (!tagManager) return;
-    
-    std::vector<std::string> allTags = tagManager->getAllTags();
+
+    // One snapshot for the whole build, so edits made meanwhile cannot leave
+    // the graph half old, half new
+    std::shared_ptr<const TagIndex> view = tagManager->snapshot();
+    std::vector<std::string> allTags;
+    for (uint32_t tag : view->sortedTags()) {
+        allTags.emplace_back(view->tagName(tag));
+    }
     if (allTags.empty()) {
         //scene()->addText("No tags found.", QFont("Arial", 20))->setDefaultTextColor(Qt::white);
         return;
     }
 
-    // 1. Create Tag Nodes (Blue)
+    // New nodes start in the middle half of the scene the graph will get
+    double radius = sceneHalfFor(allTags.size() + view->liveFileCount()) / 2;
+    int spread = static_cast<int>(radius);
+
+    // 1. Create Tag Nodes (Blue), where they were saved or on a circle
+    size_t restored = 0;
     int i = 0;
     int count = allTags.size();
     for (const auto& tagStr : allTags) {
-        QString qTag = QString::fromStdString(tagStr);
-        Node* tagNode = new Node(this, Node::Tag, qTag);
-        
-        // Distribute in a circle
         double angle = 2.0 * M_PI * i / count;
-        tagNode->setPos(200 * cos(angle), 200 * sin(angle));
-        
-        scene()->addItem(tagNode);
-        tagNodes[qTag] = tagNode;
+        addTagNode(QString::fromStdString(tagStr), QPointF(radius * cos(angle), radius * sin(angle)));
+        if (savedLayout.find(GraphLayoutStore::Kind::Tag, tagStr)) ++restored;
         i++;
     }
     
     // 2. Create File Nodes (Green) for files that have tags
-    // This is a bit inefficient (O(Tags * Files)), but fine for MVP
     for (const auto& tagStr : allTags) {
-        QString qTag = QString::fromStdString(tagStr);
-        Node* tagNode = tagNodes[qTag];
+        Node* tagNode = tagNodes[QString::fromStdString(tagStr)];
         
-        std::vector<std::string> files = tagManager->getFilesByTag(tagStr);
-        for (const auto& f : files) {
-            QString qFile = QString::fromStdString(std::filesystem::path(f).filename().string());
-            
+        for (uint32_t file : view->filesOf(view->findTag(tagStr))) {
+            std::string key = view->fileName(file);
+            QString qFile = QString::fromStdString(key);
+
             Node* fileNode;
-            if (fileNodes.find(qFile) == fileNodes.end()) {
-                fileNode = new Node(this, Node::File, qFile);
-                fileNode->setPos(
-                    QRandomGenerator::global()->bounded(400) - 200, 
-                    QRandomGenerator::global()->bounded(400) - 200
-                ); // Random pos near center
-                scene()->addItem(fileNode);
-                fileNodes[qFile] = fileNode;
+            auto it = fileNodes.find(qFile);
+            if (it == fileNodes.end()) {
+                // Random pos near center
+                fileNode = addFileNode(qFile, QPointF(QRandomGenerator::global()->bounded(2 * spread) - spread,
+                                                      QRandomGenerator::global()->bounded(2 * spread) - spread));
+                if (savedLayout.find(GraphLayoutStore::Kind::File, key)) ++restored;
             } else {
-                fileNode = fileNodes[qFile];
+                fileNode = it->second;
             }
             
             // Create Edge
-            scene()->addItem(new Edge(tagNode, fileNode));
+            new Edge(tagNode, fileNode);
         }
     }
+
+    size_t total = tagNodes.size() + fileNodes.size();
+    restartLayout(restored == total ? kRestoredTemperature
+                  : restored > 0    ? kPartialTemperature
+                                    : 1.0);
+    // Nothing to save until something moves
+    if (restored == total)
+        layoutDirty = false;
 }
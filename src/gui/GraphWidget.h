@@ -5,14 +5,18 @@
 #include <QGraphicsItem>
 #include <vector>
 #include <map>
+#include <set>
+#include "../core/LayoutEngine.h"
+#include "../core/GraphLayoutStore.h"
+#include "../core/TagManager.h"
 
 class Node;
 class Edge;
-class TagManager;
 class GraphWidget; // Forward declaration
 
 // --- Edge Class ---
-class Edge : public QGraphicsItem
+// Not an item of its own: the graph's EdgeLayer draws every edge at once
+class Edge
 {
 public:
     Edge(Node *sourceNode, Node *destNode);
@@ -20,20 +24,49 @@ public:
     Node *sourceNode() const { return source; }
     Node *destNode() const { return dest; }
 
-    void adjust();
+private:
+    Node *source, *dest;
+};
+
+// --- EdgeLayer Class ---
+// All edges as one item under the nodes, drawn with a single drawLines call
+class EdgeLayer : public QGraphicsItem
+{
+public:
+    EdgeLayer();
+
+    void setBounds(const QRectF &rect);
+    void setLines(QList<QLineF> lines);
 
     enum { Type = UserType + 2 };
     int type() const override { return Type; }
 
-protected:
+    QRectF boundingRect() const override { return bounds; }
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    QRectF bounds;
+    QList<QLineF> lines;
+};
+
+// --- ClusterNode Class ---
+// Stands in for a community of nodes while the view is zoomed out too far
+// to tell its members apart
+class ClusterNode : public QGraphicsItem
+{
+public:
+    ClusterNode(const QString &label, int members);
+
+    enum { Type = UserType + 3 };
+    int type() const override { return Type; }
+
     QRectF boundingRect() const override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
 
 private:
-    Node *source, *dest;
-    QPointF sourcePoint;
-    QPointF destPoint;
-    qreal arrowSize;
+    QString m_label;
+    int m_members;
+    qreal m_radius;
 };
 
 // --- Node Class ---
@@ -45,15 +78,18 @@ public:
     Node(GraphWidget *graph, NodeType type, const QString &text);
 
     void addEdge(Edge *edge);
+    void removeEdge(Edge *edge);
     QList<Edge *> edges() const;
     int type() const override { return Type; }
     enum { Type = UserType + 1 };
 
-    void calculateForces();
-    bool advancePosition();
+    // Slot of this node in the graph's layout
+    uint32_t layoutIndex() const { return m_layoutIndex; }
+    void setLayoutIndex(uint32_t index) { m_layoutIndex = index; }
 
     QRectF boundingRect() const override;
     QPainterPath shape() const override;
+    // Zoomed out, a node is a plain box or a point, without shadow or text
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
 
     QString text() const { return m_text; }
@@ -66,8 +102,8 @@ protected:
 
 private:
     QList<Edge *> edgeList;
-    QPointF newPos;
     GraphWidget *graph;
+    uint32_t m_layoutIndex = ForceLayout::npos;
     NodeType m_type;
     QString m_text;
 };
@@ -79,8 +115,20 @@ class GraphWidget : public QGraphicsView
 
 public:
     GraphWidget(TagManager* tagMgr, QWidget *parent = nullptr);
+    ~GraphWidget() override;
     
-    void itemMoved();
+    void itemMoved(Node *node);
+    void itemReleased(Node *node);
+    bool isApplyingLayout() const { return applyingLayout; }
+
+    // Saves where the nodes are and switches to the layout kept under root;
+    // call when the library changes
+    void setLibraryRoot(const QString &root);
+    // Builds the graph the first time it is shown; after that only the
+    // changes made meanwhile are applied, so nodes stay where they are
+    void refresh();
+    // Queued while the graph is hidden, applied at once while it is shown
+    void applyChanges(const TagManager::ChangeSet &changes);
     void buildGraph(); // Rebuilds graph from TagManager
 
 public slots:
@@ -94,12 +142,57 @@ protected:
     void scaleView(qreal scaleFactor);
 
 private:
+    Node *addTagNode(const QString &tag, const QPointF &fallback);
+    Node *addFileNode(const QString &key, const QPointF &fallback);
+    void removeNode(Node *node); // With its edges; the caller drops it from its map
+    void clearGraph();
+    void applyPendingChanges();
+    // Renumbers the nodes and hands the graph to the engine as it now is
+    void restartLayout(double temperature);
+    QPointF positionOf(Node *node) const;
+    // Makes a ClusterNode for every community large enough to collapse
+    void rebuildClusters();
+    // Shows each cluster or its members, depending on how large it is on
+    // screen, moves the shown nodes and redraws the edges
+    void updateLevelOfDetail();
+    void rememberPositions(); // Copies the node positions into savedLayout
+    void saveLayout();
+
     int timerId;
     TagManager* tagManager;
     Node *centerNode;
     
     std::map<QString, Node*> fileNodes;
     std::map<QString, Node*> tagNodes;
+
+    // Positions are simulated on the engine's thread; each tick copies the
+    // latest frame onto the nodes
+    LayoutEngine engine;
+    uint64_t graphId = 0;
+    uint64_t appliedSequence = 0;
+    uint64_t movedAt = 0; // Frame that was latest when a node was last dragged
+    std::vector<Node*> nodes; // By layout index
+    std::vector<QPointF> positions; // By layout index; hidden nodes are not moved
+    ForceLayout::EdgeList edgeEnds; // Layout indices of every edge's ends
+    EdgeLayer *edgeLayer;
+
+    struct Cluster {
+        ClusterNode *item;
+        std::vector<uint32_t> members;
+        QPointF centre;
+        bool expanded = false;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<int32_t> clusterOf; // By layout index; -1 for nodes always shown
+    std::shared_ptr<const std::vector<uint32_t>> communities; // What clusters were made from
+    bool lodDirty = false; // Positions or zoom changed since updateLevelOfDetail
+    bool applyingLayout = false; // Moves made by the tick, not by the user
+
+    QString libraryRoot;
+    GraphLayoutStore savedLayout; // Positions last saved for libraryRoot
+    bool built = false;
+    bool layoutDirty = false; // Nodes moved since the layout was saved
+    std::set<std::string> pendingFiles, pendingTags;
 };
 
 #endif // GRAPHWIDGET_H
@@ -0,0 +1,110 @@
+#include "LibrarySearchDialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QDesktopServices>
+#include <QElapsedTimer>
+#include <QUrl>
+#include <QtConcurrent>
+
+LibrarySearchDialog::LibrarySearchDialog(LibraryCatalog* catalog, const QString& initialQuery, QWidget *parent)
+    : QDialog(parent), catalog(catalog)
+{
+    setWindowTitle(QString("全部資料夾 (All Folders) - %1 個資料夾").arg(catalog->roots().size()));
+    resize(800, 600);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *queryLayout = new QHBoxLayout();
+
+    cmbMode = new QComboBox(this);
+    cmbMode->addItem("標籤查詢 (Tag Query)");
+    cmbMode->addItem("搜尋檔名與標籤 (Search)");
+    queryLayout->addWidget(cmbMode);
+
+    txtQuery = new QLineEdit(initialQuery, this);
+    txtQuery->setPlaceholderText("合約 AND 2024 AND NOT 草稿");
+    txtQuery->setClearButtonEnabled(true);
+    connect(txtQuery, &QLineEdit::returnPressed, this, &LibrarySearchDialog::runSearch);
+    queryLayout->addWidget(txtQuery);
+    layout->addLayout(queryLayout);
+
+    resultList = new QListWidget(this);
+    connect(resultList, &QListWidget::itemDoubleClicked, this, &LibrarySearchDialog::openHit);
+    layout->addWidget(resultList);
+
+    lblSummary = new QLabel("輸入查詢後按 Enter (Press Enter to search)", this);
+    lblSummary->setWordWrap(true);
+    layout->addWidget(lblSummary);
+
+    searchWatcher = new QFutureWatcher<Outcome>(this);
+    connect(searchWatcher, &QFutureWatcher<Outcome>::finished, this, &LibrarySearchDialog::onSearchFinished);
+}
+
+void LibrarySearchDialog::reject()
+{
+    // The search reports back to this dialog, so it must outlive the run
+    if (searchWatcher->isRunning()) return;
+    QDialog::reject();
+}
+
+void LibrarySearchDialog::runSearch()
+{
+    std::string text = txtQuery->text().trimmed().toStdString();
+    if (text.empty() || searchWatcher->isRunning()) return;
+
+    bool isQuery = cmbMode->currentIndex() == 0;
+    txtQuery->setEnabled(false);
+    lblSummary->setText("查詢中，尚未載入的資料夾會先載入... (Searching)");
+
+    // Shards load and run in parallel inside the catalog; this only keeps the UI responsive
+    searchWatcher->setFuture(QtConcurrent::run([this, text, isQuery]() {
+        QElapsedTimer timer;
+        timer.start();
+        Outcome outcome;
+        if (isQuery) {
+            outcome.result = catalog->query(text, 10);
+        } else {
+            outcome.result.files = catalog->search(text);
+        }
+        outcome.millis = timer.elapsed();
+        return outcome;
+    }));
+}
+
+void LibrarySearchDialog::onSearchFinished()
+{
+    Outcome outcome = searchWatcher->result();
+    txtQuery->setEnabled(true);
+    txtQuery->setFocus();
+
+    if (!outcome.result.error.empty()) {
+        lblSummary->setText(QString("查詢錯誤: %1").arg(QString::fromStdString(outcome.result.error)));
+        return;
+    }
+
+    resultList->clear();
+    const auto& files = outcome.result.files;
+    for (size_t i = 0; i < files.size() && i < size_t(kMaxShown); ++i) {
+        QString root = QString::fromStdString(files[i].root);
+        QString file = QString::fromStdString(files[i].file);
+        QListWidgetItem *item = new QListWidgetItem(QString("%1  —  %2").arg(file, root));
+        item->setData(Qt::UserRole, root + "/" + file);
+        resultList->addItem(item);
+    }
+
+    QString summary = QString("%1 個檔案 (%2 ms)").arg(files.size()).arg(outcome.millis);
+    if (files.size() > size_t(kMaxShown)) summary += QString("，僅顯示前 %1 個").arg(kMaxShown);
+    if (!outcome.result.facets.empty()) {
+        QStringList facets;
+        for (const auto& [tag, count] : outcome.result.facets) {
+            facets << QString("%1 (%2)").arg(QString::fromStdString(tag)).arg(count);
+        }
+        summary += "\n標籤 (Tags): " + facets.join(", ");
+    }
+    lblSummary->setText(summary);
+}
+
+void LibrarySearchDialog::openHit(QListWidgetItem *item)
+{
+    if (!item) return;
+    QDesktopServices::openUrl(QUrl::fromLocalFile(item->data(Qt::UserRole).toString()));
+}
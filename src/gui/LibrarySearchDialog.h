@@ -0,0 +1,44 @@
+#ifndef LIBRARYSEARCHDIALOG_H
+#define LIBRARYSEARCHDIALOG_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QListWidget>
+#include <QLabel>
+#include <QFutureWatcher>
+#include "../core/LibraryCatalog.h"
+
+// Tag queries and file searches over every folder registered in the library
+class LibrarySearchDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    LibrarySearchDialog(LibraryCatalog* catalog, const QString& initialQuery, QWidget *parent = nullptr);
+
+public slots:
+    void reject() override;
+
+private slots:
+    void runSearch();
+    void onSearchFinished();
+    void openHit(QListWidgetItem *item);
+
+private:
+    // Both modes report hits; a query also has facets or a parse error
+    struct Outcome {
+        LibraryCatalog::QueryResult result;
+        qint64 millis = 0;
+    };
+    static constexpr int kMaxShown = 5000;
+
+    LibraryCatalog* catalog;
+    QComboBox *cmbMode;
+    QLineEdit *txtQuery;
+    QListWidget *resultList;
+    QLabel *lblSummary;
+    QFutureWatcher<Outcome> *searchWatcher;
+};
+
+#endif // LIBRARYSEARCHDIALOG_H
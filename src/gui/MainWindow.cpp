@@ -1,6 +1,8 @@
 #include "MainWindow.h"
 #include "../core/FileScanner.h"
 #include "../core/DocumentParser.h"
+#include "RuntimeProfileDialog.h"
+#include "LibrarySearchDialog.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
@@ -11,9 +13,106 @@
 #include <QMenu>
 #include <QAction>
 #include <QCursor>
+#include <QSettings>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QRegularExpressionValidator>
+#include <QTimer>
 #include <fstream>
 #include <algorithm>
 #include <set>
+#include <atomic>
+
+// Tag list items show "tag (count)"; the bare tag name is kept in this role
+static constexpr int kTagNameRole = Qt::UserRole + 1;
+// The file search runs once typing pauses for this long
+static constexpr int kSearchDebounceMs = 150;
+// Content matches shown in addition to name and tag matches
+static constexpr size_t kMaxContentHits = 1000;
+// Fuzzy finder results, best first
+static constexpr size_t kMaxFuzzyResults = 1000;
+// Files on each side of the selection whose previews are prepared in advance
+static constexpr int kPrefetchNeighbours = 3;
+
+// How the preview panel shows a file
+static PreviewPrefetcher::Kind previewKindOf(const QString& filePath)
+{
+    std::string ext = std::filesystem::path(filePath.toStdString()).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    static const std::set<std::string> imageExts = {".jpg", ".jpeg", ".png", ".bmp"};
+    static const std::set<std::string> documentExts = {
+        ".docx", ".xlsx", ".pptx", ".odt", ".odf",
+        ".html", ".htm", ".shtml", ".xhtml", ".pdf"
+    };
+    if (imageExts.count(ext)) return PreviewPrefetcher::Image;
+    if (documentExts.count(ext)) return PreviewPrefetcher::Document;
+    return PreviewPrefetcher::Text;
+}
+
+// Reads the text the model should see for a file: raw text for plain/code files,
+// extracted text for office documents, empty for everything else (filename only).
+static std::string loadAnalysisContent(const std::filesystem::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    static const std::set<std::string> textExts = {
+        ".txt", ".md", ".log", ".tex", ".rtf",
+        ".cpp", ".h", ".c", ".hpp", ".cs", ".java", ".py", ".js", ".ts", 
+        ".html", ".css", ".json", ".xml", ".yaml", ".yml", ".ini", ".conf", ".env",
+        ".bat", ".sh", ".ps1", ".go", ".rs", ".lua", ".sql", ".php"
+    };
+
+    std::string content;
+    if (textExts.count(ext)) {
+        try {
+            std::ifstream f(path, std::ios::binary);
+            if (f.is_open()) {
+                // The prompt builder samples head, middle and tail within the token
+                // budget; for huge files (logs, dumps) only read the two ends.
+                const std::streamoff maxRead = 8 * 1024 * 1024;
+                f.seekg(0, std::ios::end);
+                std::streamoff size = f.tellg();
+                f.seekg(0, std::ios::beg);
+                if (size <= maxRead) {
+                    std::stringstream buffer;
+                    buffer << f.rdbuf(); // Read full content
+                    content = buffer.str();
+                } else {
+                    std::string head(maxRead / 2, '\0');
+                    f.read(head.data(), head.size());
+                    std::string tail(maxRead / 4, '\0');
+                    f.seekg(size - static_cast<std::streamoff>(tail.size()), std::ios::beg);
+                    f.read(tail.data(), tail.size());
+                    content = head + "\n[...]\n" + tail;
+                }
+            }
+        } catch (...) {}
+    }
+    else if (ext == ".docx" || ext == ".xlsx" || ext == ".pptx" || 
+             ext == ".odt" || ext == ".odf" || 
+             ext == ".html" || ext == ".htm" || ext == ".shtml" || ext == ".xhtml" || 
+             ext == ".pdf") {
+        content = DocumentParser::extractText(path.string());
+    }
+
+    // No character truncation here: LlamaEngine fits the content to the
+    // model's token budget.
+    return content;
+}
+
+// Splits the model's comma-separated answer into clean tags
+static std::vector<std::string> parseTagList(const QString& text)
+{
+    QStringList tagList = text.split(',', Qt::SkipEmptyParts);
+    std::vector<std::string> tags;
+    for (const QString& t : tagList) {
+        QString trimmed = t.trimmed();
+        if (!trimmed.isEmpty()) tags.push_back(trimmed.toStdString());
+    }
+    return tags;
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -30,12 +129,50 @@ MainWindow::MainWindow(QWidget *parent)
     watcher = new QFutureWatcher<std::string>(this);
     connect(watcher, &QFutureWatcher<std::string>::finished, this, &MainWindow::onAnalysisFinished);
 
+    batchWatcher = new QFutureWatcher<std::vector<std::string>>(this);
+    connect(batchWatcher, &QFutureWatcher<std::vector<std::string>>::finished, this, &MainWindow::onBatchAnalysisFinished);
+
+    contentWatcher = new QFutureWatcher<size_t>(this);
+    connect(contentWatcher, &QFutureWatcher<size_t>::finished, this, &MainWindow::onContentIndexUpdated);
+
+    reconcileWatcher = new QFutureWatcher<size_t>(this);
+    connect(reconcileWatcher, &QFutureWatcher<size_t>::finished, this, &MainWindow::onReconciled);
+
+    // A fuzzy search uses every core itself; a newer one waits for the
+    // cancelled one to stop
+    fuzzyPool.setMaxThreadCount(1);
+
+    // Two decodes at once, so a large image still decoding for a file already
+    // left behind does not hold up the next one
+    previewPool.setMaxThreadCount(2);
+
+    // Every tag edit, single or batched, refreshes the panels from here. Edits
+    // made on worker threads are handed over to the UI thread.
+    tagManager.addChangeListener([this](const TagManager::ChangeSet& changes) {
+        QMetaObject::invokeMethod(this, [this, changes]() { onTagsChanged(changes); }, Qt::AutoConnection);
+    });
+
+    QSettings settings("SmartFile", "SmartFileOrganizer");
+    for (const QString& root : settings.value("library/roots").toStringList()) {
+        catalog.addRoot(root.toStdString());
+    }
+
     resize(1200, 800);
     setWindowTitle("Smart File Organizer");
 }
 
 MainWindow::~MainWindow()
 {
+    cancelFuzzySearch();
+    cancelPreview();
+    // The update works on contentIndex, which goes before the watcher does
+    contentIndex.cancel();
+    contentWatcher->waitForFinished();
+    // Likewise the analyses use llamaEngine and report into tagManager
+    reconcileWatcher->waitForFinished();
+    batchCancel = true;
+    watcher->waitForFinished();
+    batchWatcher->waitForFinished();
 }
 
 void MainWindow::setupToolbar()
@@ -46,12 +183,36 @@ void MainWindow::setupToolbar()
     QAction *actOpen = toolbar->addAction("開啟資料夾 (Open Folder)");
     connect(actOpen, &QAction::triggered, this, &MainWindow::openFolder);
 
+    QAction *actExport = toolbar->addAction("匯出標籤 (Export Tags)");
+    actExport->setToolTip("將目前資料夾的標籤匯出為 JSON");
+    connect(actExport, &QAction::triggered, this, &MainWindow::exportTags);
+
+    QAction *actImport = toolbar->addAction("匯入標籤 (Import Tags)");
+    actImport->setToolTip("從 JSON 匯入標籤 (覆蓋同名檔案的標籤)");
+    connect(actImport, &QAction::triggered, this, &MainWindow::importTags);
+
+    QAction *actAddLibrary = toolbar->addAction("加入資料庫 (Add to Library)");
+    actAddLibrary->setToolTip("將資料夾加入全域資料庫，不必開啟即可跨資料夾查詢");
+    connect(actAddLibrary, &QAction::triggered, this, &MainWindow::addLibraryFolder);
+
+    QAction *actSearchAll = toolbar->addAction("🌐 全部資料夾 (All Folders)");
+    actSearchAll->setToolTip("在資料庫中所有資料夾平行執行標籤查詢或搜尋");
+    connect(actSearchAll, &QAction::triggered, this, &MainWindow::searchAllFolders);
+
     toolbar->addSeparator();
 
     QAction *actLoadModel = toolbar->addAction("載入模型 (Load Model)");
     actLoadModel->setToolTip("請選擇 ggml-model-*.gguf 檔案");
     connect(actLoadModel, &QAction::triggered, this, &MainWindow::loadModel);
 
+    QAction *actProfile = toolbar->addAction("⚙️ 推論設定 (Runtime Profile)");
+    actProfile->setToolTip("執行緒、上下文長度、KV 快取、mmap/mlock 與 GPU 層數 (依模型儲存)");
+    connect(actProfile, &QAction::triggered, this, &MainWindow::editRuntimeProfile);
+
+    actAnalyzeAll = toolbar->addAction("✨ 分析全部 (Analyze All)");
+    actAnalyzeAll->setToolTip("使用所有推論執行緒批次分析目前列出的檔案");
+    connect(actAnalyzeAll, &QAction::triggered, this, &MainWindow::analyzeAllFiles);
+
     toolbar->addSeparator();
     
     // Add Checkbox to Toolbar
@@ -81,6 +242,16 @@ void MainWindow::setupLayout()
     leftPanel = new QWidget(this);
     QVBoxLayout *leftLayout = new QVBoxLayout(leftPanel);
     leftLayout->addWidget(new QLabel("🏷️ 標籤庫 (Tags)"));
+
+    txtTagQuery = new QLineEdit(this);
+    txtTagQuery->setPlaceholderText("標籤查詢: 合約 AND 2024 AND NOT 草稿");
+    txtTagQuery->setToolTip("AND / OR / NOT 與括號；相鄰標籤視為 AND，-標籤 表示排除");
+    txtTagQuery->setClearButtonEnabled(true);
+    connect(txtTagQuery, &QLineEdit::returnPressed, this, &MainWindow::runTagQuery);
+    connect(txtTagQuery, &QLineEdit::textChanged, [this](const QString& text){
+        if (text.trimmed().isEmpty()) runTagQuery(); // Cleared: back to the full list
+    });
+    leftLayout->addWidget(txtTagQuery);
     
     tagListWidget = new QListWidget(this);
     connect(tagListWidget, &QListWidget::itemClicked, this, &MainWindow::onTagSelected);
@@ -110,13 +281,32 @@ void MainWindow::setupLayout()
     txtSearch = new QLineEdit(this);
     txtSearch->setPlaceholderText("搜尋檔案... (Search)");
     connect(txtSearch, &QLineEdit::textChanged, this, &MainWindow::filterFiles);
-    midLayout->addWidget(txtSearch);
-
-    fileList = new QListWidget(this);
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(kSearchDebounceMs);
+    connect(searchTimer, &QTimer::timeout, this, &MainWindow::applySearch);
+    chkFuzzy = new QCheckBox("模糊 (Fuzzy)", this);
+    chkFuzzy->setToolTip("依相似度排序，例如 q3 rpt final (Rank by fuzzy match)");
+    connect(chkFuzzy, &QCheckBox::toggled, this, &MainWindow::applySearch);
+    QHBoxLayout *searchLayout = new QHBoxLayout();
+    searchLayout->addWidget(txtSearch);
+    searchLayout->addWidget(chkFuzzy);
+    midLayout->addLayout(searchLayout);
+
+    fileModel = new FileListModel(this);
+    fileFilter = new FileFilterModel(this);
+    fileFilter->setSourceModel(fileModel);
+    fileList = new QListView(this);
+    fileList->setModel(fileFilter);
+    // Rows are single lines, so the view never has to measure a million of them
+    fileList->setUniformItemSizes(true);
+    fileList->setSelectionMode(QAbstractItemView::SingleSelection);
+    fileList->setEditTriggers(QAbstractItemView::NoEditTriggers);
     fileList->setContextMenuPolicy(Qt::CustomContextMenu); // Enable context menu
-    connect(fileList, &QListWidget::itemClicked, this, &MainWindow::onFileSelected);
-    connect(fileList, &QListWidget::itemDoubleClicked, this, &MainWindow::openFile); // Double click to open
-    connect(fileList, &QListWidget::customContextMenuRequested, this, &MainWindow::showContextMenu); // Right click
+    // Follows the current row, so browsing with the arrow keys previews too
+    connect(fileList->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::onFileSelected);
+    connect(fileList, &QListView::doubleClicked, this, &MainWindow::openFile); // Double click to open
+    connect(fileList, &QListView::customContextMenuRequested, this, &MainWindow::showContextMenu); // Right click
     midLayout->addWidget(fileList);
 
     mainSplitter->addWidget(middlePanel);
@@ -159,6 +349,40 @@ void MainWindow::setupLayout()
     txtPreviewText->setVisible(false); // Default hidden
     rightLayout->addWidget(txtPreviewText);
 
+    // Text files are paged from disk, with jump-to-line and find
+    textViewer = new QWidget(this);
+    QVBoxLayout *textLayout = new QVBoxLayout(textViewer);
+    textLayout->setContentsMargins(0, 0, 0, 0);
+    QHBoxLayout *textBar = new QHBoxLayout();
+    txtGoToLine = new QLineEdit(this);
+    txtGoToLine->setPlaceholderText("跳至行 (Go to line)");
+    txtGoToLine->setValidator(new QRegularExpressionValidator(QRegularExpression("[0-9]{1,19}"), txtGoToLine));
+    connect(txtGoToLine, &QLineEdit::returnPressed, this, [this]() {
+        textView->goToLine(txtGoToLine->text().toULongLong());
+    });
+    txtFindInFile = new QLineEdit(this);
+    txtFindInFile->setPlaceholderText("在檔案中尋找 (Find in file)");
+    QPushButton *btnFindNext = new QPushButton("下一個 (Next)", this);
+    connect(txtFindInFile, &QLineEdit::returnPressed, this, &MainWindow::findInFile);
+    connect(btnFindNext, &QPushButton::clicked, this, &MainWindow::findInFile);
+    lblTextInfo = new QLabel(this);
+    textBar->addWidget(txtGoToLine);
+    textBar->addWidget(txtFindInFile, 1);
+    textBar->addWidget(btnFindNext);
+    textBar->addWidget(lblTextInfo);
+    textLayout->addLayout(textBar);
+    textView = new TextPagerView(this);
+    connect(textView, &TextPagerView::indexProgress, this, [this](quint64 lines, bool done) {
+        lblTextInfo->setText(done ? QString("%1 行 (lines)").arg(lines)
+                                  : QString("索引中... %1 行 (Indexing)").arg(lines));
+    });
+    connect(textView, &TextPagerView::searchFinished, this, [this](bool found) {
+        lblTextInfo->setText(found ? QString() : QString("找不到 (Not found)"));
+    });
+    textLayout->addWidget(textView);
+    textViewer->setVisible(false);
+    rightLayout->addWidget(textViewer);
+
     // Tags Section
     lblTags = new QLabel("標籤: --", this);
     lblTags->setWordWrap(true);
@@ -209,87 +433,283 @@ void MainWindow::setupLayout()
 
 void MainWindow::onTabChanged(int index) {
     if (index == 1) { // Graph Tab
-        graphWidget->buildGraph();
+        graphWidget->refresh();
     }
 }
 
 void MainWindow::openFolder()
 {
+    // Results of a running analysis are written to the open folder's tags
+    if (watcher->isRunning() || batchWatcher->isRunning()) {
+        QMessageBox::warning(this, "Warning", "分析進行中，請稍後再開啟其他資料夾。");
+        return;
+    }
+
     QString dir = QFileDialog::getExistingDirectory(this, "Select Directory",
                                                     QString(),
                                                     QFileDialog::ShowDirsOnly
                                                     | QFileDialog::DontResolveSymlinks);
 
     if (!dir.isEmpty()) {
+        if (!currentPath.isEmpty()) catalog.unpin(currentPath.toStdString());
         currentPath = dir;
         tagManager.loadTags(currentPath.toStdString());
+        // The content index is switched over by the scan's index update, on
+        // its worker: opening it here would wait for a running update
+        thumbnails.setRoot(currentPath);
+        graphWidget->setLibraryRoot(currentPath);
+        // Cross-folder queries reuse the open library instead of loading it twice
+        catalog.pin(currentPath.toStdString(), tagManager);
+        saveLibraryRoots();
         scanFiles();
     }
 }
 
+void MainWindow::addLibraryFolder()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "加入資料庫 (Add to Library)",
+                                                    QString(),
+                                                    QFileDialog::ShowDirsOnly
+                                                    | QFileDialog::DontResolveSymlinks);
+    if (dir.isEmpty()) return;
+
+    if (catalog.addRoot(dir.toStdString())) {
+        saveLibraryRoots();
+        lblStatus->setText(QString("已加入資料庫: %1 (共 %2 個資料夾)").arg(dir).arg(catalog.roots().size()));
+    } else {
+        lblStatus->setText(QString("資料夾已在資料庫中: %1").arg(dir));
+    }
+}
+
+void MainWindow::searchAllFolders()
+{
+    if (catalog.roots().empty()) {
+        QMessageBox::warning(this, "Warning", "資料庫是空的，請先開啟或加入資料夾 (Open or add a folder first)");
+        return;
+    }
+    LibrarySearchDialog dialog(&catalog, txtTagQuery->text().trimmed(), this);
+    dialog.exec();
+}
+
+void MainWindow::saveLibraryRoots()
+{
+    QStringList roots;
+    for (const auto& root : catalog.roots()) {
+        roots << QString::fromStdString(root);
+    }
+    QSettings settings("SmartFile", "SmartFileOrganizer");
+    settings.setValue("library/roots", roots);
+}
+
+void MainWindow::exportTags()
+{
+    if (currentPath.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "請先開啟資料夾 (Open a folder first)");
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this, "匯出標籤 (Export Tags)",
+                                                    currentPath + "/tags.json", "JSON (*.json)");
+    if (fileName.isEmpty()) return;
+
+    // Serializing a large library takes a while; it runs on a snapshot, so
+    // tagging can go on meanwhile
+    lblStatus->setText("匯出中... (Exporting)");
+    auto *exportWatcher = new QFutureWatcher<bool>(this);
+    connect(exportWatcher, &QFutureWatcher<bool>::finished, this, [this, exportWatcher, fileName]() {
+        if (exportWatcher->result()) {
+            lblStatus->setText(QString("標籤已匯出: %1").arg(fileName));
+        } else {
+            QMessageBox::critical(this, "Error", "無法寫入檔案 (Failed to write file)");
+        }
+        exportWatcher->deleteLater();
+    });
+    exportWatcher->setFuture(QtConcurrent::run([this, path = fileName.toStdString()]() {
+        return tagManager.exportJson(path);
+    }));
+}
+
+void MainWindow::importTags()
+{
+    if (currentPath.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "請先開啟資料夾 (Open a folder first)");
+        return;
+    }
+
+    QString fileName = QFileDialog::getOpenFileName(this, "匯入標籤 (Import Tags)",
+                                                    currentPath, "JSON (*.json)");
+    if (fileName.isEmpty()) return;
+
+    int count = tagManager.importJson(fileName.toStdString());
+    if (count < 0) {
+        QMessageBox::critical(this, "Error", "無法解析 JSON (Failed to parse file)");
+        return;
+    }
+    lblStatus->setText(QString("已匯入 %1 個檔案的標籤").arg(count));
+}
+
 void MainWindow::scanFiles()
 {
-    fileList->clear();
     FileScanner scanner;
     bool recursive = chkRecursive->isChecked();
     std::vector<std::string> files = scanner.scanDirectory(currentPath.toStdString(), recursive);
 
-    for (const auto& file : files) {
-        std::filesystem::path p(file);
-        QListWidgetItem* item = new QListWidgetItem(QString::fromStdString(p.filename().string()));
-        item->setData(Qt::UserRole, QString::fromStdString(file)); // Store full relative path
-        fileList->addItem(item);
-    }
-    
+    // Follow files that were moved or renamed outside the app. That looks at
+    // disk for the files not found at their key, so it runs on a worker; the
+    // tags it re-keys reach the views through onTagsChanged.
+    reconcileWatcher->setFuture(QtConcurrent::run([this, root = currentPath.toStdString(), files]() {
+        return tagManager.reconcile(root, files);
+    }));
+    std::vector<std::string> keys;
+    keys.reserve(files.size());
+    for (const auto& file : files) keys.push_back(tagManager.fileKey(file));
+    cancelFuzzySearch(); // Its rows would point into the old list
+    prefetcher.cancel();
+    lastSelectedRow = -1;
+    fileModel->setFiles(currentPath.toStdString(), keys);
+    fuzzyFinder.reset(keys);
+    rebuildSearchIndex();
+    if (!txtSearch->text().trimmed().isEmpty()) applySearch();
+
+    updateContentIndex(files);
+
     updateTagList();
     lblStatus->setText(QString("目前資料夾: %1 (找到 %2 個檔案)").arg(currentPath).arg(files.size()));
 }
 
-void MainWindow::updateTagList()
+void MainWindow::onReconciled()
+{
+    size_t moved = reconcileWatcher->result();
+    if (moved) {
+        lblStatus->setText(QString("目前資料夾: %1, %2 個已移動檔案保留標籤 (tags followed moved files)")
+                               .arg(currentPath).arg(moved));
+    }
+}
+
+void MainWindow::updateTagList(const std::vector<std::pair<std::string, size_t>>* facets)
 {
     tagListWidget->clear();
-    std::vector<std::string> tags = tagManager.getAllTags();
     
     // Always add an "All Files" option
     QListWidgetItem* allItem = new QListWidgetItem("All Files");
     allItem->setData(Qt::UserRole, "ALL");
     tagListWidget->addItem(allItem);
 
-    for (const auto& tag : tags) {
-        tagListWidget->addItem(QString::fromStdString(tag));
+    auto addTagItem = [this](const std::string& tag, size_t count) {
+        QListWidgetItem* item = new QListWidgetItem(QString("%1 (%2)").arg(QString::fromStdString(tag)).arg(count));
+        item->setData(kTagNameRole, QString::fromStdString(tag));
+        tagListWidget->addItem(item);
+    };
+
+    if (facets) {
+        for (const auto& [tag, count] : *facets) {
+            addTagItem(tag, count);
+        }
+    } else {
+        for (const auto& tag : tagManager.getAllTags()) {
+            addTagItem(tag, tagManager.getTagCount(tag));
+        }
+    }
+}
+
+void MainWindow::onTagsChanged(const TagManager::ChangeSet& changes)
+{
+    // An active query re-runs so its matches and facet counts stay current
+    if (txtTagQuery->text().trimmed().isEmpty()) {
+        updateTagList();
+    } else {
+        runTagQuery();
+    }
+
+    graphWidget->applyChanges(changes);
+
+    std::shared_ptr<const TagIndex> view = tagManager.snapshot();
+    for (const auto& key : changes.files) {
+        int row = fileModel->rowOf(key);
+        if (row >= 0) indexFile(row, *view);
+    }
+
+    int selected = selectedRow();
+    if (selected < 0) return;
+    if (std::binary_search(changes.files.begin(), changes.files.end(), std::string(fileModel->key(selected)))) {
+        updateTagDisplay(QString::fromStdString(fileModel->path(selected)));
     }
 }
 
 void MainWindow::onTagSelected(QListWidgetItem *item)
 {
-    QString tag = item->text();
+    QString tag = item->data(kTagNameRole).toString();
     QString data = item->data(Qt::UserRole).toString();
     
     if (data == "ALL") {
-        // Show all files
-        for(int i=0; i<fileList->count(); ++i) {
-            fileList->item(i)->setHidden(false);
-        }
+        showAllRows();
     } else {
         // Filter by tag
-        std::vector<std::string> filesWithTag = tagManager.getFilesByTag(tag.toStdString());
-        std::set<std::string> fileSet(filesWithTag.begin(), filesWithTag.end());
-        
-        for(int i=0; i<fileList->count(); ++i) {
-            QListWidgetItem *fItem = fileList->item(i);
-            QString fname = fItem->text(); 
-            
-            // Check if this file is in the tag set
-            std::filesystem::path p(fname.toStdString());
-            std::string filenameOnly = p.filename().string();
-            
-            fItem->setHidden(fileSet.find(filenameOnly) == fileSet.end());
+        std::vector<uint32_t> rows;
+        for (const auto& key : tagManager.getFilesByTag(tag.toStdString())) {
+            int row = fileModel->rowOf(key);
+            if (row >= 0) rows.push_back(static_cast<uint32_t>(row));
+        }
+        std::sort(rows.begin(), rows.end());
+        showRows(std::move(rows));
+
+        QStringList related;
+        for (const auto& r : tagManager.relatedTags(tag.toStdString(), 5, TagManager::Relatedness::Jaccard)) {
+            related << QString("%1 (%2)").arg(QString::fromStdString(r.tag)).arg(r.count);
+        }
+        if (!related.isEmpty()) {
+            lblStatus->setText(QString("相關標籤 (Related): %1").arg(related.join(", ")));
+        }
+    }
+}
+
+void MainWindow::runTagQuery()
+{
+    QString expression = txtTagQuery->text().trimmed();
+    if (expression.isEmpty()) {
+        showAllRows();
+        updateTagList();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    TagManager::QueryResult result = tagManager.query(expression.toStdString());
+    qint64 micros = timer.nsecsElapsed() / 1000;
+
+    if (!result.error.empty()) {
+        lblStatus->setText(QString("查詢錯誤: %1").arg(QString::fromStdString(result.error)));
+        return;
+    }
+
+    std::vector<uint32_t> rows;
+    for (const auto& key : result.files) {
+        int row = fileModel->rowOf(key);
+        if (row >= 0) rows.push_back(static_cast<uint32_t>(row));
+    }
+    if (result.matchesUntagged) {
+        std::shared_ptr<const TagIndex> view = tagManager.snapshot();
+        for (int row = 0; row < fileModel->count(); ++row) {
+            uint32_t file = view->findFile(std::string(fileModel->key(row)));
+            if (file == TagIndex::npos || view->tagsOf(file).empty()) rows.push_back(static_cast<uint32_t>(row));
         }
     }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    int shown = static_cast<int>(rows.size());
+    showRows(std::move(rows));
+
+    updateTagList(&result.facets);
+    lblStatus->setText(QString("查詢結果: %1 個檔案 (%2 µs)").arg(shown).arg(micros));
 }
 
 void MainWindow::loadModel()
 {
+    if (watcher->isRunning() || batchWatcher->isRunning()) {
+        QMessageBox::warning(this, "Warning", "分析進行中，請稍後再載入模型。");
+        return;
+    }
+
     QString fileName = QFileDialog::getOpenFileName(this, "載入模型 (Load Model)",
                                                     QString(),
                                                     "GGUF Models (*.gguf);;All Files (*)");
@@ -298,8 +718,11 @@ void MainWindow::loadModel()
         lblStatus->setText("正在載入模型... (Loading Model...)");
         QApplication::processEvents(); // Force update UI
 
-        if (llamaEngine.loadModel(fileName.toStdString())) {
-            lblStatus->setText("模型載入成功! (Model loaded!)");
+        RuntimeProfile profile = loadRuntimeProfile(fileName);
+        if (llamaEngine.loadModel(fileName.toStdString(), profile)) {
+            currentModelPath = fileName;
+            lblStatus->setText(QString("模型載入成功! (Model loaded!) %1")
+                                   .arg(QString::fromStdString(profile.summary())));
             QMessageBox::information(this, "Success", "模型載入成功！");
         } else {
             lblStatus->setText("模型載入失敗 (Failed to load model)");
@@ -308,57 +731,80 @@ void MainWindow::loadModel()
     }
 }
 
-void MainWindow::analyzeFile()
+// Profiles are stored per model file name, with "default" used for models
+// that have never been tuned.
+RuntimeProfile MainWindow::loadRuntimeProfile(const QString& modelPath) const
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) {
-        QMessageBox::warning(this, "Warning", "Please select a file first.");
+    QSettings settings("SmartFile", "SmartFileOrganizer");
+    QString key = "profiles/" + QFileInfo(modelPath).fileName();
+    if (modelPath.isEmpty() || !settings.contains(key)) {
+        key = "profiles/default";
+    }
+
+    QString stored = settings.value(key).toString();
+    if (stored.isEmpty()) return RuntimeProfile();
+    try {
+        return RuntimeProfile::fromJson(nlohmann::json::parse(stored.toStdString()));
+    } catch (const std::exception&) {
+        return RuntimeProfile();
+    }
+}
+
+void MainWindow::saveRuntimeProfile(const QString& modelPath, const RuntimeProfile& profile)
+{
+    QSettings settings("SmartFile", "SmartFileOrganizer");
+    QString key = modelPath.isEmpty() ? "profiles/default" : "profiles/" + QFileInfo(modelPath).fileName();
+    settings.setValue(key, QString::fromStdString(profile.toJson().dump()));
+}
+
+void MainWindow::editRuntimeProfile()
+{
+    if (watcher->isRunning() || batchWatcher->isRunning()) {
+        QMessageBox::warning(this, "Warning", "分析進行中，請稍後再變更設定。");
         return;
     }
 
-    QString relPath = selectedItems.first()->data(Qt::UserRole).toString();
-    QString filename = selectedItems.first()->text();
+    RuntimeProfile current = llamaEngine.isModelLoaded() ? llamaEngine.runtimeProfile()
+                                                         : loadRuntimeProfile(currentModelPath);
+    QString modelName = currentModelPath.isEmpty() ? "default" : QFileInfo(currentModelPath).fileName();
 
-    std::filesystem::path path(currentPath.toStdString());
-    path /= relPath.toStdString();
-    QString filePath = QString::fromStdString(path.string());
-    
-    std::string content = "";
-    std::string ext = path.extension().string();
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    
-    static const std::set<std::string> textExts = {
-        ".txt", ".md", ".log", ".tex", ".rtf",
-        ".cpp", ".h", ".c", ".hpp", ".cs", ".java", ".py", ".js", ".ts", 
-        ".html", ".css", ".json", ".xml", ".yaml", ".yml", ".ini", ".conf", ".env",
-        ".bat", ".sh", ".ps1", ".go", ".rs", ".lua", ".sql", ".php"
-    };
+    RuntimeProfileDialog dialog(&llamaEngine, current, modelName, this);
+    if (dialog.exec() != QDialog::Accepted) return;
 
-    if (textExts.count(ext)) {
-        try {
-            std::ifstream f(filePath.toStdString());
-            if (f.is_open()) {
-                std::stringstream buffer;
-                buffer << f.rdbuf(); // Read full content
-                content = buffer.str();
-                lblStatus->setText(QString("正在分析檔案內容... (%1 chars)").arg(content.length()));
-            }
-        } catch (...) {}
-    } 
-    else if (ext == ".docx" || ext == ".xlsx" || ext == ".pptx" || 
-             ext == ".odt" || ext == ".odf" || 
-             ext == ".html" || ext == ".htm" || ext == ".shtml" || ext == ".xhtml" || 
-             ext == ".pdf") {
-        lblStatus->setText(QString("正在解析文件內容: %1").arg(filename));
-        content = DocumentParser::extractText(filePath.toStdString());
+    RuntimeProfile profile = dialog.profile();
+    saveRuntimeProfile(currentModelPath, profile);
+
+    if (llamaEngine.isModelLoaded()) {
+        lblStatus->setText("正在套用推論設定... (Applying profile...)");
+        QApplication::processEvents();
+        if (llamaEngine.applyProfile(profile)) {
+            lblStatus->setText(QString("推論設定已套用: %1").arg(QString::fromStdString(profile.summary())));
+        } else {
+            lblStatus->setText("推論設定套用失敗 (Failed to apply profile)");
+            QMessageBox::critical(this, "Error", "無法以此設定建立推論上下文 (Failed to create context with this profile)");
+        }
     }
-    else {
-        lblStatus->setText("正在分析檔名...");
+}
+
+void MainWindow::analyzeFile()
+{
+    int row = selectedRow();
+    if (row < 0) {
+        QMessageBox::warning(this, "Warning", "Please select a file first.");
+        return;
     }
 
-    // Unified safety truncation (16000 chars)
-    if (content.length() > 16000) {
-        content = content.substr(0, 16000) + "... [Truncated]";
+    QString filename = fileModel->data(fileModel->index(row)).toString();
+    std::filesystem::path path(fileModel->path(row));
+    
+    lblStatus->setText(QString("正在解析文件內容: %1").arg(filename));
+    QApplication::processEvents();
+
+    std::string content = loadAnalysisContent(path);
+    if (content.empty()) {
+        lblStatus->setText("正在分析檔名...");
+    } else {
+        lblStatus->setText(QString("正在分析檔案內容... (%1 chars)").arg(content.length()));
     }
 
     btnAnalyzeFile->setEnabled(false);
@@ -397,67 +843,268 @@ void MainWindow::onAnalysisFinished()
     QMessageBox::information(this, "Analysis Finished", "分析完成並已自動儲存標籤！\n(Analysis complete and tags saved!)");
 }
 
-void MainWindow::onFileSelected(QListWidgetItem *item)
+void MainWindow::analyzeAllFiles()
 {
-    QString filePathStr = item->text();
-    // Resolve full path if item text is relative
-    std::filesystem::path p(currentPath.toStdString());
-    p /= filePathStr.toStdString();
-    
-    updateTagDisplay(QString::fromStdString(p.filename().string()));
-    updateFilePreview(QString::fromStdString(p.string()));
+    if (!llamaEngine.isModelLoaded()) {
+        QMessageBox::warning(this, "Warning", "請先載入模型 (Please load a model first).");
+        return;
+    }
+    if (batchWatcher->isRunning()) return;
+
+    // Analyze what the user currently sees (respects tag and search filters)
+    std::vector<std::string> fullPaths;
+    std::vector<std::string> filenames; // The model only sees the name
+    batchKeys.clear();
+    for (int i = 0; i < fileFilter->rowCount(); ++i) {
+        int row = fileFilter->sourceRow(i);
+        std::filesystem::path path(fileModel->path(row));
+        fullPaths.push_back(path.string());
+        filenames.push_back(path.filename().string());
+        batchKeys.emplace_back(fileModel->key(row));
+    }
+    if (fullPaths.empty()) return;
+
+    QMessageBox::StandardButton reply = QMessageBox::question(this, "Analyze All",
+        QString("將使用 %1 個推論執行緒分析 %2 個檔案，並覆寫其標籤。是否繼續?")
+            .arg(llamaEngine.contextCount()).arg(fullPaths.size()),
+        QMessageBox::Yes | QMessageBox::No);
+    if (reply != QMessageBox::Yes) return;
+
+    btnAnalyzeFile->setEnabled(false);
     btnSaveTags->setEnabled(false);
+    actAnalyzeAll->setEnabled(false);
+    fileList->setEnabled(false);
+    lblStatus->setText(QString("批次分析中... 0 / %1").arg(fullPaths.size()));
+
+    QFuture<std::vector<std::string>> future = QtConcurrent::run([this, fullPaths, filenames]() {
+        std::vector<std::string> results(filenames.size());
+        auto done = std::make_shared<std::atomic<size_t>>(0);
+        size_t total = filenames.size();
+
+        llamaEngine.suggestTagsBatch(filenames,
+            [&fullPaths](size_t i) { return loadAnalysisContent(fullPaths[i]); },
+            [this, &results, done, total](size_t i, const std::string& result) {
+                results[i] = result; // Each index is written by exactly one worker
+                size_t finished = ++(*done);
+                QMetaObject::invokeMethod(this, [this, finished, total]() {
+                    lblStatus->setText(QString("批次分析中... %1 / %2").arg(finished).arg(total));
+                }, Qt::QueuedConnection);
+            },
+            &batchCancel);
+        return results;
+    });
+    batchWatcher->setFuture(future);
+}
+
+void MainWindow::onBatchAnalysisFinished()
+{
+    std::vector<std::string> results = batchWatcher->result();
+
+    btnAnalyzeFile->setEnabled(true);
+    actAnalyzeAll->setEnabled(true);
+    fileList->setEnabled(true);
+
+    int applied = 0;
+    int failed = 0;
+    {
+        TagManager::Batch batch(tagManager); // One journal write and one refresh for the whole run
+        for (size_t i = 0; i < results.size() && i < batchKeys.size(); ++i) {
+            if (results[i].empty() || results[i].rfind("Error:", 0) == 0) {
+                failed++;
+                continue;
+            }
+            tagManager.setTags(batchKeys[i], parseTagList(QString::fromStdString(results[i])));
+            applied++;
+        }
+    }
+    batchKeys.clear();
+
+    lblStatus->setText(QString("批次分析完成: %1 個檔案已標記, %2 個失敗").arg(applied).arg(failed));
+}
+
+void MainWindow::onFileSelected(const QModelIndex &index)
+{
+    if (!index.isValid() || restoringSelection) return;
+    QString path = QString::fromStdString(fileModel->path(fileFilter->sourceRow(index.row())));
+    updateTagDisplay(path);
+    updateFilePreview(path);
+    prefetchNeighbours(index.row());
+    btnSaveTags->setEnabled(false);
+}
+
+void MainWindow::prefetchNeighbours(int row)
+{
+    // The files ahead in the direction of browsing first
+    int direction = row >= lastSelectedRow ? 1 : -1;
+    lastSelectedRow = row;
+
+    std::vector<PreviewPrefetcher::Item> items;
+    for (int side : {direction, -direction}) {
+        for (int step = 1; step <= kPrefetchNeighbours; ++step) {
+            int neighbour = row + side * step;
+            if (neighbour < 0 || neighbour >= fileFilter->rowCount()) break;
+            int source = fileFilter->sourceRow(neighbour);
+            QString path = QString::fromStdString(fileModel->path(source));
+            items.push_back({path, previewKindOf(path), std::string(fileModel->key(source))});
+        }
+    }
+    prefetcher.prefetch(std::move(items), previewEdge());
+}
+
+int MainWindow::previewEdge() const
+{
+    // Images are decoded at the size the preview area shows them
+    QWidget *view = lblPreviewImage->parentWidget();
+    return ThumbnailCache::bucket(static_cast<int>(
+        std::max(view->width(), view->height()) * view->devicePixelRatioF()));
 }
 
 void MainWindow::updateFilePreview(const QString& filePath)
 {
-    std::filesystem::path p(filePath.toStdString());
-    std::string ext = p.extension().string();
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    
+    PreviewPrefetcher::Kind kind = previewKindOf(filePath);
+
     // Hide all first
     lblPreviewImage->setVisible(false);
     txtPreviewText->setVisible(false);
-
-    if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp") {
-        QPixmap pixmap(filePath);
-        if (!pixmap.isNull()) {
-            currentPreviewPixmap = pixmap;
-            lblPreviewImage->setVisible(true);
-            fitToWindow(); // Default to fit
-        } else {
-            lblPreviewImage->setText("無法載入圖片 (Image Load Failed)");
-            lblPreviewImage->setVisible(true);
-            currentPreviewPixmap = QPixmap();
-        }
-    } else if (ext == ".docx" || ext == ".xlsx" || ext == ".pptx" || 
-               ext == ".odt" || ext == ".odf" || 
-               ext == ".html" || ext == ".htm" || ext == ".shtml" || ext == ".xhtml" || 
-               ext == ".pdf") {
+    textViewer->setVisible(false);
+    textView->clear();
+    previewPath = filePath;
+    std::shared_ptr<std::atomic<bool>> cancelled = startPreview();
+    uint64_t generation = previewGeneration;
+
+    // Images and documents are decoded on previewPool, so holding an arrow key
+    // down never waits for them; loads for files passed over are skipped
+    if (kind == PreviewPrefetcher::Image) {
+        currentPreviewPixmap = QPixmap();
+        lblPreviewImage->setText("載入中... (Loading)");
+        lblPreviewImage->adjustSize();
+        lblPreviewImage->setVisible(true);
+
+        // Decoded at the size it is shown at; zooming in loads the rest
+        int edge = previewEdge();
+        previewPool.start([this, filePath, edge, cancelled, generation]() {
+            ThumbnailCache::Thumbnail thumbnail = thumbnails.load(filePath, edge, *cancelled);
+            if (*cancelled) return;
+            QMetaObject::invokeMethod(this, [this, thumbnail, generation]() {
+                if (generation == previewGeneration) showPreviewImage(thumbnail);
+            }, Qt::QueuedConnection);
+        });
+    } else if (kind == PreviewPrefetcher::Document) {
         txtPreviewText->setVisible(true);
-        std::string content = DocumentParser::extractText(filePath.toStdString());
-        if (content.empty()) content = "(No searchable text found or encrypted)";
-        txtPreviewText->setText(QString::fromStdString(content));
+        txtPreviewText->setText("載入中... (Loading)");
+        previewPool.start([this, filePath, cancelled, generation]() {
+            if (*cancelled) return;
+            std::string content = prefetcher.documentText(filePath);
+            if (content.empty()) content = "(No searchable text found or encrypted)";
+            if (*cancelled) return;
+            QMetaObject::invokeMethod(this, [this, content, generation]() {
+                if (generation == previewGeneration) txtPreviewText->setText(QString::fromStdString(content));
+            }, Qt::QueuedConnection);
+        });
+    } else if (textView->openFile(filePath)) {
+        // Text preview: mapped, not read, so a log of any size opens at once
+        lblTextInfo->clear();
+        textViewer->setVisible(true);
     } else {
-        // Text preview
         txtPreviewText->setVisible(true);
-        std::ifstream f(filePath.toStdString());
-        if (f.is_open()) {
-             char buffer[2048];
-             f.read(buffer, 2047);
-             buffer[f.gcount()] = '\0';
-             txtPreviewText->setText(QString::fromUtf8(buffer));
-        } else {
-             txtPreviewText->setText("(無法讀取檔案內容)");
-        }
+        txtPreviewText->setText("(無法讀取檔案內容)");
+    }
+}
+
+void MainWindow::findInFile()
+{
+    QString text = txtFindInFile->text();
+    if (text.isEmpty()) return;
+    lblTextInfo->setText("搜尋中... (Searching)");
+    textView->findNext(text);
+}
+
+std::shared_ptr<std::atomic<bool>> MainWindow::startPreview()
+{
+    cancelPreview();
+    previewCancel = std::make_shared<std::atomic<bool>>(false);
+    return previewCancel;
+}
+
+void MainWindow::cancelPreview()
+{
+    if (previewCancel) *previewCancel = true;
+    previewCancel.reset();
+    ++previewGeneration;
+    previewIsFull = true; // Nothing to load until a thumbnail arrives
+}
+
+void MainWindow::showPreviewImage(const ThumbnailCache::Thumbnail& thumbnail)
+{
+    if (thumbnail.image.isNull()) {
+        lblPreviewImage->setText("無法載入圖片 (Image Load Failed)");
+        lblPreviewImage->adjustSize();
+        currentPreviewPixmap = QPixmap();
+        return;
     }
+    currentPreviewPixmap = QPixmap::fromImage(thumbnail.image);
+    previewIsFull = thumbnail.image.size() == thumbnail.fullSize;
+    fitToWindow(); // Default to fit
+}
+
+void MainWindow::loadFullResolution()
+{
+    // Once per file; previewIsFull stays set while the load runs
+    previewIsFull = true;
+    QString filePath = previewPath;
+    std::shared_ptr<std::atomic<bool>> cancelled = previewCancel;
+    uint64_t generation = previewGeneration;
+    previewPool.start([this, filePath, cancelled, generation]() {
+        if (*cancelled) return;
+        QImage image = ThumbnailCache::loadFull(filePath);
+        if (*cancelled || image.isNull()) return;
+        QMetaObject::invokeMethod(this, [this, image, generation]() {
+            if (generation != previewGeneration || currentPreviewPixmap.isNull()) return;
+            // Same size on screen, now with every pixel
+            double shown = currentPreviewPixmap.width() * scaleFactor;
+            currentPreviewPixmap = QPixmap::fromImage(image);
+            scaleFactor = shown / currentPreviewPixmap.width();
+            updateImageDisplay();
+        }, Qt::QueuedConnection);
+    });
+}
+
+int MainWindow::selectedRow() const
+{
+    QModelIndexList selected = fileList->selectionModel()->selectedIndexes();
+    if (selected.isEmpty()) return -1;
+    return fileFilter->sourceRow(selected.first().row());
+}
+
+void MainWindow::showRows(std::vector<uint32_t> rows)
+{
+    int selected = selectedRow();
+    fileFilter->setRows(std::move(rows));
+    restoreSelection(selected);
+}
+
+void MainWindow::showAllRows()
+{
+    int selected = selectedRow();
+    fileFilter->showAll();
+    restoreSelection(selected);
+}
+
+void MainWindow::restoreSelection(int row)
+{
+    // Filters reset the view; the selected file stays selected if it is still shown
+    if (row < 0) return;
+    QModelIndex index = fileFilter->mapFromSource(fileModel->index(row));
+    if (!index.isValid()) return;
+    // The file is already previewed; moving its row is not a new selection
+    restoringSelection = true;
+    fileList->setCurrentIndex(index);
+    restoringSelection = false;
 }
 
 void MainWindow::updateTagDisplay(const QString& filePath)
 {
-    std::filesystem::path path(filePath.toStdString());
-    std::string filename = path.filename().string();
-    std::vector<std::string> tags = tagManager.getTags(filename);
+    std::vector<std::string> tags = tagManager.getTags(tagManager.fileKey(filePath.toStdString()));
     
     QString tagStr = "標籤: ";
     if (tags.empty()) {
@@ -473,76 +1120,175 @@ void MainWindow::updateTagDisplay(const QString& filePath)
 
 void MainWindow::saveTags()
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) return;
+    int row = selectedRow();
+    if (row < 0) return;
 
-    QString relPath = selectedItems.first()->data(Qt::UserRole).toString();
+    std::string key(fileModel->key(row));
 
-    std::filesystem::path path(currentPath.toStdString());
-    path /= relPath.toStdString();
-    
-    QString filePath = QString::fromStdString(path.string());
-    std::string filename = path.filename().string();
-    
     QString pendingTags = btnSaveTags->property("pendingTags").toString();
     if (pendingTags.isEmpty()) return;
     
-    // Simple parsing of comma-separated tags
-    QStringList tagList = pendingTags.split(',', Qt::SkipEmptyParts);
-    std::vector<std::string> newTags;
-    for (const QString& t : tagList) {
-        newTags.push_back(t.trimmed().toStdString());
-    }
+    std::vector<std::string> newTags = parseTagList(pendingTags);
     
-    tagManager.setTags(filename, newTags);
-    updateTagDisplay(filePath);
-    updateTagList(); // Refresh left panel to show new tags immediately
+    tagManager.setTags(key, newTags); // onTagsChanged refreshes both panels
     
     lblStatus->setText("標籤已儲存 (Tags saved)");
     btnSaveTags->setEnabled(false);
 }
 
-void MainWindow::filterFiles(const QString &text)
+void MainWindow::filterFiles(const QString &)
 {
-    QString query = text.trimmed().toLower();
-    
-    for (int i = 0; i < fileList->count(); ++i) {
-        QListWidgetItem *item = fileList->item(i);
-        QString filePath = item->text();
-        std::filesystem::path path(filePath.toStdString());
-        QString filename = QString::fromStdString(path.filename().string()).toLower();
-        
-        bool match = false;
-        
-        // 1. Check filename
-        if (filename.contains(query)) {
-            match = true;
-        } else {
-            // 2. Check tags
-            std::vector<std::string> tags = tagManager.getTags(path.filename().string());
-            for (const auto& tag : tags) {
-                if (QString::fromStdString(tag).toLower().contains(query)) {
-                    match = true;
-                    break;
+    // Restarted by every keystroke, so a search runs once typing pauses
+    cancelFuzzySearch();
+    searchTimer->start();
+}
+
+void MainWindow::applySearch()
+{
+    cancelFuzzySearch();
+    QString query = txtSearch->text().trimmed().toLower();
+    if (query.isEmpty()) {
+        showAllRows();
+        return;
+    }
+    if (chkFuzzy->isChecked()) {
+        startFuzzySearch(txtSearch->text().trimmed().toStdString());
+        return;
+    }
+    std::vector<uint32_t> rows = searchIndex.search(query.toStdString());
+    size_t nameMatches = rows.size();
+
+    // Files whose text contains every word of the query are shown as well
+    for (const auto& hit : contentIndex.search(query.toStdString(), kMaxContentHits)) {
+        int row = fileModel->rowOf(hit.file);
+        if (row >= 0) rows.push_back(static_cast<uint32_t>(row));
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    size_t contentMatches = rows.size() - nameMatches;
+    showRows(std::move(rows));
+
+    if (contentMatches) {
+        lblStatus->setText(QString("另有 %1 個檔案內容符合 (matched by content)").arg(contentMatches));
+    }
+}
+
+void MainWindow::startFuzzySearch(const std::string& query)
+{
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    fuzzyCancel = cancelled;
+    uint64_t generation = ++fuzzyGeneration;
+
+    // Partial rankings arrive about once a frame, so the list fills in while
+    // the rest of a large folder is still being scored
+    fuzzyPool.start([this, query, cancelled, generation]() {
+        QElapsedTimer timer;
+        timer.start();
+        fuzzyFinder.search(query, kMaxFuzzyResults, *cancelled,
+            [this, cancelled, generation, &timer](const std::vector<FuzzyFinder::Match>& best, bool done) {
+                if (*cancelled) return;
+                std::vector<uint32_t> rows;
+                rows.reserve(best.size());
+                for (const auto& match : best) rows.push_back(match.item);
+                qint64 millis = timer.elapsed();
+                QMetaObject::invokeMethod(this, [this, rows = std::move(rows), generation, done, millis]() mutable {
+                    if (generation != fuzzyGeneration) return; // A newer search has started
+                    size_t shown = rows.size();
+                    showRows(std::move(rows));
+                    if (done) {
+                        lblStatus->setText(QString("模糊搜尋: %1 個結果 (%2 ms) (Fuzzy matches)").arg(shown).arg(millis));
+                    }
+                }, Qt::QueuedConnection);
+            });
+    });
+}
+
+void MainWindow::cancelFuzzySearch()
+{
+    if (fuzzyCancel) *fuzzyCancel = true;
+    fuzzyCancel.reset();
+    ++fuzzyGeneration;
+}
+
+void MainWindow::updateContentIndex(std::vector<std::string> files)
+{
+    // A rescan during an update replaces it once the running one has stopped
+    if (contentWatcher->isRunning()) {
+        pendingContentFiles = std::move(files);
+        contentUpdatePending = true;
+        contentIndex.cancel();
+        return;
+    }
+
+    // Updates run one at a time, so the folder is opened before anything
+    // else touches the index
+    std::string reopen;
+    if (contentRoot != currentPath) {
+        contentRoot = currentPath;
+        reopen = currentPath.toStdString();
+    }
+    contentWatcher->setFuture(QtConcurrent::run([this, files = std::move(files), reopen]() {
+        if (!reopen.empty()) contentIndex.open(reopen);
+        return contentIndex.update(files,
+            [](const std::string& path) { return loadAnalysisContent(path); },
+            [this](size_t done, size_t total) {
+                if (done % 100 == 0 || done == total) {
+                    QMetaObject::invokeMethod(this, [this, done, total]() {
+                        lblStatus->setText(QString("建立內容索引... %1 / %2 (Indexing content)").arg(done).arg(total));
+                    }, Qt::QueuedConnection);
                 }
-            }
+                return true;
+            });
+    }));
+}
+
+void MainWindow::onContentIndexUpdated()
+{
+    if (contentUpdatePending) {
+        contentUpdatePending = false;
+        updateContentIndex(std::move(pendingContentFiles));
+        pendingContentFiles.clear();
+        return;
+    }
+
+    size_t indexed = contentWatcher->result();
+    if (indexed) {
+        lblStatus->setText(QString("內容索引完成: %1 個檔案已更新, 共 %2 個 (Content indexed)")
+                               .arg(indexed).arg(contentIndex.documentCount()));
+    }
+    if (!txtSearch->text().trimmed().isEmpty()) applySearch();
+}
+
+void MainWindow::rebuildSearchIndex()
+{
+    searchIndex.reset(fileModel->count());
+    std::shared_ptr<const TagIndex> view = tagManager.snapshot();
+    for (int row = 0; row < fileModel->count(); ++row) {
+        indexFile(row, *view);
+    }
+}
+
+void MainWindow::indexFile(int row, const TagIndex& view)
+{
+    std::vector<std::string> fields{fileModel->data(fileModel->index(row)).toString().toLower().toStdString()};
+    uint32_t file = view.findFile(std::string(fileModel->key(row)));
+    if (file != TagIndex::npos) {
+        for (uint32_t tag : view.tagsOf(file)) {
+            fields.push_back(QString::fromStdString(std::string(view.tagName(tag))).toLower().toStdString());
         }
-        
-        item->setHidden(!match);
     }
+    searchIndex.set(static_cast<uint32_t>(row), fields);
 }
 
 void MainWindow::addTag()
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) {
+    int row = selectedRow();
+    if (row < 0) {
         QMessageBox::warning(this, "Warning", "Please select a file first.");
         return;
     }
 
-    QString filename = selectedItems.first()->text();
-    std::filesystem::path path(filename.toStdString());
-    std::string fnameOnly = path.filename().string();
+    std::string key(fileModel->key(row));
 
     QInputDialog dialog(this);
     dialog.setWindowTitle("Add Tag");
@@ -554,9 +1300,7 @@ void MainWindow::addTag()
     if (dialog.exec() == QDialog::Accepted) {
         QString text = dialog.textValue();
         if (!text.isEmpty()) {
-            tagManager.addTag(fnameOnly, text.toStdString());
-            updateTagDisplay(filename);
-            updateTagList(); // Refresh left panel
+            tagManager.addTag(key, text.toStdString());
             lblStatus->setText(QString("已新增標籤: %1").arg(text));
         }
     }
@@ -564,17 +1308,15 @@ void MainWindow::addTag()
 
 void MainWindow::removeTag()
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) {
+    int row = selectedRow();
+    if (row < 0) {
         QMessageBox::warning(this, "Warning", "Please select a file first.");
         return;
     }
 
-    QString filename = selectedItems.first()->text();
-    std::filesystem::path path(filename.toStdString());
-    std::string fnameOnly = path.filename().string();
+    std::string key(fileModel->key(row));
 
-    std::vector<std::string> tags = tagManager.getTags(fnameOnly);
+    std::vector<std::string> tags = tagManager.getTags(key);
     if (tags.empty()) {
         QMessageBox::information(this, "Info", "This file has no tags.");
         return;
@@ -594,9 +1336,7 @@ void MainWindow::removeTag()
     if (dialog.exec() == QDialog::Accepted) {
         QString item = dialog.textValue();
         if (!item.isEmpty()) {
-            tagManager.removeTag(fnameOnly, item.toStdString());
-            updateTagDisplay(filename);
-            updateTagList(); // Refresh left panel
+            tagManager.removeTag(key, item.toStdString());
             lblStatus->setText(QString("已移除標籤: %1").arg(item));
         }
     }
@@ -611,7 +1351,7 @@ void MainWindow::removeGlobalTag()
         return;
     }
 
-    QString tag = selectedItems.first()->text();
+    QString tag = selectedItems.first()->data(kTagNameRole).toString();
     QString data = selectedItems.first()->data(Qt::UserRole).toString();
 
     if (data == "ALL") {
@@ -626,37 +1366,28 @@ void MainWindow::removeGlobalTag()
     
     if (reply == QMessageBox::Yes) {
         tagManager.deleteTag(tag.toStdString());
-        updateTagList();
-        
-        // Refresh right panel if a file is selected
-        QList<QListWidgetItem*> selectedFiles = fileList->selectedItems();
-        if (!selectedFiles.isEmpty()) {
-            updateTagDisplay(selectedFiles.first()->text());
-        }
-        
         lblStatus->setText(QString("已刪除標籤: %1 (Global)").arg(tag));
     }
 }
 
-void MainWindow::openFile(QListWidgetItem* item)
+void MainWindow::openFile(const QModelIndex &index)
 {
-    if (!item) return;
-    QString relPath = item->data(Qt::UserRole).toString();
-    std::filesystem::path path(currentPath.toStdString());
-    path /= relPath.toStdString();
-    
-    QDesktopServices::openUrl(QUrl::fromLocalFile(QString::fromStdString(path.string())));
+    if (!index.isValid()) return;
+    std::string path = fileModel->path(fileFilter->sourceRow(index.row()));
+    QDesktopServices::openUrl(QUrl::fromLocalFile(QString::fromStdString(path)));
 }
 
 void MainWindow::showContextMenu(const QPoint &pos)
 {
-    QListWidgetItem *item = fileList->itemAt(pos);
-    if (!item) return;
+    QModelIndex index = fileList->indexAt(pos);
+    if (!index.isValid()) return;
+    // The list may be refiltered while the menu is open, so the row is resolved now
+    QString path = QString::fromStdString(fileModel->path(fileFilter->sourceRow(index.row())));
 
     QMenu contextMenu(tr("Context menu"), this);
 
     QAction actionOpen("開啟 (Open)", this);
-    connect(&actionOpen, &QAction::triggered, [this, item](){ openFile(item); });
+    connect(&actionOpen, &QAction::triggered, [path](){ QDesktopServices::openUrl(QUrl::fromLocalFile(path)); });
     contextMenu.addAction(&actionOpen);
 
     QAction actionRename("重新命名 (Rename)", this);
@@ -672,31 +1403,24 @@ void MainWindow::showContextMenu(const QPoint &pos)
 
 void MainWindow::renameFile()
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) return;
+    int row = selectedRow();
+    if (row < 0) return;
     
-    QString oldName = selectedItems.first()->text();
-    QString relPath = selectedItems.first()->data(Qt::UserRole).toString();
+    QString oldName = fileModel->data(fileModel->index(row)).toString();
+    std::filesystem::path oldFull(fileModel->path(row));
     
     bool ok;
     QString newName = QInputDialog::getText(this, tr("Rename File"),
                                             tr("New name:"), QLineEdit::Normal,
                                             oldName, &ok);
     if (ok && !newName.isEmpty() && newName != oldName) {
-        std::filesystem::path oldFull(currentPath.toStdString());
-        oldFull /= relPath.toStdString();
-        
-        // Calculate new relative path
-        std::filesystem::path p(relPath.toStdString());
-        p.replace_filename(newName.toStdString());
-        
-        std::filesystem::path newFull(currentPath.toStdString());
-        newFull /= p;
+        std::filesystem::path newFull = oldFull;
+        newFull.replace_filename(newName.toStdString());
 
         try {
+            textView->clear(); // The file may be mapped for its preview
             std::filesystem::rename(oldFull, newFull);
-            // Update Tag Manager (Using filenames as keys)
-            tagManager.renameFile(oldName.toStdString(), newName.toStdString());
+            tagManager.renameFile(tagManager.fileKey(oldFull.string()), tagManager.fileKey(newFull.string()));
             // Refresh UI
             scanFiles(); 
             lblStatus->setText(QString("已更名: %1 -> %2").arg(oldName).arg(newName));
@@ -708,11 +1432,11 @@ void MainWindow::renameFile()
 
 void MainWindow::deleteFile()
 {
-    QList<QListWidgetItem*> selectedItems = fileList->selectedItems();
-    if (selectedItems.isEmpty()) return;
+    int row = selectedRow();
+    if (row < 0) return;
     
-    QString filename = selectedItems.first()->text();
-    QString relPath = selectedItems.first()->data(Qt::UserRole).toString();
+    QString filename = fileModel->data(fileModel->index(row)).toString();
+    std::filesystem::path path(fileModel->path(row));
     
     QMessageBox::StandardButton reply;
     reply = QMessageBox::question(this, "Delete File", 
@@ -720,17 +1444,16 @@ void MainWindow::deleteFile()
                                   QMessageBox::Yes|QMessageBox::No);
     
     if (reply == QMessageBox::Yes) {
-        std::filesystem::path path(currentPath.toStdString());
-        path /= relPath.toStdString();
-        
         try {
+            textView->clear(); // The file may be mapped for its preview
             if (std::filesystem::remove(path)) {
-                // Update Tag Manager (Using filename as key)
-                tagManager.removeFile(filename.toStdString());
+                tagManager.removeFile(tagManager.fileKey(path.string()));
                 // Refresh UI
                 scanFiles();
                 // Clear Preview
                 txtPreviewText->clear();
+                cancelPreview();
+                previewPath.clear();
                 lblPreviewImage->setText("已刪除 (Deleted)");
                 currentPreviewPixmap = QPixmap(); // Clear image
                 lblTags->setText("標籤: --");
@@ -767,6 +1490,8 @@ void MainWindow::updateImageDisplay() {
 void MainWindow::zoomIn() {
     scaleFactor *= 1.25;
     updateImageDisplay();
+    // Past 1:1 the thumbnail would only be stretched
+    if (scaleFactor > 1.0 && !previewIsFull && !currentPreviewPixmap.isNull()) loadFullResolution();
 }
 
 void MainWindow::zoomOut() {
@@ -3,6 +3,7 @@
 
 #include <QMainWindow>
 #include <QListWidget>
+#include <QListView>
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -16,9 +17,19 @@
 #include <QTextEdit>
 #include <QFutureWatcher>
 #include <QtConcurrent>
+#include <QTimer>
+#include <QThreadPool>
 #include "GraphWidget.h"
+#include "FileListModel.h"
+#include "ThumbnailCache.h"
+#include "TextPagerView.h"
+#include "PreviewPrefetcher.h"
 #include "../ai/LlamaEngine.h"
 #include "../core/TagManager.h"
+#include "../core/LibraryCatalog.h"
+#include "../core/SearchIndex.h"
+#include "../core/ContentIndex.h"
+#include "../core/FuzzyFinder.h"
 
 class MainWindow : public QMainWindow
 {
@@ -30,21 +41,33 @@ public:
 
 private slots:
     void openFolder();
+    void exportTags();
+    void importTags();
+    void addLibraryFolder();
+    void searchAllFolders();
     void scanFiles();
     void loadModel();
+    void editRuntimeProfile();
     void analyzeFile();
     void onAnalysisFinished();
+    void analyzeAllFiles();
+    void onBatchAnalysisFinished();
     void saveTags();
-    void openFile(QListWidgetItem* item); // Double click
+    void openFile(const QModelIndex &index); // Double click
     void renameFile(); // Context menu
     void deleteFile(); // Context menu
     void showContextMenu(const QPoint &pos); // Right click
     void addTag();
     void removeTag();
     void removeGlobalTag();
-    void filterFiles(const QString &text);
-    void onFileSelected(QListWidgetItem *item);
+    void filterFiles(const QString &text); // Debounced; see applySearch
+    void applySearch();
+    void onContentIndexUpdated();
+    void onReconciled();
+    void onFileSelected(const QModelIndex &index);
     void onTagSelected(QListWidgetItem *item);
+    void runTagQuery();
+    void findInFile(); // Next match in the previewed text file
     void onTabChanged(int index);
     // Zooming
     void zoomIn();
@@ -57,6 +80,7 @@ private:
     QWidget *centralWidget;
     QVBoxLayout *mainLayout;
     QToolBar *toolbar;
+    QAction *actAnalyzeAll;
     QCheckBox *chkRecursive;
     QTabWidget *tabWidget;
     QScrollArea *scrollArea;
@@ -67,6 +91,7 @@ private:
     
     // Left Panel (Tags)
     QWidget *leftPanel;
+    QLineEdit *txtTagQuery;
     QListWidget *tagListWidget;
     QPushButton *btnLeftAddTag;
     QPushButton *btnLeftRemoveTag;
@@ -74,12 +99,21 @@ private:
     // Middle Panel (Files)
     QWidget *middlePanel;
     QLineEdit *txtSearch;
-    QListWidget *fileList;
+    QCheckBox *chkFuzzy;
+    QTimer *searchTimer;
+    QListView *fileList;
+    FileListModel *fileModel;
+    FileFilterModel *fileFilter; // What fileList shows: all rows, or a search or tag filter's
     
     // Right Panel (Details)
     QWidget *rightPanel;
     QLabel *lblPreviewImage;
     QTextEdit *txtPreviewText;
+    QWidget *textViewer; // textView with its go-to-line and find bar
+    TextPagerView *textView;
+    QLineEdit *txtGoToLine;
+    QLineEdit *txtFindInFile;
+    QLabel *lblTextInfo;
     QLabel *lblTags;
     QLabel *lblStatus;
     QPushButton *btnAnalyzeFile;
@@ -93,12 +127,38 @@ private:
     // Data
     QString currentPath;
     LlamaEngine llamaEngine;
+    QString currentModelPath;
     TagManager tagManager;
+    LibraryCatalog catalog; // Every folder opened or added; the open one is served by tagManager
     QFutureWatcher<std::string> *watcher;
+    QFutureWatcher<std::vector<std::string>> *batchWatcher;
+    SearchIndex searchIndex; // Lowercased names and tags, one document per fileModel row
+    ContentIndex contentIndex; // Extracted text of the open folder's files
+    QFutureWatcher<size_t> *contentWatcher;
+    QFutureWatcher<size_t> *reconcileWatcher; // Files of the latest scan that moved
+    std::vector<std::string> pendingContentFiles; // Rescan that arrived during an update
+    QString contentRoot; // Folder the content index was last opened on
+    bool contentUpdatePending = false;
+    FuzzyFinder fuzzyFinder; // Tag keys of the fileModel rows
+    std::shared_ptr<std::atomic<bool>> fuzzyCancel; // Of the newest fuzzy search
+    uint64_t fuzzyGeneration = 0; // Results of older searches are dropped
+    QThreadPool fuzzyPool; // One search at a time; destroyed before fuzzyFinder
+    std::vector<std::string> batchKeys; // Tag keys of the files sent to analyzeAllFiles
+    std::atomic<bool> batchCancel{false}; // Set on close; the batch stops taking new files
+    
+    ThumbnailCache thumbnails;
+    PreviewPrefetcher prefetcher{&thumbnails, &tagManager}; // Outlives previewPool, which reads its text cache
+    std::shared_ptr<std::atomic<bool>> previewCancel; // Of the selected file's loads
+    uint64_t previewGeneration = 0; // Loads for files no longer selected are dropped
+    QThreadPool previewPool; // Destroyed before thumbnails
     
     // State
     QPixmap currentPreviewPixmap; // Store original for resizing logic
     double scaleFactor = 1.0;
+    QString previewPath; // File the preview shows or is loading
+    bool previewIsFull = true; // currentPreviewPixmap is the image at full resolution
+    bool restoringSelection = false;
+    int lastSelectedRow = -1; // Row of fileList, for the direction of browsing
 
 protected:
     bool eventFilter(QObject *watched, QEvent *event) override;
@@ -106,9 +166,29 @@ protected:
 private:
     void setupToolbar();
     void setupLayout();
-    void updateTagList();
+    // facets: counts within the current query result; nullptr lists every tag with its total
+    void updateTagList(const std::vector<std::pair<std::string, size_t>>* facets = nullptr);
+    void onTagsChanged(const TagManager::ChangeSet& changes);
     void updateFilePreview(const QString& filePath);
-    void updateTagDisplay(const QString& filename);
+    std::shared_ptr<std::atomic<bool>> startPreview(); // Cancels the previous file's loads
+    void cancelPreview();
+    void showPreviewImage(const ThumbnailCache::Thumbnail& thumbnail);
+    void loadFullResolution();
+    int previewEdge() const; // Longest side images are decoded at
+    void prefetchNeighbours(int row);
+    void updateTagDisplay(const QString& filePath);
+    int selectedRow() const; // fileModel row of the selected file, -1 if none
+    void showRows(std::vector<uint32_t> rows); // Ascending fileModel rows
+    void showAllRows();
+    void restoreSelection(int row);
+    void rebuildSearchIndex();
+    void indexFile(int row, const TagIndex& view);
+    void updateContentIndex(std::vector<std::string> files);
+    void startFuzzySearch(const std::string& query);
+    void cancelFuzzySearch();
+    RuntimeProfile loadRuntimeProfile(const QString& modelPath) const;
+    void saveRuntimeProfile(const QString& modelPath, const RuntimeProfile& profile);
+    void saveLibraryRoots();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,102 @@
+#include "PreviewPrefetcher.h"
+#include "../core/DocumentParser.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+// A text preview maps its file; reading the first screens' worth is enough
+// to spare it the disk seek
+constexpr qint64 kTextHeadBytes = 64 * 1024;
+
+} // namespace
+
+PreviewPrefetcher::PreviewPrefetcher(ThumbnailCache *thumbnails, TagManager *tags)
+    : thumbnails(thumbnails), tags(tags)
+{
+    // One file at a time, so prefetching never competes with itself for the disk
+    pool.setMaxThreadCount(1);
+}
+
+PreviewPrefetcher::~PreviewPrefetcher()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void PreviewPrefetcher::cancel()
+{
+    if (roundCancel) *roundCancel = true;
+    roundCancel.reset();
+}
+
+void PreviewPrefetcher::prefetch(std::vector<Item> items, int imageEdge)
+{
+    cancel();
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    roundCancel = cancelled;
+
+    pool.start([this, items = std::move(items), imageEdge, cancelled]() {
+        // Whatever the user is waiting for goes first
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        qint64 budget = kRoundBytes;
+        for (const Item& item : items) {
+            if (*cancelled) return;
+            QFileInfo info(item.path);
+            qint64 bytes = item.kind == Text ? std::min(info.size(), kTextHeadBytes) : info.size();
+            if (!info.isFile() || bytes > kMaxFileBytes || bytes > budget) continue;
+            budget -= bytes;
+
+            tags->getTags(item.key);
+            switch (item.kind) {
+            case Image:
+                thumbnails->load(item.path, imageEdge, *cancelled);
+                break;
+            case Document:
+                documentText(item.path);
+                break;
+            case Text: {
+                std::ifstream f(item.path.toStdString(), std::ios::binary);
+                char head[4096];
+                for (qint64 read = 0; f && read < kTextHeadBytes; read += sizeof(head)) {
+                    f.read(head, sizeof(head));
+                }
+                break;
+            }
+            }
+        }
+    });
+}
+
+std::string PreviewPrefetcher::documentText(const QString &path)
+{
+    // An edited file gets a new key, and its old text ages out
+    QFileInfo info(path);
+    QString key = info.absoluteFilePath() + '\n' + QString::number(info.size()) + '\n'
+                + QString::number(info.lastModified().toMSecsSinceEpoch());
+    {
+        std::lock_guard<std::mutex> lock(textMutex);
+        auto it = textEntries.find(key);
+        if (it != textEntries.end()) {
+            texts.splice(texts.begin(), texts, it.value());
+            return it.value()->second;
+        }
+    }
+
+    std::string text = DocumentParser::extractText(path.toStdString());
+
+    std::lock_guard<std::mutex> lock(textMutex);
+    if (textEntries.contains(key) || text.size() > kTextCacheBytes) return text;
+    texts.emplace_front(key, text);
+    textEntries.insert(key, texts.begin());
+    textBytes += text.size();
+    while (textBytes > kTextCacheBytes) {
+        textBytes -= texts.back().second.size();
+        textEntries.remove(texts.back().first);
+        texts.pop_back();
+    }
+    return text;
+}
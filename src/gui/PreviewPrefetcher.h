@@ -0,0 +1,64 @@
+#ifndef PREVIEWPREFETCHER_H
+#define PREVIEWPREFETCHER_H
+
+#include <QString>
+#include <QHash>
+#include <QThreadPool>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThumbnailCache.h"
+#include "../core/TagManager.h"
+
+// Gets the previews of the files around the selected one ready before they
+// are asked for, so browsing with the arrow keys finds them done. Image
+// thumbnails go into the ThumbnailCache, text extracted from documents into a
+// cache kept here, the first page of text files and the files' tags into the
+// OS caches. Work runs on one low-priority thread in the order given; a new
+// selection cancels what is left of the previous one. Files over
+// kMaxFileBytes are skipped, and one round reads at most kRoundBytes.
+class PreviewPrefetcher
+{
+public:
+    enum Kind { Image, Document, Text }; // How the preview panel shows a file
+
+    struct Item {
+        QString path;
+        Kind kind;
+        std::string key; // Tag key
+    };
+
+    static constexpr qint64 kMaxFileBytes = 64 << 20;
+    static constexpr qint64 kRoundBytes = 256 << 20;
+    static constexpr size_t kTextCacheBytes = 16 << 20;
+
+    PreviewPrefetcher(ThumbnailCache *thumbnails, TagManager *tags);
+    ~PreviewPrefetcher();
+
+    // Replaces whatever is still queued; imageEdge as for ThumbnailCache::load
+    void prefetch(std::vector<Item> items, int imageEdge);
+    void cancel();
+
+    // The text a document's preview shows, extracted once per version of the
+    // file. Thread-safe.
+    std::string documentText(const QString &path);
+
+private:
+    using Entry = std::pair<QString, std::string>;
+
+    ThumbnailCache *thumbnails;
+    TagManager *tags;
+    std::shared_ptr<std::atomic<bool>> roundCancel; // Of the newest round
+
+    std::mutex textMutex;
+    std::list<Entry> texts; // Most recently used first
+    QHash<QString, std::list<Entry>::iterator> textEntries;
+    size_t textBytes = 0;
+
+    QThreadPool pool; // Last, so it stops before the caches go
+};
+
+#endif // PREVIEWPREFETCHER_H
@@ -0,0 +1,311 @@
+#include "RuntimeProfileDialog.h"
+#include <QFormLayout>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+RuntimeProfileDialog::RuntimeProfileDialog(LlamaEngine* engine, const RuntimeProfile& profile,
+                                           const QString& modelName, QWidget *parent)
+    : QDialog(parent), engine(engine), baseProfile(profile)
+{
+    setWindowTitle(QString("推論設定 (Runtime Profile) - %1").arg(modelName));
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QFormLayout *form = new QFormLayout();
+
+    // 0 = automatic for the thread and pool settings
+    spnThreads = new QSpinBox(this);
+    spnThreads->setRange(0, 512);
+    spnThreads->setSpecialValueText("自動 (Auto)");
+    form->addRow("生成執行緒 (Generation threads)", spnThreads);
+
+    spnThreadsBatch = new QSpinBox(this);
+    spnThreadsBatch->setRange(0, 512);
+    spnThreadsBatch->setSpecialValueText("自動 (Auto)");
+    form->addRow("批次執行緒 (Batch threads)", spnThreadsBatch);
+
+    spnParallel = new QSpinBox(this);
+    spnParallel->setRange(0, 64);
+    spnParallel->setSpecialValueText("自動 (Auto)");
+    form->addRow("平行上下文 (Parallel contexts)", spnParallel);
+
+    spnCtx = new QSpinBox(this);
+    spnCtx->setRange(512, 131072);
+    spnCtx->setSingleStep(1024);
+    form->addRow("上下文長度 (Context size)", spnCtx);
+
+    spnBatch = new QSpinBox(this);
+    spnBatch->setRange(32, 16384);
+    spnBatch->setSingleStep(256);
+    form->addRow("批次大小 (Batch size)", spnBatch);
+
+    spnUBatch = new QSpinBox(this);
+    spnUBatch->setRange(32, 16384);
+    spnUBatch->setSingleStep(128);
+    form->addRow("微批次 (Micro-batch size)", spnUBatch);
+
+    cmbCacheK = new QComboBox(this);
+    cmbCacheV = new QComboBox(this);
+    for (int i = 0; RuntimeProfile::cacheTypes[i]; ++i) {
+        cmbCacheK->addItem(RuntimeProfile::cacheTypes[i]);
+        cmbCacheV->addItem(RuntimeProfile::cacheTypes[i]);
+    }
+    form->addRow("KV 快取 K (KV cache K)", cmbCacheK);
+    form->addRow("KV 快取 V (KV cache V)", cmbCacheV);
+
+    cmbFlash = new QComboBox(this);
+    cmbFlash->addItems({"auto", "on", "off"});
+    form->addRow("Flash Attention", cmbFlash);
+
+    spnGpuLayers = new QSpinBox(this);
+    spnGpuLayers->setRange(0, 999);
+    form->addRow("GPU 層數 (GPU layers)", spnGpuLayers);
+
+    chkMmap = new QCheckBox("mmap", this);
+    chkMlock = new QCheckBox("mlock", this);
+    QHBoxLayout *memLayout = new QHBoxLayout();
+    memLayout->addWidget(chkMmap);
+    memLayout->addWidget(chkMlock);
+    form->addRow("模型記憶體 (Model memory)", memLayout);
+
+    // Long documents (map-reduce over chunks)
+    chkLongDocs = new QCheckBox("長文件模式: 分段擷取關鍵字後再產生標籤", this);
+    form->addRow("長文件 (Long documents)", chkLongDocs);
+
+    spnSeq = new QSpinBox(this);
+    spnSeq->setRange(1, 64);
+    form->addRow("平行序列 (Parallel sequences)", spnSeq);
+
+    spnChunkTokens = new QSpinBox(this);
+    spnChunkTokens->setRange(128, 16384);
+    spnChunkTokens->setSingleStep(256);
+    form->addRow("分段 tokens (Chunk tokens)", spnChunkTokens);
+
+    spnLongDocTokens = new QSpinBox(this);
+    spnLongDocTokens->setRange(1024, 1048576);
+    spnLongDocTokens->setSingleStep(4096);
+    form->addRow("每檔 token 上限 (Token budget)", spnLongDocTokens);
+
+    spnLongDocSeconds = new QSpinBox(this);
+    spnLongDocSeconds->setRange(1, 3600);
+    spnLongDocSeconds->setSuffix(" s");
+    form->addRow("每檔時間上限 (Time budget)", spnLongDocSeconds);
+
+    // Speculative decoding
+    txtDraftModel = new QLineEdit(this);
+    txtDraftModel->setPlaceholderText("(無 None)");
+    QPushButton *btnBrowseDraft = new QPushButton("...", this);
+    connect(btnBrowseDraft, &QPushButton::clicked, this, &RuntimeProfileDialog::browseDraftModel);
+    QHBoxLayout *draftLayout = new QHBoxLayout();
+    draftLayout->addWidget(txtDraftModel);
+    draftLayout->addWidget(btnBrowseDraft);
+    form->addRow("草稿模型 (Draft model)", draftLayout);
+
+    spnDraft = new QSpinBox(this);
+    spnDraft->setRange(1, 32);
+    form->addRow("草稿長度 (Draft tokens)", spnDraft);
+
+    layout->addLayout(form);
+
+    btnSpecBenchmark = new QPushButton("🚀 測試推測解碼 (Benchmark speculative decoding)", this);
+    btnSpecBenchmark->setEnabled(engine && engine->hasDraftModel());
+    btnSpecBenchmark->setToolTip("以目前載入的草稿模型分別執行一般與推測解碼，回報接受率與加速倍數");
+    connect(btnSpecBenchmark, &QPushButton::clicked, this, &RuntimeProfileDialog::runSpeculativeBenchmark);
+    layout->addWidget(btnSpecBenchmark);
+
+    lblSpecStats = new QLabel(this);
+    lblSpecStats->setWordWrap(true);
+    layout->addWidget(lblSpecStats);
+    if (engine && engine->hasDraftModel()) {
+        showSpeculativeStats(engine->speculativeStats(), "累計 (Session)");
+    }
+
+    btnAutoTune = new QPushButton("⚡ 自動調校 (Auto-tune)", this);
+    btnAutoTune->setEnabled(engine && engine->isModelLoaded());
+    btnAutoTune->setToolTip("在本機測試多組設定並選出最快的組合 (需先載入模型)");
+    connect(btnAutoTune, &QPushButton::clicked, this, &RuntimeProfileDialog::runAutoTune);
+    layout->addWidget(btnAutoTune);
+
+    lblTuneStatus = new QLabel(this);
+    lblTuneStatus->setWordWrap(true);
+    layout->addWidget(lblTuneStatus);
+
+    buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &RuntimeProfileDialog::reject);
+    layout->addWidget(buttons);
+
+    tuneWatcher = new QFutureWatcher<std::vector<LlamaEngine::TuneResult>>(this);
+    connect(tuneWatcher, &QFutureWatcher<std::vector<LlamaEngine::TuneResult>>::finished,
+            this, &RuntimeProfileDialog::onAutoTuneFinished);
+
+    specWatcher = new QFutureWatcher<LlamaEngine::SpeculativeStats>(this);
+    connect(specWatcher, &QFutureWatcher<LlamaEngine::SpeculativeStats>::finished,
+            this, &RuntimeProfileDialog::onSpeculativeBenchmarkFinished);
+
+    setProfile(profile);
+}
+
+void RuntimeProfileDialog::setProfile(const RuntimeProfile& p)
+{
+    spnThreads->setValue(p.nThreads);
+    spnThreadsBatch->setValue(p.nThreadsBatch);
+    spnParallel->setValue(p.nParallel);
+    spnCtx->setValue(p.nCtx);
+    spnBatch->setValue(p.nBatch);
+    spnUBatch->setValue(p.nUBatch);
+    cmbCacheK->setCurrentText(QString::fromStdString(p.cacheTypeK));
+    cmbCacheV->setCurrentText(QString::fromStdString(p.cacheTypeV));
+    cmbFlash->setCurrentText(QString::fromStdString(p.flashAttention));
+    spnGpuLayers->setValue(p.nGpuLayers);
+    chkMmap->setChecked(p.useMmap);
+    chkMlock->setChecked(p.useMlock);
+    chkLongDocs->setChecked(p.longDocuments);
+    spnSeq->setValue(p.nSeq);
+    spnChunkTokens->setValue(p.chunkTokens);
+    spnLongDocTokens->setValue(p.longDocTokenBudget);
+    spnLongDocSeconds->setValue(p.longDocTimeBudgetMs / 1000);
+    txtDraftModel->setText(QString::fromStdString(p.draftModel));
+    spnDraft->setValue(p.nDraft);
+}
+
+RuntimeProfile RuntimeProfileDialog::profile() const
+{
+    RuntimeProfile p;
+    p.nThreads = spnThreads->value();
+    p.nThreadsBatch = spnThreadsBatch->value();
+    p.nParallel = spnParallel->value();
+    p.nCtx = spnCtx->value();
+    p.nBatch = spnBatch->value();
+    p.nUBatch = spnUBatch->value();
+    p.cacheTypeK = cmbCacheK->currentText().toStdString();
+    p.cacheTypeV = cmbCacheV->currentText().toStdString();
+    p.flashAttention = cmbFlash->currentText().toStdString();
+    p.nGpuLayers = spnGpuLayers->value();
+    p.useMmap = chkMmap->isChecked();
+    p.useMlock = chkMlock->isChecked();
+    p.longDocuments = chkLongDocs->isChecked();
+    p.nSeq = spnSeq->value();
+    p.chunkTokens = spnChunkTokens->value();
+    p.longDocTokenBudget = spnLongDocTokens->value();
+    p.longDocTimeBudgetMs = spnLongDocSeconds->value() * 1000;
+    p.draftModel = txtDraftModel->text().trimmed().toStdString();
+    p.nDraft = spnDraft->value();
+    return p;
+}
+
+void RuntimeProfileDialog::reject()
+{
+    // The benchmarks report back to this dialog, so it must outlive the runs
+    if (isBusy()) return;
+    QDialog::reject();
+}
+
+bool RuntimeProfileDialog::isBusy() const
+{
+    return tuneWatcher->isRunning() || specWatcher->isRunning();
+}
+
+void RuntimeProfileDialog::runAutoTune()
+{
+    if (!engine || !engine->isModelLoaded() || isBusy()) return;
+
+    btnAutoTune->setEnabled(false);
+    buttons->setEnabled(false);
+    lblTuneStatus->setText("自動調校中... (Auto-tuning)");
+
+    RuntimeProfile base = profile();
+    QFuture<std::vector<LlamaEngine::TuneResult>> future = QtConcurrent::run([this, base]() {
+        return engine->autoTune(base, [this](const std::string& message) {
+            QMetaObject::invokeMethod(this, [this, message]() {
+                lblTuneStatus->setText(QString::fromStdString(message));
+            }, Qt::QueuedConnection);
+        });
+    });
+    tuneWatcher->setFuture(future);
+}
+
+void RuntimeProfileDialog::onAutoTuneFinished()
+{
+    std::vector<LlamaEngine::TuneResult> results = tuneWatcher->result();
+
+    btnAutoTune->setEnabled(true);
+    buttons->setEnabled(true);
+
+    if (results.empty()) {
+        lblTuneStatus->setText("自動調校失敗 (Auto-tune failed)");
+        return;
+    }
+
+    setProfile(results.front().profile);
+
+    QString report = "自動調校完成，已套用最快設定:\n";
+    for (size_t i = 0; i < results.size() && i < 3; ++i) {
+        const auto& r = results[i];
+        report += QString("%1. %2\n    pp %3 t/s, tg %4 t/s, ~%5 s/檔\n")
+                      .arg(i + 1)
+                      .arg(QString::fromStdString(r.profile.summary()))
+                      .arg(r.promptTokensPerSec, 0, 'f', 1)
+                      .arg(r.genTokensPerSec, 0, 'f', 1)
+                      .arg(r.secondsPerDocument, 0, 'f', 2);
+    }
+    lblTuneStatus->setText(report);
+}
+
+void RuntimeProfileDialog::browseDraftModel()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, "草稿模型 (Draft Model)",
+                                                    txtDraftModel->text(),
+                                                    "GGUF Models (*.gguf);;All Files (*)");
+    if (!fileName.isEmpty()) {
+        txtDraftModel->setText(fileName);
+    }
+}
+
+void RuntimeProfileDialog::showSpeculativeStats(const LlamaEngine::SpeculativeStats& stats, const QString& title)
+{
+    QString text = QString("%1: 接受率 (acceptance) %2% (%3/%4)")
+                       .arg(title)
+                       .arg(stats.acceptanceRate() * 100.0, 0, 'f', 1)
+                       .arg(stats.acceptedTokens)
+                       .arg(stats.draftedTokens);
+    if (stats.specSeconds > 0) {
+        text += QString(", 推測 %1 t/s").arg(stats.specGenerated / stats.specSeconds, 0, 'f', 1);
+    }
+    if (stats.plainSeconds > 0) {
+        text += QString(", 一般 %1 t/s").arg(stats.plainGenerated / stats.plainSeconds, 0, 'f', 1);
+    }
+    if (stats.speedup() > 0) {
+        text += QString(", 加速 (speedup) %1x").arg(stats.speedup(), 0, 'f', 2);
+    }
+    lblSpecStats->setText(text);
+}
+
+void RuntimeProfileDialog::runSpeculativeBenchmark()
+{
+    if (!engine || !engine->hasDraftModel() || isBusy()) return;
+
+    btnSpecBenchmark->setEnabled(false);
+    btnAutoTune->setEnabled(false);
+    buttons->setEnabled(false);
+    lblSpecStats->setText("測試中... (Benchmarking)");
+
+    QFuture<LlamaEngine::SpeculativeStats> future = QtConcurrent::run([this]() {
+        std::string content =
+            "2024 年第三季營運報告。本季營收較去年同期成長 12%，主要來自雲端服務與企業授權。"
+            "Q3 operating report: revenue grew 12% year over year, driven by cloud services and "
+            "enterprise licensing. Next quarter focuses on cost control and the new product launch.";
+        return engine->benchmarkSpeculative("Q3_report_2024.docx", content);
+    });
+    specWatcher->setFuture(future);
+}
+
+void RuntimeProfileDialog::onSpeculativeBenchmarkFinished()
+{
+    btnSpecBenchmark->setEnabled(true);
+    btnAutoTune->setEnabled(engine && engine->isModelLoaded());
+    buttons->setEnabled(true);
+    showSpeculativeStats(specWatcher->result(), "本次測試 (Benchmark)");
+}
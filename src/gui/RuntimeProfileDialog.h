@@ -0,0 +1,72 @@
+#ifndef RUNTIMEPROFILEDIALOG_H
+#define RUNTIMEPROFILEDIALOG_H
+
+#include <QDialog>
+#include <QSpinBox>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QDialogButtonBox>
+#include <QFutureWatcher>
+#include "../ai/LlamaEngine.h"
+
+// Edits the llama.cpp runtime profile of one model and can auto-tune it
+class RuntimeProfileDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    RuntimeProfileDialog(LlamaEngine* engine, const RuntimeProfile& profile,
+                         const QString& modelName, QWidget *parent = nullptr);
+
+    RuntimeProfile profile() const;
+
+public slots:
+    void reject() override;
+
+private slots:
+    void runAutoTune();
+    void onAutoTuneFinished();
+    void browseDraftModel();
+    void runSpeculativeBenchmark();
+    void onSpeculativeBenchmarkFinished();
+
+private:
+    void setProfile(const RuntimeProfile& profile);
+    void showSpeculativeStats(const LlamaEngine::SpeculativeStats& stats, const QString& title);
+    bool isBusy() const;
+
+    LlamaEngine* engine;
+    RuntimeProfile baseProfile;
+
+    QSpinBox *spnThreads;
+    QSpinBox *spnThreadsBatch;
+    QSpinBox *spnCtx;
+    QSpinBox *spnBatch;
+    QSpinBox *spnUBatch;
+    QSpinBox *spnParallel;
+    QSpinBox *spnGpuLayers;
+    QComboBox *cmbCacheK;
+    QComboBox *cmbCacheV;
+    QComboBox *cmbFlash;
+    QCheckBox *chkMmap;
+    QCheckBox *chkMlock;
+    QCheckBox *chkLongDocs;
+    QSpinBox *spnSeq;
+    QSpinBox *spnChunkTokens;
+    QSpinBox *spnLongDocTokens;
+    QSpinBox *spnLongDocSeconds;
+    QLineEdit *txtDraftModel;
+    QSpinBox *spnDraft;
+    QPushButton *btnSpecBenchmark;
+    QLabel *lblSpecStats;
+    QPushButton *btnAutoTune;
+    QLabel *lblTuneStatus;
+    QDialogButtonBox *buttons;
+    QFutureWatcher<std::vector<LlamaEngine::TuneResult>> *tuneWatcher;
+    QFutureWatcher<LlamaEngine::SpeculativeStats> *specWatcher;
+};
+
+#endif // RUNTIMEPROFILEDIALOG_H
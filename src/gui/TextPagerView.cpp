@@ -0,0 +1,280 @@
+#include "TextPagerView.h"
+#include <QPainter>
+#include <QScrollBar>
+#include <QFontDatabase>
+#include <QtConcurrent>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+// Scrolling this far or less steps line by line from where the view is, so it
+// stays exact even where the index has not reached yet
+constexpr quint64 kStepLines = 1000;
+constexpr int kTabWidth = 4;
+constexpr int kTextMargin = 4;
+
+} // namespace
+
+TextPagerView::TextPagerView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    verticalScrollBar()->setSingleStep(1);
+    horizontalScrollBar()->setSingleStep(fontMetrics().horizontalAdvance(' ') * kTabWidth);
+
+    indexWatcher = new QFutureWatcher<void>(this);
+    connect(indexWatcher, &QFutureWatcher<void>::finished, this, &TextPagerView::onIndexProgress);
+    searchWatcher = new QFutureWatcher<quint64>(this);
+    connect(searchWatcher, &QFutureWatcher<quint64>::finished, this, &TextPagerView::onSearchFinished);
+}
+
+TextPagerView::~TextPagerView()
+{
+    cancelWork();
+}
+
+void TextPagerView::cancelWork()
+{
+    // Both check their flag every few megabytes
+    indexCancelled = true;
+    searchCancelled = true;
+    indexWatcher->waitForFinished();
+    searchWatcher->waitForFinished();
+}
+
+bool TextPagerView::openFile(const QString &path)
+{
+    clear();
+    if (!pager.open(path.toStdString())) return false;
+
+    indexCancelled = false;
+    indexWatcher->setFuture(QtConcurrent::run([this]() {
+        pager.buildIndex(indexCancelled, [this](uint64_t, bool) {
+            QMetaObject::invokeMethod(this, [this]() { onIndexProgress(); }, Qt::QueuedConnection);
+        });
+    }));
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+void TextPagerView::clear()
+{
+    cancelWork();
+    pager.close();
+    topOffset = 0;
+    topLine = 0;
+    pendingLine = TextPager::npos;
+    matchOffset = TextPager::npos;
+    matchLength = 0;
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+}
+
+void TextPagerView::onIndexProgress()
+{
+    if (!pager.isOpen()) return;
+    bool exact = pager.indexComplete() || topOffset < pager.indexedBytes();
+    if (exact) topLine = pager.lineAt(topOffset);
+
+    if (pendingLine != TextPager::npos && (pendingLine < pager.indexedLines() || pager.indexComplete())) {
+        quint64 line = std::min(pendingLine, pager.lineCount() - 1);
+        pendingLine = TextPager::npos;
+        scrollToOffset(pager.lineStart(line));
+    }
+    updateScrollBars();
+    viewport()->update();
+    emit indexProgress(pager.indexedLines(), pager.indexComplete());
+}
+
+void TextPagerView::goToLine(quint64 line)
+{
+    if (!pager.isOpen() || pager.size() == 0) return;
+    quint64 target = line > 0 ? line - 1 : 0;
+    if (target < pager.indexedLines() || pager.indexComplete()) {
+        pendingLine = TextPager::npos;
+        scrollToOffset(pager.lineStart(std::min(target, pager.lineCount() - 1)));
+    } else {
+        pendingLine = target;
+    }
+}
+
+void TextPagerView::findNext(const QString &text)
+{
+    if (!pager.isOpen() || text.isEmpty()) return;
+    if (searchWatcher->isRunning()) {
+        searchCancelled = true;
+        searchWatcher->waitForFinished();
+    }
+    searchCancelled = false;
+
+    std::string needle = text.toStdString();
+    quint64 from = matchOffset != TextPager::npos ? matchOffset + 1 : topOffset;
+    searchLength = needle.size();
+    searchWatcher->setFuture(QtConcurrent::run([this, needle, from]() -> quint64 {
+        quint64 hit = pager.find(needle, from, pager.size(), false, searchCancelled);
+        if (hit == TextPager::npos && from > 0 && !searchCancelled) {
+            hit = pager.find(needle, 0, std::min<quint64>(pager.size(), from + needle.size() - 1), false, searchCancelled);
+        }
+        return hit;
+    }));
+}
+
+void TextPagerView::onSearchFinished()
+{
+    if (searchCancelled || searchWatcher->isCanceled()) return;
+    quint64 hit = searchWatcher->result();
+    if (hit != TextPager::npos) {
+        matchOffset = hit;
+        matchLength = searchLength;
+
+        // A few lines of context above the match
+        quint64 lineStart = pager.startOfLine(hit);
+        quint64 top = lineStart;
+        for (int i = 0; i < visibleLines() / 3; ++i) top = pager.previousLine(top);
+        scrollToOffset(top);
+
+        int left = fontMetrics().horizontalAdvance(displayText(pager.line(lineStart).substr(0, hit - lineStart)));
+        int shown = viewport()->width() - gutterWidth() - 2 * kTextMargin;
+        QScrollBar *bar = horizontalScrollBar();
+        if (left < bar->value() || left > bar->value() + shown) bar->setValue(std::max(0, left - shown / 2));
+    }
+    emit searchFinished(hit != TextPager::npos);
+}
+
+void TextPagerView::scrollToOffset(quint64 offset)
+{
+    topOffset = pager.startOfLine(offset);
+    topLine = pager.lineAt(topOffset);
+    updateScrollBars();
+    viewport()->update();
+}
+
+int TextPagerView::visibleLines() const
+{
+    return std::max(1, viewport()->height() / fontMetrics().height());
+}
+
+int TextPagerView::gutterWidth() const
+{
+    if (!pager.isOpen()) return 0;
+    QString widest(QString::number(std::max<quint64>(pager.lineCount(), 1)).size(), QChar('9'));
+    return fontMetrics().horizontalAdvance(widest) + 2 * kTextMargin;
+}
+
+QString TextPagerView::displayText(std::string_view bytes) const
+{
+    size_t limit = std::min<size_t>(bytes.size(), kMaxLineChars * 4);
+    QString decoded = QString::fromUtf8(bytes.data(), static_cast<qsizetype>(limit));
+    QString text;
+    text.reserve(std::min<qsizetype>(decoded.size(), kMaxLineChars));
+    for (QChar c : decoded) {
+        if (text.size() >= kMaxLineChars) break;
+        if (c == QChar('\t')) {
+            do {
+                text += QChar(' ');
+            } while (text.size() % kTabWidth);
+        } else {
+            text += c;
+        }
+    }
+    return text;
+}
+
+void TextPagerView::updateScrollBars()
+{
+    syncingScrollBar = true;
+    int rows = visibleLines();
+    quint64 lines = pager.isOpen() ? pager.lineCount() : 0;
+    quint64 maxTop = lines > static_cast<quint64>(rows) ? lines - rows : 0;
+    QScrollBar *vertical = verticalScrollBar();
+    vertical->setRange(0, static_cast<int>(std::min<quint64>(maxTop, INT_MAX)));
+    vertical->setPageStep(rows);
+    vertical->setValue(static_cast<int>(std::min<quint64>(topLine, INT_MAX)));
+
+    // Wide enough for the widest line on screen
+    int widest = 0;
+    quint64 offset = topOffset;
+    for (int row = 0; row <= rows && offset < pager.size(); ++row) {
+        widest = std::max(widest, fontMetrics().horizontalAdvance(displayText(pager.line(offset))));
+        offset = pager.nextLine(offset);
+    }
+    QScrollBar *horizontal = horizontalScrollBar();
+    horizontal->setRange(0, std::max(0, widest + gutterWidth() + 2 * kTextMargin - viewport()->width()));
+    horizontal->setPageStep(viewport()->width());
+    syncingScrollBar = false;
+}
+
+void TextPagerView::scrollContentsBy(int, int dy)
+{
+    if (dy != 0 && !syncingScrollBar && pager.isOpen()) {
+        quint64 target = static_cast<quint64>(verticalScrollBar()->value());
+        if (target > topLine && target - topLine <= kStepLines) {
+            for (quint64 n = target - topLine; n > 0; --n) {
+                quint64 next = pager.nextLine(topOffset);
+                if (next >= pager.size()) break;
+                topOffset = next;
+                ++topLine;
+            }
+        } else if (target < topLine && topLine - target <= kStepLines) {
+            for (quint64 n = topLine - target; n > 0 && topOffset > 0; --n) {
+                topOffset = pager.previousLine(topOffset);
+                --topLine;
+            }
+        } else {
+            topOffset = pager.lineStart(target);
+            if (topOffset >= pager.size()) topOffset = pager.startOfLine(pager.size() - 1);
+            bool exact = pager.indexComplete() || topOffset < pager.indexedBytes();
+            topLine = exact ? pager.lineAt(topOffset) : target;
+        }
+        updateScrollBars();
+    }
+    viewport()->update();
+}
+
+void TextPagerView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void TextPagerView::paintEvent(QPaintEvent *)
+{
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+    if (!pager.isOpen()) return;
+
+    const QFontMetrics metrics = fontMetrics();
+    const int lineHeight = metrics.height();
+    const int gutter = gutterWidth();
+    const int x = gutter + kTextMargin - horizontalScrollBar()->value();
+    // Numbers are shown only once they are exact
+    const bool numbered = pager.indexComplete() || topOffset < pager.indexedBytes();
+
+    painter.fillRect(0, 0, gutter, viewport()->height(), palette().alternateBase());
+    quint64 offset = topOffset;
+    for (int row = 0; row <= visibleLines() && offset < pager.size(); ++row) {
+        const int y = row * lineHeight;
+        std::string_view bytes = pager.line(offset);
+
+        painter.setClipRect(gutter, 0, viewport()->width() - gutter, viewport()->height());
+        if (matchOffset != TextPager::npos && matchOffset >= offset && matchOffset - offset < bytes.size()) {
+            size_t column = matchOffset - offset;
+            int left = metrics.horizontalAdvance(displayText(bytes.substr(0, column)));
+            int width = metrics.horizontalAdvance(displayText(bytes.substr(column, matchLength)));
+            painter.fillRect(x + left, y, width, lineHeight, QColor(255, 230, 0));
+        }
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(x, y + metrics.ascent(), displayText(bytes));
+
+        if (numbered) {
+            painter.setClipping(false);
+            painter.setPen(palette().color(QPalette::PlaceholderText));
+            painter.drawText(QRect(0, y, gutter - kTextMargin, lineHeight), Qt::AlignRight | Qt::AlignVCenter,
+                             QString::number(topLine + row + 1));
+        }
+        offset = pager.nextLine(offset);
+    }
+}
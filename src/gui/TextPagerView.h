@@ -0,0 +1,67 @@
+#ifndef TEXTPAGERVIEW_H
+#define TEXTPAGERVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QFutureWatcher>
+#include <atomic>
+#include "../core/TextPager.h"
+
+// Read-only viewer for text files of any size. Only the lines on screen are
+// decoded and painted, straight from the mapped file; the line index is built
+// on a worker thread, so a multi-gigabyte log opens at once and line numbers
+// fill in as indexing proceeds. Jumps to lines not indexed yet are carried
+// out once the index reaches them.
+class TextPagerView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit TextPagerView(QWidget *parent = nullptr);
+    ~TextPagerView() override;
+
+    bool openFile(const QString &path);
+    void clear();
+
+    void goToLine(quint64 line); // 1-based, as shown in the gutter
+    // From just after the current match, wrapping around at the end;
+    // ASCII case-insensitive
+    void findNext(const QString &text);
+    bool isSearching() const { return searchWatcher->isRunning(); }
+
+signals:
+    void indexProgress(quint64 lines, bool done);
+    void searchFinished(bool found);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    static constexpr int kMaxLineChars = 4096; // Painted per line; the rest is cut off
+
+    void cancelWork();
+    void onIndexProgress();
+    void onSearchFinished();
+    void scrollToOffset(quint64 offset);
+    void updateScrollBars();
+    int visibleLines() const;
+    int gutterWidth() const;
+    QString displayText(std::string_view bytes) const;
+
+    TextPager pager;
+    QFutureWatcher<void> *indexWatcher;
+    QFutureWatcher<quint64> *searchWatcher;
+    std::atomic<bool> indexCancelled{false};
+    std::atomic<bool> searchCancelled{false};
+
+    quint64 topOffset = 0; // Start of the first line shown
+    quint64 topLine = 0;   // Its number, estimated past the index
+    quint64 pendingLine = TextPager::npos; // Jump waiting for the index
+    quint64 matchOffset = TextPager::npos;
+    quint64 matchLength = 0;
+    quint64 searchLength = 0; // Of the needle being searched for
+    bool syncingScrollBar = false;
+};
+
+#endif // TEXTPAGERVIEW_H
@@ -0,0 +1,186 @@
+#include "ThumbnailCache.h"
+#include <QImageReader>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QCryptographicHash>
+
+namespace {
+
+constexpr int kJpegQuality = 85;
+// A prune goes this far below the disk budget, so it does not run again on
+// the next few thumbnails
+constexpr double kPruneTarget = 0.75;
+
+// Size as stored, and as shown once EXIF orientation is applied
+QSize orientedSize(QImageReader& reader)
+{
+    QSize size = reader.size();
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) size.transpose();
+    return size;
+}
+
+} // namespace
+
+void ThumbnailCache::setRoot(const QString& root)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    thumbsDir = root.isEmpty() ? QString() : root + "/.smartfile/thumbs";
+    lru.clear();
+    entries.clear();
+    used = 0;
+    diskUsed = -1;
+}
+
+void ThumbnailCache::setDiskBudget(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    diskBudget = bytes;
+}
+
+void ThumbnailCache::setMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    while (used > budget && !lru.empty()) {
+        used -= static_cast<size_t>(lru.back().second.image.sizeInBytes());
+        entries.remove(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+int ThumbnailCache::bucket(int edge)
+{
+    for (int size : {256, 512, 1024, 2048}) {
+        if (edge <= size) return size;
+    }
+    return 4096;
+}
+
+QString ThumbnailCache::cacheKey(const QString& path, int edge) const
+{
+    QFileInfo info(path);
+    QByteArray id = info.absoluteFilePath().toUtf8();
+    id += '\0' + QByteArray::number(info.size());
+    id += '\0' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+    id += '\0' + QByteArray::number(edge);
+    return QString::fromLatin1(QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex());
+}
+
+void ThumbnailCache::remember(const QString& key, const Thumbnail& thumbnail)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.contains(key)) return;
+    lru.emplace_front(key, thumbnail);
+    entries.insert(key, lru.begin());
+    used += static_cast<size_t>(thumbnail.image.sizeInBytes());
+    while (used > budget && lru.size() > 1) {
+        used -= static_cast<size_t>(lru.back().second.image.sizeInBytes());
+        entries.remove(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+ThumbnailCache::Thumbnail ThumbnailCache::load(const QString& path, int edge, const std::atomic<bool>& cancelled)
+{
+    if (cancelled) return {};
+    QString key = cacheKey(path, edge);
+    QString dir;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it.value());
+            return it.value()->second;
+        }
+        dir = thumbsDir;
+    }
+
+    QImageReader original(path);
+    original.setAutoTransform(true);
+    Thumbnail thumbnail{QImage(), orientedSize(original)};
+
+    // The thumbnail file is tried first; its format follows from the extension
+    if (!dir.isEmpty()) {
+        for (const char* extension : {".jpg", ".png"}) {
+            QString file = dir + "/" + key + extension;
+            if (QFileInfo::exists(file) && thumbnail.image.load(file)) break;
+        }
+    }
+
+    if (thumbnail.image.isNull()) {
+        if (cancelled) return {};
+        // The box is square, so scaling the stored (unrotated) size is the same
+        QSize stored = original.size();
+        if (stored.isValid() && (stored.width() > edge || stored.height() > edge)) {
+            original.setScaledSize(stored.scaled(edge, edge, Qt::KeepAspectRatio));
+        }
+        thumbnail.image = original.read();
+        if (thumbnail.image.isNull()) return thumbnail;
+        if (!thumbnail.fullSize.isValid()) thumbnail.fullSize = thumbnail.image.size();
+
+        // Only downscaled images are worth a file; small ones decode as fast
+        if (!dir.isEmpty() && thumbnail.image.size() != thumbnail.fullSize && QDir().mkpath(dir)) {
+            bool alpha = thumbnail.image.hasAlphaChannel();
+            // Written aside and renamed into place, so a reader or a crash
+            // never sees half a thumbnail
+            QSaveFile file(dir + "/" + key + (alpha ? ".png" : ".jpg"));
+            if (file.open(QIODevice::WriteOnly)
+                && thumbnail.image.save(&file, alpha ? "PNG" : "JPG", alpha ? -1 : kJpegQuality)) {
+                qint64 bytes = file.size();
+                if (file.commit()) noteWritten(dir, bytes);
+            } else {
+                file.cancelWriting();
+            }
+        }
+    }
+
+    remember(key, thumbnail);
+    return thumbnail;
+}
+
+void ThumbnailCache::noteWritten(const QString& dir, qint64 bytes)
+{
+    qint64 limit, target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dir != thumbsDir || pruning) return;
+        if (diskUsed >= 0) {
+            diskUsed += bytes;
+            if (diskUsed <= diskBudget) return;
+        }
+        pruning = true;
+        limit = diskBudget;
+        target = static_cast<qint64>(diskBudget * kPruneTarget);
+    }
+
+    // Also measures the folder on the first write after setRoot
+    qint64 remaining = prune(dir, limit, target);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pruning = false;
+    if (dir == thumbsDir) diskUsed = remaining;
+}
+
+// If the thumbnails take more than limit bytes, removes the oldest until the
+// rest fit in target. Returns the bytes left.
+qint64 ThumbnailCache::prune(const QString& dir, qint64 limit, qint64 target)
+{
+    QFileInfoList files = QDir(dir).entryInfoList(QDir::Files | QDir::Hidden, QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (const QFileInfo& info : files) total += info.size();
+    if (total <= limit) return total;
+    for (const QFileInfo& info : files) {
+        if (total <= target) break;
+        if (QFile::remove(info.absoluteFilePath())) total -= info.size();
+    }
+    return total;
+}
+
+QImage ThumbnailCache::loadFull(const QString& path)
+{
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    return reader.read();
+}
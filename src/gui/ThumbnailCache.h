@@ -0,0 +1,60 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QImage>
+#include <QString>
+#include <QHash>
+#include <QSize>
+#include <atomic>
+#include <list>
+#include <mutex>
+
+// Preview images decoded at the size they are shown at, not at full
+// resolution: QImageReader scales while decoding, which for JPEG skips most of
+// the work. Thumbnails are kept in memory, least recently used evicted first,
+// and as files in <root>/.smartfile/thumbs named by a hash of the file's path,
+// size, modification time and the thumbnail size, so an edited file never
+// shows a stale thumbnail. The files are kept under a disk budget, the oldest
+// removed first. All methods are thread-safe.
+class ThumbnailCache
+{
+public:
+    struct Thumbnail {
+        QImage image;    // Null if the file could not be decoded
+        QSize fullSize;  // Of the original, after EXIF orientation
+    };
+
+    // Thumbnails of the previous root are dropped from memory
+    void setRoot(const QString& root);
+    void setMemoryBudget(size_t bytes);
+    void setDiskBudget(qint64 bytes);
+
+    // edge is the longest side wanted; smaller images are kept as they are.
+    // Returns a null image once cancelled is set, without decoding.
+    Thumbnail load(const QString& path, int edge, const std::atomic<bool>& cancelled);
+    static QImage loadFull(const QString& path);
+
+    // Rounds a wanted edge up to one of a few sizes, so nearby viewport sizes
+    // share thumbnails
+    static int bucket(int edge);
+
+private:
+    using Entry = std::pair<QString, Thumbnail>;
+
+    QString cacheKey(const QString& path, int edge) const;
+    void remember(const QString& key, const Thumbnail& thumbnail);
+    void noteWritten(const QString& dir, qint64 bytes);
+    static qint64 prune(const QString& dir, qint64 limit, qint64 target);
+
+    std::mutex mutex;
+    QString thumbsDir;
+    size_t budget = 64u << 20;
+    size_t used = 0;
+    qint64 diskBudget = qint64(256) << 20;
+    qint64 diskUsed = -1; // Of thumbsDir; unknown until the first file is written there
+    bool pruning = false;
+    std::list<Entry> lru; // Most recently used first
+    QHash<QString, std::list<Entry>::iterator> entries;
+};
+
+#endif // THUMBNAILCACHE_H